@@ -0,0 +1,501 @@
+/* async_writer.cpp
+ * Background writer of exported logs.
+ * The pwrite() backend hands buffers to a pool of threads. The io_uring
+ * backend (MI_WITH_IO_URING, Linux 5.6+) submits and reaps writes on the
+ * caller thread without any extra thread; if the kernel rejects the write
+ * opcode, the writer switches to the thread pool.
+ */
+
+#include "async_writer.h"
+
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+
+#if defined(__linux__) && defined(MI_WITH_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+static double
+now_seconds () {
+#ifndef _WIN32
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+#else
+    return (double) time(NULL);
+#endif
+}
+
+void
+awriter_init_state (struct AsyncWriterState *pstate) {
+    pstate->started = false;
+    pstate->stopping = false;
+    pstate->max_inflight = 0;
+    pstate->inflight = 0;
+    pstate->tasks.clear();
+    pstate->uring = NULL;
+    memset(&pstate->stats, 0, sizeof(pstate->stats));
+#ifndef _WIN32
+    pstate->threads.clear();
+#endif
+}
+
+#ifndef _WIN32
+
+// Write the rest of a request.
+// Return: successful or not
+static bool
+write_all (AsyncWriteRequest *req) {
+    while (req->done < req->data.size()) {
+        ssize_t n = pwrite(req->fd, req->data.data() + req->done,
+                            req->data.size() - req->done, req->offset + req->done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        req->done += n;
+    }
+    return true;
+}
+
+// Account for a finished request. The lock is held by the caller if the
+// thread pool is used.
+static void
+finish_request (struct AsyncWriterState *pstate, AsyncWriteRequest *req, bool success) {
+    pstate->inflight -= req->data.size();
+    pstate->stats.writes++;
+    pstate->stats.bytes += req->done;
+    if (!success)
+        pstate->stats.write_errors++;
+    delete req;
+}
+
+static void
+count_inflight (struct AsyncWriterState *pstate, size_t size) {
+    pstate->inflight += size;
+    if (pstate->inflight > pstate->stats.max_inflight)
+        pstate->stats.max_inflight = pstate->inflight;
+}
+
+// ---------------------------------------------------------------------------
+// pwrite() on a thread pool
+
+static void *
+worker_main (void *arg) {
+    AsyncWriterState *pstate = (AsyncWriterState *) arg;
+    pthread_mutex_lock(&pstate->lock);
+    while (true) {
+        while (pstate->tasks.empty() && !pstate->stopping)
+            pthread_cond_wait(&pstate->task_cond, &pstate->lock);
+        if (pstate->tasks.empty())
+            break;
+        AsyncWriteRequest *req = pstate->tasks.front();
+        pstate->tasks.pop_front();
+        pthread_mutex_unlock(&pstate->lock);
+
+        bool success = write_all(req);
+
+        pthread_mutex_lock(&pstate->lock);
+        finish_request(pstate, req, success);
+        pthread_cond_broadcast(&pstate->done_cond);
+    }
+    pthread_mutex_unlock(&pstate->lock);
+    return NULL;
+}
+
+static bool
+start_threads (struct AsyncWriterState *pstate, int n_threads) {
+    for (int i = 0; i < n_threads; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, worker_main, pstate) != 0)
+            break;
+        pstate->threads.push_back(t);
+    }
+    return !pstate->threads.empty();
+}
+
+static void
+pool_submit (struct AsyncWriterState *pstate, AsyncWriteRequest *req) {
+    size_t size = req->data.size();
+    pthread_mutex_lock(&pstate->lock);
+    if (pstate->inflight > 0 && pstate->inflight + size > pstate->max_inflight) {
+        double t = now_seconds();
+        pstate->stats.backpressure_events++;
+        while (pstate->inflight > 0 && pstate->inflight + size > pstate->max_inflight)
+            pthread_cond_wait(&pstate->done_cond, &pstate->lock);
+        pstate->stats.backpressure_seconds += now_seconds() - t;
+    }
+    count_inflight(pstate, size);
+    pstate->tasks.push_back(req);
+    pthread_cond_signal(&pstate->task_cond);
+    pthread_mutex_unlock(&pstate->lock);
+}
+
+static void
+pool_drain (struct AsyncWriterState *pstate) {
+    pthread_mutex_lock(&pstate->lock);
+    while (pstate->inflight > 0)
+        pthread_cond_wait(&pstate->done_cond, &pstate->lock);
+    pthread_mutex_unlock(&pstate->lock);
+}
+
+// ---------------------------------------------------------------------------
+// io_uring
+
+#if defined(__linux__) && defined(MI_WITH_IO_URING)
+
+static const unsigned AWRITER_URING_ENTRIES = 64;
+
+struct AsyncUring {
+    int fd;
+    unsigned entries;
+    unsigned n_pending;     // submitted but not reaped
+    bool unsupported;       // the kernel rejected IORING_OP_WRITE
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    size_t sqes_size;
+};
+
+static void
+uring_destroy (AsyncUring *u) {
+    if (u->sqes != NULL)
+        munmap(u->sqes, u->sqes_size);
+    if (u->cq_ptr != NULL && u->cq_ptr != u->sq_ptr)
+        munmap(u->cq_ptr, u->cq_size);
+    if (u->sq_ptr != NULL)
+        munmap(u->sq_ptr, u->sq_size);
+    close(u->fd);
+    delete u;
+}
+
+// Return: a ring, or NULL if io_uring is not available
+static AsyncUring *
+uring_create () {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, AWRITER_URING_ENTRIES, &p);
+    if (fd < 0)
+        return NULL;
+    AsyncUring *u = new AsyncUring;
+    memset(u, 0, sizeof(AsyncUring));
+    u->fd = fd;
+    u->entries = p.sq_entries;
+    u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && u->cq_size > u->sq_size)
+        u->sq_size = u->cq_size;
+
+    void *sq = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        uring_destroy(u);
+        return NULL;
+    }
+    u->sq_ptr = sq;
+    if (single_mmap) {
+        u->cq_ptr = sq;
+    } else {
+        void *cq = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+            uring_destroy(u);
+            return NULL;
+        }
+        u->cq_ptr = cq;
+    }
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        uring_destroy(u);
+        return NULL;
+    }
+    u->sqes = (struct io_uring_sqe *) sqes;
+
+    char *sq_base = (char *) u->sq_ptr;
+    char *cq_base = (char *) u->cq_ptr;
+    u->sq_tail = (unsigned *) (sq_base + p.sq_off.tail);
+    u->sq_mask = (unsigned *) (sq_base + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *) (sq_base + p.sq_off.array);
+    u->cq_head = (unsigned *) (cq_base + p.cq_off.head);
+    u->cq_tail = (unsigned *) (cq_base + p.cq_off.tail);
+    u->cq_mask = (unsigned *) (cq_base + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) (cq_base + p.cq_off.cqes);
+    return u;
+}
+
+// Return: submitted or not
+static bool
+uring_push (AsyncUring *u, AsyncWriteRequest *req) {
+    unsigned tail = *u->sq_tail;
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = req->fd;
+    sqe->off = req->offset + req->done;
+    sqe->addr = (unsigned long long) (req->data.data() + req->done);
+    sqe->len = req->data.size() - req->done;
+    sqe->user_data = (unsigned long long) req;
+    u->sq_array[idx] = idx;
+    __sync_synchronize();
+    *u->sq_tail = tail + 1;
+    __sync_synchronize();
+    if (syscall(__NR_io_uring_enter, u->fd, 1, 0, 0, NULL, 0) != 1) {
+        *u->sq_tail = tail;     // not consumed by the kernel
+        return false;
+    }
+    u->n_pending++;
+    return true;
+}
+
+// Submit a write, or write it synchronously if the ring refuses it.
+static void
+uring_write (struct AsyncWriterState *pstate, AsyncWriteRequest *req) {
+    if (!pstate->uring->unsupported && uring_push(pstate->uring, req))
+        return;
+    finish_request(pstate, req, write_all(req));
+}
+
+// Reap completed writes, and wait for one if wait is set.
+static void
+uring_reap (struct AsyncWriterState *pstate, bool wait) {
+    AsyncUring *u = pstate->uring;
+    if (wait && u->n_pending > 0) {
+        __sync_synchronize();
+        if (*u->cq_head == *u->cq_tail)
+            syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    }
+    unsigned head = *u->cq_head;
+    __sync_synchronize();
+    while (head != *u->cq_tail) {
+        struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+        AsyncWriteRequest *req = (AsyncWriteRequest *) cqe->user_data;
+        int res = cqe->res;
+        head++;
+        __sync_synchronize();
+        *u->cq_head = head;
+        u->n_pending--;
+
+        if (res == -EINVAL || res == -EOPNOTSUPP)
+            u->unsupported = true;
+        if (res > 0) {
+            req->done += res;
+            if (req->done < req->data.size()) {     // short write
+                uring_write(pstate, req);
+                continue;
+            }
+            finish_request(pstate, req, true);
+        } else {
+            finish_request(pstate, req, write_all(req));
+        }
+    }
+}
+
+static void
+uring_drain (struct AsyncWriterState *pstate) {
+    while (pstate->uring->n_pending > 0)
+        uring_reap(pstate, true);
+}
+
+static void
+uring_submit (struct AsyncWriterState *pstate, AsyncWriteRequest *req) {
+    AsyncUring *u = pstate->uring;
+    size_t size = req->data.size();
+    uring_reap(pstate, false);
+    if (u->n_pending >= u->entries
+            || (pstate->inflight > 0 && pstate->inflight + size > pstate->max_inflight)) {
+        double t = now_seconds();
+        pstate->stats.backpressure_events++;
+        while (u->n_pending >= u->entries
+                || (pstate->inflight > 0 && pstate->inflight + size > pstate->max_inflight))
+            uring_reap(pstate, true);
+        pstate->stats.backpressure_seconds += now_seconds() - t;
+    }
+    count_inflight(pstate, size);
+    uring_write(pstate, req);
+}
+
+#else   // io_uring is not compiled in
+
+struct AsyncUring {
+    bool unsupported;
+};
+
+static AsyncUring *
+uring_create () {
+    return NULL;
+}
+
+static void
+uring_destroy (AsyncUring *u) {
+    delete u;
+}
+
+static void
+uring_drain (struct AsyncWriterState *pstate) {
+    (void)pstate;
+}
+
+static void
+uring_submit (struct AsyncWriterState *pstate, AsyncWriteRequest *req) {
+    count_inflight(pstate, req->data.size());
+    finish_request(pstate, req, write_all(req));
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+
+bool
+awriter_start (struct AsyncWriterState *pstate, int n_threads,
+                size_t max_inflight) {
+    awriter_stop(pstate);
+    pstate->max_inflight = max_inflight;
+    pstate->uring = uring_create();
+    pthread_mutex_init(&pstate->lock, NULL);
+    pthread_cond_init(&pstate->task_cond, NULL);
+    pthread_cond_init(&pstate->done_cond, NULL);
+    pstate->started = true;
+    if (pstate->uring == NULL
+            && !start_threads(pstate, n_threads > 0 ? n_threads : 1)) {
+        awriter_stop(pstate);
+        return false;
+    }
+    return true;
+}
+
+void
+awriter_stop (struct AsyncWriterState *pstate) {
+    if (!pstate->started)
+        return;
+    awriter_drain(pstate);
+    if (pstate->uring != NULL)
+        uring_destroy(pstate->uring);
+    pthread_mutex_lock(&pstate->lock);
+    pstate->stopping = true;
+    pthread_cond_broadcast(&pstate->task_cond);
+    pthread_mutex_unlock(&pstate->lock);
+    for (size_t i = 0; i < pstate->threads.size(); i++)
+        pthread_join(pstate->threads[i], NULL);
+    pthread_mutex_destroy(&pstate->lock);
+    pthread_cond_destroy(&pstate->task_cond);
+    pthread_cond_destroy(&pstate->done_cond);
+    struct AsyncWriterStats stats = pstate->stats;
+    awriter_init_state(pstate);
+    pstate->stats = stats;  // keep the counters readable
+}
+
+bool
+awriter_submit (struct AsyncWriterState *pstate, int fd,
+                unsigned long long offset, std::string &data) {
+    if (!pstate->started)
+        return false;
+    if (data.empty())
+        return true;
+    if (pstate->uring != NULL && pstate->uring->unsupported) {
+        // Switch to the thread pool for good
+        uring_drain(pstate);
+        uring_destroy(pstate->uring);
+        pstate->uring = NULL;
+        if (!start_threads(pstate, 1)) {
+            awriter_stop(pstate);
+            return false;
+        }
+    }
+    AsyncWriteRequest *req = new AsyncWriteRequest;
+    req->fd = fd;
+    req->offset = offset;
+    req->data.swap(data);
+    req->done = 0;
+    if (pstate->uring != NULL)
+        uring_submit(pstate, req);
+    else
+        pool_submit(pstate, req);
+    return true;
+}
+
+void
+awriter_drain (struct AsyncWriterState *pstate) {
+    if (!pstate->started)
+        return;
+    if (pstate->uring != NULL)
+        uring_drain(pstate);
+    else
+        pool_drain(pstate);
+}
+
+void
+awriter_get_stats (struct AsyncWriterState *pstate, struct AsyncWriterStats *stats) {
+    if (pstate->started && pstate->uring == NULL) {
+        pthread_mutex_lock(&pstate->lock);
+        *stats = pstate->stats;
+        pthread_mutex_unlock(&pstate->lock);
+    } else {
+        *stats = pstate->stats;
+    }
+}
+
+#else   // _WIN32: writes stay synchronous
+
+bool
+awriter_start (struct AsyncWriterState *pstate, int n_threads,
+                size_t max_inflight) {
+    (void)pstate;
+    (void)n_threads;
+    (void)max_inflight;
+    return false;
+}
+
+void
+awriter_stop (struct AsyncWriterState *pstate) {
+    (void)pstate;
+}
+
+bool
+awriter_submit (struct AsyncWriterState *pstate, int fd,
+                unsigned long long offset, std::string &data) {
+    (void)pstate;
+    (void)fd;
+    (void)offset;
+    (void)data;
+    return false;
+}
+
+void
+awriter_drain (struct AsyncWriterState *pstate) {
+    (void)pstate;
+}
+
+void
+awriter_get_stats (struct AsyncWriterState *pstate, struct AsyncWriterStats *stats) {
+    *stats = pstate->stats;
+}
+
+#endif
+
+const char *
+awriter_backend (const struct AsyncWriterState *pstate) {
+    if (!pstate->started)
+        return "";
+    return pstate->uring != NULL ? "io_uring" : "pwrite";
+}
@@ -0,0 +1,76 @@
+#ifndef __DM_COLLECTOR_C_ASYNC_WRITER_H__
+#define __DM_COLLECTOR_C_ASYNC_WRITER_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstddef>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// A buffer to be written at a fixed offset of a file
+struct AsyncWriteRequest {
+    int fd;
+    unsigned long long offset;
+    std::string data;
+    size_t done;            // bytes already written
+};
+
+struct AsyncWriterStats {
+    unsigned long long writes;
+    unsigned long long bytes;
+    unsigned long long backpressure_events;    // submits that had to wait
+    double backpressure_seconds;
+    unsigned long long write_errors;
+    unsigned long long max_inflight;           // peak bytes not yet written
+};
+
+struct AsyncUring;
+
+// Writes buffers in the background, so that a stalled disk does not stall
+// the collector. Buffers are written with pwrite() by a pool of threads, or
+// through io_uring when built with MI_WITH_IO_URING and supported by the
+// kernel. The bytes in flight are bounded: a submit blocks while the limit
+// is reached, and counts a backpressure event.
+struct AsyncWriterState {
+    bool started;
+    bool stopping;
+    size_t max_inflight;
+    size_t inflight;
+    std::deque<AsyncWriteRequest *> tasks;
+    struct AsyncUring *uring;       // NULL if the thread pool is used
+    struct AsyncWriterStats stats;
+#ifndef _WIN32
+    std::vector<pthread_t> threads;
+    pthread_mutex_t lock;
+    pthread_cond_t task_cond;
+    pthread_cond_t done_cond;
+#endif
+};
+
+// Must be called before usage
+void awriter_init_state (struct AsyncWriterState *pstate);
+
+// Start the writer with n_threads (for the pwrite() backend) and a limit
+// of bytes in flight.
+// Return: successful or not (e.g. not supported on this platform)
+bool awriter_start (struct AsyncWriterState *pstate, int n_threads,
+                    size_t max_inflight);
+// Wait for all pending writes and stop the writer
+void awriter_stop (struct AsyncWriterState *pstate);
+
+// Queue a write. The content of data is taken over (data becomes empty).
+// Return: false if the writer is not started
+bool awriter_submit (struct AsyncWriterState *pstate, int fd,
+                        unsigned long long offset, std::string &data);
+// Wait until all queued writes are done, e.g. before closing a file
+void awriter_drain (struct AsyncWriterState *pstate);
+
+// Copy the counters
+void awriter_get_stats (struct AsyncWriterState *pstate, struct AsyncWriterStats *stats);
+// Return: "io_uring", "pwrite" or "" if not started
+const char *awriter_backend (const struct AsyncWriterState *pstate);
+
+#endif  // __DM_COLLECTOR_C_ASYNC_WRITER_H__
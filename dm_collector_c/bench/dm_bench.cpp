@@ -0,0 +1,606 @@
+/* dm_bench.cpp
+ * Benchmark of the dm_collector_c stages over log files: the deframers,
+ * decode_log_packet(), export, and (optionally) ws_dissector.
+ *
+ * Every stage is run -r times per log and the fastest run is reported, as
+ * one JSON object per line:
+ *   {"stage": ..., "log": ..., "log_code": "all" or "0xB0C0", "type_id": ...,
+ *    "frames": n, "bytes": n, "seconds": s, "mb_per_s": x, "frames_per_s": x,
+ *    "allocs_per_frame": x[, "pyobjects_per_frame": x]}
+ * Records of the same stage, log and log_code can be compared across commits.
+ *
+ * Usage: dm_bench [-r REPEAT] [-w WS_DISSECTOR [-t WS_DISSECTOR_PY]] LOG...
+ */
+
+#include <Python.h>
+
+#include "consts.h"
+#include "hdlc.h"
+#include "log_packet.h"
+#include "log_reader.h"
+#include "export_manager.h"
+#include "perf_counters.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <new>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// Heap allocations, through malloc() (which operator new uses as well)
+static unsigned long long g_allocs = 0;
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc (size_t size);
+void *__libc_calloc (size_t n, size_t size);
+void *__libc_realloc (void *p, size_t size);
+void __libc_free (void *p);
+
+void *
+malloc (size_t size) {
+    g_allocs++;
+    return __libc_malloc(size);
+}
+
+void *
+calloc (size_t n, size_t size) {
+    g_allocs++;
+    return __libc_calloc(n, size);
+}
+
+void *
+realloc (void *p, size_t size) {
+    g_allocs++;
+    return __libc_realloc(p, size);
+}
+
+void
+free (void *p) {
+    __libc_free(p);
+}
+}
+static const bool MALLOC_COUNTED = true;
+#else
+// Only the C++ allocations are counted
+void *
+operator new (size_t size) {
+    g_allocs++;
+    void *p = malloc(size);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void
+operator delete (void *p) throw () {
+    free(p);
+}
+static const bool MALLOC_COUNTED = false;
+#endif
+
+struct StageStats {
+    unsigned long long frames;
+    unsigned long long bytes;
+    unsigned long long allocs;
+    unsigned long long pyobjects;
+    unsigned long long ns;
+};
+
+// By log code; -1 for the whole stage
+typedef std::map<int, StageStats> StageResult;
+
+static StageStats &
+get_stats (StageResult &result, int log_code) {
+    StageResult::iterator it = result.find(log_code);
+    if (it == result.end()) {
+        StageStats s;
+        memset(&s, 0, sizeof(s));
+        it = result.insert(std::make_pair(log_code, s)).first;
+    }
+    return it->second;
+}
+
+// A deframed log packet (after check_frame_format())
+struct BenchFrame {
+    std::string data;
+    int log_code;
+};
+
+// A raw message of a decoded packet, for ws_dissector
+struct BenchMsg {
+    int log_code;
+    unsigned int aww_id;
+    std::string data;
+};
+
+static std::string
+json_string (const std::string &s) {
+    std::string out = "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char) c < 0x20)
+            c = ' ';
+        out += c;
+    }
+    return out + "\"";
+}
+
+static void
+print_result (FILE *out, const char *stage, const std::string &log, const StageResult &result,
+                bool with_pyobjects) {
+    for (StageResult::const_iterator it = result.begin(); it != result.end(); ++it) {
+        const StageStats &s = it->second;
+        char code[16];
+        const char *type_id = "all";
+        if (it->first < 0) {
+            strcpy(code, "all");
+        } else {
+            snprintf(code, sizeof(code), "0x%04X", it->first);
+            type_id = search_name(LogPacketTypeID_To_Name,
+                                    ARRAY_SIZE(LogPacketTypeID_To_Name, ValueName),
+                                    it->first);
+            if (type_id == NULL)
+                type_id = "Unsupported";
+        }
+        double seconds = s.ns * 1e-9;
+        double frames = s.frames ? (double) s.frames : 1.0;
+        fprintf(out, "{\"stage\": \"%s\", \"log\": %s, \"log_code\": \"%s\", \"type_id\": \"%s\","
+                " \"frames\": %llu, \"bytes\": %llu, \"seconds\": %.6f,"
+                " \"mb_per_s\": %.3f, \"frames_per_s\": %.1f, \"allocs_per_frame\": %.2f",
+                stage, json_string(log).c_str(), code, type_id,
+                s.frames, s.bytes, seconds,
+                seconds > 0 ? s.bytes / seconds / 1e6 : 0.0,
+                seconds > 0 ? s.frames / seconds : 0.0,
+                s.allocs / frames);
+        if (with_pyobjects)
+            fprintf(out, ", \"pyobjects_per_frame\": %.2f", s.pyobjects / frames);
+        fprintf(out, "}\n");
+    }
+}
+
+// Keep the fastest of the repeated runs
+static void
+keep_fastest (StageResult &best, const StageResult &run) {
+    if (best.empty() || run.find(-1)->second.ns < best.find(-1)->second.ns)
+        best = run;
+}
+
+// Read the log packets of a log file, for the later stages
+// Return: false if the file cannot be opened
+static bool
+load_frames (const char *path, std::vector<BenchFrame> &frames) {
+    LogReaderState reader;
+    lreader_init_state(&reader);
+    if (!lreader_open(&reader, path))
+        return false;
+    std::string frame;
+    bool crc_correct = false;
+    while (lreader_next_frame(&reader, frame, crc_correct)) {
+        if (!crc_correct)
+            continue;
+        check_frame_format(frame);
+        if (frame.size() < 8 || !is_log_packet(frame.c_str(), frame.size()))
+            continue;
+        frames.push_back(BenchFrame());
+        frames.back().data = frame;
+        unsigned short log_code;
+        memcpy(&log_code, frame.c_str() + 6, sizeof(log_code));
+        frames.back().log_code = log_code;
+    }
+    lreader_close(&reader);
+    return true;
+}
+
+// Deframe a log file with the memory-mapped reader of open_log()
+static bool
+bench_deframe (const char *path, StageResult &result) {
+    LogReaderState reader;
+    lreader_init_state(&reader);
+    if (!lreader_open(&reader, path))
+        return false;
+    StageStats &total = get_stats(result, -1);
+    std::string frame;
+    bool crc_correct = false;
+    unsigned long long allocs = g_allocs;
+    unsigned long long t0 = perf_now_ns();
+    while (lreader_next_frame(&reader, frame, crc_correct))
+        total.frames++;
+    total.ns = perf_now_ns() - t0;
+    total.allocs = g_allocs - allocs;
+    total.bytes = reader.base_offset + reader.pos;
+    lreader_close(&reader);
+    return true;
+}
+
+// Deframe a log file with the streaming deframer of feed_binary()
+static bool
+bench_deframe_stream (const char *path, StageResult &result) {
+    const size_t CHUNK_SIZE = 64 * 1024;
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return false;
+    std::string content;
+    char buf[CHUNK_SIZE];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        content.append(buf, n);
+    fclose(fp);
+
+    StageStats &total = get_stats(result, -1);
+    std::string frame;
+    bool crc_correct = false;
+    reset_binary();
+    unsigned long long allocs = g_allocs;
+    unsigned long long t0 = perf_now_ns();
+    for (size_t offset = 0; offset < content.size(); offset += CHUNK_SIZE) {
+        feed_binary(content.c_str() + offset,
+                    (int) std::min(CHUNK_SIZE, content.size() - offset));
+        while (get_next_frame(frame, crc_correct, NULL))
+            total.frames++;
+    }
+    total.ns = perf_now_ns() - t0;
+    total.allocs = g_allocs - allocs;
+    total.bytes = content.size();
+    reset_binary();
+    return true;
+}
+
+static unsigned long long
+count_pyobjects (PyObject *o) {
+    unsigned long long n = 1;
+    if (PyList_Check(o)) {
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(o); i++)
+            n += count_pyobjects(PyList_GET_ITEM(o, i));
+    } else if (PyTuple_Check(o)) {
+        for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(o); i++)
+            n += count_pyobjects(PyTuple_GET_ITEM(o, i));
+    }
+    return n;
+}
+
+// Collect the raw messages that DMLogPacket would pass to ws_dissector
+static void
+collect_msgs (PyObject *decoded, int log_code, PyObject *aww_ids,
+                std::vector<BenchMsg> &msgs) {
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(decoded); i++) {
+        PyObject *t = PyList_GET_ITEM(decoded, i);
+        if (!PyTuple_Check(t) || PyTuple_GET_SIZE(t) != 3)
+            continue;
+        PyObject *value = PyTuple_GET_ITEM(t, 1);
+        PyObject *type_str = PyTuple_GET_ITEM(t, 2);
+        if (!PyString_Check(value) || !PyString_Check(type_str)
+                || strncmp(PyString_AS_STRING(type_str), "raw_msg/", 8) != 0)
+            continue;
+        PyObject *aww_id = PyDict_GetItemString(aww_ids, PyString_AS_STRING(type_str) + 8);
+        if (aww_id == NULL || !PyInt_Check(aww_id))
+            continue;
+        msgs.push_back(BenchMsg());
+        msgs.back().log_code = log_code;
+        msgs.back().aww_id = (unsigned int) PyInt_AS_LONG(aww_id);
+        msgs.back().data.assign(PyString_AS_STRING(value), PyString_GET_SIZE(value));
+    }
+}
+
+static void
+bench_decode (const std::vector<BenchFrame> &frames, StageResult &result,
+                PyObject *aww_ids, std::vector<BenchMsg> *msgs) {
+    StageStats &total = get_stats(result, -1);
+    for (size_t i = 0; i < frames.size(); i++) {
+        const std::string &frame = frames[i].data;
+        StageStats &s = get_stats(result, frames[i].log_code);
+        unsigned long long allocs = g_allocs;
+        unsigned long long t0 = perf_now_ns();
+        PyObject *decoded = decode_log_packet(frame.c_str() + 2,  // skip first two bytes
+                                                frame.size() - 2, false);
+        unsigned long long ns = perf_now_ns() - t0;
+        s.allocs += g_allocs - allocs;
+        s.ns += ns;
+        s.frames++;
+        s.bytes += frame.size();
+        if (decoded != NULL) {
+            s.pyobjects += count_pyobjects(decoded);
+            if (msgs != NULL && aww_ids != NULL)
+                collect_msgs(decoded, frames[i].log_code, aww_ids, *msgs);
+            Py_DECREF(decoded);
+        } else {
+            PyErr_Clear();
+        }
+    }
+    for (StageResult::const_iterator it = result.begin(); it != result.end(); ++it) {
+        if (it->first < 0)
+            continue;
+        total.frames += it->second.frames;
+        total.bytes += it->second.bytes;
+        total.allocs += it->second.allocs;
+        total.pyobjects += it->second.pyobjects;
+        total.ns += it->second.ns;
+    }
+}
+
+static void
+bench_export (const std::vector<BenchFrame> &frames, StageResult &result) {
+    char path[] = "/tmp/dm_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return;
+    close(fd);
+
+    IdVector whitelist;
+    for (size_t i = 0; i < frames.size(); i++)
+        whitelist.push_back(frames[i].log_code);
+    ExportManagerState manager;
+    manager_init_state(&manager);
+    manager_change_config(&manager, path, whitelist);
+
+    StageStats &total = get_stats(result, -1);
+    for (size_t i = 0; i < frames.size(); i++) {
+        const std::string &frame = frames[i].data;
+        StageStats &s = get_stats(result, frames[i].log_code);
+        unsigned long long bytes = manager.total_bytes;
+        unsigned long long allocs = g_allocs;
+        unsigned long long t0 = perf_now_ns();
+        manager_export_binary(&manager, frame.c_str(), frame.size());
+        s.ns += perf_now_ns() - t0;
+        s.allocs += g_allocs - allocs;
+        s.frames++;
+        s.bytes += manager.total_bytes - bytes;
+    }
+    unsigned long long t0 = perf_now_ns();
+    manager_close(&manager);
+    total.ns = perf_now_ns() - t0;     // flushing
+    for (StageResult::const_iterator it = result.begin(); it != result.end(); ++it) {
+        if (it->first < 0)
+            continue;
+        total.frames += it->second.frames;
+        total.bytes += it->second.bytes;
+        total.allocs += it->second.allocs;
+        total.ns += it->second.ns;
+    }
+    unlink(path);
+}
+
+// A ws_dissector process, spoken to through pipes as WSDissector does
+struct WsProcess {
+    pid_t pid;
+    FILE *in;
+    FILE *out;
+};
+
+static bool
+ws_launch (const char *executable, WsProcess *proc) {
+    int to_child[2], from_child[2];
+    if (pipe(to_child) < 0)
+        return false;
+    if (pipe(from_child) < 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        return false;
+    }
+    proc->pid = fork();
+    if (proc->pid == 0) {
+        dup2(to_child[0], 0);
+        dup2(from_child[1], 1);
+        close(to_child[1]);
+        close(from_child[0]);
+        execl(executable, executable, (char *) NULL);
+        _exit(127);
+    }
+    close(to_child[0]);
+    close(from_child[1]);
+    proc->in = fdopen(to_child[1], "wb");
+    proc->out = fdopen(from_child[0], "rb");
+    return proc->pid > 0;
+}
+
+static void
+ws_close (WsProcess *proc) {
+    fclose(proc->in);
+    fclose(proc->out);
+    waitpid(proc->pid, NULL, 0);
+}
+
+// Return: false if ws_dissector is gone
+static bool
+ws_roundtrip (WsProcess *proc, const BenchMsg &msg, unsigned long long *out_bytes) {
+    unsigned char header[8];
+    unsigned int len = msg.data.size();
+    for (int i = 0; i < 4; i++) {     // in network order
+        header[i] = (msg.aww_id >> (24 - 8 * i)) & 0xFF;
+        header[4 + i] = (len >> (24 - 8 * i)) & 0xFF;
+    }
+    fwrite(header, 1, sizeof(header), proc->in);
+    fwrite(msg.data.c_str(), 1, len, proc->in);
+    fflush(proc->in);
+    char line[4096];
+    while (fgets(line, sizeof(line), proc->out) != NULL) {
+        if (strncmp(line, "===___===", 9) == 0)
+            return true;
+        *out_bytes += strlen(line);
+    }
+    return false;
+}
+
+static bool
+bench_ws_dissector (const char *executable, const std::vector<BenchMsg> &msgs,
+                    StageResult &result) {
+    WsProcess proc;
+    if (!ws_launch(executable, &proc))
+        return false;
+    StageStats &total = get_stats(result, -1);
+    bool ok = true;
+    for (size_t i = 0; i < msgs.size() && ok; i++) {
+        StageStats &s = get_stats(result, msgs[i].log_code);
+        unsigned long long out_bytes = 0;
+        unsigned long long allocs = g_allocs;
+        unsigned long long t0 = perf_now_ns();
+        ok = ws_roundtrip(&proc, msgs[i], &out_bytes);
+        unsigned long long ns = perf_now_ns() - t0;
+        allocs = g_allocs - allocs;
+        s.ns += ns;
+        s.allocs += allocs;
+        s.frames++;
+        s.bytes += msgs[i].data.size();
+        total.ns += ns;
+        total.allocs += allocs;
+        total.frames++;
+        total.bytes += msgs[i].data.size();
+    }
+    ws_close(&proc);
+    if (!ok)
+        fprintf(stderr, "dm_bench: %s exited\n", executable);
+    return ok;
+}
+
+// Return: WSDissector.SUPPORTED_TYPES (a new reference), read from
+// ws_dissector.py, or NULL
+static PyObject *
+load_aww_ids (const char *ws_dissector_py) {
+    PyObject *imp = PyImport_ImportModule("imp");
+    if (imp == NULL)
+        return NULL;
+    PyObject *module = PyObject_CallMethod(imp, (char *) "load_source", (char *) "ss",
+                                            "dm_bench_ws_dissector", ws_dissector_py);
+    Py_DECREF(imp);
+    if (module == NULL)
+        return NULL;
+    PyObject *cls = PyObject_GetAttrString(module, "WSDissector");
+    Py_DECREF(module);
+    if (cls == NULL)
+        return NULL;
+    PyObject *ids = PyObject_GetAttrString(cls, "SUPPORTED_TYPES");
+    Py_DECREF(cls);
+    return ids;
+}
+
+static void
+usage () {
+    fprintf(stderr,
+            "Usage: dm_bench [-r REPEAT] [-o OUTPUT] [-w WS_DISSECTOR [-t WS_DISSECTOR_PY]] LOG...\n"
+            "  -r REPEAT           runs per stage; the fastest is reported (default: 3)\n"
+            "  -o OUTPUT           where the results are written (default: stdout, which\n"
+            "                      the decoder also prints its warnings to)\n"
+            "  -w WS_DISSECTOR     also time the ws_dissector round trips\n"
+            "  -t WS_DISSECTOR_PY  where the AWW message ids are read from (default:\n"
+            "                      mobile_insight/monitor/dm_collector/dm_endec/ws_dissector.py)\n");
+}
+
+int
+main (int argc, char **argv) {
+    int repeat = 3;
+    const char *output = NULL;
+    const char *ws_dissector = NULL;
+    const char *ws_dissector_py = "mobile_insight/monitor/dm_collector/dm_endec/ws_dissector.py";
+    int opt;
+    while ((opt = getopt(argc, argv, "r:o:w:t:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            repeat = atoi(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'w':
+            ws_dissector = optarg;
+            break;
+        case 't':
+            ws_dissector_py = optarg;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (optind >= argc || repeat <= 0) {
+        usage();
+        return 2;
+    }
+
+    FILE *out = stdout;
+    if (output != NULL) {
+        out = fopen(output, "w");
+        if (out == NULL) {
+            fprintf(stderr, "dm_bench: cannot open %s\n", output);
+            return 1;
+        }
+    }
+
+    Py_DontWriteBytecodeFlag = 1;
+    Py_Initialize();
+    PyObject *aww_ids = NULL;
+    if (ws_dissector != NULL) {
+        aww_ids = load_aww_ids(ws_dissector_py);
+        if (aww_ids == NULL || !PyDict_Check(aww_ids)) {
+            PyErr_Print();
+            fprintf(stderr, "dm_bench: cannot read the AWW ids from %s\n", ws_dissector_py);
+            return 1;
+        }
+    }
+
+    fprintf(out, "{\"bench\": \"dm_bench\", \"repeat\": %d, \"malloc_counted\": %s,"
+            " \"ws_dissector\": %s}\n",
+            repeat, MALLOC_COUNTED ? "true" : "false",
+            ws_dissector != NULL ? "true" : "false");
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        const char *path = argv[i];
+        std::vector<BenchFrame> frames;
+        std::vector<BenchMsg> msgs;
+        StageResult deframe, deframe_stream, decode, exported, ws;
+        if (!load_frames(path, frames)) {
+            fprintf(stderr, "dm_bench: cannot open %s\n", path);
+            status = 1;
+            continue;
+        }
+        for (int r = 0; r < repeat; r++) {
+            StageResult run;
+            bench_deframe(path, run);
+            keep_fastest(deframe, run);
+        }
+        for (int r = 0; r < repeat; r++) {
+            StageResult run;
+            bench_deframe_stream(path, run);
+            keep_fastest(deframe_stream, run);
+        }
+        for (int r = 0; r < repeat; r++) {
+            StageResult run;
+            bench_decode(frames, run, aww_ids, r == 0 ? &msgs : NULL);
+            keep_fastest(decode, run);
+        }
+        for (int r = 0; r < repeat; r++) {
+            StageResult run;
+            bench_export(frames, run);
+            keep_fastest(exported, run);
+        }
+        for (int r = 0; ws_dissector != NULL && r < repeat; r++) {
+            StageResult run;
+            if (!bench_ws_dissector(ws_dissector, msgs, run)) {
+                status = 1;
+                break;
+            }
+            keep_fastest(ws, run);
+        }
+
+        print_result(out, "deframe", path, deframe, false);
+        print_result(out, "deframe_stream", path, deframe_stream, false);
+        print_result(out, "decode", path, decode, true);
+        print_result(out, "export", path, exported, false);
+        if (!ws.empty())
+            print_result(out, "ws_dissector", path, ws, false);
+        fflush(out);
+    }
+    if (out != stdout)
+        fclose(out);
+    Py_XDECREF(aww_ids);
+    Py_Finalize();
+    return status;
+}
@@ -0,0 +1,71 @@
+#!/usr/bin/python
+# Filename: dm_bench_compare.py
+"""
+Compare two runs of dm_bench, e.g. before and after a change.
+
+Usage: python dm_bench_compare.py OLD.jsonl NEW.jsonl [--all-codes]
+
+For each (stage, log, log_code) of both runs, print the ratios NEW / OLD of
+the throughput (mb_per_s, frames_per_s) and of allocs_per_frame. Only the
+"all" records are printed unless --all-codes is given.
+"""
+
+import json
+import sys
+
+METRICS = ("mb_per_s", "frames_per_s", "allocs_per_frame")
+
+
+def load(path):
+    """
+    Read the results of a dm_bench run
+
+    :param path: the output of dm_bench
+    :returns: a dict from (stage, log, log_code) to the result
+    """
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith("{"):
+                continue    # e.g. a warning of the decoder
+            r = json.loads(line)
+            if "stage" not in r:
+                continue    # the header
+            results[(r["stage"], r["log"], r["log_code"])] = r
+    return results
+
+
+def ratio(old, new):
+    if old == 0:
+        return "-" if new == 0 else "inf"
+    return "%.3f" % (float(new) / old)
+
+
+def main(argv):
+    args = [a for a in argv[1:] if not a.startswith("--")]
+    all_codes = "--all-codes" in argv[1:]
+    if len(args) != 2:
+        print __doc__
+        return 2
+    old = load(args[0])
+    new = load(args[1])
+
+    print "%-16s %-40s %-8s %10s %12s %16s" % (
+        "stage", "log", "code", "mb_per_s", "frames_per_s", "allocs_per_frame")
+    for key in sorted(set(old) & set(new)):
+        stage, log, code = key
+        if code != "all" and not all_codes:
+            continue
+        print "%-16s %-40s %-8s %10s %12s %16s" % (
+            (stage, log[-40:], code)
+            + tuple(ratio(old[key][m], new[key][m]) for m in METRICS))
+
+    missing = sorted(set(old) ^ set(new))
+    if missing and all_codes:
+        print "\nOnly in one run: %d records" % len(missing)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,111 @@
+/* chronicle_parser.cpp
+ * Native parser of the diag_revealer chunk stream. It replaces the
+ * per-field state machine of ChronicleProcessor, and feeds log payloads
+ * directly to the HDLC deframer.
+ */
+
+#include "chronicle_parser.h"
+#include "hdlc.h"
+
+#include <cstring>
+
+enum ChronicleParserStep {
+    READ_TYPE,
+    READ_MSG_LEN,
+    READ_TS,
+    READ_PAYLOAD,
+    READ_FILENAME,
+    SKIP_BODY,      // body of an unknown message type
+};
+
+static void
+start_field (struct ChronicleParserState *pstate, int state, size_t to_read) {
+    pstate->state = state;
+    pstate->header_len = 0;
+    pstate->to_read = to_read;
+}
+
+void
+chronicle_init_state (struct ChronicleParserState *pstate) {
+    start_field(pstate, READ_TYPE, 2);
+    pstate->msg_type = 0;
+    pstate->payload_len = 0;
+    pstate->timestamp = -1.0;
+    pstate->last_timestamp = -1.0;
+    pstate->filename.clear();
+    pstate->unknown_chunks = 0;
+}
+
+void
+chronicle_process (struct ChronicleParserState *pstate,
+                    const char *b, size_t length,
+                    std::vector<ChronicleEvent> &events) {
+    while (length > 0 || (pstate->to_read == 0 && pstate->state != READ_TYPE)) {
+        size_t n = length < pstate->to_read ? length : pstate->to_read;
+        switch (pstate->state) {
+        case READ_PAYLOAD:  // no need to wait for the complete field
+            if (n > 0)
+                feed_binary_timestamped(b, n, pstate->timestamp);
+            break;
+        case READ_FILENAME:
+            pstate->filename.append(b, n);
+            break;
+        case SKIP_BODY:
+            break;
+        default:
+            memcpy(pstate->header + pstate->header_len, b, n);
+            pstate->header_len += n;
+            break;
+        }
+        b += n;
+        length -= n;
+        pstate->to_read -= n;
+        if (pstate->to_read > 0)
+            break;
+
+        // The current field is complete
+        switch (pstate->state) {
+        case READ_TYPE:
+            pstate->msg_type = (unsigned char) pstate->header[0]
+                                | ((unsigned char) pstate->header[1] << 8);
+            start_field(pstate, READ_MSG_LEN, 2);
+            break;
+        case READ_MSG_LEN: {
+            size_t msg_len = (unsigned char) pstate->header[0]
+                                | ((unsigned char) pstate->header[1] << 8);
+            if (pstate->msg_type == CHRONICLE_TYPE_LOG && msg_len >= 8) {
+                pstate->payload_len = msg_len - 8;
+                start_field(pstate, READ_TS, 8);
+            } else if (pstate->msg_type == CHRONICLE_TYPE_START_LOG_FILE
+                        || pstate->msg_type == CHRONICLE_TYPE_END_LOG_FILE) {
+                pstate->filename.clear();
+                start_field(pstate, READ_FILENAME, msg_len);
+            } else {
+                pstate->unknown_chunks++;
+                start_field(pstate, SKIP_BODY, msg_len);
+            }
+            break;
+        }
+        case READ_TS: {
+            double ts;
+            memcpy(&ts, pstate->header, sizeof(ts));
+            pstate->timestamp = ts;
+            pstate->last_timestamp = ts;
+            start_field(pstate, READ_PAYLOAD, pstate->payload_len);
+            break;
+        }
+        case READ_FILENAME: {
+            ChronicleEvent event;
+            event.msg_type = pstate->msg_type;
+            event.filename = pstate->filename;
+            events.push_back(event);
+            pstate->filename.clear();
+            start_field(pstate, READ_TYPE, 2);
+            break;
+        }
+        default:    // READ_PAYLOAD, SKIP_BODY
+            start_field(pstate, READ_TYPE, 2);
+            break;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef __DM_COLLECTOR_C_CHRONICLE_PARSER_H__
+#define __DM_COLLECTOR_C_CHRONICLE_PARSER_H__
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Message types written by diag_revealer
+enum ChronicleMsgType {
+    CHRONICLE_TYPE_LOG = 1,
+    CHRONICLE_TYPE_START_LOG_FILE = 2,
+    CHRONICLE_TYPE_END_LOG_FILE = 3,
+};
+
+// A start/end of a log file written by diag_revealer
+struct ChronicleEvent {
+    int msg_type;
+    std::string filename;
+};
+
+// Parses the chunk stream of diag_revealer (the same protocol as
+// ChronicleProcessor in android_dev_diag_monitor.py):
+//   short msg_type, short msg_len, then
+//   TYPE_LOG:        double timestamp, payload (msg_len - 8 bytes)
+//   START/END_LOG_FILE: filename (msg_len bytes)
+// Payloads are fed to the HDLC deframer with their chunk timestamp.
+struct ChronicleParserState {
+    int state;
+    char header[8];         // the field being read
+    size_t header_len;
+    unsigned short msg_type;
+    size_t to_read;         // bytes left in the current field
+    size_t payload_len;     // of the current log chunk
+    double timestamp;       // of the current log chunk
+    double last_timestamp;  // of the last log chunk, -1.0 if none
+    std::string filename;
+    unsigned long long unknown_chunks;
+};
+
+// Must be called before usage
+void chronicle_init_state (struct ChronicleParserState *pstate);
+
+// Parse a piece of the stream, of any size. File events are appended to
+// events.
+void chronicle_process (struct ChronicleParserState *pstate,
+                        const char *b, size_t length,
+                        std::vector<ChronicleEvent> &events);
+
+#endif  // __DM_COLLECTOR_C_CHRONICLE_PARSER_H__
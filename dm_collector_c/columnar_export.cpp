@@ -0,0 +1,405 @@
+/* columnar_export.cpp
+ * Writes decoding results to column files (see columnar_export.h for the
+ * layout). Rows are flattened from the objects built by
+ * decode_log_packet(), without converting them to DMLogPacket.
+ */
+
+#include "columnar_export.h"
+
+#include <datetime.h>
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <sstream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#define make_dir(path) _mkdir(path)
+#else
+#define make_dir(path) mkdir(path, 0755)
+#endif
+
+typedef long long INT64;
+
+// Pending rows are written to disk in batches of this size
+static const unsigned long long CEXPORT_FLUSH_ROWS = 65536;
+
+// (name, value) pairs of a flattened row. Values are borrowed references.
+typedef std::vector<std::pair<std::string, PyObject *> > FlatRow;
+
+void
+cexport_init_state (struct ColumnarExportState *pstate) {
+    pstate->dir = "";
+    pstate->tables.clear();
+}
+
+bool
+cexport_open (struct ColumnarExportState *pstate, const char *dir) {
+    cexport_close(pstate);
+    if (PyDateTimeAPI == NULL)  // import datetime module
+        PyDateTime_IMPORT;
+    struct stat st;
+    if (stat(dir, &st) != 0 && make_dir(dir) != 0)
+        return false;
+    pstate->dir = dir;
+    return true;
+}
+
+static void
+flatten_list (PyObject *list, const std::string &prefix,
+                const FlatRow &base, std::vector<FlatRow> &rows);
+
+// Collect the scalar fields of a result list (and of its "dict"s) into row,
+// and the "list" fields into lists.
+static void
+collect_fields (PyObject *result, const std::string &prefix, FlatRow &row,
+                std::vector<std::pair<std::string, PyObject *> > &lists) {
+    Py_ssize_t n = PyList_Size(result);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject *t = PyList_GetItem(result, i);
+        if (!PyTuple_Check(t) || PyTuple_Size(t) != 3)
+            continue;
+        PyObject *name_obj = PyTuple_GetItem(t, 0);
+        PyObject *value = PyTuple_GetItem(t, 1);
+        const char *type = PyString_Check(PyTuple_GetItem(t, 2)) ?
+                            PyString_AsString(PyTuple_GetItem(t, 2)) : "";
+        std::string name = prefix + (PyString_Check(name_obj) ?
+                                        PyString_AsString(name_obj) : "");
+        if (strcmp(type, "dict") == 0 && PyList_Check(value))
+            collect_fields(value, name + ".", row, lists);
+        else if (strcmp(type, "list") == 0 && PyList_Check(value))
+            lists.push_back(std::make_pair(name, value));
+        else
+            row.push_back(std::make_pair(name, value));
+    }
+}
+
+// Flatten a result list into rows. Every element of a "list" field yields
+// its own rows; other fields are repeated in each of them.
+static void
+flatten_result (PyObject *result, const std::string &prefix,
+                const FlatRow &base, std::vector<FlatRow> &rows) {
+    FlatRow row = base;
+    std::vector<std::pair<std::string, PyObject *> > lists;
+    collect_fields(result, prefix, row, lists);
+    if (lists.empty()) {
+        rows.push_back(row);
+        return;
+    }
+    for (size_t i = 0; i < lists.size(); i++)
+        flatten_list(lists[i].second, lists[i].first, row, rows);
+}
+
+static void
+flatten_list (PyObject *list, const std::string &prefix,
+                const FlatRow &base, std::vector<FlatRow> &rows) {
+    Py_ssize_t n = PyList_Size(list);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject *t = PyList_GetItem(list, i);
+        if (!PyTuple_Check(t) || PyTuple_Size(t) != 3)
+            continue;
+        PyObject *value = PyTuple_GetItem(t, 1);
+        const char *type = PyString_Check(PyTuple_GetItem(t, 2)) ?
+                            PyString_AsString(PyTuple_GetItem(t, 2)) : "";
+        if (strcmp(type, "dict") == 0 && PyList_Check(value)) {
+            flatten_result(value, prefix + ".", base, rows);
+        } else if (strcmp(type, "list") == 0 && PyList_Check(value)) {
+            flatten_list(value, prefix, base, rows);
+        } else {
+            FlatRow row = base;
+            row.push_back(std::make_pair(prefix, value));
+            rows.push_back(row);
+        }
+    }
+}
+
+// Return: the column type of a value; false if it is None
+static bool
+value_type (PyObject *value, ColumnType &type) {
+    if (value == Py_None)
+        return false;
+    if (PyInt_Check(value) || PyLong_Check(value))
+        type = COL_INT64;
+    else if (PyFloat_Check(value))
+        type = COL_FLOAT64;
+    else if (PyDateTime_Check(value))
+        type = COL_TIMESTAMP;
+    else
+        type = COL_STRING;
+    return true;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+static INT64
+days_from_civil (int y, int m, int d) {
+    y -= m <= 2;
+    INT64 era = (y >= 0 ? y : y - 399) / 400;
+    INT64 yoe = y - era * 400;
+    INT64 doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    INT64 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Append a value, or null if it does not fit the column.
+// Return: false if the value is dropped
+static bool
+append_value (ColumnarColumn &col, PyObject *value) {
+    ColumnType type;
+    bool not_null = value != NULL && value_type(value, type);
+    bool fits = not_null && (type == col.type
+                                || (type == COL_INT64 && col.type == COL_FLOAT64)
+                                || col.type == COL_STRING);
+    col.valid.append(1, fits ? '\1' : '\0');
+
+    if (col.type == COL_STRING) {
+        if (fits) {
+            if (PyString_Check(value)) {
+                col.data.append(PyString_AsString(value), PyString_Size(value));
+            } else {
+                PyObject *s = PyObject_Str(value);
+                if (s != NULL) {
+                    col.data.append(PyString_AsString(s), PyString_Size(s));
+                    Py_DECREF(s);
+                } else {
+                    PyErr_Clear();
+                }
+            }
+        }
+        INT64 end = col.data_size + col.data.size();
+        col.values.append((const char *) &end, sizeof(end));
+    } else if (col.type == COL_FLOAT64) {
+        double d = fits ? PyFloat_AsDouble(value) : 0.0;
+        col.values.append((const char *) &d, sizeof(d));
+    } else if (col.type == COL_INT64) {
+        INT64 v = 0;
+        if (fits) {
+            v = PyLong_Check(value) ? PyLong_AsLongLong(value) : PyInt_AsLong(value);
+            if (PyErr_Occurred()) {     // e.g. larger than 2^63
+                PyErr_Clear();
+                v = (INT64) PyLong_AsUnsignedLongLongMask(value);
+            }
+        }
+        col.values.append((const char *) &v, sizeof(v));
+    } else {    // COL_TIMESTAMP
+        INT64 v = 0;
+        if (fits) {
+            INT64 days = days_from_civil(PyDateTime_GET_YEAR(value),
+                                            PyDateTime_GET_MONTH(value),
+                                            PyDateTime_GET_DAY(value));
+            INT64 seconds = days * 86400
+                            + PyDateTime_DATE_GET_HOUR(value) * 3600
+                            + PyDateTime_DATE_GET_MINUTE(value) * 60
+                            + PyDateTime_DATE_GET_SECOND(value);
+            v = seconds * 1000000 + PyDateTime_DATE_GET_MICROSECOND(value);
+        }
+        col.values.append((const char *) &v, sizeof(v));
+    }
+    return fits || !not_null;
+}
+
+static bool
+append_file (const std::string &path, const std::string &bytes) {
+    if (bytes.empty())
+        return true;
+    FILE *fp = fopen(path.c_str(), "ab");
+    if (fp == NULL)
+        return false;
+    bool success = fwrite(bytes.c_str(), 1, bytes.size(), fp) == bytes.size();
+    return (fclose(fp) == 0) && success;
+}
+
+static std::string
+column_path (const ColumnarTable *table, size_t k, const char *suffix) {
+    std::ostringstream oss;
+    oss << table->dir << "/c" << k << "." << suffix;
+    return oss.str();
+}
+
+static bool
+flush_table (ColumnarTable *table) {
+    bool success = true;
+    for (size_t k = 0; k < table->columns.size(); k++) {
+        ColumnarColumn &col = table->columns[k];
+        success = append_file(column_path(table, k, "valid"), col.valid)
+                    && append_file(column_path(table, k, "values"), col.values)
+                    && append_file(column_path(table, k, "data"), col.data)
+                    && success;
+        col.data_size += col.data.size();
+        col.valid.clear();
+        col.values.clear();
+        col.data.clear();
+    }
+    return success;
+}
+
+static void
+write_json_string (FILE *fp, const std::string &s) {
+    fputc('"', fp);
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+static bool
+write_schema (const ColumnarTable *table) {
+    static const char *type_names[] = {"int64", "float64", "string", "timestamp[us]"};
+    std::string path = table->dir + "/schema.json";
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL)
+        return false;
+    fprintf(fp, "{\n  \"n_rows\": %llu,\n  \"n_dropped\": %llu,\n  \"columns\": [",
+            table->n_rows, table->n_dropped);
+    for (size_t k = 0; k < table->columns.size(); k++) {
+        const ColumnarColumn &col = table->columns[k];
+        fprintf(fp, "%s\n    {\"name\": ", k == 0 ? "" : ",");
+        write_json_string(fp, col.name);
+        fprintf(fp, ", \"type\": \"%s\", \"file\": \"c%lu\", \"first_row\": %llu}",
+                type_names[col.type], (unsigned long) k, col.first_row);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    return fclose(fp) == 0;
+}
+
+// Return: table name of a decoding result, e.g. "LTE_RRC_OTA_Packet_v2"
+static std::string
+table_name (PyObject *result) {
+    std::string name = "Unsupported";
+    std::string version;
+    Py_ssize_t n = PyList_Size(result);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject *t = PyList_GetItem(result, i);
+        if (!PyTuple_Check(t) || PyTuple_Size(t) != 3
+                || !PyString_Check(PyTuple_GetItem(t, 0)))
+            continue;
+        const char *field = PyString_AsString(PyTuple_GetItem(t, 0));
+        PyObject *value = PyTuple_GetItem(t, 1);
+        if (strcmp(field, "type_id") == 0 && PyString_Check(value)) {
+            name = PyString_AsString(value);
+        } else if (version.empty()
+                    && (strcmp(field, "Version") == 0 || strcmp(field, "version") == 0)
+                    && (PyInt_Check(value) || PyLong_Check(value))) {
+            std::ostringstream oss;
+            oss << "_v" << PyLong_AsLongLong(value);
+            version = oss.str();
+        }
+    }
+    std::string ret = name + version;
+    for (size_t i = 0; i < ret.size(); i++) {   // keep it a valid file name
+        if (!isalnum((unsigned char) ret[i]) && ret[i] != '_' && ret[i] != '-')
+            ret[i] = '_';
+    }
+    return ret;
+}
+
+static ColumnarTable *
+get_table (struct ColumnarExportState *pstate, const std::string &name) {
+    std::map<std::string, ColumnarTable *>::iterator it = pstate->tables.find(name);
+    if (it != pstate->tables.end())
+        return it->second;
+    std::string dir = pstate->dir + "/" + name;
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0 && make_dir(dir.c_str()) != 0)
+        return NULL;
+    ColumnarTable *table = new ColumnarTable;
+    table->dir = dir;
+    table->n_rows = 0;
+    table->n_dropped = 0;
+    // Start from empty column files
+    for (size_t k = 0; ; k++) {
+        if (remove(column_path(table, k, "valid").c_str()) != 0)
+            break;
+        remove(column_path(table, k, "values").c_str());
+        remove(column_path(table, k, "data").c_str());
+    }
+    pstate->tables[name] = table;
+    return table;
+}
+
+static void
+append_row (ColumnarTable *table, const FlatRow &row) {
+    std::vector<PyObject *> values(table->columns.size(), (PyObject *) NULL);
+    for (size_t i = 0; i < row.size(); i++) {
+        std::map<std::string, size_t>::iterator it = table->column_index.find(row[i].first);
+        if (it != table->column_index.end()) {
+            values[it->second] = row[i].second;
+            continue;
+        }
+        ColumnType type;
+        if (!value_type(row[i].second, type))
+            continue;   // the type of a new column is unknown yet
+        ColumnarColumn col;
+        col.name = row[i].first;
+        col.type = type;
+        col.first_row = table->n_rows;
+        col.data_size = 0;
+        table->column_index[col.name] = table->columns.size();
+        table->columns.push_back(col);
+        values.push_back(row[i].second);
+    }
+    for (size_t k = 0; k < table->columns.size(); k++) {
+        if (!append_value(table->columns[k], values[k]))
+            table->n_dropped++;
+    }
+    table->n_rows++;
+}
+
+int
+cexport_append (struct ColumnarExportState *pstate, PyObject *result) {
+    if (pstate->dir.empty() || result == NULL || !PyList_Check(result))
+        return 0;
+    ColumnarTable *table = get_table(pstate, table_name(result));
+    if (table == NULL)
+        return -1;
+    std::vector<FlatRow> rows;
+    flatten_result(result, "", FlatRow(), rows);
+    for (size_t i = 0; i < rows.size(); i++)
+        append_row(table, rows[i]);
+    if (!table->columns.empty()
+            && table->columns[0].valid.size() >= CEXPORT_FLUSH_ROWS) {
+        if (!flush_table(table))
+            return -1;
+    }
+    return (int) rows.size();
+}
+
+void
+cexport_init_table (struct ColumnarTable *table) {
+    table->dir = "";
+    table->n_rows = 0;
+    table->n_dropped = 0;
+    table->columns.clear();
+    table->column_index.clear();
+}
+
+int
+cexport_append_rows (struct ColumnarTable *table, PyObject *result) {
+    if (result == NULL || !PyList_Check(result))
+        return 0;
+    if (PyDateTimeAPI == NULL)
+        PyDateTime_IMPORT;
+    std::vector<FlatRow> rows;
+    flatten_result(result, "", FlatRow(), rows);
+    for (size_t i = 0; i < rows.size(); i++)
+        append_row(table, rows[i]);
+    return (int) rows.size();
+}
+
+bool
+cexport_close (struct ColumnarExportState *pstate) {
+    bool success = true;
+    for (std::map<std::string, ColumnarTable *>::iterator it = pstate->tables.begin();
+            it != pstate->tables.end(); ++it) {
+        success = flush_table(it->second) && write_schema(it->second) && success;
+        delete it->second;
+    }
+    cexport_init_state(pstate);
+    return success;
+}
@@ -0,0 +1,73 @@
+#ifndef __DM_COLLECTOR_C_COLUMNAR_EXPORT_H__
+#define __DM_COLLECTOR_C_COLUMNAR_EXPORT_H__
+
+#include <Python.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Exports decoding results to a columnar directory layout:
+//   DIR/TABLE/schema.json
+//   DIR/TABLE/cK.valid     one byte per row, 1 if the value is not null
+//   DIR/TABLE/cK.values    int64/float64 per row; for strings, the end
+//                          offset (int64) of the value in cK.data
+//   DIR/TABLE/cK.data      concatenated string values
+// There is one table per log type and version (e.g.
+// LTE_PHY_PDSCH_Decoding_Result_v36). Fields of nested "dict"s become
+// columns named with their parent keys ("Records.Transport Blocks.TB
+// Index"), and each element of a "list" becomes its own row, with the
+// parent fields repeated. All files are little-endian and can be
+// memory-mapped (e.g. numpy.memmap). A column that first appears at row
+// first_row is null before it.
+enum ColumnType {
+    COL_INT64,
+    COL_FLOAT64,
+    COL_STRING,
+    COL_TIMESTAMP,  // int64 microseconds since 1970-01-01
+};
+
+struct ColumnarColumn {
+    std::string name;
+    ColumnType type;
+    unsigned long long first_row;
+    unsigned long long data_size;   // bytes written to cK.data
+    std::string values;             // pending bytes of cK.values
+    std::string valid;              // pending bytes of cK.valid
+    std::string data;               // pending bytes of cK.data
+};
+
+struct ColumnarTable {
+    std::string dir;
+    unsigned long long n_rows;
+    unsigned long long n_dropped;   // values whose type does not match the column
+    std::vector<ColumnarColumn> columns;
+    std::map<std::string, size_t> column_index;
+};
+
+struct ColumnarExportState {
+    std::string dir;
+    std::map<std::string, ColumnarTable *> tables;
+};
+
+// Must be called before usage
+void cexport_init_state (struct ColumnarExportState *pstate);
+
+// Return: successful or not
+bool cexport_open (struct ColumnarExportState *pstate, const char *dir);
+
+// Append a decoding result (output of decode_log_packet()).
+// Return: number of rows added, or -1 on I/O errors
+int cexport_append (struct ColumnarExportState *pstate, PyObject *result);
+
+// Flush all tables, write their schemas and free them.
+// Return: successful or not
+bool cexport_close (struct ColumnarExportState *pstate);
+
+// Tables can also be built in memory (e.g. for record arrays): rows are
+// flattened in the same way, but nothing is written to disk.
+void cexport_init_table (struct ColumnarTable *table);
+// Return: number of rows added
+int cexport_append_rows (struct ColumnarTable *table, PyObject *result);
+
+#endif  // __DM_COLLECTOR_C_COLUMNAR_EXPORT_H__
@@ -0,0 +1,224 @@
+/* compressed_log.cpp
+ * Reads and writes block-compressed logs (.mi2logz).
+ * Each block is an independent zlib stream, so that a reader can start at
+ * any block through the seek table, and parallel replay can decompress
+ * different parts of a log at the same time.
+ */
+
+#include "compressed_log.h"
+
+#include <cstring>
+#include <zlib.h>
+
+typedef unsigned int       UINT32;
+typedef unsigned long long UINT64;
+
+static const char CLOG_MAGIC[8] = {'M', 'I', '2', 'L', 'O', 'G', 'Z', '1'};
+static const char CLOG_TABLE_MAGIC[8] = {'M', 'I', '2', 'L', 'O', 'G', 'Z', 'T'};
+// Largest raw block; the reader treats larger ones as corruption
+static const size_t CLOG_BLOCK_SIZE = 1 << 20;
+// Captures are compressed on the phone while logging, so favor speed.
+static const int CLOG_LEVEL = Z_BEST_SPEED;
+
+struct CompressedBlockHeader {
+    UINT32 compressed_size;
+    UINT32 raw_size;
+};
+
+// Return: if the sizes can have been written by flush_block()
+static bool
+valid_block_header (const CompressedBlockHeader &h) {
+    return h.raw_size <= CLOG_BLOCK_SIZE
+            && h.compressed_size <= compressBound(h.raw_size);
+}
+
+struct CompressedLogFooter {
+    UINT64 n_blocks;
+    UINT64 table_offset;
+    char magic[8];
+};
+
+bool
+clog_is_compressed_path (const char *path) {
+    size_t len = strlen(path);
+    size_t suffix_len = strlen(COMPRESSED_LOG_SUFFIX);
+    return len >= suffix_len
+            && strcmp(path + len - suffix_len, COMPRESSED_LOG_SUFFIX) == 0;
+}
+
+void
+clog_writer_init (struct CompressedLogWriter *pwriter) {
+    pwriter->fp = NULL;
+    pwriter->block.clear();
+    pwriter->table.clear();
+    pwriter->raw_offset = 0;
+    pwriter->file_offset = 0;
+}
+
+bool
+clog_writer_open (struct CompressedLogWriter *pwriter, FILE *fp) {
+    clog_writer_init(pwriter);
+    if (fwrite(CLOG_MAGIC, sizeof(CLOG_MAGIC), 1, fp) != 1)
+        return false;
+    pwriter->fp = fp;
+    pwriter->file_offset = sizeof(CLOG_MAGIC);
+    pwriter->block.reserve(CLOG_BLOCK_SIZE);
+    return true;
+}
+
+// Compress and write the pending block.
+static bool
+flush_block (struct CompressedLogWriter *pwriter) {
+    if (pwriter->block.empty())
+        return true;
+    uLongf compressed_size = compressBound(pwriter->block.size());
+    std::vector<char> compressed(sizeof(CompressedBlockHeader) + compressed_size);
+    if (compress2((Bytef *) &compressed[sizeof(CompressedBlockHeader)], &compressed_size,
+                    (const Bytef *) pwriter->block.data(), pwriter->block.size(),
+                    CLOG_LEVEL) != Z_OK)
+        return false;
+    CompressedBlockHeader h;
+    h.compressed_size = compressed_size;
+    h.raw_size = pwriter->block.size();
+    memcpy(&compressed[0], &h, sizeof(h));
+    size_t n = sizeof(h) + compressed_size;
+    if (fwrite(&compressed[0], 1, n, pwriter->fp) != n)
+        return false;
+
+    CompressedBlock entry;
+    entry.raw_offset = pwriter->raw_offset;
+    entry.file_offset = pwriter->file_offset;
+    pwriter->table.push_back(entry);
+    pwriter->raw_offset += h.raw_size;
+    pwriter->file_offset += n;
+    pwriter->block.clear();
+    return true;
+}
+
+bool
+clog_write (struct CompressedLogWriter *pwriter, const char *b, size_t length) {
+    if (pwriter->fp == NULL || length > CLOG_BLOCK_SIZE)
+        return false;
+    // Blocks hold whole frames, and at most CLOG_BLOCK_SIZE bytes
+    if (pwriter->block.size() + length > CLOG_BLOCK_SIZE && !flush_block(pwriter))
+        return false;
+    pwriter->block.append(b, length);
+    if (pwriter->block.size() >= CLOG_BLOCK_SIZE)
+        return flush_block(pwriter);
+    return true;
+}
+
+bool
+clog_writer_finish (struct CompressedLogWriter *pwriter) {
+    if (pwriter->fp == NULL)
+        return false;
+    bool success = flush_block(pwriter);
+    CompressedLogFooter footer;
+    footer.n_blocks = pwriter->table.size();
+    footer.table_offset = pwriter->file_offset;
+    memcpy(footer.magic, CLOG_TABLE_MAGIC, sizeof(CLOG_TABLE_MAGIC));
+    size_t n = pwriter->table.size();
+    success = success
+            && (n == 0 || fwrite(&pwriter->table[0], sizeof(CompressedBlock), n,
+                                    pwriter->fp) == n)
+            && fwrite(&footer, sizeof(footer), 1, pwriter->fp) == 1;
+    clog_writer_init(pwriter);
+    return success;
+}
+
+bool
+clog_check_magic (FILE *fp) {
+    char magic[sizeof(CLOG_MAGIC)];
+    return fseek(fp, 0, SEEK_SET) == 0
+            && fread(magic, sizeof(magic), 1, fp) == 1
+            && memcmp(magic, CLOG_MAGIC, sizeof(CLOG_MAGIC)) == 0;
+}
+
+// Rebuild the seek table of a log without footer.
+static void
+scan_blocks (FILE *fp, UINT64 file_size, std::vector<CompressedBlock> &table,
+                UINT64 &raw_size) {
+    UINT64 offset = sizeof(CLOG_MAGIC);
+    CompressedBlockHeader h;
+    while (offset + sizeof(h) <= file_size
+            && fseek(fp, (long) offset, SEEK_SET) == 0
+            && fread(&h, sizeof(h), 1, fp) == 1
+            && valid_block_header(h)
+            && offset + sizeof(h) + h.compressed_size <= file_size) {
+        CompressedBlock entry;
+        entry.raw_offset = raw_size;
+        entry.file_offset = offset;
+        table.push_back(entry);
+        raw_size += h.raw_size;
+        offset += sizeof(h) + h.compressed_size;
+    }
+}
+
+bool
+clog_load_table (FILE *fp, std::vector<CompressedBlock> &table,
+                    unsigned long long &raw_size) {
+    table.clear();
+    raw_size = 0;
+    if (fseek(fp, 0, SEEK_END) != 0)
+        return false;
+    long end = ftell(fp);
+    if (end < (long) sizeof(CLOG_MAGIC))
+        return false;
+    UINT64 file_size = end;
+
+    CompressedLogFooter footer;
+    if (file_size >= sizeof(CLOG_MAGIC) + sizeof(footer)
+            && fseek(fp, (long) (file_size - sizeof(footer)), SEEK_SET) == 0
+            && fread(&footer, sizeof(footer), 1, fp) == 1
+            && memcmp(footer.magic, CLOG_TABLE_MAGIC, sizeof(CLOG_TABLE_MAGIC)) == 0
+            && footer.table_offset + footer.n_blocks * sizeof(CompressedBlock)
+                == file_size - sizeof(footer)) {
+        table.resize(footer.n_blocks);
+        if (footer.n_blocks == 0
+                || (fseek(fp, (long) footer.table_offset, SEEK_SET) == 0
+                    && fread(&table[0], sizeof(CompressedBlock), footer.n_blocks, fp)
+                        == footer.n_blocks)) {
+            if (footer.n_blocks > 0) {
+                CompressedBlockHeader h;
+                const CompressedBlock &last = table.back();
+                if (fseek(fp, (long) last.file_offset, SEEK_SET) != 0
+                        || fread(&h, sizeof(h), 1, fp) != 1
+                        || !valid_block_header(h))
+                    return false;
+                raw_size = last.raw_offset + h.raw_size;
+            }
+            return true;
+        }
+        table.clear();
+    }
+    scan_blocks(fp, file_size, table, raw_size);
+    return true;
+}
+
+bool
+clog_read_block (FILE *fp, const std::vector<CompressedBlock> &table,
+                    size_t k, std::vector<char> &out) {
+    if (k >= table.size())
+        return false;
+    CompressedBlockHeader h;
+    if (fseek(fp, (long) table[k].file_offset, SEEK_SET) != 0
+            || fread(&h, sizeof(h), 1, fp) != 1
+            || !valid_block_header(h))
+        return false;
+    std::vector<char> compressed(h.compressed_size);
+    if (h.compressed_size > 0
+            && fread(&compressed[0], 1, h.compressed_size, fp) != h.compressed_size)
+        return false;
+    size_t old_size = out.size();
+    out.resize(old_size + h.raw_size);
+    uLongf raw_size = h.raw_size;
+    if (h.raw_size == 0)
+        return true;
+    if (uncompress((Bytef *) &out[old_size], &raw_size,
+                    (const Bytef *) &compressed[0], h.compressed_size) != Z_OK
+            || raw_size != h.raw_size) {
+        out.resize(old_size);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef __DM_COLLECTOR_C_COMPRESSED_LOG_H__
+#define __DM_COLLECTOR_C_COMPRESSED_LOG_H__
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+// Compressed logs (.mi2logz): the raw byte stream of a .mi2log file, cut
+// into blocks of whole HDLC frames that are deflate-compressed
+// independently, followed by a seek table.
+//
+// File layout:
+//   "MI2LOGZ1"
+//   blocks: u32 compressed size, u32 raw size, zlib stream
+//   seek table: (u64 raw offset, u64 file offset) per block
+//   footer: u64 n_blocks, u64 offset of the seek table, "MI2LOGZT"
+// A file without footer (e.g. the capture was interrupted) is still
+// readable; its seek table is rebuilt from the block headers.
+// Offsets in the sidecar index refer to the raw stream.
+
+#define COMPRESSED_LOG_SUFFIX ".mi2logz"
+
+struct CompressedBlock {
+    unsigned long long raw_offset;
+    unsigned long long file_offset;
+};
+
+struct CompressedLogWriter {
+    FILE *fp;
+    std::string block;      // pending raw bytes
+    std::vector<CompressedBlock> table;
+    unsigned long long raw_offset;
+    unsigned long long file_offset;
+};
+
+// Return: if path names a compressed log
+bool clog_is_compressed_path (const char *path);
+
+// Must be called before usage
+void clog_writer_init (struct CompressedLogWriter *pwriter);
+// Start a compressed log on an opened file.
+// Return: successful or not
+bool clog_writer_open (struct CompressedLogWriter *pwriter, FILE *fp);
+// Append whole frames. A block is compressed when it is large enough.
+// Return: successful or not
+bool clog_write (struct CompressedLogWriter *pwriter, const char *b, size_t length);
+// Flush the last block and write the seek table. The file is not closed.
+// Return: successful or not
+bool clog_writer_finish (struct CompressedLogWriter *pwriter);
+
+// Reading side, used by LogReaderState
+// Return: true if fp is positioned at the start of a compressed log
+bool clog_check_magic (FILE *fp);
+// Load the seek table, and the total raw size.
+// Return: successful or not
+bool clog_load_table (FILE *fp, std::vector<CompressedBlock> &table,
+                        unsigned long long &raw_size);
+// Decompress block k and append it to out.
+// Return: successful or not
+bool clog_read_block (FILE *fp, const std::vector<CompressedBlock> &table,
+                        size_t k, std::vector<char> &out);
+
+#endif  // __DM_COLLECTOR_C_COMPRESSED_LOG_H__
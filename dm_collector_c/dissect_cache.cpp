@@ -0,0 +1,339 @@
+/* dissect_cache.cpp
+ * Implements a persistent, memory-mapped cache of ws_dissector outputs, so
+ * that replaying the same logs again does not need to call Wireshark.
+ *
+ * File layout:
+ *   DissectCacheHeader
+ *   DissectCacheBucket[n_buckets]   (open addressing, linear probing)
+ *   entries: key (4-byte msg type + payload) followed by value
+ */
+
+#include "dissect_cache.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+typedef unsigned int       UINT32;
+typedef unsigned long long UINT64;
+
+static const char DCACHE_MAGIC[8] = {'M', 'I', 'D', 'C', 'A', 'C', 'H', '1'};
+static const unsigned int DCACHE_DEFAULT_BUCKETS = 65536;
+static const size_t DCACHE_MIN_DATA = 1 << 20;
+
+struct DissectCacheHeader {
+    char magic[8];
+    char version[32];
+    UINT32 n_buckets;
+    UINT32 reserved;
+    UINT64 data_end;    // offset of the first unused byte
+    UINT64 n_entries;
+};
+
+struct DissectCacheBucket {
+    UINT64 digest;
+    UINT64 offset;      // 0 means empty
+    UINT32 key_len;
+    UINT32 value_len;
+};
+
+// FNV-1a, 64 bit
+static UINT64
+calc_digest (unsigned int msg_type, const char *b, size_t length) {
+    UINT64 h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 4; i++) {
+        h ^= (msg_type >> (8 * i)) & 0xFF;
+        h *= 0x100000001b3ULL;
+    }
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char) b[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static size_t
+data_start (UINT32 n_buckets) {
+    return sizeof(DissectCacheHeader) + n_buckets * sizeof(DissectCacheBucket);
+}
+
+// The version is stored truncated to fit the header (and NUL terminated)
+static bool
+version_matches (const DissectCacheHeader *h, const char *version) {
+    size_t stored = strnlen(h->version, sizeof(h->version));
+    if (stored >= sizeof(h->version))
+        return false;
+    size_t length = strlen(version);
+    if (length > sizeof(h->version) - 1)
+        length = sizeof(h->version) - 1;
+    return stored == length && memcmp(h->version, version, length) == 0;
+}
+
+void
+dcache_init_state (struct DissectCacheState *pstate) {
+    pstate->fd = -1;
+    pstate->base = NULL;
+    pstate->mapped_size = 0;
+    pstate->path = "";
+    pstate->hits = 0;
+    pstate->misses = 0;
+}
+
+#ifndef _WIN32
+
+static bool
+remap (struct DissectCacheState *pstate, size_t new_size) {
+    if (pstate->base != NULL) {
+        munmap(pstate->base, pstate->mapped_size);
+        pstate->base = NULL;
+        pstate->mapped_size = 0;
+    }
+    if (ftruncate(pstate->fd, new_size) != 0)
+        return false;
+    void *p = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    pstate->fd, 0);
+    if (p == MAP_FAILED)
+        return false;
+    pstate->base = (char *) p;
+    pstate->mapped_size = new_size;
+    return true;
+}
+
+bool
+dcache_open (struct DissectCacheState *pstate, const char *path,
+                const char *version, unsigned int n_buckets) {
+    dcache_close(pstate);
+    if (n_buckets == 0)
+        n_buckets = DCACHE_DEFAULT_BUCKETS;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+    // Only one process may own the cache at a time.
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        return false;
+    }
+    pstate->fd = fd;
+    pstate->path = path;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        dcache_close(pstate);
+        return false;
+    }
+
+    bool valid = false;
+    if ((size_t) st.st_size >= sizeof(DissectCacheHeader)) {
+        if (!remap(pstate, st.st_size)) {
+            dcache_close(pstate);
+            return false;
+        }
+        DissectCacheHeader *h = (DissectCacheHeader *) pstate->base;
+        valid = memcmp(h->magic, DCACHE_MAGIC, sizeof(DCACHE_MAGIC)) == 0
+                && version_matches(h, version)
+                && h->n_buckets > 0
+                && data_start(h->n_buckets) <= h->data_end
+                && h->data_end <= (UINT64) st.st_size;
+    }
+
+    if (!valid) {   // (re)build an empty table
+        size_t size = data_start(n_buckets) + DCACHE_MIN_DATA;
+        if (pstate->base != NULL) {
+            munmap(pstate->base, pstate->mapped_size);
+            pstate->base = NULL;
+        }
+        if (ftruncate(fd, 0) != 0 || !remap(pstate, size)) {
+            dcache_close(pstate);
+            return false;
+        }
+        DissectCacheHeader *h = (DissectCacheHeader *) pstate->base;
+        memset(pstate->base, 0, data_start(n_buckets));
+        memcpy(h->magic, DCACHE_MAGIC, sizeof(DCACHE_MAGIC));
+        strncpy(h->version, version, sizeof(h->version) - 1);
+        h->n_buckets = n_buckets;
+        h->data_end = data_start(n_buckets);
+        h->n_entries = 0;
+    }
+    return true;
+}
+
+void
+dcache_close (struct DissectCacheState *pstate) {
+    if (pstate->base != NULL) {
+        DissectCacheHeader *h = (DissectCacheHeader *) pstate->base;
+        UINT64 used = h->data_end;
+        munmap(pstate->base, pstate->mapped_size);
+        // drop the unused tail reserved by remap()
+        if (ftruncate(pstate->fd, used) != 0) {
+            // the file is still valid, only larger than necessary
+        }
+    }
+    if (pstate->fd >= 0) {
+        flock(pstate->fd, LOCK_UN);
+        close(pstate->fd);
+    }
+    dcache_init_state(pstate);
+}
+
+// Return: whether the entry of a used bucket lies within the data area, so
+// that a corrupt file is never read out of bounds
+static bool
+entry_in_bounds (const struct DissectCacheState *pstate,
+                    const DissectCacheBucket *bucket) {
+    const DissectCacheHeader *h = (const DissectCacheHeader *) pstate->base;
+    UINT64 end = h->data_end;
+    if (end > pstate->mapped_size)
+        return false;
+    return bucket->offset >= data_start(h->n_buckets)
+            && bucket->offset <= end
+            && bucket->key_len <= end - bucket->offset
+            && bucket->value_len <= end - bucket->offset - bucket->key_len;
+}
+
+// Return: the bucket that holds the key, or the empty bucket where it should
+// be inserted. NULL if the table is full or corrupt.
+static DissectCacheBucket *
+find_bucket (struct DissectCacheState *pstate, UINT64 digest,
+                const char *key_prefix, const char *b, size_t length) {
+    DissectCacheHeader *h = (DissectCacheHeader *) pstate->base;
+    DissectCacheBucket *buckets =
+        (DissectCacheBucket *) (pstate->base + sizeof(DissectCacheHeader));
+    UINT32 n = h->n_buckets;
+    for (UINT32 k = 0; k < n; k++) {
+        DissectCacheBucket *bucket = &buckets[(digest + k) % n];
+        if (bucket->offset == 0)
+            return bucket;
+        if (!entry_in_bounds(pstate, bucket))
+            return NULL;
+        if (bucket->digest == digest && bucket->key_len == length + 4) {
+            const char *key = pstate->base + bucket->offset;
+            if (memcmp(key, key_prefix, 4) == 0
+                    && memcmp(key + 4, b, length) == 0)
+                return bucket;
+        }
+    }
+    return NULL;
+}
+
+static void
+encode_key_prefix (unsigned int msg_type, char prefix[4]) {
+    for (int i = 0; i < 4; i++)
+        prefix[i] = (char) ((msg_type >> (8 * i)) & 0xFF);
+}
+
+bool
+dcache_lookup (struct DissectCacheState *pstate, unsigned int msg_type,
+                const char *b, size_t length, std::string &out) {
+    if (pstate->base == NULL)
+        return false;
+    char prefix[4];
+    encode_key_prefix(msg_type, prefix);
+    UINT64 digest = calc_digest(msg_type, b, length);
+    DissectCacheBucket *bucket = find_bucket(pstate, digest, prefix, b, length);
+    if (bucket == NULL || bucket->offset == 0) {
+        pstate->misses++;
+        return false;
+    }
+    out.assign(pstate->base + bucket->offset + bucket->key_len,
+                bucket->value_len);
+    pstate->hits++;
+    return true;
+}
+
+bool
+dcache_store (struct DissectCacheState *pstate, unsigned int msg_type,
+                const char *b, size_t length,
+                const char *value, size_t value_length) {
+    if (pstate->base == NULL)
+        return false;
+    char prefix[4];
+    encode_key_prefix(msg_type, prefix);
+    UINT64 digest = calc_digest(msg_type, b, length);
+    DissectCacheHeader *h = (DissectCacheHeader *) pstate->base;
+
+    // Keep the load factor below 3/4; a full cache simply stops growing.
+    if (h->n_entries * 4 >= (UINT64) h->n_buckets * 3)
+        return false;
+    DissectCacheBucket *bucket = find_bucket(pstate, digest, prefix, b, length);
+    if (bucket == NULL)
+        return false;
+    if (bucket->offset != 0)
+        return true;
+
+    size_t needed = 4 + length + value_length;
+    if (h->data_end + needed > pstate->mapped_size) {
+        size_t bucket_index = (char *) bucket - pstate->base;
+        size_t new_size = pstate->mapped_size * 2;
+        if (new_size < h->data_end + needed)
+            new_size = h->data_end + needed;
+        if (!remap(pstate, new_size)) {
+            dcache_close(pstate);
+            return false;
+        }
+        h = (DissectCacheHeader *) pstate->base;
+        bucket = (DissectCacheBucket *) (pstate->base + bucket_index);
+    }
+
+    char *p = pstate->base + h->data_end;
+    memcpy(p, prefix, 4);
+    memcpy(p + 4, b, length);
+    memcpy(p + 4 + length, value, value_length);
+
+    bucket->digest = digest;
+    bucket->key_len = 4 + length;
+    bucket->value_len = value_length;
+    bucket->offset = h->data_end;   // publish the entry last
+    h->data_end += needed;
+    h->n_entries++;
+    return true;
+}
+
+#else   // _WIN32: the cache is not supported
+
+bool
+dcache_open (struct DissectCacheState *pstate, const char *path,
+                const char *version, unsigned int n_buckets) {
+    (void)pstate;
+    (void)path;
+    (void)version;
+    (void)n_buckets;
+    return false;
+}
+
+void
+dcache_close (struct DissectCacheState *pstate) {
+    dcache_init_state(pstate);
+}
+
+bool
+dcache_lookup (struct DissectCacheState *pstate, unsigned int msg_type,
+                const char *b, size_t length, std::string &out) {
+    (void)pstate;
+    (void)msg_type;
+    (void)b;
+    (void)length;
+    (void)out;
+    return false;
+}
+
+bool
+dcache_store (struct DissectCacheState *pstate, unsigned int msg_type,
+                const char *b, size_t length,
+                const char *value, size_t value_length) {
+    (void)pstate;
+    (void)msg_type;
+    (void)b;
+    (void)length;
+    (void)value;
+    (void)value_length;
+    return false;
+}
+
+#endif
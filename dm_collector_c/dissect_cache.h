@@ -0,0 +1,38 @@
+#ifndef __DM_COLLECTOR_C_DISSECT_CACHE_H__
+#define __DM_COLLECTOR_C_DISSECT_CACHE_H__
+
+#include <string>
+#include <cstddef>
+
+// A persistent cache of ws_dissector outputs.
+// The cache file is a memory-mapped open-addressing hash table. Keys are
+// (AWW protocol number, raw payload); values are the PDML text returned by
+// ws_dissector. The dissector version is stored in the file header, and the
+// table is discarded whenever it does not match the running dissector.
+struct DissectCacheState {
+    int fd;
+    char *base;         // mmap()-ed file, NULL if the cache is closed
+    size_t mapped_size;
+    std::string path;
+    unsigned long long hits;
+    unsigned long long misses;
+};
+
+// Must be called before usage
+void dcache_init_state (struct DissectCacheState *pstate);
+
+// Open (or create) a cache file bound to a dissector version.
+// Return: successful or not
+bool dcache_open (struct DissectCacheState *pstate, const char *path,
+                    const char *version, unsigned int n_buckets);
+void dcache_close (struct DissectCacheState *pstate);
+
+// Return: true if found, and the cached output is copied to out
+bool dcache_lookup (struct DissectCacheState *pstate, unsigned int msg_type,
+                    const char *b, size_t length, std::string &out);
+// Return: true if the entry is inserted (or already exists)
+bool dcache_store (struct DissectCacheState *pstate, unsigned int msg_type,
+                    const char *b, size_t length,
+                    const char *value, size_t value_length);
+
+#endif  // __DM_COLLECTOR_C_DISSECT_CACHE_H__
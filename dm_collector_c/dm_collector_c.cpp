@@ -5,15 +5,35 @@
  */
 
 #include <Python.h>
+#include <structmember.h>
+#include <datetime.h>
+#include <pythread.h>
 
 #include "consts.h"
 #include "hdlc.h"
 #include "log_config.h"
 #include "log_packet.h"
 #include "export_manager.h"
+#include "dissect_cache.h"
+#include "ws_shm.h"
+#include "log_reader.h"
+#include "log_index.h"
+#include "parallel_replay.h"
+#include "columnar_export.h"
+#include "chronicle_parser.h"
+#include "fd_reader.h"
+#include "throughput_aggregator.h"
+#include "rlc_tracker.h"
+#include "message_stats.h"
+#include "meas_kernels.h"
+#include "perf_counters.h"
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <set>
+#include <map>
+#include <cstring>
 #include <algorithm>
 #include <iostream>
 #include <sstream>
@@ -25,22 +45,745 @@
 
 #ifndef _WIN32
 #include <sys/time.h>
+#include <unistd.h>
 #endif
 
 // NOTE: the following number should be updated every time.
-#define DM_COLLECTOR_C_VERSION "1.0.12"
+#define DM_COLLECTOR_C_VERSION "1.0.34"
 
 // Global variable to control exportation of raw log
 static ExportManagerState g_emanager;
 
+// Global variable to parse the chunk stream of diag_revealer
+static ChronicleParserState g_chronicle;
+
+// Global variables of the fd attached by attach_fd(), and the file events
+// its chunk stream has delivered
+static FdReaderState g_fdreader;
+static std::vector<ChronicleEvent> g_chronicle_events;
+
+// Global variable of the windowed DL/UL link statistics
+static ThroughputAggregatorState g_taggr;
+
+// Global variable of the RLC AM sequence number tracker
+static RlcTrackerState g_rtracker;
+
+// Global variable of the per log code message statistics
+static MessageStatsState g_mstats;
+
+// Per-stage counters and timers
+static PerfCountersState g_perf;
+
+// Global variable to cache ws_dissector outputs across replays
+static DissectCacheState g_dcache;
+
+// Global variable of the shared-memory transport to ws_dissector
+static WsShmState g_wsshm;
+// Held by ws_shm_decode() while it waits without the GIL, so that requests
+// do not interleave and the transport is not closed under them
+static PyThread_type_lock g_wsshm_lock = NULL;
+
 static PyObject *dm_collector_c_disable_logs (PyObject *self, PyObject *args);
 static PyObject *dm_collector_c_enable_logs (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_set_export_rotation (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_set_export_async (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_get_export_stats (PyObject *self, PyObject *args);
 static PyObject *dm_collector_c_set_filtered_export (PyObject *self, PyObject *args);
 static PyObject *dm_collector_c_set_filtered (PyObject *self, PyObject *args);
 static PyObject *dm_collector_c_generate_diag_cfg (PyObject *self, PyObject *args);
 static PyObject *dm_collector_c_feed_binary (PyObject *self, PyObject *args);
 static PyObject *dm_collector_c_reset (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_feed_chronicle (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_read_chronicle (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_attach_fd (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_detach_fd (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_poll_log_packets (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_get_chronicle_events (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_set_throughput_window (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_get_throughput_summaries (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_set_rlc_window (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_get_rlc_summaries (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_enable_msg_statistics (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_get_msg_statistics (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_enable_stats (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_get_stats (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_record_ws_roundtrip (PyObject *self, PyObject *args);
 static PyObject *dm_collector_c_receive_log_packet (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_open_log (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_open_logs (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_open_log_headers (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_build_log_index (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_export_columnar (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_to_records (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_extract_measurements (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_open_log_index (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_dissect_cache_open (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_dissect_cache_close (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_dissect_cache_lookup (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_dissect_cache_store (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_ws_shm_open (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_ws_shm_set_peer (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_ws_shm_close (PyObject *self, PyObject *args);
+static PyObject *dm_collector_c_ws_shm_decode (PyObject *self, PyObject *args);
+
+// Iterator returned by open_log()
+typedef struct {
+    PyObject_HEAD
+    LogReaderState *state;
+    bool skip_decoding;
+    LogFrameFilter *filter;     // NULL if all frames are decoded
+} LogReaderObject;
+
+static bool to_qcdm_timestamp (PyObject *o, unsigned long long *timestamp,
+                                bool upper_bound);
+static bool build_type_mask (PyObject *type_names, std::vector<bool> &types);
+
+static void log_reader_dealloc (LogReaderObject *self);
+static PyObject *log_reader_iternext (LogReaderObject *self);
+static PyObject *log_reader_close (LogReaderObject *self, PyObject *args);
+
+static PyMethodDef LogReaderMethods[] = {
+    {"close", (PyCFunction) log_reader_close, METH_NOARGS,
+        "Close the log file."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyTypeObject LogReaderType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "dm_collector_c.LogReader",         /* tp_name */
+    sizeof(LogReaderObject),            /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    (destructor) log_reader_dealloc,    /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    0,                                  /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    0,                                  /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+    "Iterates over the decoded log packets of a log file.",  /* tp_doc */
+    0,                                  /* tp_traverse */
+    0,                                  /* tp_clear */
+    0,                                  /* tp_richcompare */
+    0,                                  /* tp_weaklistoffset */
+    PyObject_SelfIter,                  /* tp_iter */
+    (iternextfunc) log_reader_iternext, /* tp_iternext */
+    LogReaderMethods,                   /* tp_methods */
+};
+
+// Deframed frames yielded by open_log_headers(), in one read-only buffer
+// that the memoryviews of the frames refer to. The buffer never grows past
+// its initial capacity, so the views stay valid.
+typedef struct {
+    PyObject_HEAD
+    std::string *data;
+} FrameBlockObject;
+
+static void frame_block_dealloc (FrameBlockObject *self);
+static int frame_block_getbuffer (FrameBlockObject *self, Py_buffer *view, int flags);
+
+static PyBufferProcs FrameBlockBufferProcs = {
+    0,                                          /* bf_getreadbuffer */
+    0,                                          /* bf_getwritebuffer */
+    0,                                          /* bf_getsegcount */
+    0,                                          /* bf_getcharbuffer */
+    (getbufferproc) frame_block_getbuffer,      /* bf_getbuffer */
+    0,                                          /* bf_releasebuffer */
+};
+
+static PyTypeObject FrameBlockType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "dm_collector_c.FrameBlock",        /* tp_name */
+    sizeof(FrameBlockObject),           /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    (destructor) frame_block_dealloc,   /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    0,                                  /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    &FrameBlockBufferProcs,             /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, /* tp_flags */
+    "Deframed frames that memoryviews refer to.",  /* tp_doc */
+};
+
+// Iterator returned by open_log_headers()
+typedef struct {
+    PyObject_HEAD
+    LogReaderState *state;
+    LogFrameFilter *filter;     // NULL if all log packets are returned
+    FrameBlockObject *block;    // where the next frames are copied, or NULL
+} HeaderReaderObject;
+
+static void header_reader_dealloc (HeaderReaderObject *self);
+static PyObject *header_reader_iternext (HeaderReaderObject *self);
+static PyObject *header_reader_close (HeaderReaderObject *self, PyObject *args);
+
+static PyMethodDef HeaderReaderMethods[] = {
+    {"close", (PyCFunction) header_reader_close, METH_NOARGS,
+        "Close the log file."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyTypeObject HeaderReaderType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "dm_collector_c.HeaderReader",      /* tp_name */
+    sizeof(HeaderReaderObject),         /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    (destructor) header_reader_dealloc, /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    0,                                  /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    0,                                  /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+    "Iterates over the headers of the log packets of a log file.",  /* tp_doc */
+    0,                                  /* tp_traverse */
+    0,                                  /* tp_clear */
+    0,                                  /* tp_richcompare */
+    0,                                  /* tp_weaklistoffset */
+    PyObject_SelfIter,                  /* tp_iter */
+    (iternextfunc) header_reader_iternext,  /* tp_iternext */
+    HeaderReaderMethods,                /* tp_methods */
+};
+
+// Iterator returned by open_logs()
+typedef struct {
+    PyObject_HEAD
+    ParallelReplayState *state;
+    bool skip_decoding;
+} ParallelReplayObject;
+
+static void parallel_replay_dealloc (ParallelReplayObject *self);
+static PyObject *parallel_replay_iternext (ParallelReplayObject *self);
+static PyObject *parallel_replay_close (ParallelReplayObject *self, PyObject *args);
+
+static PyMethodDef ParallelReplayMethods[] = {
+    {"close", (PyCFunction) parallel_replay_close, METH_NOARGS,
+        "Stop worker threads and close the log files."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyTypeObject ParallelReplayType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "dm_collector_c.ParallelReplay",    /* tp_name */
+    sizeof(ParallelReplayObject),       /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    (destructor) parallel_replay_dealloc,   /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    0,                                  /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    0,                                  /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+    "Iterates over the decoded log packets of several log files.",  /* tp_doc */
+    0,                                  /* tp_traverse */
+    0,                                  /* tp_clear */
+    0,                                  /* tp_richcompare */
+    0,                                  /* tp_weaklistoffset */
+    PyObject_SelfIter,                  /* tp_iter */
+    (iternextfunc) parallel_replay_iternext,    /* tp_iternext */
+    ParallelReplayMethods,              /* tp_methods */
+};
+
+// Returned by open_log_index()
+typedef struct {
+    PyObject_HEAD
+    LogIndexState *index;
+    LogReaderState *reader;
+} LogIndexObject;
+
+// Iterator returned by LogIndex.iterate()
+typedef struct {
+    PyObject_HEAD
+    LogIndexObject *owner;
+    size_t pos;
+    std::vector<bool> *types;   // indexed by log code, NULL means all types
+    unsigned long long t0;
+    unsigned long long t1;
+    bool skip_decoding;
+} LogIndexIterObject;
+
+static void log_index_dealloc (LogIndexObject *self);
+static Py_ssize_t log_index_length (LogIndexObject *self);
+static PyObject *log_index_counts (LogIndexObject *self, PyObject *args);
+static PyObject *log_index_seek (LogIndexObject *self, PyObject *args);
+static PyObject *log_index_frame_info (LogIndexObject *self, PyObject *args);
+static PyObject *log_index_iterate (LogIndexObject *self, PyObject *args);
+static PyObject *log_index_close (LogIndexObject *self, PyObject *args);
+static void log_index_iter_dealloc (LogIndexIterObject *self);
+static PyObject *log_index_iter_iternext (LogIndexIterObject *self);
+
+static PyMethodDef LogIndexMethods[] = {
+    {"counts", (PyCFunction) log_index_counts, METH_NOARGS,
+        "Count indexed frames by type.\n"
+        "\n"
+        "Returns:\n"
+        "    A dict that maps type names to numbers of frames.\n"
+    },
+    {"seek", (PyCFunction) log_index_seek, METH_VARARGS,
+        "Find the first frame at or after a time.\n"
+        "\n"
+        "Args:\n"
+        "    timestamp: a datetime, in the same format as decoded timestamps.\n"
+        "\n"
+        "Returns:\n"
+        "    A frame number, or len(index) if there is none.\n"
+    },
+    {"frame_info", (PyCFunction) log_index_frame_info, METH_VARARGS,
+        "Get the index entry of a frame.\n"
+        "\n"
+        "Args:\n"
+        "    i: the frame number.\n"
+        "\n"
+        "Returns:\n"
+        "    (file offset, log code, raw QCDM timestamp).\n"
+    },
+    {"iterate", (PyCFunction) log_index_iterate, METH_VARARGS,
+        "Iterate over the decoded packets of some types within a time window.\n"
+        "Only matching frames are read from the log file.\n"
+        "\n"
+        "Args:\n"
+        "    type_names: a sequence of type names, or None for all types.\n"
+        "    t0: (optional) a datetime; earlier packets are skipped.\n"
+        "    t1: (optional) a datetime; later packets are skipped.\n"
+        "    skip_decoding: If set to True, only the header would be decoded.\n"
+        "        Default to False.\n"
+        "\n"
+        "Returns:\n"
+        "    An iterator of decoded messages.\n"
+        "\n"
+        "Raises\n"
+        "    ValueError: when an unrecognized type name is passed in.\n"
+    },
+    {"close", (PyCFunction) log_index_close, METH_NOARGS,
+        "Close the index and the log file."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PySequenceMethods LogIndexAsSequence = {
+    (lenfunc) log_index_length,         /* sq_length */
+};
+
+static PyTypeObject LogIndexType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "dm_collector_c.LogIndex",          /* tp_name */
+    sizeof(LogIndexObject),             /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    (destructor) log_index_dealloc,     /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    &LogIndexAsSequence,                /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    0,                                  /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+    "Sidecar frame index of a log file.",  /* tp_doc */
+    0,                                  /* tp_traverse */
+    0,                                  /* tp_clear */
+    0,                                  /* tp_richcompare */
+    0,                                  /* tp_weaklistoffset */
+    0,                                  /* tp_iter */
+    0,                                  /* tp_iternext */
+    LogIndexMethods,                    /* tp_methods */
+};
+
+static PyTypeObject LogIndexIterType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "dm_collector_c.LogIndexIterator",  /* tp_name */
+    sizeof(LogIndexIterObject),         /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    (destructor) log_index_iter_dealloc,    /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    0,                                  /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    0,                                  /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+    "Iterates over the indexed packets of a log file.",  /* tp_doc */
+    0,                                  /* tp_traverse */
+    0,                                  /* tp_clear */
+    0,                                  /* tp_richcompare */
+    0,                                  /* tp_weaklistoffset */
+    PyObject_SelfIter,                  /* tp_iter */
+    (iternextfunc) log_index_iter_iternext, /* tp_iternext */
+};
+
+// A decoded log packet. The conversions of decoded_list are done once and
+// cached, so that every analyzer receiving the packet shares the work.
+typedef struct {
+    PyObject_HEAD
+    PyObject *decoded_list;
+    PyObject *type_id;          // None if the list has no "type_id"
+    PyObject *timestamp;        // None if the list has no "timestamp"
+    PyObject *dict_cache;       // NULL until decode() is called
+    PyObject *list_cache;       // NULL until decode_list() is called
+} LogPacketObject;
+
+static int log_packet_init (LogPacketObject *self, PyObject *args, PyObject *kwds);
+static void log_packet_dealloc (LogPacketObject *self);
+static int log_packet_traverse (LogPacketObject *self, visitproc visit, void *arg);
+static int log_packet_clear (LogPacketObject *self);
+static PyObject *log_packet_decode (LogPacketObject *self, PyObject *args);
+static PyObject *log_packet_decode_list (LogPacketObject *self, PyObject *args);
+static PyObject *log_packet_reduce (LogPacketObject *self, PyObject *args);
+
+static PyMethodDef LogPacketMethods[] = {
+    {"decode", (PyCFunction) log_packet_decode, METH_NOARGS,
+        "Convert the packet to a dict.\n"
+        "\n"
+        "The dict is built on the first call, and every call returns a new\n"
+        "copy of it. Its nested dicts and lists are shared by the copies, so\n"
+        "they should be treated as read-only.\n"
+        "\n"
+        "Returns:\n"
+        "    A dict that maps field names to values, e.g.\n"
+        "    {\"type_id\": \"LTE_RRC_OTA_Packet\",\n"
+        "     \"timestamp\": datetime.datetime(...), \"Pkt Version\": 2, ...}.\n"
+        "    Nested structures are converted to dicts and lists.\n"
+    },
+    {"decode_list", (PyCFunction) log_packet_decode_list, METH_NOARGS,
+        "Convert the packet to a list of field values.\n"
+        "\n"
+        "The list is built on the first call and shared by later calls.\n"
+        "\n"
+        "Returns:\n"
+        "    A list of values, in the order of decoded_list.\n"
+    },
+    {"__reduce__", (PyCFunction) log_packet_reduce, METH_NOARGS,
+        "Support pickling."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyMemberDef LogPacketMembers[] = {
+    {(char *) "decoded_list", T_OBJECT, offsetof(LogPacketObject, decoded_list),
+        READONLY, (char *) "The (field_name, value, type_str) list of the packet."},
+    {(char *) "type_id", T_OBJECT, offsetof(LogPacketObject, type_id),
+        READONLY, (char *) "Type name of the packet."},
+    {(char *) "timestamp", T_OBJECT, offsetof(LogPacketObject, timestamp),
+        READONLY, (char *) "Timestamp of the packet, as a datetime."},
+    {NULL, 0, 0, 0, NULL}        /* Sentinel */
+};
+
+static PyTypeObject LogPacketType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "dm_collector_c.LogPacket",         /* tp_name */
+    sizeof(LogPacketObject),            /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    (destructor) log_packet_dealloc,    /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    0,                                  /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    0,                                  /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,  /* tp_flags */
+    "LogPacket(decoded_list)\n"
+    "\n"
+    "A decoded log packet that caches its conversions.",  /* tp_doc */
+    (traverseproc) log_packet_traverse, /* tp_traverse */
+    (inquiry) log_packet_clear,         /* tp_clear */
+    0,                                  /* tp_richcompare */
+    0,                                  /* tp_weaklistoffset */
+    0,                                  /* tp_iter */
+    0,                                  /* tp_iternext */
+    LogPacketMethods,                   /* tp_methods */
+    LogPacketMembers,                   /* tp_members */
+    0,                                  /* tp_getset */
+    0,                                  /* tp_base */
+    0,                                  /* tp_dict */
+    0,                                  /* tp_descr_get */
+    0,                                  /* tp_descr_set */
+    0,                                  /* tp_dictoffset */
+    (initproc) log_packet_init,         /* tp_init */
+    0,                                  /* tp_alloc */
+    PyType_GenericNew,                  /* tp_new */
+};
+
+// Returned by to_records(): the numeric fields of repeated records, as a
+// struct of arrays in one read-only buffer. The buffer holds an array of
+// n_rows 8-byte values per field, followed by an array of n_rows validity
+// bytes per field.
+typedef struct {
+    PyObject_HEAD
+    std::string *data;
+    Py_ssize_t n_rows;
+    Py_ssize_t n_dropped;       // values whose type does not match the field
+    PyObject *fields;           // [(name, dtype, offset, valid_offset)]
+} RecordArrayObject;
+
+static void record_array_dealloc (RecordArrayObject *self);
+static PyObject *record_array_column (RecordArrayObject *self, PyObject *args);
+static PyObject *record_array_valid (RecordArrayObject *self, PyObject *args);
+static Py_ssize_t record_array_getreadbuf (RecordArrayObject *self, Py_ssize_t segment, void **ptr);
+static Py_ssize_t record_array_getsegcount (RecordArrayObject *self, Py_ssize_t *lenp);
+static Py_ssize_t record_array_getcharbuf (RecordArrayObject *self, Py_ssize_t segment, char **ptr);
+static int record_array_getbuffer (RecordArrayObject *self, Py_buffer *view, int flags);
+
+static PyMethodDef RecordArrayMethods[] = {
+    {"column", (PyCFunction) record_array_column, METH_VARARGS,
+        "Get the values of a field without copying.\n"
+        "\n"
+        "Args:\n"
+        "    name: field name, e.g. \"Records.Transport Blocks.TBS\".\n"
+        "\n"
+        "Returns:\n"
+        "    A read-only buffer of n_rows values, e.g. for\n"
+        "    numpy.frombuffer(buf, dtype).\n"
+        "\n"
+        "Raises\n"
+        "    KeyError: when there is no such field.\n"
+    },
+    {"valid", (PyCFunction) record_array_valid, METH_VARARGS,
+        "Get the validity bytes of a field without copying.\n"
+        "\n"
+        "Args:\n"
+        "    name: field name.\n"
+        "\n"
+        "Returns:\n"
+        "    A read-only buffer of n_rows bytes; 0 means the row has no value.\n"
+        "\n"
+        "Raises\n"
+        "    KeyError: when there is no such field.\n"
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyMemberDef RecordArrayMembers[] = {
+    {(char *) "n_rows", T_PYSSIZET, offsetof(RecordArrayObject, n_rows),
+        READONLY, (char *) "Number of records."},
+    {(char *) "n_dropped", T_PYSSIZET, offsetof(RecordArrayObject, n_dropped),
+        READONLY, (char *) "Number of values whose type does not match their field."},
+    {(char *) "fields", T_OBJECT, offsetof(RecordArrayObject, fields),
+        READONLY, (char *) "A list of (name, dtype, offset, valid_offset)."},
+    {NULL, 0, 0, 0, NULL}        /* Sentinel */
+};
+
+static PyBufferProcs RecordArrayBufferProcs = {
+    (readbufferproc) record_array_getreadbuf,   /* bf_getreadbuffer */
+    0,                                          /* bf_getwritebuffer */
+    (segcountproc) record_array_getsegcount,    /* bf_getsegcount */
+    (charbufferproc) record_array_getcharbuf,   /* bf_getcharbuffer */
+    (getbufferproc) record_array_getbuffer,     /* bf_getbuffer */
+    0,                                          /* bf_releasebuffer */
+};
+
+static PyTypeObject RecordArrayType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "dm_collector_c.RecordArray",       /* tp_name */
+    sizeof(RecordArrayObject),          /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    (destructor) record_array_dealloc,  /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    0,                                  /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    &RecordArrayBufferProcs,            /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, /* tp_flags */
+    "Numeric fields of repeated records, as a struct of arrays.",  /* tp_doc */
+    0,                                  /* tp_traverse */
+    0,                                  /* tp_clear */
+    0,                                  /* tp_richcompare */
+    0,                                  /* tp_weaklistoffset */
+    0,                                  /* tp_iter */
+    0,                                  /* tp_iternext */
+    RecordArrayMethods,                 /* tp_methods */
+    RecordArrayMembers,                 /* tp_members */
+};
+
+// An analyzer subscribed to the events of a monitor
+struct DispatchEntry {
+    PyObject *module;
+    std::vector<bool> types;    // by log code; empty if every type is wanted
+};
+
+// Sends the events of a monitor only to the analyzers that subscribed to
+// their types, so that analyzers no longer filter every packet themselves.
+typedef struct {
+    PyObject_HEAD
+    std::vector<DispatchEntry> *entries;        // in subscription order
+    // Modules that receive a log code (-1: events that are not log packets).
+    // Rebuilt after every change of the subscriptions.
+    std::map<int, std::vector<PyObject *> > *targets;
+    std::map<std::string, int> *codes;          // type name -> log code
+} EventDispatcherObject;
+
+static PyObject *event_dispatcher_new (PyTypeObject *type, PyObject *args, PyObject *kwds);
+static void event_dispatcher_dealloc (EventDispatcherObject *self);
+static int event_dispatcher_traverse (EventDispatcherObject *self, visitproc visit, void *arg);
+static int event_dispatcher_clear (EventDispatcherObject *self);
+static PyObject *event_dispatcher_subscribe (EventDispatcherObject *self, PyObject *args);
+static PyObject *event_dispatcher_unsubscribe (EventDispatcherObject *self, PyObject *args);
+static PyObject *event_dispatcher_send (EventDispatcherObject *self, PyObject *args);
+
+static PyMethodDef EventDispatcherMethods[] = {
+    {"subscribe", (PyCFunction) event_dispatcher_subscribe, METH_VARARGS,
+        "Subscribe a module to some types of events.\n"
+        "\n"
+        "Args:\n"
+        "    module: an object with a recv(source, event) method\n"
+        "    type_names: a type name or a sequence of type names, which are\n"
+        "        added to the subscribed types of the module. If it is\n"
+        "        omitted or None, the module receives every event.\n"
+        "\n"
+        "Returns:\n"
+        "    None\n"
+        "\n"
+        "Raises:\n"
+        "    TypeError: type_names is not a string or a sequence.\n"
+        "\n"
+        "Unknown type names are ignored. Modules are called in the order in\n"
+        "which they subscribed first."
+    },
+    {"unsubscribe", (PyCFunction) event_dispatcher_unsubscribe, METH_VARARGS,
+        "Remove a module and its subscriptions.\n"
+        "\n"
+        "Args:\n"
+        "    module: a module passed to subscribe()\n"
+        "\n"
+        "Returns:\n"
+        "    True if the module was subscribed, otherwise False.\n"
+    },
+    {"send", (PyCFunction) event_dispatcher_send, METH_VARARGS,
+        "Call module.recv(source, event) for every module subscribed to\n"
+        "event.type_id.\n"
+        "\n"
+        "Events whose type_id is not a log packet type (e.g. 'Monitor.STOP')\n"
+        "are sent to every module.\n"
+        "\n"
+        "Args:\n"
+        "    source: the monitor that raises the event\n"
+        "    event: an Event\n"
+        "\n"
+        "Returns:\n"
+        "    None\n"
+        "\n"
+        "Raises:\n"
+        "    AttributeError: event has no type_id.\n"
+        "    Any exception raised by a recv() method."
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyTypeObject EventDispatcherType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "dm_collector_c.EventDispatcher",   /* tp_name */
+    sizeof(EventDispatcherObject),      /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    (destructor) event_dispatcher_dealloc,  /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    0,                                  /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    0,                                  /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,    /* tp_flags */
+    "EventDispatcher()\n"
+    "\n"
+    "Sends the events of a monitor to the modules subscribed to their types.",  /* tp_doc */
+    (traverseproc) event_dispatcher_traverse,   /* tp_traverse */
+    (inquiry) event_dispatcher_clear,   /* tp_clear */
+    0,                                  /* tp_richcompare */
+    0,                                  /* tp_weaklistoffset */
+    0,                                  /* tp_iter */
+    0,                                  /* tp_iternext */
+    EventDispatcherMethods,             /* tp_methods */
+    0,                                  /* tp_members */
+    0,                                  /* tp_getset */
+    0,                                  /* tp_base */
+    0,                                  /* tp_dict */
+    0,                                  /* tp_descr_get */
+    0,                                  /* tp_descr_set */
+    0,                                  /* tp_dictoffset */
+    0,                                  /* tp_init */
+    0,                                  /* tp_alloc */
+    event_dispatcher_new,               /* tp_new */
+};
 
 static PyMethodDef DmCollectorCMethods[] = {
     {"disable_logs", dm_collector_c_disable_logs, METH_VARARGS,
@@ -68,6 +811,9 @@ static PyMethodDef DmCollectorCMethods[] = {
     {"set_filtered_export", dm_collector_c_set_filtered_export, METH_VARARGS,
         "Configure this moduel to output a filtered log file.\n"
         "\n"
+        "If the path ends with \".mi2logz\", the log is compressed in\n"
+        "blocks; it is finished when another path is configured or at exit.\n"
+        "\n"
         "Args:\n"
         "    type_names: a sequence of type names.\n"
         "\n"
@@ -77,6 +823,50 @@ static PyMethodDef DmCollectorCMethods[] = {
         "Raises\n"
         "    ValueError: when an unrecognized type name is passed in.\n"
     },
+    {"set_export_rotation", dm_collector_c_set_export_rotation, METH_VARARGS,
+        "Cut the exported log into segments.\n"
+        "\n"
+        "Applies to the next path given to set_filtered_export(), which is\n"
+        "then a strftime() template expanded with the local start time of\n"
+        "each segment, e.g. \"diag_log_%Y%m%d_%H%M%S.mi2log\". A segment is\n"
+        "written to \"<name>.part\" and renamed when it is complete.\n"
+        "\n"
+        "Args:\n"
+        "    max_size: maximum bytes per segment, 0 for unlimited.\n"
+        "    max_seconds: maximum duration of a segment, 0 for unlimited.\n"
+        "        Default to 0.\n"
+        "    preallocate: bytes to reserve for each segment (Linux only).\n"
+        "        Default to 0.\n"
+        "\n"
+        "Returns:\n"
+        "    Successful or not.\n"
+    },
+    {"set_export_async", dm_collector_c_set_export_async, METH_VARARGS,
+        "Write the exported log in the background.\n"
+        "\n"
+        "Frames are buffered and written by a pool of threads with pwrite(),\n"
+        "or through io_uring if the module is built with MI_WITH_IO_URING.\n"
+        "When max_inflight bytes are queued, exporting blocks until the disk\n"
+        "catches up; such events are counted by get_export_stats().\n"
+        "Compressed (.mi2logz) logs are always written synchronously.\n"
+        "\n"
+        "Args:\n"
+        "    enabled: True or False.\n"
+        "    max_inflight: maximum bytes queued. Default to 16MB.\n"
+        "    n_threads: number of writer threads. Default to 1.\n"
+        "\n"
+        "Returns:\n"
+        "    Successful or not.\n"
+    },
+    {"get_export_stats", dm_collector_c_get_export_stats, METH_VARARGS,
+        "Return the counters of the asynchronous log writer and of rotation.\n"
+        "\n"
+        "Returns:\n"
+        "    A dict with backend (\"io_uring\", \"pwrite\" or \"\"), writes,\n"
+        "    bytes, backpressure_events, backpressure_seconds, write_errors,\n"
+        "    max_inflight and rename_errors (finished segments that could not\n"
+        "    be renamed from \"<name>.part\").\n"
+    },
     {"set_filtered", dm_collector_c_set_filtered, METH_VARARGS,
         "Configure this moduel to only decode filtered logs.\n"
         "\n"
@@ -93,6 +883,218 @@ static PyMethodDef DmCollectorCMethods[] = {
         "Feed raw packets."},
     {"reset", dm_collector_c_reset, METH_VARARGS,
         "Reset dm_collector."},
+    {"feed_chronicle", dm_collector_c_feed_chronicle, METH_VARARGS,
+        "Feed a piece of the chunk stream written by diag_revealer.\n"
+        "\n"
+        "Log payloads are fed to the HDLC deframer, and the timestamp of\n"
+        "their chunk is returned by receive_log_packet(). Chunks may span\n"
+        "several calls.\n"
+        "\n"
+        "Args:\n"
+        "    data: a string of any length.\n"
+        "\n"
+        "Returns:\n"
+        "    (last_timestamp, events): the timestamp of the last log chunk\n"
+        "    (None if no chunk has a timestamp yet), and a list of\n"
+        "    (msg_type, filename) for log files started or ended by\n"
+        "    diag_revealer.\n"
+    },
+    {"read_chronicle", dm_collector_c_read_chronicle, METH_VARARGS,
+        "Read from a file descriptor and feed it to feed_chronicle().\n"
+        "\n"
+        "The GIL is released while waiting for data.\n"
+        "\n"
+        "Args:\n"
+        "    fd: a file descriptor, e.g. the FIFO of diag_revealer.\n"
+        "    size: maximum bytes to read.\n"
+        "\n"
+        "Returns:\n"
+        "    The same as feed_chronicle(), or None at the end of file.\n"
+        "\n"
+        "Raises\n"
+        "    OSError: when read() fails.\n"
+    },
+    {"attach_fd", dm_collector_c_attach_fd, METH_VARARGS,
+        "Read logs directly from a file descriptor.\n"
+        "\n"
+        "The fd is set to non-blocking mode and read by poll_log_packets()\n"
+        "with large reads driven by epoll. Do not mix it with feed_binary()\n"
+        "or feed_chronicle().\n"
+        "\n"
+        "Args:\n"
+        "    fd: a file descriptor, e.g. the FIFO of diag_revealer.\n"
+        "    chronicle: If set to True, the fd carries the chunk stream of\n"
+        "        diag_revealer; otherwise raw HDLC frames. Default to False.\n"
+        "\n"
+        "Returns:\n"
+        "    Successful or not.\n"
+    },
+    {"detach_fd", dm_collector_c_detach_fd, METH_VARARGS,
+        "Stop reading the fd given to attach_fd(). The fd is not closed."},
+    {"poll_log_packets", dm_collector_c_poll_log_packets, METH_VARARGS,
+        "Wait for log packets from the attached fd.\n"
+        "\n"
+        "The GIL is released while waiting for the fd, so other threads\n"
+        "run until data arrives. Deframing and filtering run in C++.\n"
+        "\n"
+        "Args:\n"
+        "    timeout_ms: maximum time to wait, -1 for forever. Default to -1.\n"
+        "    max_packets: maximum packets returned at once. Default to 1024.\n"
+        "    skip_decoding: If set to True, only the header would be decoded.\n"
+        "        Default to False.\n"
+        "    include_timestamp: Return the time when each message is\n"
+        "        received, as receive_log_packet(). Default to False.\n"
+        "    callback: If given, it is called with each packet instead.\n"
+        "\n"
+        "Returns:\n"
+        "    A list of packets (empty on timeout), or the number of packets\n"
+        "    passed to callback. None at the end of file.\n"
+        "\n"
+        "Raises\n"
+        "    OSError: when reading fails.\n"
+        "    Any exception of callback or decoding. The packets read but not\n"
+        "    delivered yet are returned first by the next call.\n"
+    },
+    {"get_chronicle_events", dm_collector_c_get_chronicle_events, METH_VARARGS,
+        "Return the file events read by poll_log_packets() since the last\n"
+        "call, in the same form as feed_chronicle(). Events read along with\n"
+        "packets not delivered yet are returned once those are delivered.\n"
+    },
+    {"set_throughput_window", dm_collector_c_set_throughput_window, METH_VARARGS,
+        "Aggregate DL/UL link statistics natively over averaging windows.\n"
+        "\n"
+        "LTE_PHY_PDSCH_Packet, LTE_MAC_UL_Tx_Statistics and\n"
+        "LTE_MAC_UL_Buffer_Status_Internal packets are summed up from their\n"
+        "binary fields as they are received or replayed, even if they are not\n"
+        "enabled by set_filtered(). A window is closed by the first of these\n"
+        "packets that is at least window seconds after its start.\n"
+        "\n"
+        "Args:\n"
+        "    window: window length in seconds; 0 disables the aggregation and\n"
+        "        drops pending summaries.\n"
+        "\n"
+        "Returns:\n"
+        "    None\n"
+    },
+    {"get_throughput_summaries", dm_collector_c_get_throughput_summaries, METH_VARARGS,
+        "Collect the summaries of closed windows.\n"
+        "\n"
+        "Args:\n"
+        "    flush: (optional) also close the current window, e.g. at the end\n"
+        "        of a log. Default: False.\n"
+        "\n"
+        "Returns:\n"
+        "    A list of dicts with the keys \"start\", \"end\" (datetimes),\n"
+        "    \"duration\" (seconds), \"dl_tbs_bits\", \"dl_bandwidth_mbps\",\n"
+        "    \"pdsch_count\", \"mcs\" ({\"QPSK\": n, \"16QAM\": n, \"64QAM\": n,\n"
+        "    \"Other\": n}), \"ul_grant_received\", \"ul_grant_utilized\" (bytes),\n"
+        "    \"ul_bandwidth_mbps\", \"ul_utilized_mbps\",\n"
+        "    \"ul_grant_utilization\" (%) and \"ul_buffer\" ({lcid: {\"last\": bytes,\n"
+        "    \"peak\": bytes, \"avg\": bytes}}).\n"
+    },
+    {"set_rlc_window", dm_collector_c_set_rlc_window, METH_VARARGS,
+        "Track the sequence numbers of LTE RLC AM natively, per RB config.\n"
+        "\n"
+        "The PDUs of LTE_RLC_UL_AM_All_PDU and LTE_RLC_DL_AM_All_PDU are\n"
+        "tracked as these packets are decoded, so they must be enabled by\n"
+        "set_filtered(). A data PDU whose SN is still waiting for an ACK is\n"
+        "counted as a retransmission; a status PDU acks the SNs below its\n"
+        "ACK_SN that it does not NACK. ACK latency is measured in sys_fn/sub_fn\n"
+        "frame time. A window is closed by the first of these packets that is\n"
+        "at least window seconds after its start.\n"
+        "\n"
+        "Args:\n"
+        "    window: window length in seconds; 0 disables the tracker and\n"
+        "        drops its state.\n"
+        "\n"
+        "Returns:\n"
+        "    None\n"
+    },
+    {"get_rlc_summaries", dm_collector_c_get_rlc_summaries, METH_VARARGS,
+        "Collect the RLC summaries of closed windows.\n"
+        "\n"
+        "Args:\n"
+        "    flush: (optional) also close the current window, e.g. at the end\n"
+        "        of a log. Default: False.\n"
+        "\n"
+        "Returns:\n"
+        "    A list of dicts with the keys \"start\", \"end\" (datetimes),\n"
+        "    \"duration\" (seconds) and \"bearers\" ({rb_cfg_idx: {\"UL\": stats,\n"
+        "    \"DL\": stats}}). The stats of a direction are a dict with the keys\n"
+        "    \"data_pdus\", \"data_bytes\", \"retx_pdus\", \"status_pdus\",\n"
+        "    \"status_bytes\" (the status PDUs sent in this direction), \"nacks\",\n"
+        "    \"acked_pdus\", \"ack_latency_avg_ms\", \"ack_latency_max_ms\" (for\n"
+        "    the data of this direction), \"highest_sn\" (-1 if none) and\n"
+        "    \"outstanding\" (SNs not acked at the end of the window).\n"
+    },
+    {"enable_msg_statistics", dm_collector_c_enable_msg_statistics, METH_VARARGS,
+        "Collect per log code statistics of the received or replayed packets.\n"
+        "\n"
+        "The statistics are read from the frame headers only, before the\n"
+        "packets are filtered by set_filtered(), so they cost no decoding.\n"
+        "Sizes and inter-arrival times are kept in HDR histograms with a\n"
+        "relative error of about 3%.\n"
+        "\n"
+        "Args:\n"
+        "    enable: (optional) True to enable, False to disable. Default: True.\n"
+        "        The statistics collected so far are dropped in both cases.\n"
+        "\n"
+        "Returns:\n"
+        "    None\n"
+    },
+    {"get_msg_statistics", dm_collector_c_get_msg_statistics, METH_VARARGS,
+        "Return a snapshot of the statistics of enable_msg_statistics().\n"
+        "\n"
+        "Args:\n"
+        "    reset: (optional) start over after the snapshot. Default: False.\n"
+        "\n"
+        "Returns:\n"
+        "    A dict with the keys \"frames\" (CRC correct frames),\n"
+        "    \"crc_failures\" and \"log_codes\" ({type_name: stats}, where\n"
+        "    unknown codes are named like \"0xB0C0\"). The stats of a log code\n"
+        "    are a dict with the keys \"count\", \"bytes\" (sum of log_msg_len),\n"
+        "    \"size\" (bytes) and \"interarrival_ms\", the last two being dicts\n"
+        "    with the keys \"min\", \"max\", \"mean\", \"p50\", \"p90\", \"p99\" and\n"
+        "    \"p999\".\n"
+    },
+    {"enable_stats", dm_collector_c_enable_stats, METH_VARARGS,
+        "Count and time the stages of collection: bytes fed, frames deframed,\n"
+        "CRC failures, filtered-out frames, exported bytes, decoding time per\n"
+        "log code, LogPacket conversions and ws_dissector round trips.\n"
+        "\n"
+        "Args:\n"
+        "    enable: (optional) True to enable, False to disable. Default: True.\n"
+        "        The counters are reset in both cases.\n"
+        "    dump_interval: (optional) if positive, a one-line summary is\n"
+        "        printed (to logcat on Android) at most every dump_interval\n"
+        "        seconds while packets are decoded. Default: 0.\n"
+        "\n"
+        "Returns:\n"
+        "    None\n"
+    },
+    {"get_stats", dm_collector_c_get_stats, METH_VARARGS,
+        "Return a snapshot of the counters of enable_stats().\n"
+        "\n"
+        "Args:\n"
+        "    reset: (optional) start over after the snapshot. Default: False.\n"
+        "\n"
+        "Returns:\n"
+        "    A dict with the keys \"enabled\", \"elapsed\" (seconds),\n"
+        "    \"bytes_fed\", \"frames\", \"crc_failures\", \"filtered_out\",\n"
+        "    \"export_bytes\", \"decode\" ({type_name: timer}, where unknown\n"
+        "    codes are named like \"0xB0C0\"), \"build\" and \"ws_dissector\".\n"
+        "    A timer is a dict with the keys \"count\", \"total_ms\", \"mean_us\"\n"
+        "    and \"max_us\".\n"
+    },
+    {"record_ws_roundtrip", dm_collector_c_record_ws_roundtrip, METH_VARARGS,
+        "Add a ws_dissector round trip to the counters of enable_stats().\n"
+        "\n"
+        "Args:\n"
+        "    seconds: the duration of the round trip\n"
+        "\n"
+        "Returns:\n"
+        "    None\n"
+    },
     {"generate_diag_cfg", dm_collector_c_generate_diag_cfg, METH_VARARGS,
         "Generate a Diag.cfg file.\n"
         "\n"
@@ -111,28 +1113,253 @@ static PyMethodDef DmCollectorCMethods[] = {
         "    skip_decoding: If set to True, only the header would be decoded.\n"
         "        Default to False.\n"
         "    include_timestamp: Return the time when the message is received.\n"
-        "        Default to False.\n"
+        "        Messages fed by feed_chronicle() carry the timestamp of their\n"
+        "        chunk. Default to False.\n"
         "\n"
         "Returns:\n"
         "    If include_timestamp is True, return (decoded, posix_timestamp);\n"
         "    otherwise only return decoded message.\n"
     },
-    {NULL, NULL, 0, NULL}        /* Sentinel */
-};
-
-// sort, unique and bucketing
-static void
-sort_type_ids(IdVector& type_ids, std::vector<IdVector>& out_vectors) {
-    sort(type_ids.begin(), type_ids.end());
-    IdVector::iterator itr = std::unique(type_ids.begin(), type_ids.end());
-    type_ids.resize(std::distance(type_ids.begin(), itr));
-
-    out_vectors.clear();
-    int last_equip_id = -1;
-    size_t i = 0, j = 0;
-    for (j = 0; j < type_ids.size(); j++) {
-        if (j != 0 && last_equip_id != get_equip_id(type_ids[j])) {
-            out_vectors.push_back(IdVector(type_ids.begin() + i,
+    {"open_log", dm_collector_c_open_log, METH_VARARGS,
+        "Open a log file (.mi2log, .mi2logz or .qmdl) for offline decoding.\n"
+        "\n"
+        "The file is memory-mapped and deframed natively, without\n"
+        "feed_binary() and receive_log_packet(). Filters set by\n"
+        "set_filtered() and set_filtered_export() apply.\n"
+        "\n"
+        "Frames outside type_names or [t0, t1] are skipped from their header\n"
+        "without being decoded, and reading stops once the window has passed.\n"
+        "If the log has a valid index (see build_log_index()), reading starts\n"
+        "at t0 directly.\n"
+        "\n"
+        "Args:\n"
+        "    path: the log file.\n"
+        "    skip_decoding: If set to True, only the header would be decoded.\n"
+        "        Default to False.\n"
+        "    type_names: (optional) a sequence of type names to replay.\n"
+        "    t0, t1: (optional) datetime bounds of the replay window.\n"
+        "\n"
+        "Returns:\n"
+        "    An iterator of decoded messages.\n"
+        "\n"
+        "Raises\n"
+        "    IOError: when the file cannot be opened.\n"
+    },
+    {"open_log_headers", dm_collector_c_open_log_headers, METH_VARARGS,
+        "Iterate over the log packets of a log file without decoding them.\n"
+        "\n"
+        "This is the fast path for pre-filtering, counting and sharding: no\n"
+        "Python string or datetime is created, and filters set by\n"
+        "set_filtered() and set_filtered_export() do not apply. Frames are\n"
+        "copied into shared blocks of 256 KB, which stay in memory as long as\n"
+        "one of their views is referenced.\n"
+        "\n"
+        "Args:\n"
+        "    path: the log file.\n"
+        "    type_names: (optional) a sequence of type names to return.\n"
+        "    t0, t1: (optional) datetime bounds of the window.\n"
+        "\n"
+        "Returns:\n"
+        "    An iterator of (log_code, length, timestamp, frame) tuples, where\n"
+        "    timestamp is the raw QCDM timestamp (1/52428800 s since\n"
+        "    1980-01-06) and frame is a read-only memoryview of the deframed\n"
+        "    packet, starting with its 0x10 command code.\n"
+        "\n"
+        "Raises\n"
+        "    IOError: when the file cannot be opened.\n"
+        "    ValueError: when an unrecognized type name is passed in.\n"
+    },
+    {"open_logs", dm_collector_c_open_logs, METH_VARARGS,
+        "Open several log files for parallel offline decoding.\n"
+        "\n"
+        "Files are split into chunks at HDLC frame boundaries, which are read\n"
+        "and deframed on worker threads. Packets are decoded on the calling\n"
+        "thread, and files are merged in timestamp order. Filters set by\n"
+        "set_filtered() and set_filtered_export() apply.\n"
+        "\n"
+        "Args:\n"
+        "    paths: a sequence of log files.\n"
+        "    skip_decoding: If set to True, only the header would be decoded.\n"
+        "        Default to False.\n"
+        "    n_threads: (optional) number of worker threads. Default to the\n"
+        "        number of CPUs; 0 means no worker threads.\n"
+        "    chunk_size: (optional) bytes of each chunk.\n"
+        "\n"
+        "Returns:\n"
+        "    An iterator of decoded messages.\n"
+        "\n"
+        "Raises\n"
+        "    IOError: when a file cannot be opened.\n"
+    },
+    {"build_log_index", dm_collector_c_build_log_index, METH_VARARGS,
+        "Build the sidecar frame index of a log file in one pass.\n"
+        "\n"
+        "For each log packet, the index records the offset of its frame, its\n"
+        "log code and its timestamp.\n"
+        "\n"
+        "Args:\n"
+        "    path: the log file.\n"
+        "    index_path: (optional) the index file. Default to path + '.idx'.\n"
+        "\n"
+        "Returns:\n"
+        "    Successful or not.\n"
+    },
+    {"open_log_index", dm_collector_c_open_log_index, METH_VARARGS,
+        "Open a log file with its sidecar frame index. The index is (re)built\n"
+        "if it is missing or out of date.\n"
+        "\n"
+        "Args:\n"
+        "    path: the log file.\n"
+        "    index_path: (optional) the index file. Default to path + '.idx'.\n"
+        "\n"
+        "Returns:\n"
+        "    A LogIndex object.\n"
+        "\n"
+        "Raises\n"
+        "    IOError: when the log or the index cannot be opened.\n"
+    },
+    {"export_columnar", dm_collector_c_export_columnar, METH_VARARGS,
+        "Decode log files and export some types of logs to column files.\n"
+        "\n"
+        "There is one table (a directory) per log type and version, and one\n"
+        "typed column per field. Nested fields are named with their parent\n"
+        "keys, and each element of a list becomes a row. See\n"
+        "columnar_export.h for the file layout.\n"
+        "\n"
+        "Args:\n"
+        "    paths: a sequence of log files.\n"
+        "    directory: the output directory.\n"
+        "    type_names: a sequence of type names to export.\n"
+        "\n"
+        "Returns:\n"
+        "    A dict that maps table names to numbers of rows.\n"
+        "\n"
+        "Raises\n"
+        "    ValueError: when an unrecognized type name is passed in.\n"
+        "    IOError: when a file cannot be read or written.\n"
+    },
+    {"to_records", dm_collector_c_to_records, METH_VARARGS,
+        "Convert decoded packets to a struct of arrays.\n"
+        "\n"
+        "Fields are flattened as in export_columnar(): nested fields are named\n"
+        "with their parent keys, and each element of a list (e.g. each\n"
+        "record of LTE_PHY_PDSCH_Decoding_Result) becomes a row. Only integer,\n"
+        "float and timestamp fields are kept. The result supports the buffer\n"
+        "protocol, so NumPy can view a field without copying:\n"
+        "\n"
+        "    name, dtype, offset, valid_offset = records.fields[k]\n"
+        "    numpy.frombuffer(records, dtype, records.n_rows, offset)\n"
+        "\n"
+        "Args:\n"
+        "    packets: a sequence of decoded lists or LogPacket objects, usually\n"
+        "        of one type.\n"
+        "\n"
+        "Returns:\n"
+        "    A RecordArray. dtype is \"<i8\", \"<f8\" or \"<M8[us]\" (microseconds\n"
+        "    since 1970-01-01).\n"
+        "\n"
+        "Raises\n"
+        "    TypeError: when a packet is not a decoded list.\n"
+    },
+    {"extract_measurements", dm_collector_c_extract_measurements, METH_VARARGS,
+        "Extract the measurement arrays of a raw packet in one pass.\n"
+        "\n"
+        "RSRP, RSRQ and WCDMA measurements are converted with vector\n"
+        "instructions when available, to the same values as decoding gives,\n"
+        "and returned as packed little-endian arrays (e.g. for\n"
+        "numpy.frombuffer(s, '<f4') or array.array('f', s)).\n"
+        "\n"
+        "Args:\n"
+        "    frame: a deframed packet, e.g. from open_log_headers().\n"
+        "\n"
+        "Returns:\n"
+        "    None if the type or version is not supported. For\n"
+        "    LTE_PHY_Connected_Mode_Intra_Freq_Meas: a dict with the keys\n"
+        "    \"type_id\", \"timestamp\" (raw QCDM timestamp), \"earfcn\",\n"
+        "    \"serving_pci\", \"serving_rsrp\", \"serving_rsrq\", \"n_cells\" and\n"
+        "    the neighbor cell arrays \"pci\" ('<u2'), \"rsrp\" and \"rsrq\"\n"
+        "    ('<f4'). For the WCDMA cells of LTE_PHY_Inter_RAT_Measurement:\n"
+        "    \"type_id\", \"timestamp\", \"n_cells\", \"uarfcn\" ('<u2'), \"rscp\",\n"
+        "    \"rssi\" and \"ecno\" ('<f4'). For the measurement results of\n"
+        "    LTE_PHY_Idle_Neighbor_Cell_Meas: \"type_id\", \"timestamp\",\n"
+        "    \"n_cells\", \"earfcn\" ('<u4'), \"pci\" ('<u2'), \"rsrp\", \"rsrq\"\n"
+        "    and \"rssi\" ('<f4'), one element per cell.\n"
+    },
+    {"dissect_cache_open", dm_collector_c_dissect_cache_open, METH_VARARGS,
+        "Open a persistent cache of ws_dissector outputs.\n"
+        "\n"
+        "Args:\n"
+        "    path: the cache file. It is created if it does not exist.\n"
+        "    version: version string of ws_dissector. Entries created by\n"
+        "        another version are discarded.\n"
+        "    n_buckets: (optional) hash table size of a new cache file.\n"
+        "\n"
+        "Returns:\n"
+        "    Successful or not.\n"
+    },
+    {"dissect_cache_close", dm_collector_c_dissect_cache_close, METH_VARARGS,
+        "Close the ws_dissector output cache."},
+    {"dissect_cache_lookup", dm_collector_c_dissect_cache_lookup, METH_VARARGS,
+        "Look up a cached ws_dissector output.\n"
+        "\n"
+        "Args:\n"
+        "    msg_type: AWW protocol number of the message.\n"
+        "    b: raw message.\n"
+        "\n"
+        "Returns:\n"
+        "    The cached output, or None if not found.\n"
+    },
+    {"dissect_cache_store", dm_collector_c_dissect_cache_store, METH_VARARGS,
+        "Add a ws_dissector output to the cache.\n"
+        "\n"
+        "Args:\n"
+        "    msg_type: AWW protocol number of the message.\n"
+        "    b: raw message.\n"
+        "    decoded: output of ws_dissector.\n"
+        "\n"
+        "Returns:\n"
+        "    Successful or not.\n"
+    },
+    {"ws_shm_open", dm_collector_c_ws_shm_open, METH_VARARGS,
+        "Create a shared-memory transport to ws_dissector (Linux only).\n"
+        "\n"
+        "Args:\n"
+        "    path: the shared memory file, passed to 'ws_dissector --shm'.\n"
+        "    capacity: (optional) bytes of each ring, a power of two.\n"
+        "\n"
+        "Returns:\n"
+        "    Successful or not.\n"
+    },
+    {"ws_shm_set_peer", dm_collector_c_ws_shm_set_peer, METH_VARARGS,
+        "Set the pid of ws_dissector, so that its exit can be detected."},
+    {"ws_shm_close", dm_collector_c_ws_shm_close, METH_VARARGS,
+        "Close the shared-memory transport and remove its file."},
+    {"ws_shm_decode", dm_collector_c_ws_shm_decode, METH_VARARGS,
+        "Decode a message with ws_dissector through shared memory.\n"
+        "\n"
+        "Args:\n"
+        "    msg_type: AWW protocol number of the message.\n"
+        "    b: raw message.\n"
+        "\n"
+        "Returns:\n"
+        "    Output of ws_dissector, or None if the transport is broken.\n"
+    },
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+// sort, unique and bucketing
+static void
+sort_type_ids(IdVector& type_ids, std::vector<IdVector>& out_vectors) {
+    sort(type_ids.begin(), type_ids.end());
+    IdVector::iterator itr = std::unique(type_ids.begin(), type_ids.end());
+    type_ids.resize(std::distance(type_ids.begin(), itr));
+
+    out_vectors.clear();
+    int last_equip_id = -1;
+    size_t i = 0, j = 0;
+    for (j = 0; j < type_ids.size(); j++) {
+        if (j != 0 && last_equip_id != get_equip_id(type_ids[j])) {
+            out_vectors.push_back(IdVector(type_ids.begin() + i,
                                             type_ids.begin() + j));
             i = j;
         }
@@ -414,286 +1641,2427 @@ dm_collector_c_enable_logs (PyObject *self, PyObject *args) {
         goto raise_exception;
     }
 
-    success = generate_log_config_msgs(serial_port, sequence);
-    if (!success) {
-        goto raise_exception;
+    success = generate_log_config_msgs(serial_port, sequence);
+    if (!success) {
+        goto raise_exception;
+    }
+    Py_DECREF(sequence);
+    Py_DECREF(serial_port);
+    Py_RETURN_TRUE;
+
+    raise_exception:
+        Py_DECREF(sequence);
+        Py_DECREF(serial_port);
+        return NULL;
+}
+
+// Return: successful or not
+static PyObject *
+dm_collector_c_set_filtered_export (PyObject *self, PyObject *args) {
+    (void)self;
+    const char *path;
+    PyObject *sequence = NULL;
+    IdVector type_ids;
+    bool success = false;
+
+    if (!PyArg_ParseTuple(args, "sO", &path, &sequence)) {
+        return NULL;
+    }
+    Py_INCREF(sequence);
+
+    // Check arguments
+    if (!PySequence_Check(sequence)) {
+        PyErr_SetString(PyExc_TypeError, "\'type_names\' is not a sequence.");
+        goto raise_exception;
+    }
+
+    success = map_typenames_to_ids(sequence, type_ids);
+    if (!success) {
+        PyErr_SetString(PyExc_ValueError, "Wrong type name.");
+        goto raise_exception;
+    }
+    Py_DECREF(sequence);
+
+    manager_change_config(&g_emanager, path, type_ids);
+    Py_RETURN_TRUE;
+
+    raise_exception:
+        Py_DECREF(sequence);
+        return NULL;
+}
+
+// Return: successful or not
+static PyObject *
+dm_collector_c_set_export_rotation (PyObject *self, PyObject *args) {
+    (void)self;
+    unsigned long long max_size = 0;
+    unsigned int max_seconds = 0;
+    unsigned long long preallocate = 0;
+    if (!PyArg_ParseTuple(args, "K|IK:set_export_rotation",
+                            &max_size, &max_seconds, &preallocate))
+        return NULL;
+    manager_set_rotation(&g_emanager, max_size, max_seconds, preallocate);
+    Py_RETURN_TRUE;
+}
+
+// Return: successful or not
+static PyObject *
+dm_collector_c_set_export_async (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *arg_enabled = NULL;
+    unsigned long long max_inflight = 16 << 20;
+    int n_threads = 1;
+    if (!PyArg_ParseTuple(args, "O|Ki:set_export_async",
+                            &arg_enabled, &max_inflight, &n_threads))
+        return NULL;
+    int enabled = PyObject_IsTrue(arg_enabled);
+    if (enabled < 0)
+        return NULL;
+    if (manager_set_async(&g_emanager, enabled ? n_threads : -1, max_inflight))
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+static PyObject *
+dm_collector_c_get_export_stats (PyObject *self, PyObject *args) {
+    (void)self;
+    (void)args;
+    AsyncWriterStats stats;
+    awriter_get_stats(&g_emanager.awriter, &stats);
+    return Py_BuildValue("{s:s,s:K,s:K,s:K,s:d,s:K,s:K,s:K}",
+                            "backend", awriter_backend(&g_emanager.awriter),
+                            "writes", stats.writes,
+                            "bytes", stats.bytes,
+                            "backpressure_events", stats.backpressure_events,
+                            "backpressure_seconds", stats.backpressure_seconds,
+                            "write_errors", stats.write_errors,
+                            "max_inflight", stats.max_inflight,
+                            "rename_errors", g_emanager.rename_errors);
+}
+
+// Return: successful or not
+static PyObject *
+dm_collector_c_set_filtered (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *sequence = NULL;
+    IdVector type_ids;
+    bool success = false;
+
+    if (!PyArg_ParseTuple(args, "O", &sequence)) {
+        return NULL;
+    }
+    Py_INCREF(sequence);
+
+    // Check arguments
+    if (!PySequence_Check(sequence)) {
+        PyErr_SetString(PyExc_TypeError, "\'type_names\' is not a sequence.");
+        goto raise_exception;
+    }
+
+    success = map_typenames_to_ids(sequence, type_ids);
+    if (!success) {
+        PyErr_SetString(PyExc_ValueError, "Wrong type name.");
+        goto raise_exception;
+    }
+    Py_DECREF(sequence);
+
+    manager_change_config(&g_emanager, NULL, type_ids);
+    Py_RETURN_TRUE;
+
+    raise_exception:
+        Py_DECREF(sequence);
+        return NULL;
+}
+
+// Return: successful or not
+static PyObject *
+dm_collector_c_generate_diag_cfg (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *file = NULL;
+    PyObject *sequence = NULL;
+    bool success = false;
+    BinaryBuffer buf;
+    IdVector empty;
+
+    if (!PyArg_ParseTuple(args, "OO", &file, &sequence)) {
+        return NULL;
+    }
+    Py_INCREF(file);
+    Py_INCREF(sequence);
+
+    // Check arguments
+    if (!check_file(file)) {
+        PyErr_SetString(PyExc_TypeError, "\'file\' is not a file object.");
+        goto raise_exception;
+    }
+    if (!PySequence_Check(sequence)) {
+        PyErr_SetString(PyExc_TypeError, "\'type_names\' is not a sequence.");
+        goto raise_exception;
+    }
+
+    // Config Headers
+    success = generate_log_config_headers(file, sequence);
+    if (!success) {
+        goto raise_exception;
+    }
+
+    // Disable previous logs
+    for (int k = 0; k < 2; k++) {
+        if (k == 0) {   // Disable normal log msgs
+            // buf = encode_log_config(DISABLE, empty);
+            buf = encode_log_config(DISABLE_DEBUG, empty);
+        } else {        // Disable debug msgs
+            // buf = encode_log_config(DISABLE_DEBUG, empty);
+            buf = encode_log_config(DISABLE, empty);
+        }
+        if (buf.first != NULL && buf.second != 0) {
+            (void) send_msg(file, buf.first, buf.second);
+            delete [] buf.first;
+            buf.first = NULL;
+        } else {
+            PyErr_SetString(PyExc_RuntimeError, "Log config msg failed to encode.");
+            goto raise_exception;
+        }
+    }
+
+    success = generate_log_config_msgs(file, sequence);
+    if (!success) {
+        goto raise_exception;
+    }
+
+    // Config End
+    success = generate_log_config_ends(file, sequence);
+    if (!success) {
+        goto raise_exception;
+    }
+
+    Py_DECREF(sequence);
+    Py_DECREF(file);
+    Py_RETURN_TRUE;
+
+    raise_exception:
+        Py_DECREF(sequence);
+        Py_DECREF(file);
+        return NULL;
+}
+
+// Return: None
+static PyObject *
+dm_collector_c_feed_binary (PyObject *self, PyObject *args) {
+    (void)self;
+    const char *b;
+    int length;
+    if (!PyArg_ParseTuple(args, "s#", &b, &length)){
+        // printf("dm_collector_c_feed_binary returns NULL\n");
+        return NULL;
+    }
+    if (perf_enabled(&g_perf))
+        g_perf.bytes_fed += length;
+    feed_binary(b, length);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+dm_collector_c_reset (PyObject *self, PyObject *args) {
+    (void)self;
+    (void)args;
+    reset_binary();
+    chronicle_init_state(&g_chronicle);
+    Py_RETURN_NONE;
+}
+
+// Return: (last_timestamp, events)
+static PyObject *
+build_chronicle_result (const std::vector<ChronicleEvent> &events) {
+    PyObject *list = PyList_New(events.size());
+    if (list == NULL)
+        return NULL;
+    for (size_t i = 0; i < events.size(); i++) {
+        PyObject *t = Py_BuildValue("(is#)", events[i].msg_type,
+                                    events[i].filename.c_str(),
+                                    (int) events[i].filename.size());
+        if (t == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, t);
+    }
+    PyObject *ts;
+    if (g_chronicle.last_timestamp >= 0) {
+        ts = PyFloat_FromDouble(g_chronicle.last_timestamp);
+    } else {
+        Py_INCREF(Py_None);
+        ts = Py_None;
+    }
+    PyObject *ret = Py_BuildValue("(NN)", ts, list);
+    return ret;
+}
+
+static PyObject *
+dm_collector_c_feed_chronicle (PyObject *self, PyObject *args) {
+    (void)self;
+    const char *b;
+    int length;
+    if (!PyArg_ParseTuple(args, "s#:feed_chronicle", &b, &length))
+        return NULL;
+    if (perf_enabled(&g_perf))
+        g_perf.bytes_fed += length;
+    std::vector<ChronicleEvent> events;
+    chronicle_process(&g_chronicle, b, length, events);
+    return build_chronicle_result(events);
+}
+
+static PyObject *
+dm_collector_c_read_chronicle (PyObject *self, PyObject *args) {
+    (void)self;
+    int fd;
+    int size;
+    if (!PyArg_ParseTuple(args, "ii:read_chronicle", &fd, &size))
+        return NULL;
+    if (size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be positive.");
+        return NULL;
+    }
+#ifndef _WIN32
+    std::vector<char> buf(size);
+    ssize_t n;
+    Py_BEGIN_ALLOW_THREADS
+    n = read(fd, &buf[0], size);
+    Py_END_ALLOW_THREADS
+    if (n < 0)
+        return PyErr_SetFromErrno(PyExc_OSError);
+    if (n == 0)
+        Py_RETURN_NONE;
+    if (perf_enabled(&g_perf))
+        g_perf.bytes_fed += n;
+    std::vector<ChronicleEvent> events;
+    chronicle_process(&g_chronicle, &buf[0], n, events);
+    return build_chronicle_result(events);
+#else
+    (void)fd;
+    PyErr_SetString(PyExc_NotImplementedError, "read_chronicle() is not supported.");
+    return NULL;
+#endif
+}
+
+
+// Print the per-stage counters if a periodic dump is due
+static void
+dump_perf_if_due () {
+    if (perf_dump_due(&g_perf))
+        printf("dm_collector_c stats: %s\n",
+                perf_format(&g_perf, g_emanager.total_bytes).c_str());
+}
+
+// Decode a deframed packet whose CRC is correct. Unless use_whitelist is
+// false, the frame is also filtered, and exported if a filtered log file is
+// configured.
+// Return: decoded_list, or NULL if the frame is filtered out or is not a log
+// packet (no exception is set in this case)
+static PyObject *
+decode_frame (std::string& frame, bool skip_decoding, bool use_whitelist = true) {
+    check_frame_format(frame);
+
+    // Aggregated packets need not be enabled or decoded
+    if (use_whitelist && taggr_enabled(&g_taggr))
+        taggr_feed(&g_taggr, frame.c_str(), frame.size());
+    if (use_whitelist)
+        mstats_feed(&g_mstats, frame.c_str(), frame.size());
+
+    if (use_whitelist
+            && !manager_export_binary(&g_emanager, frame.c_str(), frame.size())) {
+        if (perf_enabled(&g_perf))
+            g_perf.filtered_out++;
+        return NULL;
+    }
+    if(is_log_packet(frame.c_str(), frame.size())){
+        const char *s = frame.c_str();
+        if (!perf_enabled(&g_perf))
+            return decode_log_packet(s + 2,  // skip first two bytes
+                                        frame.size() - 2,
+                                        skip_decoding);
+        unsigned long long t0 = perf_now_ns();
+        PyObject *decoded = decode_log_packet(s + 2, frame.size() - 2, skip_decoding);
+        unsigned short log_code = 0;
+        if (frame.size() >= 8)
+            memcpy(&log_code, s + 6, sizeof(log_code));
+        perf_record_decode(&g_perf, log_code, perf_now_ns() - t0);
+        dump_perf_if_due();
+        return decoded;
+    }
+    else if(is_debug_packet(frame.c_str(), frame.size())){
+        //Yuanjie: the original debug msg does not have header...
+
+        unsigned short n_size = frame.size()+sizeof(char)*14;
+
+        unsigned char tmp[14]={
+            0xFF, 0xFF,
+            0x00, 0x00, 0xeb, 0x1f,
+            0x00, 0x00, 0x73, 0xB7,
+            0xB8, 0x65, 0xDD, 0x00
+        };
+        // tmp[2]=(char)(n_size);
+        *(tmp+2)=n_size;
+        *(tmp)=n_size;
+        char *s = new char[n_size];
+        memmove(s,tmp,sizeof(char)*14);
+        memmove(s+sizeof(char)*14,frame.c_str(),frame.size());
+        PyObject *decoded = decode_log_packet_modem(s, n_size, skip_decoding);
+
+        // char *s = new char[n_size];
+        // memset(s,0,sizeof(char)*n_size);
+        // *s = n_size;
+        // *(s+2) = n_size;
+        // *(s+4) = 0xeb;
+        // *(s+5) = 0x1f;
+        // memmove(s+sizeof(char)*14,frame.c_str(),frame.size());
+        // PyObject *decoded = decode_log_packet(s, n_size, skip_decoding);
+
+
+
+        // // The following code does not crash on Android.
+        // // But if use s and frame.size(), it crashes
+        // const char *s = frame.c_str();
+        // PyObject *decoded = decode_log_packet(  s + 2,  // skip first two bytes
+        //                                         frame.size() - 2,
+        //                                         skip_decoding);
+
+        // delete [] s; //Yuanjie: bug for it on Android, but no problem on laptop
+        return decoded;
+    }
+    else {
+        return NULL;
+    }
+}
+
+// Return: decoded_list or None
+static PyObject *
+dm_collector_c_receive_log_packet (PyObject *self, PyObject *args) {
+
+    // (void)self;
+
+    std::string frame;
+    bool crc_correct = false;
+    bool skip_decoding = false, include_timestamp = false;  // default values
+    double posix_timestamp = -1.0;
+
+    bool success = get_next_frame(frame, crc_correct, &posix_timestamp);
+    if (success && perf_enabled(&g_perf)) {
+        g_perf.frames++;
+        if (!crc_correct)
+            g_perf.crc_failures++;
+    }
+    // printf("success=%d crc_correct=%d is_log_packet=%d\n", success, crc_correct, is_log_packet(frame.c_str(), frame.size()));
+    // if (success && crc_correct && is_log_packet(frame.c_str(), frame.size())) {
+    if (success && crc_correct) {
+        PyObject *arg_skip_decoding = NULL;
+        PyObject *arg_include_timestamp = NULL;
+        if (!PyArg_ParseTuple(args, "|OO:receive_log_packet",
+                                    &arg_skip_decoding, &arg_include_timestamp))
+            return NULL;
+        if (arg_skip_decoding != NULL) {
+            Py_INCREF(arg_skip_decoding);
+            skip_decoding = (PyObject_IsTrue(arg_skip_decoding) == 1);
+            Py_DECREF(arg_skip_decoding);
+        }
+        if (arg_include_timestamp != NULL) {
+            Py_INCREF(arg_include_timestamp);
+            include_timestamp = (PyObject_IsTrue(arg_include_timestamp) == 1);
+            Py_DECREF(arg_include_timestamp);
+        }
+
+        PyObject *decoded = decode_frame(frame, skip_decoding);
+        if (decoded == NULL) {
+            if (PyErr_Occurred())
+                return NULL;
+            Py_RETURN_NONE;
+        }
+        if (include_timestamp) {
+            if (posix_timestamp < 0)    // not fed by feed_chronicle()
+                posix_timestamp = get_posix_timestamp();
+            PyObject *ret = Py_BuildValue("(Od)", decoded, posix_timestamp);
+            Py_DECREF(decoded);
+            return ret;
+        } else {
+            return decoded;
+        }
+
+    } else {
+        if (success)
+            mstats_crc_failure(&g_mstats);
+        Py_RETURN_NONE;
+    }
+}
+
+// A deframed packet that passed the filter
+struct PolledFrame {
+    std::string data;
+    double timestamp;
+};
+
+// Frames read but not delivered yet by poll_log_packets() (e.g. the
+// callback raised), and the file events read with them. The events are
+// only returned by get_chronicle_events() once these frames are delivered.
+static std::deque<PolledFrame> g_polled_pending;
+static std::vector<ChronicleEvent> g_polled_pending_events;
+
+static void
+flush_polled_pending_events () {
+    g_chronicle_events.insert(g_chronicle_events.end(),
+                                g_polled_pending_events.begin(),
+                                g_polled_pending_events.end());
+    g_polled_pending_events.clear();
+}
+
+// Return: successful or not
+static PyObject *
+dm_collector_c_attach_fd (PyObject *self, PyObject *args) {
+    (void)self;
+    int fd;
+    PyObject *arg_chronicle = NULL;
+    if (!PyArg_ParseTuple(args, "i|O:attach_fd", &fd, &arg_chronicle))
+        return NULL;
+    bool chronicle = arg_chronicle != NULL && PyObject_IsTrue(arg_chronicle) == 1;
+    reset_binary();
+    chronicle_init_state(&g_chronicle);
+    g_chronicle_events.clear();
+    g_polled_pending.clear();
+    g_polled_pending_events.clear();
+    if (fdreader_attach(&g_fdreader, fd, chronicle))
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+static PyObject *
+dm_collector_c_detach_fd (PyObject *self, PyObject *args) {
+    (void)self;
+    (void)args;
+    fdreader_detach(&g_fdreader);
+    Py_RETURN_NONE;
+}
+
+// Return: a list of packets, the number of packets passed to callback, or
+// None at the end of file
+static PyObject *
+dm_collector_c_poll_log_packets (PyObject *self, PyObject *args) {
+    (void)self;
+    int timeout_ms = -1;
+    int max_packets = 1024;
+    PyObject *arg_skip_decoding = NULL;
+    PyObject *arg_include_timestamp = NULL;
+    PyObject *callback = NULL;
+    if (!PyArg_ParseTuple(args, "|iiOOO:poll_log_packets", &timeout_ms, &max_packets,
+                            &arg_skip_decoding, &arg_include_timestamp, &callback))
+        return NULL;
+    bool skip_decoding = arg_skip_decoding != NULL
+                            && PyObject_IsTrue(arg_skip_decoding) == 1;
+    bool include_timestamp = arg_include_timestamp != NULL
+                                && PyObject_IsTrue(arg_include_timestamp) == 1;
+    if (callback == Py_None)
+        callback = NULL;
+    if (callback != NULL && !PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "callback is not callable.");
+        return NULL;
+    }
+    if (max_packets <= 0)
+        max_packets = 1;
+
+    // Frames left by a previous call come first
+    std::vector<PolledFrame> frames;
+    while (!g_polled_pending.empty() && (int) frames.size() < max_packets) {
+        frames.push_back(PolledFrame());
+        frames.back().data.swap(g_polled_pending.front().data);
+        frames.back().timestamp = g_polled_pending.front().timestamp;
+        g_polled_pending.pop_front();
+    }
+    if (frames.empty() && g_fdreader.fd < 0) {
+        PyErr_SetString(PyExc_RuntimeError, "No fd is attached.");
+        return NULL;
+    }
+
+    // The GIL is only released while waiting for the fd: deframing, export
+    // and the aggregators use state that other threads may change.
+    int status = 1;
+    unsigned long long bytes_read = g_fdreader.bytes_read;
+    unsigned long long n_frames = 0, n_crc_failures = 0, n_filtered_out = 0;
+    g_fdreader.eof = false;
+    while (frames.empty()) {
+        std::string frame;
+        bool crc_correct = false;
+        double timestamp = -1.0;
+        while ((int) frames.size() < max_packets
+                && get_next_frame(frame, crc_correct, &timestamp)) {
+            n_frames++;
+            if (!crc_correct) {
+                n_crc_failures++;
+                mstats_crc_failure(&g_mstats);
+                continue;
+            }
+            check_frame_format(frame);
+            if (taggr_enabled(&g_taggr))
+                taggr_feed(&g_taggr, frame.c_str(), frame.size());
+            mstats_feed(&g_mstats, frame.c_str(), frame.size());
+            if (!manager_export_binary(&g_emanager, frame.c_str(), frame.size())) {
+                n_filtered_out++;
+                continue;
+            }
+            frames.push_back(PolledFrame());
+            frames.back().data.swap(frame);
+            frames.back().timestamp = timestamp;
+        }
+        if (!frames.empty() || status != 1)
+            break;
+        int ready;
+        Py_BEGIN_ALLOW_THREADS
+        ready = fdreader_wait(&g_fdreader, timeout_ms);
+        Py_END_ALLOW_THREADS
+        status = ready > 0 ? fdreader_feed(&g_fdreader, &g_chronicle,
+                                            g_polled_pending_events)
+                            : ready;
+    }
+    if (perf_enabled(&g_perf)) {
+        g_perf.bytes_fed += g_fdreader.bytes_read - bytes_read;
+        g_perf.frames += n_frames;
+        g_perf.crc_failures += n_crc_failures;
+        g_perf.filtered_out += n_filtered_out;
+    }
+
+    if (frames.empty()) {
+        flush_polled_pending_events();
+        if (status < 0)
+            return PyErr_SetFromErrno(PyExc_OSError);
+        if (status == 2)
+            Py_RETURN_NONE;
+    }
+
+    PyObject *ret = callback != NULL ? NULL : PyList_New(0);
+    long n_called = 0;
+    double now = include_timestamp ? get_posix_timestamp() : -1.0;
+    size_t i = 0;
+    bool failed = ret == NULL && callback == NULL;
+    for (; i < frames.size() && !failed; i++) {
+        PyObject *decoded = decode_frame(frames[i].data, skip_decoding, false);
+        if (decoded == NULL) {
+            failed = PyErr_Occurred() != NULL;
+            continue;
+        }
+        if (include_timestamp) {
+            double timestamp = frames[i].timestamp >= 0 ? frames[i].timestamp : now;
+            decoded = Py_BuildValue("(Nd)", decoded, timestamp);
+            if (decoded == NULL) {
+                failed = true;
+                continue;
+            }
+        }
+        if (callback != NULL) {
+            PyObject *r = PyObject_CallFunctionObjArgs(callback, decoded, NULL);
+            Py_DECREF(decoded);
+            if (r == NULL) {
+                failed = true;
+                continue;
+            }
+            Py_DECREF(r);
+            n_called++;
+        } else {
+            int err = PyList_Append(ret, decoded);
+            Py_DECREF(decoded);
+            failed = err < 0;
+        }
+    }
+    if (failed) {
+        // The frame that failed is consumed. Keep the rest for the next call,
+        // ahead of those still pending.
+        for (size_t j = frames.size(); j > i; j--) {
+            g_polled_pending.push_front(PolledFrame());
+            g_polled_pending.front().data.swap(frames[j - 1].data);
+            g_polled_pending.front().timestamp = frames[j - 1].timestamp;
+        }
+        Py_XDECREF(ret);
+        return NULL;
+    }
+    if (g_polled_pending.empty())
+        flush_polled_pending_events();
+    if (callback != NULL)
+        return PyInt_FromLong(n_called);
+    return ret;
+}
+
+// Return: (last_timestamp, events)
+static PyObject *
+dm_collector_c_get_chronicle_events (PyObject *self, PyObject *args) {
+    (void)self;
+    (void)args;
+    PyObject *ret = build_chronicle_result(g_chronicle_events);
+    g_chronicle_events.clear();
+    return ret;
+}
+
+// Return: None
+static PyObject *
+dm_collector_c_set_throughput_window (PyObject *self, PyObject *args) {
+    (void)self;
+    double window;
+    if (!PyArg_ParseTuple(args, "d:set_throughput_window", &window))
+        return NULL;
+    if (window < 0) {
+        PyErr_SetString(PyExc_ValueError, "window must not be negative.");
+        return NULL;
+    }
+    taggr_configure(&g_taggr, window);
+    Py_RETURN_NONE;
+}
+
+// Convert a QCDM timestamp, in the same way as _decode_by_fmt()
+static PyObject *
+qcdm_timestamp_to_datetime (unsigned long long ts) {
+    if (PyDateTimeAPI == NULL)
+        PyDateTime_IMPORT;
+    const double PER_SECOND = 52428800.0;
+    const double PER_USECOND = 52428800.0 / 1.0e6;
+    int seconds = int(double(ts) / PER_SECOND);
+    int useconds = (double(ts) / PER_USECOND) - double(seconds) * 1.0e6;
+    PyObject *epoch = PyDateTime_FromDateAndTime(1980, 1, 6, 0, 0, 0, 0);
+    PyObject *delta = PyDelta_FromDSU(0, seconds, useconds);
+    PyObject *ret = (epoch && delta) ? PyNumber_Add(epoch, delta) : NULL;
+    Py_XDECREF(epoch);
+    Py_XDECREF(delta);
+    return ret;
+}
+
+static PyObject *
+build_throughput_summary (const ThroughputSummary &s) {
+    double duration = (s.t_end - s.t_start) / 52428800.0;
+    double mbits = duration > 0 ? 1.0 / (duration * 1000000.0) : 0.0;
+    unsigned long long ul_bits = s.ul_grant_received * 8;
+    unsigned long long ul_utilized_bits = s.ul_grant_utilized * 8;
+
+    PyObject *buffers = PyDict_New();
+    for (std::map<int, LcidBufferStats>::const_iterator it = s.ul_buffer.begin();
+            it != s.ul_buffer.end(); ++it) {
+        const LcidBufferStats &b = it->second;
+        PyObject *stats = Py_BuildValue("{s:I,s:I,s:d}",
+                                        "last", b.last,
+                                        "peak", b.peak,
+                                        "avg", b.n_samples ? double(b.sum) / b.n_samples : 0.0);
+        PyObject *lcid = PyInt_FromLong(it->first);
+        PyDict_SetItem(buffers, lcid, stats);
+        Py_DECREF(lcid);
+        Py_DECREF(stats);
+    }
+    PyObject *mcs = Py_BuildValue("{s:I,s:I,s:I,s:I}",
+                                    "QPSK", s.mcs_counts[0],
+                                    "16QAM", s.mcs_counts[1],
+                                    "64QAM", s.mcs_counts[2],
+                                    "Other", s.mcs_counts[3]);
+    return Py_BuildValue("{s:N,s:N,s:d,s:K,s:d,s:I,s:N,s:K,s:K,s:d,s:d,s:d,s:N}",
+                            "start", qcdm_timestamp_to_datetime(s.t_start),
+                            "end", qcdm_timestamp_to_datetime(s.t_end),
+                            "duration", duration,
+                            "dl_tbs_bits", s.dl_tbs_bits,
+                            "dl_bandwidth_mbps", s.dl_tbs_bits * mbits,
+                            "pdsch_count", s.n_pdsch,
+                            "mcs", mcs,
+                            "ul_grant_received", s.ul_grant_received,
+                            "ul_grant_utilized", s.ul_grant_utilized,
+                            "ul_bandwidth_mbps", ul_bits * mbits,
+                            "ul_utilized_mbps", ul_utilized_bits * mbits,
+                            "ul_grant_utilization",
+                            ul_bits ? ul_utilized_bits * 100.0 / ul_bits : 0.0,
+                            "ul_buffer", buffers);
+}
+
+// Return: a list of window summaries
+static PyObject *
+dm_collector_c_get_throughput_summaries (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *arg_flush = NULL;
+    if (!PyArg_ParseTuple(args, "|O:get_throughput_summaries", &arg_flush))
+        return NULL;
+    if (arg_flush != NULL && PyObject_IsTrue(arg_flush) == 1)
+        taggr_flush(&g_taggr);
+    PyObject *ret = PyList_New(0);
+    while (ret != NULL && !g_taggr.done.empty()) {
+        PyObject *summary = build_throughput_summary(g_taggr.done.front());
+        g_taggr.done.pop_front();
+        if (summary == NULL) {
+            Py_CLEAR(ret);
+            break;
+        }
+        PyList_Append(ret, summary);
+        Py_DECREF(summary);
+    }
+    return ret;
+}
+
+// Return: None
+static PyObject *
+dm_collector_c_set_rlc_window (PyObject *self, PyObject *args) {
+    (void)self;
+    double window;
+    if (!PyArg_ParseTuple(args, "d:set_rlc_window", &window))
+        return NULL;
+    if (window < 0) {
+        PyErr_SetString(PyExc_ValueError, "window must not be negative.");
+        return NULL;
+    }
+    rtrack_configure(&g_rtracker, window);
+    set_rlc_tracker(rtrack_enabled(&g_rtracker) ? &g_rtracker : NULL);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+build_rlc_link_stats (const RlcLinkStats &l) {
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:d,s:I,s:i,s:I}",
+                            "data_pdus", l.data_pdus,
+                            "data_bytes", l.data_bytes,
+                            "retx_pdus", l.retx_pdus,
+                            "status_pdus", l.status_pdus,
+                            "status_bytes", l.status_bytes,
+                            "nacks", l.nacks,
+                            "acked_pdus", l.acked_pdus,
+                            "ack_latency_avg_ms",
+                            l.acked_pdus ? double(l.ack_latency_sum) / l.acked_pdus : 0.0,
+                            "ack_latency_max_ms", l.ack_latency_max,
+                            "highest_sn", l.highest_sn,
+                            "outstanding", l.outstanding);
+}
+
+static PyObject *
+build_rlc_summary (const RlcTrackerSummary &s) {
+    PyObject *bearers = PyDict_New();
+    for (std::map<int, RlcBearerSummary>::const_iterator it = s.bearers.begin();
+            it != s.bearers.end(); ++it) {
+        PyObject *stats = Py_BuildValue("{s:N,s:N}",
+                                        "UL", build_rlc_link_stats(it->second.link[RTRACK_UL]),
+                                        "DL", build_rlc_link_stats(it->second.link[RTRACK_DL]));
+        PyObject *idx = PyInt_FromLong(it->first);
+        PyDict_SetItem(bearers, idx, stats);
+        Py_DECREF(idx);
+        Py_DECREF(stats);
+    }
+    return Py_BuildValue("{s:N,s:N,s:d,s:N}",
+                            "start", qcdm_timestamp_to_datetime(s.t_start),
+                            "end", qcdm_timestamp_to_datetime(s.t_end),
+                            "duration", (s.t_end - s.t_start) / 52428800.0,
+                            "bearers", bearers);
+}
+
+// Return: a list of window summaries
+static PyObject *
+dm_collector_c_get_rlc_summaries (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *arg_flush = NULL;
+    if (!PyArg_ParseTuple(args, "|O:get_rlc_summaries", &arg_flush))
+        return NULL;
+    if (arg_flush != NULL && PyObject_IsTrue(arg_flush) == 1)
+        rtrack_flush(&g_rtracker);
+    PyObject *ret = PyList_New(0);
+    while (ret != NULL && !g_rtracker.done.empty()) {
+        PyObject *summary = build_rlc_summary(g_rtracker.done.front());
+        g_rtracker.done.pop_front();
+        if (summary == NULL) {
+            Py_CLEAR(ret);
+            break;
+        }
+        PyList_Append(ret, summary);
+        Py_DECREF(summary);
+    }
+    return ret;
+}
+
+// Return: None
+static PyObject *
+dm_collector_c_enable_msg_statistics (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *arg_enable = NULL;
+    if (!PyArg_ParseTuple(args, "|O:enable_msg_statistics", &arg_enable))
+        return NULL;
+    mstats_configure(&g_mstats, arg_enable == NULL || PyObject_IsTrue(arg_enable) == 1);
+    Py_RETURN_NONE;
+}
+
+// Return: the type name of a log code, or "0xXXXX" for unknown codes
+static PyObject *
+build_type_name_key (int code) {
+    const char *name = search_name(LogPacketTypeID_To_Name,
+                                    ARRAY_SIZE(LogPacketTypeID_To_Name, ValueName),
+                                    code);
+    if (name != NULL)
+        return PyString_FromString(name);
+    // PyString_FromFormat() supports neither widths nor %X
+    char buf[16];
+    snprintf(buf, sizeof(buf), "0x%04X", code);
+    return PyString_FromString(buf);
+}
+
+// Summarize a histogram, whose values are multiplied by scale
+static PyObject *
+build_hist_summary (const HdrHistogram &h, double scale) {
+    return Py_BuildValue("{s:d,s:d,s:d,s:d,s:d,s:d,s:d}",
+                            "min", h.min * scale,
+                            "max", h.max * scale,
+                            "mean", h.total ? double(h.sum) / h.total * scale : 0.0,
+                            "p50", mstats_hist_quantile(&h, 0.5) * scale,
+                            "p90", mstats_hist_quantile(&h, 0.9) * scale,
+                            "p99", mstats_hist_quantile(&h, 0.99) * scale,
+                            "p999", mstats_hist_quantile(&h, 0.999) * scale);
+}
+
+// Return: {"frames": n, "crc_failures": n, "log_codes": {type_name: stats}}
+static PyObject *
+dm_collector_c_get_msg_statistics (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *arg_reset = NULL;
+    if (!PyArg_ParseTuple(args, "|O:get_msg_statistics", &arg_reset))
+        return NULL;
+    const double MS_PER_TICK = 1000.0 / 52428800.0;
+
+    PyObject *codes = PyDict_New();
+    for (std::map<int, MsgCodeStats>::const_iterator it = g_mstats.codes.begin();
+            it != g_mstats.codes.end(); ++it) {
+        const MsgCodeStats &c = it->second;
+        PyObject *key = build_type_name_key(it->first);
+        PyObject *stats = Py_BuildValue("{s:K,s:K,s:N,s:N}",
+                                        "count", c.count,
+                                        "bytes", c.bytes,
+                                        "size", build_hist_summary(c.size, 1.0),
+                                        "interarrival_ms",
+                                        build_hist_summary(c.interarrival, MS_PER_TICK));
+        PyDict_SetItem(codes, key, stats);
+        Py_DECREF(key);
+        Py_DECREF(stats);
+    }
+    PyObject *ret = Py_BuildValue("{s:K,s:K,s:N}",
+                                    "frames", g_mstats.n_frames,
+                                    "crc_failures", g_mstats.n_crc_failures,
+                                    "log_codes", codes);
+    if (arg_reset != NULL && PyObject_IsTrue(arg_reset) == 1)
+        mstats_configure(&g_mstats, g_mstats.enabled);
+    return ret;
+}
+
+// Return: None
+static PyObject *
+dm_collector_c_enable_stats (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *arg_enable = NULL;
+    double dump_interval = 0;
+    if (!PyArg_ParseTuple(args, "|Od:enable_stats", &arg_enable, &dump_interval))
+        return NULL;
+    perf_configure(&g_perf, arg_enable == NULL || PyObject_IsTrue(arg_enable) == 1,
+                    dump_interval, g_emanager.total_bytes);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+build_timer_summary (const PerfTimer &t) {
+    return Py_BuildValue("{s:K,s:d,s:d,s:d}",
+                            "count", t.count,
+                            "total_ms", t.total_ns * 1e-6,
+                            "mean_us", t.count ? t.total_ns * 1e-3 / t.count : 0.0,
+                            "max_us", t.max_ns * 1e-3);
+}
+
+// Return: {"frames": n, ..., "decode": {type_name: timer}, ...}
+static PyObject *
+dm_collector_c_get_stats (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *arg_reset = NULL;
+    if (!PyArg_ParseTuple(args, "|O:get_stats", &arg_reset))
+        return NULL;
+
+    PyObject *decode = PyDict_New();
+    for (std::map<int, PerfTimer>::const_iterator it = g_perf.decode.begin();
+            it != g_perf.decode.end(); ++it) {
+        PyObject *key = build_type_name_key(it->first);
+        PyObject *timer = build_timer_summary(it->second);
+        PyDict_SetItem(decode, key, timer);
+        Py_DECREF(key);
+        Py_DECREF(timer);
+    }
+    PyObject *ret = Py_BuildValue("{s:O,s:d,s:K,s:K,s:K,s:K,s:K,s:N,s:N,s:N}",
+                                    "enabled", g_perf.enabled ? Py_True : Py_False,
+                                    "elapsed", perf_now_ns() * 1e-9 - g_perf.t_start,
+                                    "bytes_fed", g_perf.bytes_fed,
+                                    "frames", g_perf.frames,
+                                    "crc_failures", g_perf.crc_failures,
+                                    "filtered_out", g_perf.filtered_out,
+                                    "export_bytes",
+                                    perf_export_bytes(&g_perf, g_emanager.total_bytes),
+                                    "decode", decode,
+                                    "build", build_timer_summary(g_perf.build),
+                                    "ws_dissector", build_timer_summary(g_perf.ws_dissector));
+    if (arg_reset != NULL && PyObject_IsTrue(arg_reset) == 1)
+        perf_configure(&g_perf, g_perf.enabled, g_perf.dump_interval, g_emanager.total_bytes);
+    return ret;
+}
+
+// Return: None
+static PyObject *
+dm_collector_c_record_ws_roundtrip (PyObject *self, PyObject *args) {
+    (void)self;
+    double seconds;
+    if (!PyArg_ParseTuple(args, "d:record_ws_roundtrip", &seconds))
+        return NULL;
+    if (perf_enabled(&g_perf) && seconds >= 0)
+        perf_timer_add(&g_perf.ws_dissector, (unsigned long long) (seconds * 1e9));
+    Py_RETURN_NONE;
+}
+
+// Return: a LogReader iterator
+static PyObject *
+dm_collector_c_open_log (PyObject *self, PyObject *args) {
+    (void)self;
+    const char *path;
+    PyObject *arg_skip_decoding = NULL;
+    PyObject *type_names = Py_None;
+    PyObject *arg_t0 = Py_None;
+    PyObject *arg_t1 = Py_None;
+    if (!PyArg_ParseTuple(args, "s|OOOO:open_log", &path, &arg_skip_decoding,
+                            &type_names, &arg_t0, &arg_t1))
+        return NULL;
+
+    LogFrameFilter *filter = NULL;
+    if (type_names != Py_None || arg_t0 != Py_None || arg_t1 != Py_None) {
+        filter = new LogFrameFilter;
+        lreader_init_filter(filter);
+        if ((type_names != Py_None && !build_type_mask(type_names, filter->types))
+                || (arg_t0 != Py_None && !to_qcdm_timestamp(arg_t0, &filter->t0, false))
+                || (arg_t1 != Py_None && !to_qcdm_timestamp(arg_t1, &filter->t1, true))) {
+            delete filter;
+            return NULL;
+        }
+        filter->has_window = (arg_t0 != Py_None || arg_t1 != Py_None);
+        filter->in_window = !filter->has_window;
+    }
+
+    LogReaderObject *reader = PyObject_New(LogReaderObject, &LogReaderType);
+    if (reader == NULL) {
+        delete filter;
+        return NULL;
+    }
+    reader->state = new LogReaderState;
+    lreader_init_state(reader->state);
+    reader->skip_decoding = (arg_skip_decoding != NULL
+                                && PyObject_IsTrue(arg_skip_decoding) == 1);
+    reader->filter = filter;
+    if (!lreader_open(reader->state, path)) {
+        Py_DECREF(reader);
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *) path);
+        return NULL;
+    }
+
+    // Jump to the window with the sidecar index, if there is a valid one
+    if (filter != NULL && filter->t0 > 0) {
+        LogIndexState index;
+        lindex_init_state(&index);
+        std::string index_path = std::string(path) + ".idx";
+        if (lindex_open(&index, path, index_path.c_str())) {
+            size_t i = lindex_seek(&index, filter->t0);
+            unsigned long long offset = i < index.n_frames ? index.offsets[i]
+                                                            : reader->state->total_size;
+            (void) lreader_seek(reader->state, offset);
+            lindex_close(&index);
+        }
+    }
+    return (PyObject *) reader;
+}
+
+// Return: a HeaderReader iterator
+static PyObject *
+dm_collector_c_open_log_headers (PyObject *self, PyObject *args) {
+    (void)self;
+    const char *path;
+    PyObject *type_names = Py_None;
+    PyObject *arg_t0 = Py_None;
+    PyObject *arg_t1 = Py_None;
+    if (!PyArg_ParseTuple(args, "s|OOO:open_log_headers", &path,
+                            &type_names, &arg_t0, &arg_t1))
+        return NULL;
+
+    LogFrameFilter *filter = NULL;
+    if (type_names != Py_None || arg_t0 != Py_None || arg_t1 != Py_None) {
+        filter = new LogFrameFilter;
+        lreader_init_filter(filter);
+        if ((type_names != Py_None && !build_type_mask(type_names, filter->types))
+                || (arg_t0 != Py_None && !to_qcdm_timestamp(arg_t0, &filter->t0, false))
+                || (arg_t1 != Py_None && !to_qcdm_timestamp(arg_t1, &filter->t1, true))) {
+            delete filter;
+            return NULL;
+        }
+        filter->has_window = (arg_t0 != Py_None || arg_t1 != Py_None);
+        filter->in_window = !filter->has_window;
+    }
+
+    HeaderReaderObject *reader = PyObject_New(HeaderReaderObject, &HeaderReaderType);
+    if (reader == NULL) {
+        delete filter;
+        return NULL;
+    }
+    reader->state = new LogReaderState;
+    lreader_init_state(reader->state);
+    reader->filter = filter;
+    reader->block = NULL;
+    if (!lreader_open(reader->state, path)) {
+        Py_DECREF(reader);
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *) path);
+        return NULL;
+    }
+    return (PyObject *) reader;
+}
+
+// Return: a ParallelReplay iterator
+static PyObject *
+dm_collector_c_open_logs (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *sequence = NULL;
+    PyObject *arg_skip_decoding = NULL;
+    int n_threads = -1;
+    unsigned int chunk_size = 0;
+    if (!PyArg_ParseTuple(args, "O|OiI:open_logs", &sequence, &arg_skip_decoding,
+                            &n_threads, &chunk_size))
+        return NULL;
+    if (!PySequence_Check(sequence)) {
+        PyErr_SetString(PyExc_TypeError, "\'paths\' is not a sequence.");
+        return NULL;
+    }
+    std::vector<std::string> paths;
+    Py_ssize_t n = PySequence_Length(sequence);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject *item = PySequence_GetItem(sequence, i);
+        if (item == NULL)
+            return NULL;
+        if (!PyString_Check(item)) {
+            Py_DECREF(item);
+            PyErr_SetString(PyExc_TypeError, "\'paths\' should only contain strings.");
+            return NULL;
+        }
+        paths.push_back(PyString_AsString(item));
+        Py_DECREF(item);
+    }
+    if (n_threads < 0) {
+#ifndef _WIN32
+        n_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#else
+        n_threads = 0;
+#endif
+    }
+
+    ParallelReplayObject *obj = PyObject_New(ParallelReplayObject, &ParallelReplayType);
+    if (obj == NULL)
+        return NULL;
+    obj->state = new ParallelReplayState;
+    preplay_init_state(obj->state);
+    obj->skip_decoding = (arg_skip_decoding != NULL
+                            && PyObject_IsTrue(arg_skip_decoding) == 1);
+    if (!preplay_open(obj->state, paths, g_emanager.whitelist, n_threads, chunk_size)) {
+        Py_DECREF(obj);
+        PyErr_SetString(PyExc_IOError, "Cannot open log files.");
+        return NULL;
+    }
+    return (PyObject *) obj;
+}
+
+// Return: successful or not
+static PyObject *
+dm_collector_c_build_log_index (PyObject *self, PyObject *args) {
+    (void)self;
+    const char *path;
+    const char *index_path = NULL;
+    if (!PyArg_ParseTuple(args, "s|s:build_log_index", &path, &index_path))
+        return NULL;
+    std::string real_index_path = index_path ? index_path : std::string(path) + ".idx";
+    bool success;
+    Py_BEGIN_ALLOW_THREADS
+    success = lindex_build(path, real_index_path.c_str());
+    Py_END_ALLOW_THREADS
+    if (success) {
+        Py_RETURN_TRUE;
+    } else {
+        Py_RETURN_FALSE;
+    }
+}
+
+// Return: a LogIndex object
+static PyObject *
+dm_collector_c_open_log_index (PyObject *self, PyObject *args) {
+    (void)self;
+    const char *path;
+    const char *index_path = NULL;
+    if (!PyArg_ParseTuple(args, "s|s:open_log_index", &path, &index_path))
+        return NULL;
+    std::string real_index_path = index_path ? index_path : std::string(path) + ".idx";
+
+    LogIndexObject *obj = PyObject_New(LogIndexObject, &LogIndexType);
+    if (obj == NULL)
+        return NULL;
+    obj->index = new LogIndexState;
+    obj->reader = new LogReaderState;
+    lindex_init_state(obj->index);
+    lreader_init_state(obj->reader);
+
+    bool success;
+    Py_BEGIN_ALLOW_THREADS
+    success = lindex_open(obj->index, path, real_index_path.c_str())
+                || (lindex_build(path, real_index_path.c_str())
+                    && lindex_open(obj->index, path, real_index_path.c_str()));
+    Py_END_ALLOW_THREADS
+    if (!success || !lreader_open(obj->reader, path)) {
+        Py_DECREF(obj);
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *) path);
+        return NULL;
+    }
+    return (PyObject *) obj;
+}
+
+// Return: {table_name: n_rows}
+static PyObject *
+dm_collector_c_export_columnar (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *paths = NULL;
+    const char *directory;
+    PyObject *type_names = NULL;
+    IdVector type_ids;
+    if (!PyArg_ParseTuple(args, "OsO:export_columnar", &paths, &directory, &type_names))
+        return NULL;
+    if (!PySequence_Check(paths) || !PySequence_Check(type_names)) {
+        PyErr_SetString(PyExc_TypeError, "\'paths\' or \'type_names\' is not a sequence.");
+        return NULL;
+    }
+    if (!map_typenames_to_ids(type_names, type_ids)) {
+        PyErr_SetString(PyExc_ValueError, "Wrong type name.");
+        return NULL;
+    }
+    std::set<int> types(type_ids.begin(), type_ids.end());
+
+    ColumnarExportState exporter;
+    cexport_init_state(&exporter);
+    if (!cexport_open(&exporter, directory)) {
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *) directory);
+        return NULL;
+    }
+    std::map<std::string, size_t> n_rows;
+    Py_ssize_t n = PySequence_Length(paths);
+    bool success = n >= 0;
+    for (Py_ssize_t i = 0; i < n && success; i++) {
+        PyObject *item = PySequence_GetItem(paths, i);
+        if (item == NULL) {
+            success = false;
+            break;
+        }
+        if (!PyString_Check(item)) {
+            Py_DECREF(item);
+            continue;
+        }
+        std::string path = PyString_AsString(item);
+        Py_DECREF(item);
+
+        LogReaderState reader;
+        lreader_init_state(&reader);
+        if (!lreader_open(&reader, path.c_str())) {
+            PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *) path.c_str());
+            success = false;
+            break;
+        }
+        std::string frame;
+        bool crc_correct = false;
+        while (lreader_next_frame(&reader, frame, crc_correct)) {
+            if (!crc_correct)
+                continue;
+            check_frame_format(frame);
+            // 8 = 2 (0x1000) + 2 (len1) + 2 (log_msg_len) + 2 (type_id)
+            if (!is_log_packet(frame.c_str(), frame.size()) || frame.size() < 8)
+                continue;
+            unsigned short type_id;
+            memcpy(&type_id, frame.c_str() + 6, sizeof(type_id));
+            if (types.count(type_id) == 0)
+                continue;
+            PyObject *decoded = decode_log_packet(frame.c_str() + 2,  // skip first two bytes
+                                                    frame.size() - 2,
+                                                    false);
+            if (decoded == NULL) {
+                if (PyErr_Occurred() == NULL)
+                    continue;   // not decodable; skip the packet
+                success = false;
+                break;
+            }
+            if (cexport_append(&exporter, decoded) < 0) {
+                PyErr_SetString(PyExc_IOError, "Failed to write column files.");
+                success = false;
+            }
+            Py_DECREF(decoded);
+            if (!success)
+                break;
+        }
+        lreader_close(&reader);
+    }
+
+    PyObject *ret = success ? PyDict_New() : NULL;
+    for (std::map<std::string, ColumnarTable *>::iterator it = exporter.tables.begin();
+            ret != NULL && it != exporter.tables.end(); ++it) {
+        PyObject *value = PyLong_FromUnsignedLongLong(it->second->n_rows);
+        if (value == NULL || PyDict_SetItemString(ret, it->first.c_str(), value) < 0)
+            Py_CLEAR(ret);
+        Py_XDECREF(value);
+    }
+    if (!cexport_close(&exporter) && ret != NULL) {
+        Py_DECREF(ret);
+        PyErr_SetString(PyExc_IOError, "Failed to write column files.");
+        return NULL;
+    }
+    return ret;
+}
+
+// Return: a RecordArray object
+static PyObject *
+dm_collector_c_to_records (PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *packets = NULL;
+    if (!PyArg_ParseTuple(args, "O:to_records", &packets))
+        return NULL;
+    PyObject *seq = PySequence_Fast(packets, "\'packets\' is not a sequence.");
+    if (seq == NULL)
+        return NULL;
+
+    ColumnarTable table;
+    cexport_init_table(&table);
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject *decoded = PySequence_Fast_GET_ITEM(seq, i);
+        if (PyObject_TypeCheck(decoded, &LogPacketType))
+            decoded = ((LogPacketObject *) decoded)->decoded_list;
+        if (decoded == NULL || !PyList_Check(decoded)) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_TypeError, "A packet is not a decoded list.");
+            return NULL;
+        }
+        cexport_append_rows(&table, decoded);
+    }
+    Py_DECREF(seq);
+
+    // Lay out the numeric columns: all values first, then all validity
+    // bytes, so every array of values is 8-byte aligned.
+    std::vector<const ColumnarColumn *> columns;
+    for (size_t k = 0; k < table.columns.size(); k++) {
+        if (table.columns[k].type != COL_STRING)
+            columns.push_back(&table.columns[k]);
+    }
+    size_t n_rows = table.n_rows;
+    RecordArrayObject *ret = PyObject_New(RecordArrayObject, &RecordArrayType);
+    if (ret == NULL)
+        return NULL;
+    ret->data = new std::string;
+    ret->data->reserve(columns.size() * n_rows * 9);
+    ret->n_rows = n_rows;
+    ret->n_dropped = table.n_dropped;
+    ret->fields = PyList_New(0);
+    if (ret->fields == NULL) {
+        Py_DECREF(ret);
+        return NULL;
+    }
+    size_t valid_start = columns.size() * n_rows * 8;
+    for (size_t k = 0; k < columns.size(); k++) {
+        const ColumnarColumn *col = columns[k];
+        // A field that first appears at first_row is invalid before it
+        ret->data->append(col->first_row * 8, '\0');
+        ret->data->append(col->values);
+        const char *dtype = col->type == COL_INT64 ? "<i8"
+                            : (col->type == COL_FLOAT64 ? "<f8" : "<M8[us]");
+        PyObject *field = Py_BuildValue("(ssnn)", col->name.c_str(), dtype,
+                                        (Py_ssize_t) (k * n_rows * 8),
+                                        (Py_ssize_t) (valid_start + k * n_rows));
+        int err = field != NULL ? PyList_Append(ret->fields, field) : -1;
+        Py_XDECREF(field);
+        if (err < 0) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+    }
+    for (size_t k = 0; k < columns.size(); k++) {
+        ret->data->append(columns[k]->first_row, '\0');
+        ret->data->append(columns[k]->valid);
+    }
+    return (PyObject *) ret;
+}
+
+// Return: the field tuple, or NULL with KeyError set
+static PyObject *
+find_record_field (RecordArrayObject *self, PyObject *args) {
+    const char *name;
+    if (!PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+    Py_ssize_t n = PyList_GET_SIZE(self->fields);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject *field = PyList_GET_ITEM(self->fields, i);
+        if (strcmp(PyString_AS_STRING(PyTuple_GET_ITEM(field, 0)), name) == 0)
+            return field;
+    }
+    PyErr_SetString(PyExc_KeyError, name);
+    return NULL;
+}
+
+// Return: a buffer that refers to the values of a field
+static PyObject *
+record_array_column (RecordArrayObject *self, PyObject *args) {
+    PyObject *field = find_record_field(self, args);
+    if (field == NULL)
+        return NULL;
+    Py_ssize_t offset = PyInt_AsSsize_t(PyTuple_GET_ITEM(field, 2));
+    return PyBuffer_FromObject((PyObject *) self, offset, self->n_rows * 8);
+}
+
+// Return: a buffer that refers to the validity bytes of a field
+static PyObject *
+record_array_valid (RecordArrayObject *self, PyObject *args) {
+    PyObject *field = find_record_field(self, args);
+    if (field == NULL)
+        return NULL;
+    Py_ssize_t offset = PyInt_AsSsize_t(PyTuple_GET_ITEM(field, 3));
+    return PyBuffer_FromObject((PyObject *) self, offset, self->n_rows);
+}
+
+static void
+record_array_dealloc (RecordArrayObject *self) {
+    delete self->data;
+    Py_XDECREF(self->fields);
+    PyObject_Del(self);
+}
+
+static Py_ssize_t
+record_array_getreadbuf (RecordArrayObject *self, Py_ssize_t segment, void **ptr) {
+    if (segment != 0) {
+        PyErr_SetString(PyExc_SystemError, "accessing non-existent segment");
+        return -1;
+    }
+    *ptr = (void *) self->data->data();
+    return self->data->size();
+}
+
+static Py_ssize_t
+record_array_getsegcount (RecordArrayObject *self, Py_ssize_t *lenp) {
+    if (lenp != NULL)
+        *lenp = self->data->size();
+    return 1;
+}
+
+static Py_ssize_t
+record_array_getcharbuf (RecordArrayObject *self, Py_ssize_t segment, char **ptr) {
+    return record_array_getreadbuf(self, segment, (void **) ptr);
+}
+
+static int
+record_array_getbuffer (RecordArrayObject *self, Py_buffer *view, int flags) {
+    return PyBuffer_FillInfo(view, (PyObject *) self, (void *) self->data->data(),
+                                self->data->size(), 1, flags);
+}
+
+template <typename T>
+static PyObject *
+pack_array (const std::vector<T> &v) {
+    return PyString_FromStringAndSize(v.empty() ? "" : (const char *) &v[0],
+                                        v.size() * sizeof(T));
+}
+
+// Return: a dict of arrays, or None
+static PyObject *
+dm_collector_c_extract_measurements (PyObject *self, PyObject *args) {
+    (void)self;
+    Py_buffer frame;
+    if (!PyArg_ParseTuple(args, "s*:extract_measurements", &frame))
+        return NULL;
+    MeasArrays arrays;
+    bool success = mkern_extract((const char *) frame.buf, frame.len, &arrays);
+    PyBuffer_Release(&frame);
+    if (!success)
+        Py_RETURN_NONE;
+
+    const char *name = search_name(LogPacketTypeID_To_Name,
+                                    ARRAY_SIZE(LogPacketTypeID_To_Name, ValueName),
+                                    arrays.log_code);
+    if (arrays.log_code == LTE_PHY_Connected_Mode_LTE_Intra_Freq_Meas_Results)
+        return Py_BuildValue("{s:s,s:K,s:I,s:i,s:d,s:d,s:n,s:N,s:N,s:N}",
+                                "type_id", name,
+                                "timestamp", arrays.timestamp,
+                                "earfcn", arrays.earfcn,
+                                "serving_pci", arrays.serving_pci,
+                                "serving_rsrp", (double) arrays.serving_rsrp,
+                                "serving_rsrq", (double) arrays.serving_rsrq,
+                                "n_cells", (Py_ssize_t) arrays.pci.size(),
+                                "pci", pack_array(arrays.pci),
+                                "rsrp", pack_array(arrays.rsrp),
+                                "rsrq", pack_array(arrays.rsrq));
+    if (arrays.log_code == LTE_PHY_Idle_Neighbor_Cell_Meas)
+        return Py_BuildValue("{s:s,s:K,s:n,s:N,s:N,s:N,s:N,s:N}",
+                                "type_id", name,
+                                "timestamp", arrays.timestamp,
+                                "n_cells", (Py_ssize_t) arrays.pci.size(),
+                                "earfcn", pack_array(arrays.cell_earfcn),
+                                "pci", pack_array(arrays.pci),
+                                "rsrp", pack_array(arrays.rsrp),
+                                "rsrq", pack_array(arrays.rsrq),
+                                "rssi", pack_array(arrays.rssi));
+    return Py_BuildValue("{s:s,s:K,s:n,s:N,s:N,s:N,s:N}",
+                            "type_id", name,
+                            "timestamp", arrays.timestamp,
+                            "n_cells", (Py_ssize_t) arrays.rscp.size(),
+                            "uarfcn", pack_array(arrays.uarfcn),
+                            "rscp", pack_array(arrays.rscp),
+                            "rssi", pack_array(arrays.rssi),
+                            "ecno", pack_array(arrays.ecno));
+}
+
+// Return: successful or not
+static PyObject *
+dm_collector_c_dissect_cache_open (PyObject *self, PyObject *args) {
+    (void)self;
+    const char *path;
+    const char *version;
+    unsigned int n_buckets = 0;
+    if (!PyArg_ParseTuple(args, "ss|I", &path, &version, &n_buckets)) {
+        return NULL;
+    }
+    if (dcache_open(&g_dcache, path, version, n_buckets)) {
+        Py_RETURN_TRUE;
+    } else {
+        Py_RETURN_FALSE;
+    }
+}
+
+// Return: None
+static PyObject *
+dm_collector_c_dissect_cache_close (PyObject *self, PyObject *args) {
+    (void)self;
+    (void)args;
+    dcache_close(&g_dcache);
+    Py_RETURN_NONE;
+}
+
+// Return: cached string or None
+static PyObject *
+dm_collector_c_dissect_cache_lookup (PyObject *self, PyObject *args) {
+    (void)self;
+    unsigned int msg_type;
+    const char *b;
+    int length;
+    if (!PyArg_ParseTuple(args, "Is#", &msg_type, &b, &length)) {
+        return NULL;
+    }
+    std::string decoded;
+    if (!dcache_lookup(&g_dcache, msg_type, b, length, decoded)) {
+        Py_RETURN_NONE;
+    }
+    return PyString_FromStringAndSize(decoded.c_str(), decoded.size());
+}
+
+// Return: successful or not
+static PyObject *
+dm_collector_c_dissect_cache_store (PyObject *self, PyObject *args) {
+    (void)self;
+    unsigned int msg_type;
+    const char *b;
+    int length;
+    const char *decoded;
+    int decoded_length;
+    if (!PyArg_ParseTuple(args, "Is#s#", &msg_type, &b, &length,
+                            &decoded, &decoded_length)) {
+        return NULL;
+    }
+    if (dcache_store(&g_dcache, msg_type, b, length, decoded, decoded_length)) {
+        Py_RETURN_TRUE;
+    } else {
+        Py_RETURN_FALSE;
+    }
+}
+
+static void
+acquire_wsshm_lock () {
+    if (!PyThread_acquire_lock(g_wsshm_lock, NOWAIT_LOCK)) {
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(g_wsshm_lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+// Return: successful or not
+static PyObject *
+dm_collector_c_ws_shm_open (PyObject *self, PyObject *args) {
+    (void)self;
+    const char *path;
+    unsigned int capacity = 0;
+    if (!PyArg_ParseTuple(args, "s|I", &path, &capacity)) {
+        return NULL;
+    }
+    acquire_wsshm_lock();
+    bool success = wsshm_open(&g_wsshm, path, capacity);
+    PyThread_release_lock(g_wsshm_lock);
+    if (success) {
+        Py_RETURN_TRUE;
+    } else {
+        Py_RETURN_FALSE;
+    }
+}
+
+// Return: None
+static PyObject *
+dm_collector_c_ws_shm_set_peer (PyObject *self, PyObject *args) {
+    (void)self;
+    int pid;
+    if (!PyArg_ParseTuple(args, "i", &pid)) {
+        return NULL;
+    }
+    acquire_wsshm_lock();
+    wsshm_set_peer(&g_wsshm, pid);
+    PyThread_release_lock(g_wsshm_lock);
+    Py_RETURN_NONE;
+}
+
+// Return: None
+static PyObject *
+dm_collector_c_ws_shm_close (PyObject *self, PyObject *args) {
+    (void)self;
+    (void)args;
+    acquire_wsshm_lock();
+    wsshm_close(&g_wsshm);
+    PyThread_release_lock(g_wsshm_lock);
+    Py_RETURN_NONE;
+}
+
+// Return: decoded string or None
+static PyObject *
+dm_collector_c_ws_shm_decode (PyObject *self, PyObject *args) {
+    (void)self;
+    unsigned int msg_type;
+    const char *b;
+    int length;
+    if (!PyArg_ParseTuple(args, "Is#", &msg_type, &b, &length)) {
+        return NULL;
+    }
+    std::string decoded;
+    bool success;
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(g_wsshm_lock, WAIT_LOCK);
+    success = wsshm_decode(&g_wsshm, msg_type, b, length, decoded);
+    PyThread_release_lock(g_wsshm_lock);
+    Py_END_ALLOW_THREADS
+    if (!success) {
+        Py_RETURN_NONE;
+    }
+    return PyString_FromStringAndSize(decoded.c_str(), decoded.size());
+}
+
+// Offset of the first unconsumed byte of a log file
+static unsigned long long
+reader_position (const LogReaderState *pstate) {
+    return pstate->base_offset + pstate->pos;
+}
+
+// Count a frame read from a log file, and the bytes consumed since *ppos
+static void
+count_reader_frame (const LogReaderState *pstate, unsigned long long *ppos,
+                    bool crc_correct) {
+    unsigned long long pos = reader_position(pstate);
+    if (pos > *ppos)
+        g_perf.bytes_fed += pos - *ppos;
+    *ppos = pos;
+    g_perf.frames++;
+    if (!crc_correct)
+        g_perf.crc_failures++;
+}
+
+static void
+log_reader_dealloc (LogReaderObject *self) {
+    if (self->state != NULL) {
+        lreader_close(self->state);
+        delete self->state;
+    }
+    delete self->filter;
+    PyObject_Del(self);
+}
+
+// Return: the next decoded_list, or NULL at the end of file
+static PyObject *
+log_reader_iternext (LogReaderObject *self) {
+    std::string frame;
+    bool crc_correct = false;
+    unsigned long long pos = reader_position(self->state);
+    while (lreader_next_frame(self->state, frame, crc_correct)) {
+        if (perf_enabled(&g_perf))
+            count_reader_frame(self->state, &pos, crc_correct);
+        if (!crc_correct) {
+            mstats_crc_failure(&g_mstats);
+            continue;
+        }
+        if (self->filter != NULL) {
+            check_frame_format(frame);
+            int keep = lreader_filter_frame(self->filter, frame.c_str(), frame.size());
+            if (keep < 0) {     // past the window
+                lreader_close(self->state);
+                return NULL;
+            }
+            if (keep == 0) {
+                if (perf_enabled(&g_perf))
+                    g_perf.filtered_out++;
+                continue;
+            }
+        }
+        PyObject *decoded = decode_frame(frame, self->skip_decoding);
+        if (decoded != NULL || PyErr_Occurred())
+            return decoded;
+    }
+    return NULL;
+}
+
+// Return: None
+static PyObject *
+log_reader_close (LogReaderObject *self, PyObject *args) {
+    (void)args;
+    lreader_close(self->state);
+    Py_RETURN_NONE;
+}
+
+static void
+frame_block_dealloc (FrameBlockObject *self) {
+    delete self->data;
+    PyObject_Del(self);
+}
+
+static int
+frame_block_getbuffer (FrameBlockObject *self, Py_buffer *view, int flags) {
+    return PyBuffer_FillInfo(view, (PyObject *) self, (void *) self->data->data(),
+                                self->data->size(), 1, flags);
+}
+
+static void
+header_reader_dealloc (HeaderReaderObject *self) {
+    if (self->state != NULL) {
+        lreader_close(self->state);
+        delete self->state;
+    }
+    delete self->filter;
+    Py_XDECREF(self->block);
+    PyObject_Del(self);
+}
+
+// Return: the next (log_code, length, timestamp, frame), or NULL at the end
+// of file
+static PyObject *
+header_reader_iternext (HeaderReaderObject *self) {
+    const size_t BLOCK_SIZE = 256 * 1024;
+    // 16 = 2 (0x1000) + 2 (len1) + 2 (log_msg_len) + 2 (type_id) + 8 (timestamp)
+    const size_t HEADER_LEN = 16;
+    std::string frame;
+    bool crc_correct = false;
+    unsigned long long pos = reader_position(self->state);
+    while (lreader_next_frame(self->state, frame, crc_correct)) {
+        if (perf_enabled(&g_perf))
+            count_reader_frame(self->state, &pos, crc_correct);
+        if (!crc_correct)
+            continue;
+        check_frame_format(frame);
+        if (frame.size() < HEADER_LEN || !is_log_packet(frame.c_str(), frame.size()))
+            continue;
+        if (self->filter != NULL) {
+            int keep = lreader_filter_frame(self->filter, frame.c_str(), frame.size());
+            if (keep < 0) {     // past the window
+                lreader_close(self->state);
+                return NULL;
+            }
+            if (keep == 0) {
+                if (perf_enabled(&g_perf))
+                    g_perf.filtered_out++;
+                continue;
+            }
+        }
+
+        if (self->block == NULL
+                || self->block->data->size() + frame.size() > self->block->data->capacity()) {
+            FrameBlockObject *block = PyObject_New(FrameBlockObject, &FrameBlockType);
+            if (block == NULL)
+                return NULL;
+            block->data = new std::string;
+            block->data->reserve(std::max(BLOCK_SIZE, frame.size()));
+            Py_XDECREF(self->block);
+            self->block = block;
+        }
+        std::string *data = self->block->data;
+        const char *p = data->data() + data->size();
+        data->append(frame);
+
+        unsigned short log_code;
+        unsigned long long timestamp;
+        memcpy(&log_code, p + 6, sizeof(log_code));
+        memcpy(&timestamp, p + 8, sizeof(timestamp));
+        Py_buffer view;
+        if (PyBuffer_FillInfo(&view, (PyObject *) self->block, (void *) p,
+                                frame.size(), 1, PyBUF_FULL_RO) < 0)
+            return NULL;
+        // The memoryview takes over the reference to the block
+        PyObject *mview = PyMemoryView_FromBuffer(&view);
+        if (mview == NULL) {
+            PyBuffer_Release(&view);
+            return NULL;
+        }
+        return Py_BuildValue("(inKN)", (int) log_code, (Py_ssize_t) frame.size(),
+                                timestamp, mview);
+    }
+    return NULL;
+}
+
+// Return: None
+static PyObject *
+header_reader_close (HeaderReaderObject *self, PyObject *args) {
+    (void)args;
+    lreader_close(self->state);
+    Py_RETURN_NONE;
+}
+
+static void
+parallel_replay_dealloc (ParallelReplayObject *self) {
+    if (self->state != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        preplay_close(self->state);
+        Py_END_ALLOW_THREADS
+        delete self->state;
+    }
+    PyObject_Del(self);
+}
+
+// Return: the next decoded_list, or NULL at the end
+static PyObject *
+parallel_replay_iternext (ParallelReplayObject *self) {
+    while (true) {
+        ReplayFrame *frame;
+        Py_BEGIN_ALLOW_THREADS
+        frame = preplay_next(self->state);
+        Py_END_ALLOW_THREADS
+        if (frame == NULL)
+            return NULL;
+        PyObject *decoded = decode_frame(frame->data, self->skip_decoding);
+        if (decoded != NULL || PyErr_Occurred())
+            return decoded;
+    }
+}
+
+// Return: None
+static PyObject *
+parallel_replay_close (ParallelReplayObject *self, PyObject *args) {
+    (void)args;
+    Py_BEGIN_ALLOW_THREADS
+    preplay_close(self->state);
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+// Microseconds since the QCDM epoch of a raw timestamp, computed as the
+// QCDM_TIMESTAMP case of _decode_by_fmt() does
+static long long
+qcdm_to_useconds (unsigned long long timestamp) {
+    const double PER_SECOND = 52428800.0;
+    const double PER_USECOND = 52428800.0 / 1.0e6;
+    int seconds = int(double(timestamp) / PER_SECOND);
+    int useconds = (double(timestamp) / PER_USECOND) - double(seconds) * 1.0e6;
+    return (long long) seconds * 1000000 + useconds;
+}
+
+// Return: the first raw timestamp decoded to usec or later
+static unsigned long long
+first_qcdm_timestamp (long long usec) {
+    if (usec <= 0)
+        return 0;
+    unsigned long long t = (unsigned long long) (usec * 52.4288);
+    // Step over the rounding of both conversions
+    while (t > 0 && qcdm_to_useconds(t - 1) >= usec)
+        t--;
+    while (qcdm_to_useconds(t) < usec)
+        t++;
+    return t;
+}
+
+// Convert a datetime (as in decoded packets) to a raw QCDM timestamp: the
+// first one decoded to that datetime, or the last one if upper_bound is
+// set, so that packets stamped exactly at a bound are included.
+// Return: successful or not. An exception is set on failure.
+static bool
+to_qcdm_timestamp (PyObject *o, unsigned long long *timestamp, bool upper_bound) {
+    PyObject *datetime_mod = PyImport_ImportModule("datetime");
+    if (datetime_mod == NULL)
+        return false;
+    PyObject *epoch = PyObject_CallMethod(datetime_mod, (char *) "datetime",
+                                            (char *) "iii", 1980, 1, 6);
+    Py_DECREF(datetime_mod);
+    if (epoch == NULL)
+        return false;
+    PyObject *delta = PyNumber_Subtract(o, epoch);
+    Py_DECREF(epoch);
+    if (delta == NULL)
+        return false;
+    // Exact microseconds, as timedelta.total_seconds() is a float
+    const char *fields[3] = {"days", "seconds", "microseconds"};
+    long values[3];
+    for (int i = 0; i < 3; i++) {
+        PyObject *v = PyObject_GetAttrString(delta, fields[i]);
+        values[i] = v != NULL ? PyInt_AsLong(v) : -1;
+        Py_XDECREF(v);
+        if (v == NULL || PyErr_Occurred()) {
+            Py_DECREF(delta);
+            return false;
+        }
+    }
+    Py_DECREF(delta);
+    long long usec = ((long long) values[0] * 86400 + values[1]) * 1000000 + values[2];
+    if (!upper_bound)
+        *timestamp = first_qcdm_timestamp(usec);
+    else if (usec < 0)
+        *timestamp = 0;
+    else
+        *timestamp = first_qcdm_timestamp(usec + 1) - 1;
+    return true;
+}
+
+// Set types[log_code] for each type name.
+// Return: successful or not (an exception is set)
+static bool
+build_type_mask (PyObject *type_names, std::vector<bool> &types) {
+    IdVector type_ids;
+    if (!PySequence_Check(type_names)) {
+        PyErr_SetString(PyExc_TypeError, "\'type_names\' is not a sequence.");
+        return false;
+    }
+    if (!map_typenames_to_ids(type_names, type_ids)) {
+        PyErr_SetString(PyExc_ValueError, "Wrong type name.");
+        return false;
+    }
+    types.assign(0x10000, false);
+    for (size_t i = 0; i < type_ids.size(); i++)
+        types[type_ids[i] & 0xFFFF] = true;
+    return true;
+}
+
+static void
+log_index_dealloc (LogIndexObject *self) {
+    if (self->index != NULL) {
+        lindex_close(self->index);
+        delete self->index;
+    }
+    if (self->reader != NULL) {
+        lreader_close(self->reader);
+        delete self->reader;
+    }
+    PyObject_Del(self);
+}
+
+static Py_ssize_t
+log_index_length (LogIndexObject *self) {
+    return self->index->n_frames;
+}
+
+// Return: {type_name: count}
+static PyObject *
+log_index_counts (LogIndexObject *self, PyObject *args) {
+    (void)args;
+    std::vector<size_t> counts(0x10000, 0);
+    for (size_t i = 0; i < self->index->n_frames; i++)
+        counts[self->index->log_codes[i]]++;
+
+    PyObject *ret = PyDict_New();
+    for (int code = 0; code < 0x10000; code++) {
+        if (counts[code] == 0)
+            continue;
+        PyObject *key = build_type_name_key(code);
+        PyObject *value = PyInt_FromSize_t(counts[code]);
+        PyDict_SetItem(ret, key, value);
+        Py_DECREF(key);
+        Py_DECREF(value);
     }
-    Py_DECREF(sequence);
-    Py_DECREF(serial_port);
-    Py_RETURN_TRUE;
+    return ret;
+}
 
-    raise_exception:
-        Py_DECREF(sequence);
-        Py_DECREF(serial_port);
+// Return: frame number
+static PyObject *
+log_index_seek (LogIndexObject *self, PyObject *args) {
+    PyObject *arg_timestamp;
+    unsigned long long timestamp;
+    if (!PyArg_ParseTuple(args, "O:seek", &arg_timestamp))
         return NULL;
+    if (!to_qcdm_timestamp(arg_timestamp, &timestamp, false))
+        return NULL;
+    return PyInt_FromSize_t(lindex_seek(self->index, timestamp));
 }
 
-// Return: successful or not
+// Return: (offset, log_code, timestamp)
 static PyObject *
-dm_collector_c_set_filtered_export (PyObject *self, PyObject *args) {
-    (void)self;
-    const char *path;
-    PyObject *sequence = NULL;
-    IdVector type_ids;
-    bool success = false;
-
-    if (!PyArg_ParseTuple(args, "sO", &path, &sequence)) {
+log_index_frame_info (LogIndexObject *self, PyObject *args) {
+    Py_ssize_t i;
+    if (!PyArg_ParseTuple(args, "n:frame_info", &i))
+        return NULL;
+    if (i < 0 || (size_t) i >= self->index->n_frames) {
+        PyErr_SetString(PyExc_IndexError, "frame number out of range");
         return NULL;
     }
-    Py_INCREF(sequence);
+    return Py_BuildValue("(KiK)", self->index->offsets[i],
+                            (int) self->index->log_codes[i],
+                            self->index->timestamps[i]);
+}
 
-    // Check arguments
-    if (!PySequence_Check(sequence)) {
-        PyErr_SetString(PyExc_TypeError, "\'type_names\' is not a sequence.");
-        goto raise_exception;
-    }
+// Return: a LogIndexIterator
+static PyObject *
+log_index_iterate (LogIndexObject *self, PyObject *args) {
+    PyObject *type_names = Py_None;
+    PyObject *arg_t0 = Py_None;
+    PyObject *arg_t1 = Py_None;
+    PyObject *arg_skip_decoding = NULL;
+    if (!PyArg_ParseTuple(args, "|OOOO:iterate",
+                            &type_names, &arg_t0, &arg_t1, &arg_skip_decoding))
+        return NULL;
 
-    success = map_typenames_to_ids(sequence, type_ids);
-    if (!success) {
-        PyErr_SetString(PyExc_ValueError, "Wrong type name.");
-        goto raise_exception;
-    }
-    Py_DECREF(sequence);
+    unsigned long long t0 = 0, t1 = ~0ULL;
+    if (arg_t0 != Py_None && !to_qcdm_timestamp(arg_t0, &t0, false))
+        return NULL;
+    if (arg_t1 != Py_None && !to_qcdm_timestamp(arg_t1, &t1, true))
+        return NULL;
 
-    manager_change_config(&g_emanager, path, type_ids);
-    Py_RETURN_TRUE;
+    std::vector<bool> *types = NULL;
+    if (type_names != Py_None) {
+        types = new std::vector<bool>;
+        if (!build_type_mask(type_names, *types)) {
+            delete types;
+            return NULL;
+        }
+    }
 
-    raise_exception:
-        Py_DECREF(sequence);
+    LogIndexIterObject *it = PyObject_New(LogIndexIterObject, &LogIndexIterType);
+    if (it == NULL) {
+        delete types;
         return NULL;
+    }
+    Py_INCREF(self);
+    it->owner = self;
+    it->pos = (arg_t0 != Py_None) ? lindex_seek(self->index, t0) : 0;
+    it->types = types;
+    it->t0 = t0;
+    it->t1 = t1;
+    it->skip_decoding = (arg_skip_decoding != NULL
+                            && PyObject_IsTrue(arg_skip_decoding) == 1);
+    return (PyObject *) it;
 }
 
-// Return: successful or not
+// Return: None
 static PyObject *
-dm_collector_c_set_filtered (PyObject *self, PyObject *args) {
-    (void)self;
-    PyObject *sequence = NULL;
-    IdVector type_ids;
-    bool success = false;
+log_index_close (LogIndexObject *self, PyObject *args) {
+    (void)args;
+    lindex_close(self->index);
+    lreader_close(self->reader);
+    Py_RETURN_NONE;
+}
 
-    if (!PyArg_ParseTuple(args, "O", &sequence)) {
-        return NULL;
-    }
-    Py_INCREF(sequence);
+static void
+log_index_iter_dealloc (LogIndexIterObject *self) {
+    Py_XDECREF(self->owner);
+    delete self->types;
+    PyObject_Del(self);
+}
 
-    // Check arguments
-    if (!PySequence_Check(sequence)) {
-        PyErr_SetString(PyExc_TypeError, "\'type_names\' is not a sequence.");
-        goto raise_exception;
+// Return: the next decoded_list, or NULL at the end
+static PyObject *
+log_index_iter_iternext (LogIndexIterObject *self) {
+    const LogIndexState *index = self->owner->index;
+    std::string frame;
+    bool crc_correct = false;
+    for (; self->pos < index->n_frames; self->pos++) {
+        size_t i = self->pos;
+        if (self->types != NULL && !(*self->types)[index->log_codes[i]])
+            continue;
+        if (index->timestamps[i] < self->t0 || index->timestamps[i] > self->t1)
+            continue;
+        if (!lreader_seek(self->owner->reader, index->offsets[i])
+                || !lreader_next_frame(self->owner->reader, frame, crc_correct)
+                || !crc_correct)
+            continue;
+        PyObject *decoded = decode_frame(frame, self->skip_decoding, false);
+        if (decoded != NULL || PyErr_Occurred()) {
+            self->pos++;
+            return decoded;
+        }
     }
+    return NULL;
+}
 
-    success = map_typenames_to_ids(sequence, type_ids);
-    if (!success) {
-        PyErr_SetString(PyExc_ValueError, "Wrong type name.");
-        goto raise_exception;
+// Unpack a (field_name, value, type_str) entry of a decoded_list.
+// Return: borrowed references, or false with an exception set
+static bool
+unpack_entry (PyObject *entry, PyObject **name, PyObject **value, const char **type_str) {
+    if (!PyTuple_Check(entry) || PyTuple_GET_SIZE(entry) != 3) {
+        PyErr_SetString(PyExc_ValueError,
+                        "decoded_list entries must be (name, value, type) tuples");
+        return false;
     }
-    Py_DECREF(sequence);
+    *name = PyTuple_GET_ITEM(entry, 0);
+    *value = PyTuple_GET_ITEM(entry, 1);
+    PyObject *type_obj = PyTuple_GET_ITEM(entry, 2);
+    *type_str = PyString_Check(type_obj) ? PyString_AS_STRING(type_obj) : "";
+    return true;
+}
 
-    manager_change_config(&g_emanager, NULL, type_ids);
-    Py_RETURN_TRUE;
+static PyObject *convert_to_dict (PyObject *decoded_list);
+static PyObject *convert_to_list (PyObject *decoded_list);
 
-    raise_exception:
-        Py_DECREF(sequence);
-        return NULL;
+// Convert the value of an entry: nested "dict" and "list" entries are
+// converted recursively, the others ("msg" or "") are kept as they are.
+static PyObject *
+convert_value (PyObject *value, const char *type_str) {
+    if (strcmp(type_str, "dict") == 0)
+        return convert_to_dict(value);
+    if (strcmp(type_str, "list") == 0)
+        return convert_to_list(value);
+    Py_INCREF(value);
+    return value;
 }
 
-// Return: successful or not
+// Same as DMLogPacket._parse_internal_list_dict()
 static PyObject *
-dm_collector_c_generate_diag_cfg (PyObject *self, PyObject *args) {
-    (void)self;
-    PyObject *file = NULL;
-    PyObject *sequence = NULL;
-    bool success = false;
-    BinaryBuffer buf;
-    IdVector empty;
-
-    if (!PyArg_ParseTuple(args, "OO", &file, &sequence)) {
+convert_to_dict (PyObject *decoded_list) {
+    PyObject *seq = PySequence_Fast(decoded_list, "decoded_list must be a list");
+    if (seq == NULL)
         return NULL;
+    PyObject *d = PyDict_New();
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    for (Py_ssize_t i = 0; d != NULL && i < n; i++) {
+        PyObject *name, *value;
+        const char *type_str;
+        if (!unpack_entry(PySequence_Fast_GET_ITEM(seq, i), &name, &value, &type_str)) {
+            Py_CLEAR(d);
+            break;
+        }
+        PyObject *x = convert_value(value, type_str);
+        if (x == NULL || PyDict_SetItem(d, name, x) < 0)
+            Py_CLEAR(d);
+        Py_XDECREF(x);
     }
-    Py_INCREF(file);
-    Py_INCREF(sequence);
+    Py_DECREF(seq);
+    return d;
+}
 
-    // Check arguments
-    if (!check_file(file)) {
-        PyErr_SetString(PyExc_TypeError, "\'file\' is not a file object.");
-        goto raise_exception;
-    }
-    if (!PySequence_Check(sequence)) {
-        PyErr_SetString(PyExc_TypeError, "\'type_names\' is not a sequence.");
-        goto raise_exception;
+// Same as DMLogPacket._parse_internal_list_list()
+static PyObject *
+convert_to_list (PyObject *decoded_list) {
+    PyObject *seq = PySequence_Fast(decoded_list, "decoded_list must be a list");
+    if (seq == NULL)
+        return NULL;
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    PyObject *lst = PyList_New(n);
+    for (Py_ssize_t i = 0; lst != NULL && i < n; i++) {
+        PyObject *name, *value;
+        const char *type_str;
+        if (!unpack_entry(PySequence_Fast_GET_ITEM(seq, i), &name, &value, &type_str)) {
+            Py_CLEAR(lst);
+            break;
+        }
+        PyObject *x = convert_value(value, type_str);
+        if (x == NULL)
+            Py_CLEAR(lst);
+        else
+            PyList_SET_ITEM(lst, i, x);     // steals the reference
     }
+    Py_DECREF(seq);
+    return lst;
+}
 
-    // Config Headers
-    success = generate_log_config_headers(file, sequence);
-    if (!success) {
-        goto raise_exception;
+static int
+log_packet_init (LogPacketObject *self, PyObject *args, PyObject *kwds) {
+    (void)kwds;
+    PyObject *decoded_list = NULL;
+    if (!PyArg_ParseTuple(args, "O", &decoded_list))
+        return -1;
+    if (!PySequence_Check(decoded_list)) {
+        PyErr_SetString(PyExc_TypeError, "decoded_list must be a list");
+        return -1;
     }
 
-    // Disable previous logs
-    for (int k = 0; k < 2; k++) {
-        if (k == 0) {   // Disable normal log msgs
-            // buf = encode_log_config(DISABLE, empty);
-            buf = encode_log_config(DISABLE_DEBUG, empty);
-        } else {        // Disable debug msgs
-            // buf = encode_log_config(DISABLE_DEBUG, empty);
-            buf = encode_log_config(DISABLE, empty);
-        }
-        if (buf.first != NULL && buf.second != 0) {
-            (void) send_msg(file, buf.first, buf.second);
-            delete [] buf.first;
-            buf.first = NULL;
-        } else {
-            PyErr_SetString(PyExc_RuntimeError, "Log config msg failed to encode.");
-            goto raise_exception;
+    // Look up the header fields once, instead of in every analyzer
+    PyObject *type_id = Py_None, *timestamp = Py_None;
+    Py_ssize_t n = PySequence_Size(decoded_list);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject *entry = PySequence_GetItem(decoded_list, i);
+        if (entry == NULL)
+            return -1;
+        if (PyTuple_Check(entry) && PyTuple_GET_SIZE(entry) == 3) {
+            PyObject *name = PyTuple_GET_ITEM(entry, 0);
+            if (PyString_Check(name)) {
+                if (type_id == Py_None && strcmp(PyString_AS_STRING(name), "type_id") == 0)
+                    type_id = PyTuple_GET_ITEM(entry, 1);
+                else if (timestamp == Py_None
+                            && strcmp(PyString_AS_STRING(name), "timestamp") == 0)
+                    timestamp = PyTuple_GET_ITEM(entry, 1);
+            }
         }
+        // The tuple is still referenced by decoded_list
+        Py_DECREF(entry);
     }
 
-    success = generate_log_config_msgs(file, sequence);
-    if (!success) {
-        goto raise_exception;
-    }
+    Py_INCREF(decoded_list);
+    Py_INCREF(type_id);
+    Py_INCREF(timestamp);
+    Py_CLEAR(self->decoded_list);
+    Py_CLEAR(self->type_id);
+    Py_CLEAR(self->timestamp);
+    Py_CLEAR(self->dict_cache);
+    Py_CLEAR(self->list_cache);
+    self->decoded_list = decoded_list;
+    self->type_id = type_id;
+    self->timestamp = timestamp;
+    return 0;
+}
 
-    // Config End
-    success = generate_log_config_ends(file, sequence);
-    if (!success) {
-        goto raise_exception;
-    }
+static void
+log_packet_dealloc (LogPacketObject *self) {
+    PyObject_GC_UnTrack(self);
+    log_packet_clear(self);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
 
-    Py_DECREF(sequence);
-    Py_DECREF(file);
-    Py_RETURN_TRUE;
+static int
+log_packet_traverse (LogPacketObject *self, visitproc visit, void *arg) {
+    Py_VISIT(self->decoded_list);
+    Py_VISIT(self->type_id);
+    Py_VISIT(self->timestamp);
+    Py_VISIT(self->dict_cache);
+    Py_VISIT(self->list_cache);
+    return 0;
+}
 
-    raise_exception:
-        Py_DECREF(sequence);
-        Py_DECREF(file);
-        return NULL;
+static int
+log_packet_clear (LogPacketObject *self) {
+    Py_CLEAR(self->decoded_list);
+    Py_CLEAR(self->type_id);
+    Py_CLEAR(self->timestamp);
+    Py_CLEAR(self->dict_cache);
+    Py_CLEAR(self->list_cache);
+    return 0;
 }
 
-// Return: None
+// Return: a copy of the cached dict, so that the analyzers receiving the
+// packet cannot change each other's view of it
 static PyObject *
-dm_collector_c_feed_binary (PyObject *self, PyObject *args) {
-    (void)self;
-    const char *b;
-    int length;
-    if (!PyArg_ParseTuple(args, "s#", &b, &length)){
-        // printf("dm_collector_c_feed_binary returns NULL\n");
+log_packet_decode (LogPacketObject *self, PyObject *args) {
+    (void)args;
+    if (self->decoded_list == NULL) {
+        PyErr_SetString(PyExc_ValueError, "LogPacket is not initialized");
         return NULL;
     }
-    feed_binary(b, length);
-    Py_RETURN_NONE;
+    if (self->dict_cache == NULL) {
+        unsigned long long t0 = perf_enabled(&g_perf) ? perf_now_ns() : 0;
+        self->dict_cache = convert_to_dict(self->decoded_list);
+        if (self->dict_cache == NULL)
+            return NULL;
+        if (perf_enabled(&g_perf))
+            perf_timer_add(&g_perf.build, perf_now_ns() - t0);
+    }
+    return PyDict_Copy(self->dict_cache);
 }
 
+// Return: the cached list (a new reference)
 static PyObject *
-dm_collector_c_reset (PyObject *self, PyObject *args) {
-    (void)self;
+log_packet_decode_list (LogPacketObject *self, PyObject *args) {
     (void)args;
-    reset_binary();
-    Py_RETURN_NONE;
+    if (self->decoded_list == NULL) {
+        PyErr_SetString(PyExc_ValueError, "LogPacket is not initialized");
+        return NULL;
+    }
+    if (self->list_cache == NULL) {
+        unsigned long long t0 = perf_enabled(&g_perf) ? perf_now_ns() : 0;
+        self->list_cache = convert_to_list(self->decoded_list);
+        if (self->list_cache == NULL)
+            return NULL;
+        if (perf_enabled(&g_perf))
+            perf_timer_add(&g_perf.build, perf_now_ns() - t0);
+    }
+    Py_INCREF(self->list_cache);
+    return self->list_cache;
 }
 
+// Return: (type, (decoded_list,)), so that the caches are rebuilt on demand.
+// Subclasses whose constructors transform their input (DMLogPacket)
+// override __reduce__.
+static PyObject *
+log_packet_reduce (LogPacketObject *self, PyObject *args) {
+    (void)args;
+    PyObject *decoded_list = self->decoded_list ? self->decoded_list : Py_None;
+    return Py_BuildValue("(O(O))", (PyObject *) Py_TYPE(self), decoded_list);
+}
 
-// Return: decoded_list or None
 static PyObject *
-dm_collector_c_receive_log_packet (PyObject *self, PyObject *args) {
+event_dispatcher_new (PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    (void)args;
+    (void)kwds;
+    EventDispatcherObject *self = (EventDispatcherObject *) type->tp_alloc(type, 0);
+    if (self == NULL)
+        return NULL;
+    self->entries = new std::vector<DispatchEntry>();
+    self->targets = new std::map<int, std::vector<PyObject *> >();
+    self->codes = new std::map<std::string, int>();
+    return (PyObject *) self;
+}
 
-    // (void)self;
+static int
+event_dispatcher_traverse (EventDispatcherObject *self, visitproc visit, void *arg) {
+    if (self->entries == NULL)
+        return 0;
+    for (size_t i = 0; i < self->entries->size(); i++)
+        Py_VISIT((*self->entries)[i].module);
+    return 0;
+}
 
-    std::string frame;
-    bool crc_correct = false;
-    bool skip_decoding = false, include_timestamp = false;  // default values
-    double posix_timestamp = (include_timestamp? get_posix_timestamp(): -1.0);
+static int
+event_dispatcher_clear (EventDispatcherObject *self) {
+    if (self->entries == NULL)
+        return 0;
+    // Modules may be released (and their recv() may run) only after the
+    // containers are consistent again
+    std::vector<DispatchEntry> entries;
+    entries.swap(*self->entries);
+    self->targets->clear();
+    for (size_t i = 0; i < entries.size(); i++)
+        Py_DECREF(entries[i].module);
+    return 0;
+}
 
-    bool success = get_next_frame(frame, crc_correct);
-    // printf("success=%d crc_correct=%d is_log_packet=%d\n", success, crc_correct, is_log_packet(frame.c_str(), frame.size()));
-    // if (success && crc_correct && is_log_packet(frame.c_str(), frame.size())) {
-    if (success && crc_correct) {
-        PyObject *arg_skip_decoding = NULL;
-        PyObject *arg_include_timestamp = NULL;
-        if (!PyArg_ParseTuple(args, "|OO:receive_log_packet",
-                                    &arg_skip_decoding, &arg_include_timestamp))
+static void
+event_dispatcher_dealloc (EventDispatcherObject *self) {
+    PyObject_GC_UnTrack(self);
+    event_dispatcher_clear(self);
+    delete self->entries;
+    delete self->targets;
+    delete self->codes;
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+// Return: the log code of a type name, or -1 if it is not a log packet type
+static int
+dispatch_code (EventDispatcherObject *self, const char *name) {
+    std::map<std::string, int>::const_iterator it = self->codes->find(name);
+    if (it != self->codes->end())
+        return it->second;
+    IdVector ids;
+    int code = -1;
+    if (find_ids(LogPacketTypeID_To_Name,
+                    ARRAY_SIZE(LogPacketTypeID_To_Name, ValueName),
+                    name, ids) > 0)
+        code = ids[0] & 0xFFFF;     // any id of the name is subscribed with it
+    (*self->codes)[name] = code;
+    return code;
+}
+
+static PyObject *
+event_dispatcher_subscribe (EventDispatcherObject *self, PyObject *args) {
+    PyObject *module = NULL;
+    PyObject *type_names = Py_None;
+    if (!PyArg_ParseTuple(args, "O|O", &module, &type_names))
+        return NULL;
+
+    IdVector ids;
+    if (type_names != Py_None) {
+        PyObject *seq = PyString_Check(type_names)
+                        ? Py_BuildValue("(O)", type_names)
+                        : PySequence_Fast(type_names, "type_names is not a sequence");
+        if (seq == NULL)
             return NULL;
-        if (arg_skip_decoding != NULL) {
-            Py_INCREF(arg_skip_decoding);
-            skip_decoding = (PyObject_IsTrue(arg_skip_decoding) == 1);
-            Py_DECREF(arg_skip_decoding);
-        }
-        if (arg_include_timestamp != NULL) {
-            Py_INCREF(arg_include_timestamp);
-            include_timestamp = (PyObject_IsTrue(arg_include_timestamp) == 1);
-            Py_DECREF(arg_include_timestamp);
+        for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+            PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+            if (PyString_Check(item))
+                find_ids(LogPacketTypeID_To_Name,
+                            ARRAY_SIZE(LogPacketTypeID_To_Name, ValueName),
+                            PyString_AS_STRING(item), ids);
         }
+        Py_DECREF(seq);
+    }
 
-        check_frame_format(frame);
+    std::vector<DispatchEntry> &entries = *self->entries;
+    size_t i = 0;
+    while (i < entries.size() && entries[i].module != module)
+        i++;
+    if (i == entries.size()) {
+        DispatchEntry e;
+        Py_INCREF(module);
+        e.module = module;
+        entries.push_back(e);
+    }
+    DispatchEntry &e = entries[i];
+    if (type_names == Py_None) {
+        e.types.clear();
+    } else {
+        // The first types narrow down a module that receives every event
+        if (e.types.empty())
+            e.types.assign(0x10000, false);
+        for (size_t j = 0; j < ids.size(); j++)
+            e.types[ids[j] & 0xFFFF] = true;
+    }
+    self->targets->clear();
+    Py_RETURN_NONE;
+}
 
-        if (!manager_export_binary(&g_emanager, frame.c_str(), frame.size()))
-            Py_RETURN_NONE;
-        if(is_log_packet(frame.c_str(), frame.size())){
-            const char *s = frame.c_str();
-            PyObject *decoded = decode_log_packet(s + 2,  // skip first two bytes
-                                                  frame.size() - 2,
-                                                  skip_decoding);
-            if (include_timestamp) {
-                PyObject *ret = Py_BuildValue("(Od)", decoded, posix_timestamp);
-                Py_DECREF(decoded);
-                return ret;
-            } else {
-                return decoded;
-            }
-        }
-        else if(is_debug_packet(frame.c_str(), frame.size())){
-            //Yuanjie: the original debug msg does not have header...
-
-            unsigned short n_size = frame.size()+sizeof(char)*14;
-
-            unsigned char tmp[14]={
-                0xFF, 0xFF,
-                0x00, 0x00, 0xeb, 0x1f,
-                0x00, 0x00, 0x73, 0xB7,
-                0xB8, 0x65, 0xDD, 0x00
-            };
-            // tmp[2]=(char)(n_size);
-            *(tmp+2)=n_size;
-            *(tmp)=n_size;
-            char *s = new char[n_size];
-            memmove(s,tmp,sizeof(char)*14);
-            memmove(s+sizeof(char)*14,frame.c_str(),frame.size());
-            PyObject *decoded = decode_log_packet_modem(s, n_size, skip_decoding);
-
-            // char *s = new char[n_size];
-            // memset(s,0,sizeof(char)*n_size);
-            // *s = n_size;
-            // *(s+2) = n_size;
-            // *(s+4) = 0xeb;
-            // *(s+5) = 0x1f;
-            // memmove(s+sizeof(char)*14,frame.c_str(),frame.size());
-            // PyObject *decoded = decode_log_packet(s, n_size, skip_decoding);
-
-
-
-            // // The following code does not crash on Android.
-            // // But if use s and frame.size(), it crashes
-            // const char *s = frame.c_str();
-            // PyObject *decoded = decode_log_packet(  s + 2,  // skip first two bytes
-            //                                         frame.size() - 2,
-            //                                         skip_decoding);
-
-            if (include_timestamp) {
-                PyObject *ret = Py_BuildValue("(Od)", decoded, posix_timestamp);
-                Py_DECREF(decoded);
-                // delete [] s; //Yuanjie: bug for it on Android, but no problem on laptop
-                return ret;
-            } else {
-                // delete [] s; //Yuanjie: bug for it on Android, but no problem on laptop
-                return decoded;
-            }
+static PyObject *
+event_dispatcher_unsubscribe (EventDispatcherObject *self, PyObject *args) {
+    PyObject *module = NULL;
+    if (!PyArg_ParseTuple(args, "O", &module))
+        return NULL;
+    std::vector<DispatchEntry> &entries = *self->entries;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].module == module) {
+            entries.erase(entries.begin() + i);
+            self->targets->clear();
+            Py_DECREF(module);
+            Py_RETURN_TRUE;
         }
-        else {
-            Py_RETURN_NONE;
+    }
+    Py_RETURN_FALSE;
+}
+
+static PyObject *
+event_dispatcher_send (EventDispatcherObject *self, PyObject *args) {
+    PyObject *source = NULL, *event = NULL;
+    if (!PyArg_ParseTuple(args, "OO", &source, &event))
+        return NULL;
+    PyObject *type_id = PyObject_GetAttrString(event, "type_id");
+    if (type_id == NULL)
+        return NULL;
+    int code = PyString_Check(type_id) ? dispatch_code(self, PyString_AS_STRING(type_id)) : -1;
+    Py_DECREF(type_id);
+
+    std::map<int, std::vector<PyObject *> >::iterator it = self->targets->find(code);
+    if (it == self->targets->end()) {
+        std::vector<PyObject *> modules;
+        for (size_t i = 0; i < self->entries->size(); i++) {
+            const DispatchEntry &e = (*self->entries)[i];
+            if (code < 0 || e.types.empty() || e.types[code])
+                modules.push_back(e.module);
         }
+        it = self->targets->insert(std::make_pair(code, modules)).first;
+    }
 
-    } else {
-        Py_RETURN_NONE;
+    // recv() may change the subscriptions, so the modules are held until
+    // they are called
+    std::vector<PyObject *> modules = it->second;
+    for (size_t i = 0; i < modules.size(); i++)
+        Py_INCREF(modules[i]);
+    static PyObject *recv_name = PyString_InternFromString("recv");
+    PyObject *ret = Py_None;
+    for (size_t i = 0; i < modules.size() && ret != NULL; i++) {
+        ret = PyObject_CallMethodObjArgs(modules[i], recv_name, source, event, NULL);
+        Py_XDECREF(ret);
     }
+    for (size_t i = 0; i < modules.size(); i++)
+        Py_DECREF(modules[i]);
+    if (ret == NULL)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+// Finish a compressed log that is still being written.
+static void
+close_export (void) {
+    manager_close(&g_emanager);
 }
 
 // Init the module
@@ -746,6 +4114,22 @@ initdm_collector_c(void)
         }
     }
 
+    if (PyType_Ready(&LogReaderType) < 0
+            || PyType_Ready(&HeaderReaderType) < 0
+            || PyType_Ready(&FrameBlockType) < 0
+            || PyType_Ready(&LogIndexType) < 0
+            || PyType_Ready(&LogIndexIterType) < 0
+            || PyType_Ready(&ParallelReplayType) < 0
+            || PyType_Ready(&LogPacketType) < 0
+            || PyType_Ready(&RecordArrayType) < 0
+            || PyType_Ready(&EventDispatcherType) < 0)
+        return;
+
+    Py_INCREF(&LogPacketType);
+    PyModule_AddObject(dm_collector_c, "LogPacket", (PyObject *) &LogPacketType);
+    Py_INCREF(&EventDispatcherType);
+    PyModule_AddObject(dm_collector_c, "EventDispatcher", (PyObject *) &EventDispatcherType);
+
     PyObject_SetAttrString(dm_collector_c, "log_packet_types", log_packet_types);
     Py_DECREF(log_packet_types);
 
@@ -755,4 +4139,13 @@ initdm_collector_c(void)
     Py_DECREF(pystr);
 
     manager_init_state(&g_emanager);
+    Py_AtExit(close_export);
+    chronicle_init_state(&g_chronicle);
+    taggr_init_state(&g_taggr);
+    rtrack_init_state(&g_rtracker);
+    mstats_init_state(&g_mstats);
+    perf_init_state(&g_perf);
+    dcache_init_state(&g_dcache);
+    wsshm_init_state(&g_wsshm);
+    g_wsshm_lock = PyThread_allocate_lock();
 }
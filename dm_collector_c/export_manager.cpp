@@ -13,6 +13,17 @@
 #include "log_packet.h"
 #include "log_packet_helper.h"
 
+#include <cstring>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
+// Frames are handed to the async writer in buffers of this size
+static const size_t ASYNC_BUFFER_SIZE = 256 * 1024;
+
 // A simple but dirty function to retrieve type ID.
 // Return -1 if the packet is not recognized
 static int
@@ -33,9 +44,162 @@ manager_init_state (struct ExportManagerState *pstate) {
     pstate->log_fp = NULL;
     pstate->filename = "";
     pstate->whitelist.clear();
+    pstate->compressed = false;
+    clog_writer_init(&pstate->clog);
+    pstate->path_template = "";
+    pstate->max_size = 0;
+    pstate->max_seconds = 0;
+    pstate->preallocate = 0;
+    pstate->part_filename = "";
+    pstate->segment_bytes = 0;
+    pstate->segment_start = 0;
+    pstate->last_filename = "";
+    pstate->n_collisions = 0;
+    pstate->rename_errors = 0;
+    pstate->total_bytes = 0;
+    pstate->async = false;
+    awriter_init_state(&pstate->awriter);
+    pstate->pending.clear();
     return;
 }
 
+static bool
+async_enabled (const struct ExportManagerState *pstate) {
+    return pstate->async && !pstate->compressed && pstate->log_fp != NULL;
+}
+
+// Hand the buffered frames to the writer; they end at segment_bytes.
+static void
+flush_pending (struct ExportManagerState *pstate) {
+    if (pstate->pending.empty())
+        return;
+    unsigned long long offset = pstate->segment_bytes - pstate->pending.size();
+    if (!awriter_submit(&pstate->awriter, fileno(pstate->log_fp), offset,
+                        pstate->pending)) {
+        // the writer is gone, write synchronously
+        if (fseek(pstate->log_fp, (long) offset, SEEK_SET) == 0) {
+            size_t cnt = fwrite(pstate->pending.data(), 1, pstate->pending.size(),
+                                pstate->log_fp);
+            (void)cnt;
+        }
+        pstate->pending.clear();
+    }
+}
+
+static bool
+rotation_enabled (const struct ExportManagerState *pstate) {
+    return pstate->max_size > 0 || pstate->max_seconds > 0;
+}
+
+// Expand the template with the segment start time. Segments that would get
+// the same name are numbered, e.g. "log.1.mi2log".
+static std::string
+segment_filename (struct ExportManagerState *pstate, time_t t) {
+    char buf[1024];
+    struct tm tm_local;
+#ifdef _WIN32
+    tm_local = *localtime(&t);
+#else
+    localtime_r(&t, &tm_local);
+#endif
+    std::string name = pstate->path_template;
+    if (strftime(buf, sizeof(buf), pstate->path_template.c_str(), &tm_local) > 0)
+        name = buf;
+    if (name != pstate->last_filename) {
+        pstate->last_filename = name;
+        pstate->n_collisions = 0;
+        return name;
+    }
+    pstate->n_collisions++;
+    size_t dot = name.rfind('.');
+    size_t slash = name.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = name.size();
+    char suffix[32];
+    sprintf(suffix, ".%d", pstate->n_collisions);
+    return name.substr(0, dot) + suffix + name.substr(dot);
+}
+
+// Open the file that new frames go to.
+static void
+open_segment (struct ExportManagerState *pstate) {
+    if (rotation_enabled(pstate)) {
+        pstate->segment_start = time(NULL);
+        pstate->filename = segment_filename(pstate, pstate->segment_start);
+        pstate->part_filename = pstate->filename + ".part";
+    } else {
+        pstate->filename = pstate->path_template;
+        pstate->part_filename = "";
+    }
+    pstate->segment_bytes = 0;
+    pstate->log_fp = fopen(pstate->part_filename.empty() ? pstate->filename.c_str()
+                                                         : pstate->part_filename.c_str(), "wb");
+    pstate->compressed = clog_is_compressed_path(pstate->filename.c_str());
+    if (pstate->log_fp == NULL)
+        return;
+    if (pstate->compressed && !clog_writer_open(&pstate->clog, pstate->log_fp)) {
+        fclose(pstate->log_fp);
+        pstate->log_fp = NULL;
+        return;
+    }
+#ifdef __linux__
+    // Reserve blocks without changing the file size, so a crashed capture
+    // does not leave a zero-filled tail.
+    if (pstate->preallocate > 0)
+        (void) fallocate(fileno(pstate->log_fp), FALLOC_FL_KEEP_SIZE,
+                            0, pstate->preallocate);
+#endif
+}
+
+// Close the current file; a finished segment is renamed to its final name.
+static void
+close_segment (struct ExportManagerState *pstate) {
+    if (pstate->log_fp == NULL)
+        return;
+    if (async_enabled(pstate)) {
+        flush_pending(pstate);
+        awriter_drain(&pstate->awriter);
+    }
+    if (pstate->compressed)
+        clog_writer_finish(&pstate->clog);
+    fclose(pstate->log_fp);
+    pstate->log_fp = NULL;
+    pstate->compressed = false;
+    if (!pstate->part_filename.empty()) {
+#ifdef _WIN32
+        remove(pstate->filename.c_str());
+#endif
+        // On failure the .part file is kept, so nothing is lost
+        if (rename(pstate->part_filename.c_str(), pstate->filename.c_str()) != 0)
+            pstate->rename_errors++;
+        pstate->part_filename = "";
+    }
+}
+
+// Return: bytes written to the current file
+static unsigned long long
+segment_size (const struct ExportManagerState *pstate) {
+    if (pstate->compressed)
+        return pstate->clog.file_offset;
+    return pstate->segment_bytes;
+}
+
+// Start a new segment if the current one is full or too old.
+static void
+check_rotation (struct ExportManagerState *pstate, size_t length) {
+    if (!rotation_enabled(pstate))
+        return;
+    unsigned long long size = segment_size(pstate);
+    bool full = pstate->max_size > 0 && size > 0
+                    && size + length > pstate->max_size;
+    bool expired = pstate->max_seconds > 0
+                    && time(NULL) - pstate->segment_start >= (time_t) pstate->max_seconds;
+    if (full || expired) {
+        close_segment(pstate);
+        open_segment(pstate);
+    }
+}
+
 bool
 manager_export_binary (struct ExportManagerState *pstate, const char *b, size_t length) {
 
@@ -44,8 +208,22 @@ manager_export_binary (struct ExportManagerState *pstate, const char *b, size_t
 
         if (pstate->log_fp != NULL) {
             std::string frame = encode_hdlc_frame(b, (int) length);
-            size_t cnt = fwrite(frame.c_str(), sizeof(char), frame.size(), pstate->log_fp);
-            (void)cnt;
+            check_rotation(pstate, frame.size());
+            if (pstate->log_fp != NULL)
+                pstate->total_bytes += frame.size();
+            if (pstate->log_fp == NULL) {
+                // failed to open the next segment
+            } else if (pstate->compressed) {
+                clog_write(&pstate->clog, frame.c_str(), frame.size());
+            } else if (async_enabled(pstate)) {
+                pstate->pending.append(frame);
+                pstate->segment_bytes += frame.size();
+                if (pstate->pending.size() >= ASYNC_BUFFER_SIZE)
+                    flush_pending(pstate);
+            } else {
+                size_t cnt = fwrite(frame.c_str(), sizeof(char), frame.size(), pstate->log_fp);
+                pstate->segment_bytes += cnt;
+            }
         }
         return true;
     }
@@ -56,15 +234,49 @@ manager_export_binary (struct ExportManagerState *pstate, const char *b, size_t
 void
 manager_change_config (struct ExportManagerState *pstate,
                         const char *new_path, const IdVector &whitelist) {
-    if (pstate->log_fp != NULL && new_path != NULL && pstate->filename != new_path) {   // close old file
-        fclose(pstate->log_fp);
-        pstate->log_fp = NULL;
-        pstate->filename = "";
+    if (pstate->log_fp != NULL && new_path != NULL && pstate->path_template != new_path) {   // close old file
+        manager_close(pstate);
     }
     if (pstate->log_fp == NULL && new_path != NULL) {   // open new file if necessary
-        pstate->log_fp = fopen(new_path, "wb");
-        pstate->filename = new_path;
+        pstate->path_template = new_path;
+        open_segment(pstate);
     }
     pstate->whitelist.clear();
     pstate->whitelist.insert(whitelist.begin(), whitelist.end());
 }
+
+void
+manager_close (struct ExportManagerState *pstate) {
+    close_segment(pstate);
+    pstate->filename = "";
+    pstate->path_template = "";
+}
+
+void
+manager_set_rotation (struct ExportManagerState *pstate,
+                        unsigned long long max_size, unsigned int max_seconds,
+                        unsigned long long preallocate) {
+    pstate->max_size = max_size;
+    pstate->max_seconds = max_seconds;
+    pstate->preallocate = preallocate;
+}
+
+bool
+manager_set_async (struct ExportManagerState *pstate, int n_threads,
+                    size_t max_inflight) {
+    if (async_enabled(pstate)) {
+        flush_pending(pstate);
+        awriter_drain(&pstate->awriter);
+        // continue with stdio after the last asynchronous write
+        if (fseek(pstate->log_fp, (long) pstate->segment_bytes, SEEK_SET) != 0)
+            return false;
+    }
+    awriter_stop(&pstate->awriter);
+    pstate->async = false;
+    if (n_threads < 0)
+        return true;
+    if (pstate->log_fp != NULL)
+        fflush(pstate->log_fp);     // later writes bypass stdio
+    pstate->async = awriter_start(&pstate->awriter, n_threads, max_inflight);
+    return pstate->async;
+}
@@ -1,23 +1,61 @@
 #ifndef __DM_COLLECTOR_C_EXPORT_MANAGER_H__
 #define __DM_COLLECTOR_C_EXPORT_MANAGER_H__
 
+#include "async_writer.h"
+#include "compressed_log.h"
 #include "utils.h"
 
 #include <set>
 #include <string>
 #include <cstdio>
+#include <ctime>
 
 // Manage the output of logs.
+// With rotation enabled, the configured path is a strftime() template. Each
+// segment is written to "<name>.part" and renamed to its final name once it
+// is closed, so that only complete segments are visible under the template.
 struct ExportManagerState {
     FILE *log_fp;   // Point to the current log.
     std::string filename;
     std::set<int> whitelist;
+    bool compressed;    // write a .mi2logz log
+    struct CompressedLogWriter clog;
+
+    // Rotation
+    std::string path_template;
+    unsigned long long max_size;    // bytes per segment, 0 if unlimited
+    unsigned int max_seconds;       // seconds per segment, 0 if unlimited
+    unsigned long long preallocate; // bytes reserved for each segment
+    std::string part_filename;      // "<name>.part" of the current segment
+    unsigned long long segment_bytes;
+    time_t segment_start;
+    std::string last_filename;      // strftime() name of the last opened
+                                    // segment, before collision suffixes
+    int n_collisions;               // segments sharing the same name
+    unsigned long long rename_errors;   // segments left as "<name>.part"
+    unsigned long long total_bytes; // HDLC bytes exported, over all segments
+
+    // Asynchronous output of uncompressed logs
+    bool async;
+    struct AsyncWriterState awriter;
+    std::string pending;            // frames not yet handed to awriter
 };
 
 // Must be called before usage
 void manager_init_state (struct ExportManagerState *pstate);
 void manager_change_config (struct ExportManagerState *pstate,
                             const char *new_path, const IdVector &whitelist);
+// Close the current log, and finish it if it is compressed.
+void manager_close (struct ExportManagerState *pstate);
+// Cut the log into segments. Takes effect on the next configured path.
+void manager_set_rotation (struct ExportManagerState *pstate,
+                            unsigned long long max_size, unsigned int max_seconds,
+                            unsigned long long preallocate);
+// Write logs in the background, with at most max_inflight bytes queued.
+// n_threads < 0 disables it.
+// Return: successful or not
+bool manager_set_async (struct ExportManagerState *pstate, int n_threads,
+                        size_t max_inflight);
 
 // Export raw msgs that are in the whitelist
 bool manager_export_binary (struct ExportManagerState *pstate, const char *b, size_t length);
@@ -0,0 +1,173 @@
+/* fd_reader.cpp
+ * Reads a live file descriptor into the HDLC deframer without going
+ * through Python for every block.
+ */
+
+#include "fd_reader.h"
+#include "hdlc.h"
+
+#include <cerrno>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+static const size_t FDREADER_READ_SIZE = 256 * 1024;
+
+void
+fdreader_init_state (struct FdReaderState *pstate) {
+    pstate->fd = -1;
+    pstate->epfd = -1;
+    pstate->chronicle = false;
+    pstate->eof = false;
+    pstate->old_flags = 0;
+    pstate->buf.clear();
+    pstate->bytes_read = 0;
+    pstate->reads = 0;
+    pstate->wakeups = 0;
+}
+
+#ifndef _WIN32
+
+bool
+fdreader_attach (struct FdReaderState *pstate, int fd, bool chronicle) {
+    fdreader_detach(pstate);
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return false;
+    pstate->fd = fd;
+    pstate->old_flags = flags;
+    pstate->chronicle = chronicle;
+    pstate->buf.resize(FDREADER_READ_SIZE);
+#ifdef __linux__
+    pstate->epfd = epoll_create(1);
+    if (pstate->epfd >= 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(pstate->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            // e.g. a regular file, which is always readable
+            close(pstate->epfd);
+            pstate->epfd = -1;
+        }
+    }
+#endif
+    return true;
+}
+
+void
+fdreader_detach (struct FdReaderState *pstate) {
+    if (pstate->fd >= 0)
+        (void) fcntl(pstate->fd, F_SETFL, pstate->old_flags);
+    if (pstate->epfd >= 0)
+        close(pstate->epfd);
+    fdreader_init_state(pstate);
+}
+
+int
+fdreader_wait (struct FdReaderState *pstate, int timeout_ms) {
+    if (pstate->fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    while (true) {
+        int n;
+#ifdef __linux__
+        if (pstate->epfd >= 0) {
+            struct epoll_event ev;
+            n = epoll_wait(pstate->epfd, &ev, 1, timeout_ms);
+        } else
+#endif
+        {
+            struct pollfd p;
+            p.fd = pstate->fd;
+            p.events = POLLIN;
+            n = poll(&p, 1, timeout_ms);
+        }
+        if (n < 0 && errno == EINTR)
+            continue;   // the remaining timeout is not tracked
+        return n;
+    }
+}
+
+int
+fdreader_feed (struct FdReaderState *pstate,
+                struct ChronicleParserState *chronicle,
+                std::vector<ChronicleEvent> &events) {
+    if (pstate->fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    pstate->wakeups++;
+
+    bool fed = false;
+    while (true) {
+        ssize_t n = read(pstate->fd, &pstate->buf[0], pstate->buf.size());
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return fed ? 1 : 0;
+            return -1;
+        }
+        if (n == 0) {
+            pstate->eof = true;
+            return fed ? 1 : 2;
+        }
+        pstate->reads++;
+        pstate->bytes_read += n;
+        fed = true;
+        if (pstate->chronicle) {
+            chronicle_process(chronicle, &pstate->buf[0], n, events);
+        } else {
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            feed_binary_timestamped(&pstate->buf[0], n,
+                                    tv.tv_sec + tv.tv_usec / 1.0e6);
+        }
+        if ((size_t) n < pstate->buf.size())
+            return 1;   // most likely drained; avoid an extra read()
+    }
+}
+
+#else   // _WIN32: not supported
+
+bool
+fdreader_attach (struct FdReaderState *pstate, int fd, bool chronicle) {
+    (void)pstate;
+    (void)fd;
+    (void)chronicle;
+    return false;
+}
+
+void
+fdreader_detach (struct FdReaderState *pstate) {
+    fdreader_init_state(pstate);
+}
+
+int
+fdreader_wait (struct FdReaderState *pstate, int timeout_ms) {
+    (void)pstate;
+    (void)timeout_ms;
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+fdreader_feed (struct FdReaderState *pstate,
+                struct ChronicleParserState *chronicle,
+                std::vector<ChronicleEvent> &events) {
+    (void)pstate;
+    (void)chronicle;
+    (void)events;
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __DM_COLLECTOR_C_FD_READER_H__
+#define __DM_COLLECTOR_C_FD_READER_H__
+
+#include <vector>
+#include <cstddef>
+
+#include "chronicle_parser.h"
+
+// Live ingestion from a file descriptor (e.g. the diag_revealer FIFO).
+// The fd is switched to non-blocking mode and waited on with epoll (poll()
+// on other POSIX systems). Everything readable is fed to the HDLC deframer,
+// either as raw HDLC bytes or through the chronicle parser.
+struct FdReaderState {
+    int fd;                 // -1 if detached
+    int epfd;               // -1 if poll() is used
+    bool chronicle;         // the fd carries the diag_revealer chunk stream
+    bool eof;
+    int old_flags;          // to restore on detach
+    std::vector<char> buf;
+    unsigned long long bytes_read;
+    unsigned long long reads;
+    unsigned long long wakeups;
+};
+
+// Must be called before usage
+void fdreader_init_state (struct FdReaderState *pstate);
+
+// Return: successful or not
+bool fdreader_attach (struct FdReaderState *pstate, int fd, bool chronicle);
+void fdreader_detach (struct FdReaderState *pstate);
+
+// Wait at most timeout_ms (-1: forever) until the fd is readable. Only the
+// fd is touched, so this is the part to run without the GIL.
+// Return: > 0 if readable (or closed), 0 on timeout, -1 on error
+int fdreader_wait (struct FdReaderState *pstate, int timeout_ms);
+// Feed everything that can be read without blocking to the deframer (or
+// the chronicle parser).
+// Return: 1 if data was fed, 0 if nothing was readable, -1 on error (errno
+// is set), 2 at the end of file (the writer closed the fd)
+int fdreader_feed (struct FdReaderState *pstate,
+                    struct ChronicleParserState *chronicle,
+                    std::vector<ChronicleEvent> &events);
+
+#endif  // __DM_COLLECTOR_C_FD_READER_H__
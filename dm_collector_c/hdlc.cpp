@@ -3,6 +3,9 @@
 #include "hdlc.h"
 
 #include <string>
+#include <deque>
+#include <utility>
+#include <cstring>
 
 static const int ESCAPE_XOR = 0x20;
 
@@ -87,49 +90,52 @@ encode_hdlc_frame (const char *payld, int length) {
 }
 
 static std::string buffer;
+// Timestamps of the fed bytes: (stream offset where they end, timestamp)
+static std::deque<std::pair<UINT64, double> > timestamp_marks;
+static UINT64 consumed = 0;     // stream offset of buffer[0]
 
 void
 feed_binary (const char *b, int length) {
     buffer.append(b, length);
+    if (!timestamp_marks.empty())
+        timestamp_marks.push_back(std::make_pair(consumed + buffer.size(), -1.0));
+}
+
+void
+feed_binary_timestamped (const char *b, size_t length, double timestamp) {
+    buffer.append(b, length);
+    if (!timestamp_marks.empty() && timestamp_marks.back().second == timestamp)
+        timestamp_marks.back().first = consumed + buffer.size();
+    else
+        timestamp_marks.push_back(std::make_pair(consumed + buffer.size(), timestamp));
 }
 
 void
 reset_binary() {
+    consumed += buffer.size();
     buffer.clear();
+    timestamp_marks.clear();
 }
 
-static void
-unescape (std::string& frame) {
-    bool esc = false;
-    std::string output;
-    for (size_t i = 0; i < frame.size(); i++) {
-        if (esc) {
-            output.append(1, char(frame[i] ^ ESCAPE_XOR));
-            esc = false;
-        } else if (frame[i] == '\x7d') {
-            esc = true;
-        } else {
-            output.append(1, frame[i]);
+bool
+deframe (const char *b, size_t length, std::string& output_frame) {
+    output_frame.clear();
+    output_frame.reserve(length);
+    const char *end = b + length;
+    while (b < end) {
+        const char *esc = (const char *) memchr(b, '\x7d', end - b);
+        if (esc == NULL) {
+            output_frame.append(b, end - b);
+            break;
         }
+        output_frame.append(b, esc - b);
+        if (esc + 1 < end)
+            output_frame.append(1, char(esc[1] ^ ESCAPE_XOR));
+        b = esc + 2;
     }
-    frame = output;
-    return;
-}
 
-// Return: if there is new frame or not
-bool
-get_next_frame (std::string& output_frame, bool& crc_correct) {
-    size_t delim = buffer.find('\x7e');
-    if (delim == std::string::npos)
+    if (output_frame.size() <= 2)
         return false;
-    output_frame = buffer.substr(0, delim);
-    buffer.erase(0, delim + 1);
-
-    unescape(output_frame);
-    if (output_frame.size() <= 2) {
-        crc_correct = false;
-        return true;
-    }
     // little endian
     UINT16 b1 = output_frame[output_frame.size() - 1] & 0xFF;
     UINT16 b2 = output_frame[output_frame.size() - 2] & 0xFF;
@@ -137,8 +143,25 @@ get_next_frame (std::string& output_frame, bool& crc_correct) {
     output_frame.erase(output_frame.size() - 2);
 
     UINT16 crc16 = calc_crc((UINT8 *) output_frame.c_str(), output_frame.size(), 0);
+    return frame_crc16 == crc16;
+}
 
-    crc_correct = (frame_crc16 == crc16);
+// Return: if there is new frame or not
+bool
+get_next_frame (std::string& output_frame, bool& crc_correct, double *timestamp) {
+    size_t delim = buffer.find('\x7e');
+    if (delim == std::string::npos)
+        return false;
+    crc_correct = deframe(buffer.c_str(), delim, output_frame);
+
+    UINT64 end = consumed + delim;
+    while (!timestamp_marks.empty() && timestamp_marks.front().first <= end)
+        timestamp_marks.pop_front();
+    if (timestamp != NULL)
+        *timestamp = timestamp_marks.empty() ? -1.0 : timestamp_marks.front().second;
+
+    buffer.erase(0, delim + 1);
+    consumed += delim + 1;
     return true;
 }
 
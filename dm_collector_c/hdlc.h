@@ -5,8 +5,17 @@
 
 std::string encode_hdlc_frame (const char *payld, int length);
 void feed_binary (const char *b, int length);
+// Feed bytes received at a POSIX timestamp. A frame gets the timestamp of
+// the bytes that complete it.
+void feed_binary_timestamped (const char *b, size_t length, double timestamp);
 void reset_binary ();
-bool get_next_frame (std::string& output_frame, bool& crc_correct);
+// If timestamp is given, it is set to the timestamp of the frame, or -1.0
+// if the frame was fed without timestamp.
+bool get_next_frame (std::string& output_frame, bool& crc_correct,
+                        double *timestamp = NULL);
+// Unescape a frame (without the trailing 0x7e) and remove its CRC.
+// Return: if the CRC is correct or not
+bool deframe (const char *b, size_t length, std::string& output_frame);
 void check_frame_format (std::string& output_frame);
 
 #endif  // __DM_COLLECTOR_C_HDLC_H__
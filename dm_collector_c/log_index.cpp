@@ -0,0 +1,200 @@
+/* log_index.cpp
+ * Builds and reads the sidecar frame index of a log file.
+ */
+
+#include <Python.h>
+
+#include "log_index.h"
+#include "log_reader.h"
+#include "hdlc.h"
+#include "log_packet.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include <sys/stat.h>
+
+typedef unsigned short     UINT16;
+typedef unsigned long long UINT64;
+typedef long long          INT64;
+
+static const char LINDEX_MAGIC[8] = {'M', 'I', 'I', 'N', 'D', 'E', 'X', '1'};
+
+struct LogIndexHeader {
+    char magic[8];
+    UINT64 log_size;    // size of the log file when indexed
+    INT64 log_mtime;    // modification time of the log file when indexed
+    UINT64 n_frames;
+};
+
+static size_t
+index_size (UINT64 n_frames) {
+    return sizeof(LogIndexHeader) + n_frames * (2 * sizeof(UINT64) + sizeof(UINT16));
+}
+
+void
+lindex_init_state (struct LogIndexState *pstate) {
+    pstate->base = NULL;
+    pstate->mapped_size = 0;
+    pstate->n_frames = 0;
+    pstate->offsets = NULL;
+    pstate->timestamps = NULL;
+    pstate->log_codes = NULL;
+    pstate->max_timestamps.clear();
+}
+
+bool
+lindex_build (const char *log_path, const char *index_path) {
+    struct stat st;
+    if (stat(log_path, &st) != 0)
+        return false;
+    LogReaderState reader;
+    lreader_init_state(&reader);
+    if (!lreader_open(&reader, log_path))
+        return false;
+
+    std::vector<UINT64> offsets;
+    std::vector<UINT64> timestamps;
+    std::vector<UINT16> log_codes;
+    std::string frame;
+    bool crc_correct = false;
+    while (lreader_next_frame(&reader, frame, crc_correct)) {
+        if (!crc_correct)
+            continue;
+        check_frame_format(frame);
+        // 16 = 2 (0x1000) + 2 (len1) + 2 (log_msg_len) + 2 (type_id) + 8 (timestamp)
+        if (!is_log_packet(frame.c_str(), frame.size()) || frame.size() < 16)
+            continue;
+        UINT16 log_code;
+        UINT64 timestamp;
+        memcpy(&log_code, frame.c_str() + 6, sizeof(log_code));
+        memcpy(&timestamp, frame.c_str() + 8, sizeof(timestamp));
+        offsets.push_back(reader.frame_offset);
+        timestamps.push_back(timestamp);
+        log_codes.push_back(log_code);
+    }
+    lreader_close(&reader);
+
+    // Write to a temporary file first, so that readers never see a
+    // partial index.
+    std::string tmp_path = std::string(index_path) + ".tmp";
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == NULL)
+        return false;
+    LogIndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, LINDEX_MAGIC, sizeof(LINDEX_MAGIC));
+    h.log_size = st.st_size;
+    h.log_mtime = st.st_mtime;
+    h.n_frames = offsets.size();
+    size_t n = offsets.size();
+    bool success = fwrite(&h, sizeof(h), 1, fp) == 1
+            && (n == 0 || (fwrite(&offsets[0], sizeof(UINT64), n, fp) == n
+                            && fwrite(&timestamps[0], sizeof(UINT64), n, fp) == n
+                            && fwrite(&log_codes[0], sizeof(UINT16), n, fp) == n));
+    success = (fclose(fp) == 0) && success;
+#ifdef _WIN32
+    remove(index_path);
+#endif
+    if (!success || rename(tmp_path.c_str(), index_path) != 0) {
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Map the index file, or read it into memory where mmap() is unavailable.
+static bool
+load_index_file (struct LogIndexState *pstate, const char *index_path) {
+#ifndef _WIN32
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(LogIndexHeader)) {
+        close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    pstate->base = (char *) p;
+    pstate->mapped_size = st.st_size;
+    return true;
+#else
+    FILE *fp = fopen(index_path, "rb");
+    if (fp == NULL)
+        return false;
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || (size_t) st.st_size < sizeof(LogIndexHeader)) {
+        fclose(fp);
+        return false;
+    }
+    pstate->base = new char[st.st_size];
+    pstate->mapped_size = st.st_size;
+    bool success = fread(pstate->base, 1, st.st_size, fp) == (size_t) st.st_size;
+    fclose(fp);
+    return success;
+#endif
+}
+
+bool
+lindex_open (struct LogIndexState *pstate,
+                const char *log_path, const char *index_path) {
+    lindex_close(pstate);
+    struct stat log_st;
+    if (stat(log_path, &log_st) != 0)
+        return false;
+    if (!load_index_file(pstate, index_path)) {
+        lindex_close(pstate);
+        return false;
+    }
+
+    const LogIndexHeader *h = (const LogIndexHeader *) pstate->base;
+    if (memcmp(h->magic, LINDEX_MAGIC, sizeof(LINDEX_MAGIC)) != 0
+            || h->log_size != (UINT64) log_st.st_size
+            || h->log_mtime != (INT64) log_st.st_mtime
+            || index_size(h->n_frames) != pstate->mapped_size) {
+        lindex_close(pstate);
+        return false;
+    }
+    size_t n = h->n_frames;
+    pstate->n_frames = n;
+    pstate->offsets = (const UINT64 *) (pstate->base + sizeof(LogIndexHeader));
+    pstate->timestamps = pstate->offsets + n;
+    pstate->log_codes = (const UINT16 *) (pstate->timestamps + n);
+
+    pstate->max_timestamps.resize(n);
+    UINT64 max_ts = 0;
+    for (size_t i = 0; i < n; i++) {
+        max_ts = std::max(max_ts, pstate->timestamps[i]);
+        pstate->max_timestamps[i] = max_ts;
+    }
+    return true;
+}
+
+void
+lindex_close (struct LogIndexState *pstate) {
+    if (pstate->base != NULL) {
+#ifndef _WIN32
+        munmap(pstate->base, pstate->mapped_size);
+#else
+        delete [] pstate->base;
+#endif
+    }
+    lindex_init_state(pstate);
+}
+
+size_t
+lindex_seek (const struct LogIndexState *pstate, unsigned long long timestamp) {
+    return std::lower_bound(pstate->max_timestamps.begin(),
+                            pstate->max_timestamps.end(),
+                            timestamp) - pstate->max_timestamps.begin();
+}
@@ -0,0 +1,44 @@
+#ifndef __DM_COLLECTOR_C_LOG_INDEX_H__
+#define __DM_COLLECTOR_C_LOG_INDEX_H__
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// A sidecar index of a log file. For each log packet, it records the byte
+// offset of its HDLC frame, its log code and its QCDM timestamp.
+// The file is columnar:
+//   LogIndexHeader
+//   unsigned long long offsets[n_frames]
+//   unsigned long long timestamps[n_frames]
+//   unsigned short log_codes[n_frames]
+struct LogIndexState {
+    char *base;         // mmap()-ed index, NULL if not opened
+    size_t mapped_size;
+    size_t n_frames;
+    const unsigned long long *offsets;
+    const unsigned long long *timestamps;
+    const unsigned short *log_codes;
+    // max_timestamps[i] = max(timestamps[0..i]), for binary search
+    std::vector<unsigned long long> max_timestamps;
+};
+
+// Must be called before usage
+void lindex_init_state (struct LogIndexState *pstate);
+
+// Build the index of log_path in one pass, and save it to index_path.
+// Return: successful or not
+bool lindex_build (const char *log_path, const char *index_path);
+
+// Open an index. It fails if the index does not match the current log file
+// (size or modification time changed).
+// Return: successful or not
+bool lindex_open (struct LogIndexState *pstate,
+                    const char *log_path, const char *index_path);
+void lindex_close (struct LogIndexState *pstate);
+
+// Return: the first frame whose timestamp is not earlier than timestamp,
+// assuming timestamps are (mostly) increasing; n_frames if there is none
+size_t lindex_seek (const struct LogIndexState *pstate, unsigned long long timestamp);
+
+#endif  // __DM_COLLECTOR_C_LOG_INDEX_H__
@@ -49,6 +49,7 @@
 #include "srch_tng_1x_searcher_dump.h"
 #include "wcdma_rrc_states.h"
 #include "wcdma_search_cell_reselection_rank.h"
+#include "rlc_tracker.h"
 
 #define SSTR( x ) static_cast< std::ostringstream & >( \
         ( std::ostringstream() << std::dec << x ) ).str()
@@ -86,6 +87,14 @@ namespace patch
 
 // TODO: split this .cpp to multiple files.
 
+// Tracker of RLC AM sequence numbers, NULL if disabled
+static struct RlcTrackerState *rlc_tracker = NULL;
+
+void
+set_rlc_tracker (struct RlcTrackerState *ptracker) {
+    rlc_tracker = ptracker;
+}
+
 static int
 _decode_wcdma_signaling_messages(const char *b, int offset, size_t length,
                                     PyObject *result) {
@@ -3123,6 +3132,8 @@ static int _decode_lte_rlc_ul_am_all_pdu_subpkt (const char *b, int offset,
                                 "sys_fn");
                         int iLoggedBytes = _search_result_int(result_pdu_item,
                                 "logged_bytes");
+                        int iPduBytes = _search_result_int(result_pdu_item,
+                                "pdu_bytes");
                         // D/C LookAhead and SN (or Ack_SN) has already been parsed.
                         iLoggedBytes -= 2;
 
@@ -3172,6 +3183,7 @@ static int _decode_lte_rlc_ul_am_all_pdu_subpkt (const char *b, int offset,
                             Py_DECREF(old_object);
                             Py_DECREF(pystr);
 
+                            std::vector<int> nacks;
                             if (iLoggedBytes > 0) {
                                 // Decode NACK
                                 int numNack = iLoggedBytes / 1.5;
@@ -3202,6 +3214,7 @@ static int _decode_lte_rlc_ul_am_all_pdu_subpkt (const char *b, int offset,
                                         if (iE2 == 2) {
                                             indexNack = numNack - 1;
                                         }
+                                        nacks.push_back(iNack);
                                         old_object = _replace_result_int(
                                                 result_pdu_nack_item, "NACK_SN", iNack);
                                         Py_DECREF(old_object);
@@ -3222,6 +3235,7 @@ static int _decode_lte_rlc_ul_am_all_pdu_subpkt (const char *b, int offset,
                                             indexNack = numNack - 1;
                                         }
                                         iHeadFromPadding = (iNonDecodeNACK & 1) * 512;
+                                        nacks.push_back(iNack);
                                         old_object = _replace_result_int(
                                                 result_pdu_nack_item, "NACK_SN", iNack);
                                         Py_DECREF(old_object);
@@ -3238,6 +3252,10 @@ static int _decode_lte_rlc_ul_am_all_pdu_subpkt (const char *b, int offset,
                                 Py_DECREF(t2);
                                 Py_DECREF(result_pdu_nack);
                             }
+                            if (rlc_tracker != NULL)
+                                rtrack_status_pdu(rlc_tracker, RTRACK_UL, rb_cfg_idx,
+                                        sys_fn, sub_fn, iAckSN, iPduBytes,
+                                        nacks);
                         } else {
                             // Type = DATA
                             pystr = Py_BuildValue("s", "RLCUL DATA");
@@ -3284,6 +3302,10 @@ static int _decode_lte_rlc_ul_am_all_pdu_subpkt (const char *b, int offset,
                             old_object = _replace_result_int(result_pdu_item,
                                     "SN", iNonDecodeSN);
                             Py_DECREF(old_object);
+                            if (rlc_tracker != NULL)
+                                rtrack_data_pdu(rlc_tracker, RTRACK_UL, rb_cfg_idx,
+                                        sys_fn, sub_fn, iNonDecodeSN,
+                                        iPduBytes);
 
                             offset += _decode_by_fmt(
                                     LteRlcUlAmAllPdu_Subpkt_PDU_DATA,
@@ -3516,6 +3538,8 @@ static int _decode_lte_rlc_dl_am_all_pdu_subpkt (const char *b, int offset,
                                 "sys_fn");
                         int iLoggedBytes = _search_result_int(result_pdu_item,
                                 "logged_bytes");
+                        int iPduBytes = _search_result_int(result_pdu_item,
+                                "pdu_bytes");
                         // D/C LookAhead and SN (or Ack_SN) has already been parsed.
                         iLoggedBytes -= 2;
 
@@ -3570,6 +3594,7 @@ static int _decode_lte_rlc_dl_am_all_pdu_subpkt (const char *b, int offset,
                             Py_DECREF(old_object);
                             Py_DECREF(pystr);
 
+                            std::vector<int> nacks;
                             if (iLoggedBytes > 0) {
                                 // Decode NACK
                                 int numNack = iLoggedBytes / 1.5;
@@ -3600,6 +3625,7 @@ static int _decode_lte_rlc_dl_am_all_pdu_subpkt (const char *b, int offset,
                                         if (iE2 == 2) {
                                             indexNack = numNack - 1;
                                         }
+                                        nacks.push_back(iNack);
                                         old_object = _replace_result_int(
                                                 result_pdu_nack_item, "NACK_SN", iNack);
                                         Py_DECREF(old_object);
@@ -3620,6 +3646,7 @@ static int _decode_lte_rlc_dl_am_all_pdu_subpkt (const char *b, int offset,
                                             indexNack = numNack - 1;
                                         }
                                         iHeadFromPadding = (iNonDecodeNACK & 1) * 512;
+                                        nacks.push_back(iNack);
                                         old_object = _replace_result_int(
                                                 result_pdu_nack_item, "NACK_SN", iNack);
                                         Py_DECREF(old_object);
@@ -3636,6 +3663,10 @@ static int _decode_lte_rlc_dl_am_all_pdu_subpkt (const char *b, int offset,
                                 Py_DECREF(t2);
                                 Py_DECREF(result_pdu_nack);
                             }
+                            if (rlc_tracker != NULL)
+                                rtrack_status_pdu(rlc_tracker, RTRACK_DL, rb_cfg_idx,
+                                        sys_fn, sub_fn, iAckSN, iPduBytes,
+                                        nacks);
                         } else {
                             // Type = DATA
                             pystr = Py_BuildValue("s", "RLCDL DATA");
@@ -3687,6 +3718,10 @@ static int _decode_lte_rlc_dl_am_all_pdu_subpkt (const char *b, int offset,
                             old_object = _replace_result_int(result_pdu_item,
                                     "SN", iNonDecodeSN);
                             Py_DECREF(old_object);
+                            if (rlc_tracker != NULL)
+                                rtrack_data_pdu(rlc_tracker, RTRACK_DL, rb_cfg_idx,
+                                        sys_fn, sub_fn, iNonDecodeSN,
+                                        iPduBytes);
                             offset += _decode_by_fmt(
                                     LteRlcDlAmAllPdu_Subpkt_PDU_DATA,
                                     ARRAY_SIZE(
@@ -6674,6 +6709,14 @@ decode_log_packet (const char *b, size_t length, bool skip_decoding) {
         return result;
     }
 
+    if (rlc_tracker != NULL && length >= 14
+            && (type_id == LTE_RLC_UL_AM_All_PDU || type_id == LTE_RLC_DL_AM_All_PDU)) {
+        // The "timestamp" of LogPacketHeaderFmt
+        unsigned long long timestamp;
+        memcpy(&timestamp, b + 6, sizeof(timestamp));
+        rtrack_begin_packet(rlc_tracker, timestamp);
+    }
+
     on_demand_decode(b+offset, length-offset, type_id, result);
 
     return result;
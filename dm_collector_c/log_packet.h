@@ -2865,6 +2865,11 @@ PyObject * decode_log_packet (const char *b, size_t length, bool skip_decoding);
 
 void on_demand_decode (const char *b, size_t length, LogPacketType type_id, PyObject* result);
 
+// Feed the PDUs of LTE_RLC_UL/DL_AM_All_PDU to a tracker as they are
+// decoded, or stop feeding them if ptracker is NULL.
+struct RlcTrackerState;
+void set_rlc_tracker (struct RlcTrackerState *ptracker);
+
 
 PyObject * decode_log_packet_modem (const char *b, size_t length, bool skip_decoding);
 
@@ -0,0 +1,245 @@
+/* log_reader.cpp
+ * Reads HDLC frames directly from a log file, without going through
+ * feed_binary()/receive_log_packet().
+ */
+
+#include <Python.h>
+
+#include "log_reader.h"
+#include "hdlc.h"
+#include "consts.h"
+#include "log_packet.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const size_t LREADER_BLOCK_SIZE = 1 << 20;
+// 60 seconds of QCDM ticks (52428800 per second)
+static const unsigned long long LREADER_WINDOW_SLACK = 60ULL * 52428800;
+
+void
+lreader_init_state (struct LogReaderState *pstate) {
+    pstate->fd = -1;
+    pstate->fp = NULL;
+    pstate->base = NULL;
+    pstate->size = 0;
+    pstate->pos = 0;
+    pstate->mapped = false;
+    pstate->eof = false;
+    pstate->buf.clear();
+    pstate->base_offset = 0;
+    pstate->frame_offset = 0;
+    pstate->total_size = 0;
+    pstate->compressed = false;
+    pstate->blocks.clear();
+    pstate->next_block = 0;
+}
+
+static bool
+compressed_block_less (unsigned long long offset, const CompressedBlock &block) {
+    return offset < block.raw_offset;
+}
+
+bool
+lreader_open (struct LogReaderState *pstate, const char *path) {
+    lreader_close(pstate);
+    if (clog_is_compressed_path(path)) {
+        pstate->fp = fopen(path, "rb");
+        if (pstate->fp == NULL)
+            return false;
+        if (!clog_check_magic(pstate->fp)
+                || !clog_load_table(pstate->fp, pstate->blocks, pstate->total_size)) {
+            lreader_close(pstate);
+            return false;
+        }
+        pstate->compressed = true;
+        return true;
+    }
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            close(fd);
+            pstate->eof = true;
+            return true;
+        }
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            (void) madvise(p, st.st_size, MADV_SEQUENTIAL);
+            pstate->fd = fd;
+            pstate->base = (const char *) p;
+            pstate->size = st.st_size;
+            pstate->total_size = st.st_size;
+            pstate->mapped = true;
+            pstate->eof = true;
+            return true;
+        }
+    }
+    close(fd);
+#endif
+    // Fall back to block reads
+    pstate->fp = fopen(path, "rb");
+    if (pstate->fp == NULL)
+        return false;
+    if (fseek(pstate->fp, 0, SEEK_END) == 0) {
+        long end = ftell(pstate->fp);
+        pstate->total_size = end > 0 ? end : 0;
+    }
+    if (fseek(pstate->fp, 0, SEEK_SET) != 0) {
+        lreader_close(pstate);
+        return false;
+    }
+    return true;
+}
+
+void
+lreader_close (struct LogReaderState *pstate) {
+#ifndef _WIN32
+    if (pstate->mapped)
+        munmap((void *) pstate->base, pstate->size);
+    if (pstate->fd >= 0)
+        close(pstate->fd);
+#endif
+    if (pstate->fp != NULL)
+        fclose(pstate->fp);
+    lreader_init_state(pstate);
+}
+
+// Keep the unconsumed bytes and append the next block of the file.
+// Return: false if no more data could be read
+static bool
+read_block (struct LogReaderState *pstate) {
+    if (pstate->eof || pstate->fp == NULL)
+        return false;
+    size_t remain = pstate->size - pstate->pos;
+    if (remain > 0)
+        memmove(&pstate->buf[0], &pstate->buf[pstate->pos], remain);
+    pstate->base_offset += pstate->pos;
+    if (pstate->compressed) {
+        pstate->buf.resize(remain);
+        bool success = clog_read_block(pstate->fp, pstate->blocks,
+                                        pstate->next_block, pstate->buf);
+        pstate->next_block++;
+        if (!success || pstate->next_block >= pstate->blocks.size())
+            pstate->eof = true;
+        pstate->base = pstate->buf.empty() ? NULL : &pstate->buf[0];
+        pstate->size = pstate->buf.size();
+        pstate->pos = 0;
+        return success;
+    }
+    pstate->buf.resize(remain + LREADER_BLOCK_SIZE);
+    size_t n = fread(&pstate->buf[remain], 1, LREADER_BLOCK_SIZE, pstate->fp);
+    if (n < LREADER_BLOCK_SIZE)
+        pstate->eof = true;
+    pstate->base = &pstate->buf[0];
+    pstate->size = remain + n;
+    pstate->pos = 0;
+    return n > 0;
+}
+
+bool
+lreader_seek (struct LogReaderState *pstate, unsigned long long offset) {
+    if (pstate->mapped) {
+        if (offset > pstate->size)
+            return false;
+        pstate->pos = offset;
+        return true;
+    }
+    if (pstate->compressed) {
+        // Decompress the block that holds offset
+        size_t k = std::upper_bound(pstate->blocks.begin(), pstate->blocks.end(),
+                                    offset, compressed_block_less)
+                    - pstate->blocks.begin();
+        if (offset > pstate->total_size || k == 0)
+            return offset == 0 && pstate->blocks.empty();
+        k--;
+        pstate->buf.clear();
+        pstate->base = NULL;
+        pstate->size = 0;
+        pstate->pos = 0;
+        pstate->eof = false;
+        pstate->next_block = k;
+        pstate->base_offset = pstate->blocks[k].raw_offset;
+        if (!read_block(pstate))
+            return false;
+        pstate->pos = offset - pstate->base_offset;
+        return pstate->pos <= pstate->size;
+    }
+    if (pstate->fp == NULL || fseek(pstate->fp, (long) offset, SEEK_SET) != 0)
+        return false;
+    pstate->buf.clear();
+    pstate->base = NULL;
+    pstate->size = 0;
+    pstate->pos = 0;
+    pstate->eof = false;
+    pstate->base_offset = offset;
+    return true;
+}
+
+bool
+lreader_next_frame (struct LogReaderState *pstate,
+                    std::string& output_frame, bool& crc_correct) {
+    size_t search_from = pstate->pos;
+    while (true) {
+        const char *p = NULL;
+        if (search_from < pstate->size)
+            p = (const char *) memchr(pstate->base + search_from, '\x7e',
+                                        pstate->size - search_from);
+        if (p != NULL) {
+            size_t delim = p - pstate->base;
+            crc_correct = deframe(pstate->base + pstate->pos,
+                                    delim - pstate->pos, output_frame);
+            pstate->frame_offset = pstate->base_offset + pstate->pos;
+            pstate->pos = delim + 1;
+            return true;
+        }
+        // An incomplete frame at the end of file is dropped.
+        search_from = pstate->size - pstate->pos;
+        if (!read_block(pstate))
+            return false;
+    }
+}
+
+void
+lreader_init_filter (struct LogFrameFilter *pfilter) {
+    pfilter->types.clear();
+    pfilter->has_window = false;
+    pfilter->t0 = 0;
+    pfilter->t1 = ~0ULL;
+    pfilter->in_window = true;
+}
+
+int
+lreader_filter_frame (struct LogFrameFilter *pfilter, const char *b, size_t length) {
+    // 16 = 2 (0x1000) + 2 (len1) + 2 (log_msg_len) + 2 (type_id) + 8 (timestamp)
+    if (is_log_packet(b, length) && length >= 16) {
+        unsigned short log_code;
+        unsigned long long timestamp;
+        memcpy(&log_code, b + 6, sizeof(log_code));
+        memcpy(&timestamp, b + 8, sizeof(timestamp));
+        if (pfilter->has_window) {
+            pfilter->in_window = timestamp >= pfilter->t0 && timestamp <= pfilter->t1;
+            if (timestamp > pfilter->t1 && timestamp - pfilter->t1 > LREADER_WINDOW_SLACK)
+                return -1;
+            if (!pfilter->in_window)
+                return 0;
+        }
+        return pfilter->types.empty() || pfilter->types[log_code] ? 1 : 0;
+    }
+    if (is_debug_packet(b, length)) {
+        if (!pfilter->in_window)
+            return 0;
+        return pfilter->types.empty() || pfilter->types[Modem_debug_message] ? 1 : 0;
+    }
+    return pfilter->has_window || !pfilter->types.empty() ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#ifndef __DM_COLLECTOR_C_LOG_READER_H__
+#define __DM_COLLECTOR_C_LOG_READER_H__
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdio>
+
+#include "compressed_log.h"
+
+// Reads HDLC frames from a log file (.mi2log, .mi2logz or .qmdl).
+// The file is memory-mapped and deframed in place. If mmap() is not
+// available, it is read in large blocks instead. Compressed logs are
+// decompressed block by block; all offsets refer to the decompressed stream.
+struct LogReaderState {
+    int fd;
+    FILE *fp;               // used if the file is not mapped
+    const char *base;       // mapped file, or &buf[0]
+    size_t size;            // bytes available at base
+    size_t pos;             // first unconsumed byte
+    bool mapped;
+    bool eof;
+    std::vector<char> buf;
+    unsigned long long base_offset;     // file offset of base
+    unsigned long long frame_offset;    // file offset of the last frame
+    unsigned long long total_size;      // size of the (decompressed) stream
+    bool compressed;
+    std::vector<CompressedBlock> blocks;
+    size_t next_block;                  // next compressed block to read
+};
+
+// Must be called before usage
+void lreader_init_state (struct LogReaderState *pstate);
+
+// Return: successful or not
+bool lreader_open (struct LogReaderState *pstate, const char *path);
+void lreader_close (struct LogReaderState *pstate);
+
+// Continue reading at a file offset, e.g. the start of an indexed frame.
+// Return: successful or not
+bool lreader_seek (struct LogReaderState *pstate, unsigned long long offset);
+
+// Extract the next frame, with the same semantics as get_next_frame().
+// Return: false at the end of file
+bool lreader_next_frame (struct LogReaderState *pstate,
+                            std::string& output_frame, bool& crc_correct);
+
+// Skips frames by their header (log code and QCDM timestamp), so that
+// frames outside a replay window are never decoded.
+struct LogFrameFilter {
+    std::vector<bool> types;        // by log code; empty for all types
+    bool has_window;
+    unsigned long long t0;
+    unsigned long long t1;
+    bool in_window;                 // the last log packet was in the window
+};
+
+// Must be called before usage
+void lreader_init_filter (struct LogFrameFilter *pfilter);
+
+// Check a deframed frame (after check_frame_format()). Debug messages have
+// no timestamp; they are kept if the last log packet was in the window.
+// Log packets more than a minute after t1 end the window, which tolerates
+// the slightly out-of-order timestamps of different subsystems.
+// Return: 1 if the frame should be decoded, 0 if skipped, -1 if the window
+// has passed
+int lreader_filter_frame (struct LogFrameFilter *pfilter, const char *b, size_t length);
+
+#endif  // __DM_COLLECTOR_C_LOG_READER_H__
@@ -0,0 +1,277 @@
+/* meas_kernels.cpp
+ * Batch conversion of RSRP/RSRQ/WCDMA_MEAS fields, so that measurement
+ * arrays can be read without building a Python float per value.
+ */
+
+#include "meas_kernels.h"
+#include "consts.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MKERN_NEON
+#endif
+
+// 16 = 2 (0x1000) + 2 (len1) + 2 (log_msg_len) + 2 (type_id) + 8 (timestamp)
+static const size_t MKERN_HEADER_LEN = 16;
+// Values converted per vector step
+static const size_t MKERN_BATCH = 8;
+
+template <typename T>
+static T
+read_le (const char *p) {
+    T v;
+    memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+// out[i] = x[i] * scale + offset, for 8 contiguous 16-bit values
+static inline void
+convert_batch (const short *x, float scale, float offset, float *out) {
+#if defined(__SSE2__)
+    __m128i v = _mm_loadu_si128((const __m128i *) x);
+    // sign-extend to 32 bits
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    __m128 s = _mm_set1_ps(scale);
+    __m128 o = _mm_set1_ps(offset);
+    _mm_storeu_ps(out, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), s), o));
+    _mm_storeu_ps(out + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), s), o));
+#elif defined(MKERN_NEON)
+    int16x8_t v = vld1q_s16(x);
+    float32x4_t o = vdupq_n_f32(offset);
+    float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+    float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+    vst1q_f32(out, vmlaq_n_f32(o, lo, scale));
+    vst1q_f32(out + 4, vmlaq_n_f32(o, hi, scale));
+#else
+    for (size_t i = 0; i < MKERN_BATCH; i++)
+        out[i] = x[i] * scale + offset;
+#endif
+}
+
+static void
+convert_strided (const char *b, size_t stride, size_t elem_size, size_t n,
+                    float scale, float offset, float *out) {
+    short x[MKERN_BATCH];
+    size_t i = 0;
+    for (; i + MKERN_BATCH <= n; i += MKERN_BATCH) {
+        // Gather, so that the arithmetic runs on whole vectors
+        for (size_t j = 0; j < MKERN_BATCH; j++) {
+            const char *p = b + (i + j) * stride;
+            x[j] = (elem_size == 2) ? read_le<short>(p)
+                                    : (short) *((const unsigned char *) p);
+        }
+        convert_batch(x, scale, offset, out + i);
+    }
+    for (; i < n; i++) {
+        const char *p = b + i * stride;
+        short v = (elem_size == 2) ? read_le<short>(p)
+                                    : (short) *((const unsigned char *) p);
+        out[i] = v * scale + offset;
+    }
+}
+
+// As convert_strided(), for values of bit fields: out[i] = ((u32 >> shift)
+// & mask) * scale + offset, where u32 starts at b + i * stride
+static void
+convert_bits (const char *b, size_t stride, size_t n, int shift,
+                unsigned int mask, float scale, float offset, float *out) {
+    short x[MKERN_BATCH];
+    size_t i = 0;
+    for (; i + MKERN_BATCH <= n; i += MKERN_BATCH) {
+        for (size_t j = 0; j < MKERN_BATCH; j++)
+            x[j] = (short) ((read_le<unsigned int>(b + (i + j) * stride) >> shift) & mask);
+        convert_batch(x, scale, offset, out + i);
+    }
+    for (; i < n; i++) {
+        short v = (short) ((read_le<unsigned int>(b + i * stride) >> shift) & mask);
+        out[i] = v * scale + offset;
+    }
+}
+
+void
+mkern_q4_to_float (const char *b, size_t stride, size_t n, float offset,
+                    float *out) {
+    convert_strided(b, stride, 2, n, 0.0625f, offset, out);
+}
+
+void
+mkern_wcdma_meas_to_float (const char *b, size_t stride, size_t n,
+                            float *out) {
+    convert_strided(b, stride, 1, n, 1.0f, -256.0f, out);
+}
+
+// LtePhyCmlifmrFmt, LtePhyCmlifmrFmt_v3/v4_Header and _Neighbor_Cell
+static bool
+extract_cmlifmr (const char *p, size_t length, struct MeasArrays *out) {
+    const size_t CELL_LEN = 12;
+    if (length < 8)
+        return false;
+    int version = (unsigned char) p[0];
+    size_t offset = 8;
+    size_t header_len;
+    if (version == 3) {
+        header_len = 16;
+        if (offset + header_len > length)
+            return false;
+        out->earfcn = read_le<unsigned short>(p + offset);
+        offset += 2;
+    } else if (version == 4) {
+        header_len = 20;
+        if (offset + header_len > length)
+            return false;
+        out->earfcn = read_le<unsigned int>(p + offset);
+        offset += 4;
+    } else {
+        return false;
+    }
+    out->serving_pci = read_le<unsigned short>(p + offset);
+    mkern_q4_to_float(p + offset + 4, 2, 1, -180.0f, &out->serving_rsrp);
+    mkern_q4_to_float(p + offset + 8, 2, 1, -30.0f, &out->serving_rsrq);
+    size_t n_cells = (unsigned char) p[offset + 12];
+    offset = 8 + header_len;
+    if (offset + n_cells * CELL_LEN > length)
+        return false;
+
+    const char *cells = p + offset;
+    out->pci.resize(n_cells);
+    out->rsrp.resize(n_cells);
+    out->rsrq.resize(n_cells);
+    for (size_t i = 0; i < n_cells; i++)
+        out->pci[i] = read_le<unsigned short>(cells + i * CELL_LEN);
+    if (n_cells > 0) {
+        mkern_q4_to_float(cells + 2, CELL_LEN, n_cells, -180.0f, &out->rsrp[0]);
+        mkern_q4_to_float(cells + 6, CELL_LEN, n_cells, -30.0f, &out->rsrq[0]);
+    }
+    return true;
+}
+
+// LtePhyIratFmt, LtePhyIratWCDMAFmt, LtePhyIratWCDMACellMetaFmt and
+// LtePhyIratWCDMACellFmt
+static bool
+extract_irat_wcdma (const char *p, size_t length, struct MeasArrays *out) {
+    const int SUBPKT_WCDMA = 35;    // LtePhyIratType_WCDMA
+    const size_t CELL_LEN = 16;
+    if (length < 4 || p[0] != 1)
+        return false;
+    int n_subpkt = (unsigned char) p[1];
+    size_t offset = 4;
+    for (int i = 0; i < n_subpkt; i++) {
+        if (offset + 4 > length)
+            return false;
+        int subpkt_id = (unsigned char) p[offset];
+        size_t subpkt_size = read_le<unsigned short>(p + offset + 2);
+        if (subpkt_size < 4)
+            return false;   // the size includes this header
+        offset += 4;
+        if (subpkt_id != SUBPKT_WCDMA) {
+            offset += subpkt_size - 4;
+            continue;
+        }
+        if (offset + 8 > length)
+            return false;
+        int n_freq = (unsigned char) p[offset + 4];
+        offset += 8;
+        for (int j = 0; j < n_freq; j++) {
+            if (offset + 4 > length)
+                return false;
+            unsigned short freq = read_le<unsigned short>(p + offset);
+            size_t n_cells = (unsigned char) p[offset + 2];
+            offset += 4;
+            if (offset + n_cells * CELL_LEN > length)
+                return false;
+            size_t first = out->rscp.size();
+            out->uarfcn.resize(first + n_cells, freq);
+            out->rscp.resize(first + n_cells);
+            out->rssi.resize(first + n_cells);
+            out->ecno.resize(first + n_cells);
+            if (n_cells > 0) {
+                const char *cells = p + offset;
+                mkern_wcdma_meas_to_float(cells + 8, CELL_LEN, n_cells, &out->rscp[first]);
+                mkern_wcdma_meas_to_float(cells + 9, CELL_LEN, n_cells, &out->rssi[first]);
+                mkern_wcdma_meas_to_float(cells + 10, CELL_LEN, n_cells, &out->ecno[first]);
+            }
+            offset += n_cells * CELL_LEN;
+        }
+    }
+    return true;
+}
+
+// LtePhyIncm_Fmt, and the results (ID 27, version 2 and 4) of
+// LtePhyIncm_Subpacket_Payload_27v2/v4 and LtePhyIncm_Subpacket_27v2_cell
+static bool
+extract_idle_ncell (const char *p, size_t length, struct MeasArrays *out) {
+    const int SUBPKT_RESULT = 27;
+    const size_t CELL_LEN = 52;
+    if (length < 4 || p[0] != 1)
+        return false;
+    int n_subpkt = (unsigned char) p[1];
+    size_t offset = 4;
+    for (int i = 0; i < n_subpkt; i++) {
+        if (offset + 4 > length)
+            return false;
+        int subpkt_id = (unsigned char) p[offset];
+        int subpkt_ver = (unsigned char) p[offset + 1];
+        size_t subpkt_size = read_le<unsigned short>(p + offset + 2);
+        if (subpkt_size < 4 || offset + subpkt_size > length)
+            return false;
+        size_t next = offset + subpkt_size;
+        if (subpkt_id != SUBPKT_RESULT || (subpkt_ver != 2 && subpkt_ver != 4)) {
+            offset = next;  // e.g. a request
+            continue;
+        }
+        offset += 4;
+        // The E-ARFCN is 2 bytes in version 2, and 4 in version 4
+        size_t earfcn_len = subpkt_ver == 2 ? 2 : 4;
+        size_t header_len = subpkt_ver == 2 ? 4 : 8;
+        if (offset + header_len > length)
+            return false;
+        unsigned int earfcn = subpkt_ver == 2 ? read_le<unsigned short>(p + offset)
+                                                : read_le<unsigned int>(p + offset);
+        size_t n_cells = read_le<unsigned short>(p + offset + earfcn_len) & 63;
+        offset += header_len;
+        if (offset + n_cells * CELL_LEN > length)
+            return false;
+
+        const char *cells = p + offset;
+        size_t first = out->pci.size();
+        out->cell_earfcn.resize(first + n_cells, earfcn);
+        out->pci.resize(first + n_cells);
+        out->rsrp.resize(first + n_cells);
+        out->rsrq.resize(first + n_cells);
+        out->rssi.resize(first + n_cells);
+        for (size_t j = 0; j < n_cells; j++)
+            out->pci[first + j] = read_le<unsigned int>(cells + j * CELL_LEN) & 1023;
+        if (n_cells > 0) {
+            convert_bits(cells + 12, CELL_LEN, n_cells, 0, 4095, 0.0625f, -180.0f,
+                            &out->rsrp[first]);
+            convert_bits(cells + 20, CELL_LEN, n_cells, 10, 1023, 0.0625f, -30.0f,
+                            &out->rsrq[first]);
+            convert_bits(cells + 28, CELL_LEN, n_cells, 11, 2047, 0.0625f, -110.0f,
+                            &out->rssi[first]);
+        }
+        offset = next;
+    }
+    return true;
+}
+
+bool
+mkern_extract (const char *b, size_t length, struct MeasArrays *out) {
+    if (length < MKERN_HEADER_LEN || b[0] != '\x10')
+        return false;
+    out->log_code = read_le<unsigned short>(b + 6);
+    out->timestamp = read_le<unsigned long long>(b + 8);
+    const char *p = b + MKERN_HEADER_LEN;
+    size_t n = length - MKERN_HEADER_LEN;
+    if (out->log_code == LTE_PHY_Connected_Mode_LTE_Intra_Freq_Meas_Results)
+        return extract_cmlifmr(p, n, out);
+    if (out->log_code == LTE_PHY_IRAT_MDB)
+        return extract_irat_wcdma(p, n, out);
+    if (out->log_code == LTE_PHY_Idle_Neighbor_Cell_Meas)
+        return extract_idle_ncell(p, n, out);
+    return false;
+}
@@ -0,0 +1,49 @@
+#ifndef __DM_COLLECTOR_C_MEAS_KERNELS_H__
+#define __DM_COLLECTOR_C_MEAS_KERNELS_H__
+
+#include <vector>
+#include <cstddef>
+
+// Batch conversions of the measurement fields of log_packet.h, for arrays
+// of records (e.g. neighbor cells) that are stride bytes apart. They give
+// the same values as the RSRP, RSRQ and WCDMA_MEAS cases of
+// _decode_by_fmt(), with SSE2 or NEON when available.
+
+// 16-bit values in 1/16 dB: out[i] = x * 0.0625 + offset
+// (offset is -180 for RSRP, -30 for RSRQ)
+void mkern_q4_to_float (const char *b, size_t stride, size_t n, float offset,
+                        float *out);
+// 8-bit values: out[i] = x - 256
+void mkern_wcdma_meas_to_float (const char *b, size_t stride, size_t n,
+                                float *out);
+
+// The neighbor cells of a measurement packet, as arrays
+struct MeasArrays {
+    int log_code;
+    unsigned long long timestamp;   // QCDM timestamp
+    // LTE_PHY_Connected_Mode_LTE_Intra_Freq_Meas_Results
+    unsigned int earfcn;
+    int serving_pci;
+    float serving_rsrp;
+    float serving_rsrq;
+    std::vector<unsigned short> pci;
+    std::vector<float> rsrp;
+    std::vector<float> rsrq;
+    // LTE_PHY_IRAT_MDB (WCDMA cells)
+    std::vector<unsigned short> uarfcn;
+    std::vector<float> rscp;
+    std::vector<float> rssi;
+    std::vector<float> ecno;
+    // LTE_PHY_Idle_Neighbor_Cell_Meas: pci, rsrp, rsrq and rssi above,
+    // one element per cell, with the E-ARFCN of each cell
+    std::vector<unsigned int> cell_earfcn;
+};
+
+// Extract the arrays of a deframed packet (after check_frame_format()).
+// LTE_PHY_Connected_Neighbor_Cell_Meas is not supported, since the decoder
+// has no log code or format for it.
+// Return: false if the type or version is not supported, or the packet is
+// truncated
+bool mkern_extract (const char *b, size_t length, struct MeasArrays *out);
+
+#endif  // __DM_COLLECTOR_C_MEAS_KERNELS_H__
@@ -0,0 +1,135 @@
+/* message_stats.cpp
+ * Per log code counts, sizes and inter-arrival times, read from the frame
+ * headers without decoding the packets.
+ */
+
+#include "message_stats.h"
+
+#include <cstring>
+
+// 16 = 2 (0x1000) + 2 (len1) + 2 (log_msg_len) + 2 (type_id) + 8 (timestamp)
+static const size_t MSTATS_HEADER_LEN = 16;
+
+template <typename T>
+static T
+read_le (const char *p) {
+    T v;
+    memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+static inline int
+highest_bit (unsigned long long v) {
+    int n = 0;
+    while (v >>= 1)
+        n++;
+    return n;
+}
+
+static inline size_t
+bucket_index (unsigned long long value) {
+    if (value < 2 * MSTATS_SUB_BUCKETS)
+        return (size_t) value;
+    int shift = highest_bit(value) - MSTATS_SUB_BUCKET_BITS;
+    return (size_t) (shift + 1) * MSTATS_SUB_BUCKETS
+            + (size_t) (value >> shift) - MSTATS_SUB_BUCKETS;
+}
+
+// The largest value counted in a bucket
+static inline unsigned long long
+bucket_upper_bound (size_t index) {
+    if (index < 2 * MSTATS_SUB_BUCKETS)
+        return index;
+    int shift = (int) (index / MSTATS_SUB_BUCKETS) - 1;
+    unsigned long long lower =
+        (unsigned long long) (MSTATS_SUB_BUCKETS + index % MSTATS_SUB_BUCKETS) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
+
+void
+mstats_hist_init (struct HdrHistogram *phist) {
+    phist->counts.clear();
+    phist->total = 0;
+    phist->sum = 0;
+    phist->min = 0;
+    phist->max = 0;
+}
+
+void
+mstats_hist_record (struct HdrHistogram *phist, unsigned long long value) {
+    size_t index = bucket_index(value);
+    if (index >= phist->counts.size())
+        phist->counts.resize(index + 1, 0);
+    phist->counts[index]++;
+    if (phist->total == 0 || value < phist->min)
+        phist->min = value;
+    if (value > phist->max)
+        phist->max = value;
+    phist->total++;
+    phist->sum += value;
+}
+
+unsigned long long
+mstats_hist_quantile (const struct HdrHistogram *phist, double q) {
+    if (phist->total == 0)
+        return 0;
+    if (q < 0)
+        q = 0;
+    unsigned long long rank = (unsigned long long) (q * phist->total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < phist->counts.size(); i++) {
+        seen += phist->counts[i];
+        if (seen >= rank) {
+            unsigned long long v = bucket_upper_bound(i);
+            return v < phist->max ? v : phist->max;
+        }
+    }
+    return phist->max;
+}
+
+void
+mstats_init_state (struct MessageStatsState *pstate) {
+    pstate->enabled = false;
+    pstate->n_frames = 0;
+    pstate->n_crc_failures = 0;
+    pstate->codes.clear();
+}
+
+void
+mstats_configure (struct MessageStatsState *pstate, bool enabled) {
+    mstats_init_state(pstate);
+    pstate->enabled = enabled;
+}
+
+void
+mstats_feed (struct MessageStatsState *pstate, const char *b, size_t length) {
+    if (!pstate->enabled)
+        return;
+    pstate->n_frames++;
+    if (length < MSTATS_HEADER_LEN || b[0] != '\x10')
+        return;     // not a log packet
+    unsigned short log_msg_len = read_le<unsigned short>(b + 4);
+    unsigned short log_code = read_le<unsigned short>(b + 6);
+    unsigned long long timestamp = read_le<unsigned long long>(b + 8);
+
+    std::map<int, MsgCodeStats>::iterator it = pstate->codes.find(log_code);
+    if (it == pstate->codes.end()) {
+        it = pstate->codes.insert(std::make_pair((int) log_code, MsgCodeStats())).first;
+        MsgCodeStats &s = it->second;
+        s.count = 0;
+        s.bytes = 0;
+        s.last_timestamp = 0;
+        mstats_hist_init(&s.interarrival);
+        mstats_hist_init(&s.size);
+    }
+    MsgCodeStats &s = it->second;
+    // Intervals across a clock going back (e.g. a new log) are not counted
+    if (s.count > 0 && timestamp >= s.last_timestamp)
+        mstats_hist_record(&s.interarrival, timestamp - s.last_timestamp);
+    s.last_timestamp = timestamp;
+    s.count++;
+    s.bytes += log_msg_len;
+    mstats_hist_record(&s.size, log_msg_len);
+}
@@ -0,0 +1,62 @@
+#ifndef __DM_COLLECTOR_C_MESSAGE_STATS_H__
+#define __DM_COLLECTOR_C_MESSAGE_STATS_H__
+
+#include <map>
+#include <vector>
+#include <cstddef>
+
+// A histogram of non-negative integers with a bounded relative error, in the
+// spirit of HdrHistogram: values below 2 * MSTATS_SUB_BUCKETS are counted
+// exactly, and larger ones in buckets of 1 / MSTATS_SUB_BUCKETS (about 3%)
+// of their magnitude. Buckets are only allocated up to the largest value.
+#define MSTATS_SUB_BUCKET_BITS  5
+#define MSTATS_SUB_BUCKETS      (1 << MSTATS_SUB_BUCKET_BITS)
+
+struct HdrHistogram {
+    std::vector<unsigned int> counts;
+    unsigned long long total;
+    unsigned long long sum;
+    unsigned long long min;
+    unsigned long long max;
+};
+
+void mstats_hist_init (struct HdrHistogram *phist);
+void mstats_hist_record (struct HdrHistogram *phist, unsigned long long value);
+// Return: the largest value equivalent to the q-th quantile (0 <= q <= 1),
+// or 0 if the histogram is empty
+unsigned long long mstats_hist_quantile (const struct HdrHistogram *phist, double q);
+
+// The packets of one log code
+struct MsgCodeStats {
+    unsigned long long count;
+    unsigned long long bytes;               // sum of log_msg_len
+    unsigned long long last_timestamp;      // QCDM timestamp
+    struct HdrHistogram interarrival;       // QCDM timestamp ticks
+    struct HdrHistogram size;               // log_msg_len
+};
+
+// Statistics of the received or replayed frames, read from their headers
+// only, so that they are cheap enough for day-long captures.
+struct MessageStatsState {
+    bool enabled;
+    unsigned long long n_frames;            // CRC correct frames
+    unsigned long long n_crc_failures;
+    std::map<int, MsgCodeStats> codes;      // by log code
+};
+
+// Must be called before usage
+void mstats_init_state (struct MessageStatsState *pstate);
+
+// Enable or disable the statistics; both drop the collected ones.
+void mstats_configure (struct MessageStatsState *pstate, bool enabled);
+
+// Count a deframed packet (after check_frame_format()) whose CRC is correct
+void mstats_feed (struct MessageStatsState *pstate, const char *b, size_t length);
+
+inline void
+mstats_crc_failure (struct MessageStatsState *pstate) {
+    if (pstate->enabled)
+        pstate->n_crc_failures++;
+}
+
+#endif  // __DM_COLLECTOR_C_MESSAGE_STATS_H__
@@ -0,0 +1,303 @@
+/* parallel_replay.cpp
+ * Deframes log files on worker threads for offline replay.
+ *
+ * Decoding into Python objects needs the GIL, so it stays on the consumer
+ * thread; workers do the I/O, HDLC deframing, CRC checks and filtering,
+ * and extract the timestamps used to merge files.
+ */
+
+#include <Python.h>
+
+#include "parallel_replay.h"
+#include "log_reader.h"
+#include "hdlc.h"
+#include "consts.h"
+#include "log_packet.h"
+
+#include <cstring>
+
+typedef unsigned short     UINT16;
+typedef unsigned long long UINT64;
+
+static const size_t PREPLAY_DEFAULT_CHUNK_SIZE = 4 << 20;
+// Same as the prefix removed by check_frame_format()
+static const char FRAME_PREFIX[] = "\x98\x01\x00\x00\x01\x00\x00\x00";
+static const size_t FRAME_PREFIX_LEN = 8;
+
+// Deframe one chunk. Runs without the GIL.
+static void
+process_chunk (const struct ParallelReplayState *pstate, ReplayChunk *chunk) {
+    LogReaderState reader;
+    lreader_init_state(&reader);
+    if (!lreader_open(&reader, pstate->paths[chunk->file].c_str()))
+        return;
+    std::string frame;
+    bool crc_correct = false;
+    if (chunk->begin > 0) {
+        // Skip the frame that crosses the boundary; the previous chunk owns it.
+        if (!lreader_seek(&reader, chunk->begin)
+                || !lreader_next_frame(&reader, frame, crc_correct)) {
+            lreader_close(&reader);
+            return;
+        }
+    }
+
+    while (lreader_next_frame(&reader, frame, crc_correct)) {
+        if (reader.frame_offset > chunk->end)
+            break;
+        if (!crc_correct)
+            continue;
+        size_t skip = 0;
+        if (frame.size() >= FRAME_PREFIX_LEN
+                && memcmp(frame.c_str(), FRAME_PREFIX, FRAME_PREFIX_LEN) == 0)
+            skip = FRAME_PREFIX_LEN;
+        const char *b = frame.c_str() + skip;
+        size_t length = frame.size() - skip;
+
+        // Same as get_log_type() in export_manager.cpp
+        int type_id = -1;
+        UINT64 timestamp = 0;
+        bool has_timestamp = false;
+        if (is_log_packet(b, length) && length >= 8) {
+            UINT16 t;
+            memcpy(&t, b + 6, sizeof(t));
+            type_id = t;
+            if (length >= 16) {
+                memcpy(&timestamp, b + 8, sizeof(timestamp));
+                has_timestamp = true;
+            }
+        } else if (is_debug_packet(b, length)) {
+            type_id = Modem_debug_message;
+        }
+        if (pstate->whitelist.count(type_id) == 0)
+            continue;
+
+        chunk->frames.push_back(ReplayFrame());
+        chunk->frames.back().timestamp = timestamp;
+        chunk->frames.back().has_timestamp = has_timestamp;
+        chunk->frames.back().data.swap(frame);
+    }
+    lreader_close(&reader);
+}
+
+#ifndef _WIN32
+
+static void *
+worker_main (void *arg) {
+    ParallelReplayState *pstate = (ParallelReplayState *) arg;
+    pthread_mutex_lock(&pstate->lock);
+    while (true) {
+        while (pstate->tasks.empty() && !pstate->stopping)
+            pthread_cond_wait(&pstate->task_cond, &pstate->lock);
+        if (pstate->stopping)
+            break;
+        ReplayChunk *chunk = pstate->tasks.front();
+        pstate->tasks.pop_front();
+        pthread_mutex_unlock(&pstate->lock);
+
+        process_chunk(pstate, chunk);
+
+        pthread_mutex_lock(&pstate->lock);
+        chunk->ready = true;
+        pthread_cond_broadcast(&pstate->ready_cond);
+    }
+    pthread_mutex_unlock(&pstate->lock);
+    return NULL;
+}
+
+#endif
+
+// Schedule a chunk if it exists and is not scheduled yet. Lock held.
+static void
+schedule (struct ParallelReplayState *pstate, size_t file, size_t index) {
+    if (index >= pstate->chunks[file].size())
+        return;
+    ReplayChunk *chunk = pstate->chunks[file][index];
+    if (chunk->scheduled)
+        return;
+    chunk->scheduled = true;
+    pstate->tasks.push_back(chunk);
+#ifndef _WIN32
+    pthread_cond_signal(&pstate->task_cond);
+#endif
+}
+
+// Wait until a scheduled chunk is processed. Lock held.
+static void
+wait_ready (struct ParallelReplayState *pstate, ReplayChunk *chunk) {
+#ifndef _WIN32
+    if (!pstate->threads.empty()) {
+        while (!chunk->ready)
+            pthread_cond_wait(&pstate->ready_cond, &pstate->lock);
+        return;
+    }
+#endif
+    // No workers: process it here
+    if (!chunk->ready) {
+        for (std::deque<ReplayChunk *>::iterator it = pstate->tasks.begin();
+                it != pstate->tasks.end(); ++it) {
+            if (*it == chunk) {
+                pstate->tasks.erase(it);
+                break;
+            }
+        }
+        process_chunk(pstate, chunk);
+        chunk->ready = true;
+    }
+}
+
+void
+preplay_init_state (struct ParallelReplayState *pstate) {
+    pstate->paths.clear();
+    pstate->chunks.clear();
+    pstate->whitelist.clear();
+    pstate->prefetch = 1;
+    pstate->cur_chunk.clear();
+    pstate->cur_frame.clear();
+    pstate->last_timestamp.clear();
+    pstate->tasks.clear();
+    pstate->started = false;
+    pstate->stopping = false;
+#ifndef _WIN32
+    pstate->threads.clear();
+#endif
+}
+
+bool
+preplay_open (struct ParallelReplayState *pstate,
+                const std::vector<std::string> &paths,
+                const std::set<int> &whitelist,
+                int n_threads, size_t chunk_size) {
+    if (chunk_size == 0)
+        chunk_size = PREPLAY_DEFAULT_CHUNK_SIZE;
+    pstate->paths = paths;
+    pstate->whitelist = whitelist;
+    pstate->stopping = false;
+    pstate->prefetch = n_threads > 1 ? n_threads : 1;
+    pstate->chunks.assign(paths.size(), std::vector<ReplayChunk *>());
+    pstate->cur_chunk.assign(paths.size(), 0);
+    pstate->cur_frame.assign(paths.size(), 0);
+    pstate->last_timestamp.assign(paths.size(), 0);
+
+    for (size_t f = 0; f < paths.size(); f++) {
+        // Chunks are cut in the decompressed stream of .mi2logz logs
+        LogReaderState reader;
+        lreader_init_state(&reader);
+        if (!lreader_open(&reader, paths[f].c_str())) {
+            preplay_close(pstate);
+            return false;
+        }
+        UINT64 size = reader.total_size;
+        lreader_close(&reader);
+        UINT64 begin = 0;
+        do {
+            ReplayChunk *chunk = new ReplayChunk;
+            chunk->file = f;
+            chunk->begin = begin;
+            chunk->end = (size - begin > chunk_size) ? begin + chunk_size : size;
+            chunk->scheduled = false;
+            chunk->ready = false;
+            pstate->chunks[f].push_back(chunk);
+            begin = chunk->end;
+        } while (begin < size);
+    }
+
+#ifndef _WIN32
+    pthread_mutex_init(&pstate->lock, NULL);
+    pthread_cond_init(&pstate->task_cond, NULL);
+    pthread_cond_init(&pstate->ready_cond, NULL);
+    pstate->started = true;
+    for (int i = 0; i < n_threads; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, worker_main, pstate) != 0)
+            break;
+        pstate->threads.push_back(t);
+    }
+    pthread_mutex_lock(&pstate->lock);
+#endif
+    // The head of every file is needed to merge them.
+    for (size_t f = 0; f < paths.size(); f++)
+        schedule(pstate, f, 0);
+#ifndef _WIN32
+    pthread_mutex_unlock(&pstate->lock);
+#endif
+    return true;
+}
+
+// Make the current frame of a file available, moving to later chunks as
+// needed. Lock held.
+// Return: the current frame, or NULL if the file is finished
+static ReplayFrame *
+current_frame (struct ParallelReplayState *pstate, size_t f) {
+    std::vector<ReplayChunk *> &chunks = pstate->chunks[f];
+    while (pstate->cur_chunk[f] < chunks.size()) {
+        size_t c = pstate->cur_chunk[f];
+        schedule(pstate, f, c);
+        ReplayChunk *chunk = chunks[c];
+        wait_ready(pstate, chunk);
+        if (pstate->cur_frame[f] < chunk->frames.size())
+            return &chunk->frames[pstate->cur_frame[f]];
+        // This chunk is consumed
+        std::vector<ReplayFrame>().swap(chunk->frames);
+        pstate->cur_chunk[f]++;
+        pstate->cur_frame[f] = 0;
+    }
+    return NULL;
+}
+
+ReplayFrame *
+preplay_next (struct ParallelReplayState *pstate) {
+#ifndef _WIN32
+    pthread_mutex_lock(&pstate->lock);
+#endif
+    ReplayFrame *best = NULL;
+    size_t best_file = 0;
+    UINT64 best_timestamp = 0;
+    for (size_t f = 0; f < pstate->paths.size(); f++) {
+        ReplayFrame *frame = current_frame(pstate, f);
+        if (frame == NULL)
+            continue;
+        // Frames without a timestamp stay right after their predecessor.
+        UINT64 timestamp = frame->has_timestamp ? frame->timestamp
+                                                : pstate->last_timestamp[f];
+        if (best == NULL || timestamp < best_timestamp) {
+            best = frame;
+            best_file = f;
+            best_timestamp = timestamp;
+        }
+    }
+    if (best != NULL) {
+        pstate->cur_frame[best_file]++;
+        pstate->last_timestamp[best_file] = best_timestamp;
+        // Only files being consumed are read ahead, which bounds memory.
+        size_t c = pstate->cur_chunk[best_file];
+        for (size_t k = 1; k <= pstate->prefetch; k++)
+            schedule(pstate, best_file, c + k);
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&pstate->lock);
+#endif
+    return best;
+}
+
+void
+preplay_close (struct ParallelReplayState *pstate) {
+#ifndef _WIN32
+    if (pstate->started) {
+        pthread_mutex_lock(&pstate->lock);
+        pstate->stopping = true;
+        pthread_cond_broadcast(&pstate->task_cond);
+        pthread_mutex_unlock(&pstate->lock);
+        for (size_t i = 0; i < pstate->threads.size(); i++)
+            pthread_join(pstate->threads[i], NULL);
+        pthread_mutex_destroy(&pstate->lock);
+        pthread_cond_destroy(&pstate->task_cond);
+        pthread_cond_destroy(&pstate->ready_cond);
+    }
+#endif
+    for (size_t f = 0; f < pstate->chunks.size(); f++) {
+        for (size_t c = 0; c < pstate->chunks[f].size(); c++)
+            delete pstate->chunks[f][c];
+    }
+    preplay_init_state(pstate);
+}
@@ -0,0 +1,76 @@
+#ifndef __DM_COLLECTOR_C_PARALLEL_REPLAY_H__
+#define __DM_COLLECTOR_C_PARALLEL_REPLAY_H__
+
+#include <set>
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstddef>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// A deframed packet whose CRC is correct, with its QCDM timestamp
+struct ReplayFrame {
+    unsigned long long timestamp;
+    bool has_timestamp;     // false for debug messages
+    std::string data;
+};
+
+// A piece of a log file. It holds the frames that start within
+// (begin, end], except that the first piece of a file starts at 0.
+// Pieces are split at 0x7e bytes, so no frame is decoded twice.
+struct ReplayChunk {
+    size_t file;
+    unsigned long long begin;
+    unsigned long long end;
+    bool scheduled;
+    bool ready;
+    std::vector<ReplayFrame> frames;
+};
+
+// Offline replay of several log files on a pool of worker threads.
+// Workers read, deframe, check and filter the chunks; the consumer merges
+// the files by timestamp (within a file, the original order is kept).
+struct ParallelReplayState {
+    std::vector<std::string> paths;
+    std::vector<std::vector<ReplayChunk *> > chunks;  // per file
+    std::set<int> whitelist;
+    size_t prefetch;        // chunks scheduled ahead of a consumed chunk
+
+    // merge state, per file
+    std::vector<size_t> cur_chunk;
+    std::vector<size_t> cur_frame;
+    std::vector<unsigned long long> last_timestamp;
+
+    std::deque<ReplayChunk *> tasks;
+    bool started;           // threads and locks are initialized
+    bool stopping;
+#ifndef _WIN32
+    std::vector<pthread_t> threads;
+    pthread_mutex_t lock;
+    pthread_cond_t task_cond;
+    pthread_cond_t ready_cond;
+#endif
+};
+
+// Must be called before usage
+void preplay_init_state (struct ParallelReplayState *pstate);
+
+// Start replaying. With n_threads == 0 (or where threads are unavailable),
+// chunks are processed by the consumer itself.
+// Return: successful or not (e.g. a file cannot be opened)
+bool preplay_open (struct ParallelReplayState *pstate,
+                    const std::vector<std::string> &paths,
+                    const std::set<int> &whitelist,
+                    int n_threads, size_t chunk_size);
+
+// Return: the next frame in timestamp order, or NULL at the end.
+// The frame is valid until the next call. May block.
+ReplayFrame *preplay_next (struct ParallelReplayState *pstate);
+
+// Stop workers and free all chunks.
+void preplay_close (struct ParallelReplayState *pstate);
+
+#endif  // __DM_COLLECTOR_C_PARALLEL_REPLAY_H__
@@ -0,0 +1,120 @@
+/* perf_counters.cpp
+ * Counters and timers of the collection stages (deframing, filtering,
+ * decoding, conversion to Python objects, ws_dissector), so that the time
+ * spent on real devices can be attributed without a profiler.
+ */
+
+#include "perf_counters.h"
+
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/time.h>
+#include <time.h>
+#else
+#include <ctime>
+#endif
+
+unsigned long long
+perf_now_ns () {
+#if defined(CLOCK_MONOTONIC) && !defined(_WIN32)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#elif !defined(_WIN32)
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+#else
+    return (unsigned long long) clock() * (1000000000ULL / CLOCKS_PER_SEC);
+#endif
+}
+
+static void
+reset_timer (struct PerfTimer *ptimer) {
+    ptimer->count = 0;
+    ptimer->total_ns = 0;
+    ptimer->max_ns = 0;
+}
+
+void
+perf_init_state (struct PerfCountersState *pstate) {
+    pstate->enabled = false;
+    pstate->t_start = perf_now_ns() * 1e-9;
+    pstate->bytes_fed = 0;
+    pstate->frames = 0;
+    pstate->crc_failures = 0;
+    pstate->filtered_out = 0;
+    pstate->export_bytes_base = 0;
+    pstate->decode.clear();
+    reset_timer(&pstate->build);
+    reset_timer(&pstate->ws_dissector);
+    pstate->dump_interval = 0;
+    pstate->next_dump = 0;
+}
+
+void
+perf_configure (struct PerfCountersState *pstate, bool enabled,
+                    double dump_interval, unsigned long long export_bytes) {
+    perf_init_state(pstate);
+    pstate->enabled = enabled;
+    pstate->export_bytes_base = export_bytes;
+    if (enabled && dump_interval > 0) {
+        pstate->dump_interval = dump_interval;
+        pstate->next_dump = pstate->t_start + dump_interval;
+    }
+}
+
+void
+perf_timer_add (struct PerfTimer *ptimer, unsigned long long ns) {
+    ptimer->count++;
+    ptimer->total_ns += ns;
+    if (ns > ptimer->max_ns)
+        ptimer->max_ns = ns;
+}
+
+void
+perf_record_decode (struct PerfCountersState *pstate, int log_code,
+                        unsigned long long ns) {
+    std::map<int, PerfTimer>::iterator it = pstate->decode.find(log_code);
+    if (it == pstate->decode.end()) {
+        it = pstate->decode.insert(std::make_pair(log_code, PerfTimer())).first;
+        reset_timer(&it->second);
+    }
+    perf_timer_add(&it->second, ns);
+}
+
+bool
+perf_dump_due (struct PerfCountersState *pstate) {
+    if (!pstate->enabled || pstate->dump_interval <= 0)
+        return false;
+    double now = perf_now_ns() * 1e-9;
+    if (now < pstate->next_dump)
+        return false;
+    pstate->next_dump = now + pstate->dump_interval;
+    return true;
+}
+
+std::string
+perf_format (const struct PerfCountersState *pstate,
+                unsigned long long export_bytes) {
+    struct PerfTimer decode;
+    reset_timer(&decode);
+    for (std::map<int, PerfTimer>::const_iterator it = pstate->decode.begin();
+            it != pstate->decode.end(); ++it) {
+        decode.count += it->second.count;
+        decode.total_ns += it->second.total_ns;
+    }
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+                "elapsed=%.1fs bytes_fed=%llu frames=%llu crc_failures=%llu"
+                " filtered_out=%llu export_bytes=%llu decoded=%llu decode_ms=%.1f"
+                " build_ms=%.1f ws_dissector=%llu ws_dissector_ms=%.1f",
+                perf_now_ns() * 1e-9 - pstate->t_start,
+                pstate->bytes_fed, pstate->frames, pstate->crc_failures,
+                pstate->filtered_out, perf_export_bytes(pstate, export_bytes),
+                decode.count, decode.total_ns * 1e-6,
+                pstate->build.total_ns * 1e-6,
+                pstate->ws_dissector.count, pstate->ws_dissector.total_ns * 1e-6);
+    return buf;
+}
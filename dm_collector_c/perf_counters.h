@@ -0,0 +1,66 @@
+#ifndef __DM_COLLECTOR_C_PERF_COUNTERS_H__
+#define __DM_COLLECTOR_C_PERF_COUNTERS_H__
+
+#include <map>
+#include <string>
+
+// Durations of one stage
+struct PerfTimer {
+    unsigned long long count;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+};
+
+// Counters of the collection hot path. When disabled, every call site costs
+// one branch; when enabled, a monotonic clock read per timed call.
+struct PerfCountersState {
+    bool enabled;
+    double t_start;                         // monotonic seconds
+    unsigned long long bytes_fed;           // raw bytes given to the deframers
+    unsigned long long frames;              // deframed, including CRC failures
+    unsigned long long crc_failures;
+    unsigned long long filtered_out;        // not in the whitelist or window
+    unsigned long long export_bytes_base;   // ExportManagerState::total_bytes at start
+    std::map<int, PerfTimer> decode;        // decode_log_packet() by log code
+    struct PerfTimer build;                 // LogPacket dict/list conversions
+    struct PerfTimer ws_dissector;          // round trips, measured by the caller
+    double dump_interval;                   // seconds, 0 if never dumped
+    double next_dump;
+};
+
+// Must be called before usage
+void perf_init_state (struct PerfCountersState *pstate);
+
+// Enable or disable the counters; both reset them. With dump_interval > 0,
+// perf_dump_due() becomes true every dump_interval seconds.
+void perf_configure (struct PerfCountersState *pstate, bool enabled,
+                        double dump_interval, unsigned long long export_bytes);
+
+// Monotonic time in nanoseconds
+unsigned long long perf_now_ns ();
+
+void perf_timer_add (struct PerfTimer *ptimer, unsigned long long ns);
+void perf_record_decode (struct PerfCountersState *pstate, int log_code,
+                            unsigned long long ns);
+
+// Return: true if a periodic dump should be written now
+bool perf_dump_due (struct PerfCountersState *pstate);
+// A one-line summary, for periodic dumps
+std::string perf_format (const struct PerfCountersState *pstate,
+                            unsigned long long export_bytes);
+
+// Return: the bytes exported since the counters were configured, given
+// ExportManagerState::total_bytes
+inline unsigned long long
+perf_export_bytes (const struct PerfCountersState *pstate,
+                    unsigned long long export_bytes) {
+    return export_bytes >= pstate->export_bytes_base
+            ? export_bytes - pstate->export_bytes_base : 0;
+}
+
+inline bool
+perf_enabled (const struct PerfCountersState *pstate) {
+    return pstate->enabled;
+}
+
+#endif  // __DM_COLLECTOR_C_PERF_COUNTERS_H__
@@ -0,0 +1,192 @@
+/* rlc_tracker.cpp
+ * Per-RB sequence number tracking of LTE RLC AM, so that retransmissions,
+ * NACKs and ACK latency can be followed over long captures without keeping
+ * every PDU in Python.
+ */
+
+#include "rlc_tracker.h"
+
+#include <cstring>
+
+static const double QCDM_TICKS_PER_SECOND = 52428800.0;
+// Summaries kept until they are collected
+static const size_t RTRACK_MAX_PENDING = 4096;
+// Frame time wraps around with sys_fn (1024 frames of 10 subframes)
+static const int RTRACK_FN_MODULUS = 10240;
+static const unsigned short RTRACK_NOT_SENT = 0xffff;
+
+static void
+reset_summary (RlcTrackerSummary &s, unsigned long long t_start) {
+    s.t_start = t_start;
+    s.t_end = t_start;
+    s.bearers.clear();
+}
+
+void
+rtrack_init_state (struct RlcTrackerState *pstate) {
+    pstate->window_ticks = 0;
+    pstate->in_window = false;
+    reset_summary(pstate->current, 0);
+    pstate->done.clear();
+    pstate->n_dropped = 0;
+    pstate->bearers.clear();
+}
+
+void
+rtrack_configure (struct RlcTrackerState *pstate, double window_seconds) {
+    rtrack_init_state(pstate);
+    if (window_seconds > 0)
+        pstate->window_ticks = (unsigned long long) (window_seconds * QCDM_TICKS_PER_SECOND);
+    if (window_seconds > 0 && pstate->window_ticks == 0)
+        pstate->window_ticks = 1;
+}
+
+static RlcBearerRings &
+get_rings (struct RlcTrackerState *pstate, int rb_cfg_idx) {
+    std::map<int, RlcBearerRings>::iterator it = pstate->bearers.find(rb_cfg_idx);
+    if (it != pstate->bearers.end())
+        return it->second;
+    RlcBearerRings &r = pstate->bearers[rb_cfg_idx];
+    for (int d = 0; d < 2; d++) {
+        for (int i = 0; i < RTRACK_SN_MODULUS; i++)
+            r.ring[d].tx_time[i] = RTRACK_NOT_SENT;
+        r.ring[d].highest_sn = -1;
+        r.ring[d].outstanding = 0;
+    }
+    return r;
+}
+
+static RlcBearerSummary &
+get_summary (struct RlcTrackerState *pstate, int rb_cfg_idx) {
+    std::map<int, RlcBearerSummary>::iterator it =
+        pstate->current.bearers.find(rb_cfg_idx);
+    if (it != pstate->current.bearers.end())
+        return it->second;
+    RlcBearerSummary &s = pstate->current.bearers[rb_cfg_idx];
+    memset(&s, 0, sizeof(s));
+    s.link[RTRACK_UL].highest_sn = -1;
+    s.link[RTRACK_DL].highest_sn = -1;
+    return s;
+}
+
+static void
+close_window (struct RlcTrackerState *pstate) {
+    // Snapshot the transmission windows
+    for (std::map<int, RlcBearerSummary>::iterator it = pstate->current.bearers.begin();
+            it != pstate->current.bearers.end(); ++it) {
+        const RlcBearerRings &r = get_rings(pstate, it->first);
+        for (int d = 0; d < 2; d++) {
+            it->second.link[d].highest_sn = r.ring[d].highest_sn;
+            it->second.link[d].outstanding = r.ring[d].outstanding;
+        }
+    }
+    if (pstate->done.size() >= RTRACK_MAX_PENDING) {
+        pstate->done.pop_front();
+        pstate->n_dropped++;
+    }
+    pstate->done.push_back(pstate->current);
+    pstate->in_window = false;
+}
+
+void
+rtrack_begin_packet (struct RlcTrackerState *pstate, unsigned long long timestamp) {
+    if (pstate->window_ticks == 0)
+        return;
+    if (pstate->in_window
+            && (timestamp < pstate->current.t_start    // e.g. a new log
+                || timestamp - pstate->current.t_start >= pstate->window_ticks))
+        close_window(pstate);
+    if (!pstate->in_window) {
+        reset_summary(pstate->current, timestamp);
+        pstate->in_window = true;
+    }
+    pstate->current.t_end = timestamp;
+}
+
+static inline int
+frame_time (int sys_fn, int sub_fn) {
+    return (sys_fn * 10 + sub_fn) % RTRACK_FN_MODULUS;
+}
+
+void
+rtrack_data_pdu (struct RlcTrackerState *pstate, RlcDirection dir,
+                    int rb_cfg_idx, int sys_fn, int sub_fn, int sn,
+                    int pdu_bytes) {
+    if (!pstate->in_window)
+        return;
+    RlcSnRing &ring = get_rings(pstate, rb_cfg_idx).ring[dir];
+    RlcLinkStats &stats = get_summary(pstate, rb_cfg_idx).link[dir];
+    sn &= RTRACK_SN_MODULUS - 1;
+
+    stats.data_pdus++;
+    stats.data_bytes += pdu_bytes;
+    if (ring.tx_time[sn] != RTRACK_NOT_SENT)
+        stats.retx_pdus++;
+    else
+        ring.outstanding++;
+    ring.tx_time[sn] = frame_time(sys_fn, sub_fn);
+
+    if (ring.highest_sn < 0) {
+        ring.highest_sn = sn;
+        return;
+    }
+    int advance = (sn - ring.highest_sn) & (RTRACK_SN_MODULUS - 1);
+    if (advance == 0 || advance >= RTRACK_WINDOW_SIZE)
+        return;
+    // SNs that fall behind the window can no longer be acked
+    for (int i = 1; i <= advance; i++) {
+        int old = (ring.highest_sn + i + RTRACK_WINDOW_SIZE) & (RTRACK_SN_MODULUS - 1);
+        if (ring.tx_time[old] != RTRACK_NOT_SENT) {
+            ring.tx_time[old] = RTRACK_NOT_SENT;
+            ring.outstanding--;
+        }
+    }
+    ring.highest_sn = sn;
+}
+
+void
+rtrack_status_pdu (struct RlcTrackerState *pstate, RlcDirection dir,
+                    int rb_cfg_idx, int sys_fn, int sub_fn, int ack_sn,
+                    int pdu_bytes, const std::vector<int> &nacks) {
+    if (!pstate->in_window)
+        return;
+    RlcDirection data_dir = (dir == RTRACK_UL) ? RTRACK_DL : RTRACK_UL;
+    RlcSnRing &ring = get_rings(pstate, rb_cfg_idx).ring[data_dir];
+    RlcBearerSummary &s = get_summary(pstate, rb_cfg_idx);
+    s.link[dir].status_pdus++;
+    s.link[dir].status_bytes += pdu_bytes;
+
+    RlcLinkStats &stats = s.link[data_dir];
+    stats.nacks += nacks.size();
+    if (ring.outstanding == 0)
+        return;
+
+    // Every SN of the window below ack_sn, except the NACKed ones
+    int now = frame_time(sys_fn, sub_fn);
+    int first = (ack_sn - RTRACK_WINDOW_SIZE) & (RTRACK_SN_MODULUS - 1);
+    for (int i = 0; i < RTRACK_WINDOW_SIZE; i++) {
+        int sn = (first + i) & (RTRACK_SN_MODULUS - 1);
+        if (ring.tx_time[sn] == RTRACK_NOT_SENT)
+            continue;
+        bool nacked = false;
+        for (size_t j = 0; j < nacks.size() && !nacked; j++)
+            nacked = (nacks[j] & (RTRACK_SN_MODULUS - 1)) == sn;
+        if (nacked)
+            continue;
+        unsigned int latency = (now - ring.tx_time[sn] + RTRACK_FN_MODULUS)
+                                    % RTRACK_FN_MODULUS;
+        stats.acked_pdus++;
+        stats.ack_latency_sum += latency;
+        if (latency > stats.ack_latency_max)
+            stats.ack_latency_max = latency;
+        ring.tx_time[sn] = RTRACK_NOT_SENT;
+        ring.outstanding--;
+    }
+}
+
+void
+rtrack_flush (struct RlcTrackerState *pstate) {
+    if (pstate->in_window && !pstate->current.bearers.empty())
+        close_window(pstate);
+    pstate->in_window = false;
+}
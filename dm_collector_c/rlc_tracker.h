@@ -0,0 +1,97 @@
+#ifndef __DM_COLLECTOR_C_RLC_TRACKER_H__
+#define __DM_COLLECTOR_C_RLC_TRACKER_H__
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <cstddef>
+
+// 10-bit sequence numbers of LTE RLC AM
+#define RTRACK_SN_MODULUS   1024
+#define RTRACK_WINDOW_SIZE  512
+
+enum RlcDirection {
+    RTRACK_UL = 0,
+    RTRACK_DL = 1
+};
+
+// One direction of a radio bearer within a window. Status PDUs are counted
+// in the direction they are sent, while the NACKs and ACKs they carry are
+// counted in the direction of the data they acknowledge.
+struct RlcLinkStats {
+    unsigned long long data_pdus;
+    unsigned long long data_bytes;
+    unsigned long long retx_pdus;       // SNs sent again before being acked
+    unsigned long long status_pdus;
+    unsigned long long status_bytes;
+    unsigned long long nacks;
+    unsigned long long acked_pdus;
+    unsigned long long ack_latency_sum;     // ms, from sys_fn/sub_fn
+    unsigned int ack_latency_max;
+    int highest_sn;                     // -1 if no data PDU yet
+    unsigned int outstanding;           // SNs sent but not acked yet
+};
+
+struct RlcBearerSummary {
+    struct RlcLinkStats link[2];        // by RlcDirection
+};
+
+struct RlcTrackerSummary {
+    unsigned long long t_start;         // QCDM timestamps
+    unsigned long long t_end;
+    std::map<int, RlcBearerSummary> bearers;    // by RB Cfg Idx
+};
+
+// The transmission window of one direction of a radio bearer: the frame
+// time (sys_fn * 10 + sub_fn) each SN was last sent, until it is acked.
+struct RlcSnRing {
+    unsigned short tx_time[RTRACK_SN_MODULUS];
+    int highest_sn;
+    unsigned int outstanding;
+};
+
+struct RlcBearerRings {
+    struct RlcSnRing ring[2];           // by RlcDirection
+};
+
+// Tracks the sequence numbers of LTE_RLC_UL_AM_All_PDU and
+// LTE_RLC_DL_AM_All_PDU per RB config, fed by their decoders, and produces
+// one summary per window. Like ThroughputAggregatorState, a window is
+// closed by the first packet that is at least window_ticks after its start.
+struct RlcTrackerState {
+    unsigned long long window_ticks;    // 0 if disabled
+    bool in_window;
+    struct RlcTrackerSummary current;
+    std::deque<RlcTrackerSummary> done;
+    unsigned long long n_dropped;       // summaries not collected in time
+    std::map<int, RlcBearerRings> bearers;  // kept across windows
+};
+
+// Must be called before usage
+void rtrack_init_state (struct RlcTrackerState *pstate);
+
+// Set the summary window; 0 disables the tracker and drops its state.
+void rtrack_configure (struct RlcTrackerState *pstate, double window_seconds);
+
+// Start a packet whose PDUs are fed next
+void rtrack_begin_packet (struct RlcTrackerState *pstate, unsigned long long timestamp);
+
+// A data PDU sent in direction dir
+void rtrack_data_pdu (struct RlcTrackerState *pstate, RlcDirection dir,
+                        int rb_cfg_idx, int sys_fn, int sub_fn, int sn,
+                        int pdu_bytes);
+// A status PDU sent in direction dir, which acknowledges every SN below
+// ack_sn that is not NACKed, of the opposite direction.
+void rtrack_status_pdu (struct RlcTrackerState *pstate, RlcDirection dir,
+                        int rb_cfg_idx, int sys_fn, int sub_fn, int ack_sn,
+                        int pdu_bytes, const std::vector<int> &nacks);
+
+// Close the current window, e.g. at the end of a log.
+void rtrack_flush (struct RlcTrackerState *pstate);
+
+inline bool
+rtrack_enabled (const struct RlcTrackerState *pstate) {
+    return pstate->window_ticks > 0;
+}
+
+#endif  // __DM_COLLECTOR_C_RLC_TRACKER_H__
@@ -0,0 +1,230 @@
+/* throughput_aggregator.cpp
+ * Windowed DL/UL link statistics computed from the binary PDSCH and MAC
+ * packets, so that bandwidth estimation does not decode every subframe.
+ * The field offsets follow the Fmt arrays of log_packet.h.
+ */
+
+#include "throughput_aggregator.h"
+#include "consts.h"
+
+#include <cstring>
+
+static const double QCDM_TICKS_PER_SECOND = 52428800.0;
+// Summaries kept until they are collected
+static const size_t TAGGR_MAX_PENDING = 4096;
+// 16 = 2 (0x1000) + 2 (len1) + 2 (log_msg_len) + 2 (type_id) + 8 (timestamp)
+static const size_t TAGGR_HEADER_LEN = 16;
+
+template <typename T>
+static T
+read_le (const char *p) {
+    T v;
+    memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+static void
+reset_summary (ThroughputSummary &s, unsigned long long t_start) {
+    s.t_start = t_start;
+    s.t_end = t_start;
+    s.dl_tbs_bits = 0;
+    s.n_pdsch = 0;
+    memset(s.mcs_counts, 0, sizeof(s.mcs_counts));
+    s.ul_grant_received = 0;
+    s.ul_grant_utilized = 0;
+    s.ul_buffer.clear();
+}
+
+void
+taggr_init_state (struct ThroughputAggregatorState *pstate) {
+    pstate->window_ticks = 0;
+    pstate->in_window = false;
+    reset_summary(pstate->current, 0);
+    pstate->done.clear();
+    pstate->n_dropped = 0;
+    pstate->n_malformed = 0;
+}
+
+void
+taggr_configure (struct ThroughputAggregatorState *pstate, double window_seconds) {
+    taggr_init_state(pstate);
+    if (window_seconds > 0)
+        pstate->window_ticks = (unsigned long long) (window_seconds * QCDM_TICKS_PER_SECOND);
+    if (window_seconds > 0 && pstate->window_ticks == 0)
+        pstate->window_ticks = 1;
+}
+
+// LTE_PHY_PDSCH_Packet (LtePhyPdschDemapperConfigFmt_v23/v103/v104)
+// c_rnti is set if the packet carries user data
+static bool
+feed_pdsch (ThroughputSummary &s, const char *p, size_t length, bool &c_rnti) {
+    c_rnti = false;
+    if (length < 1)
+        return false;
+    int version = (unsigned char) p[0];
+    size_t tbs0_offset;
+    if (version == 23 || version == 103)
+        tbs0_offset = 44;
+    else if (version == 104)
+        tbs0_offset = 42;   // no reserved bytes before "TBS 0"
+    else
+        return true;        // not supported, but not malformed either
+    if (length < tbs0_offset + 8)
+        return false;
+    // "PDSCH RNTI Type" is the lowest 4 bits of "Number of Tx Antennas(M)"
+    int rnti_type = read_le<unsigned short>(p + 6) & 15;
+    if (rnti_type != 0)     // only C-RNTI carries user data
+        return true;
+    c_rnti = true;
+    unsigned int tbs0 = read_le<unsigned short>(p + tbs0_offset);
+    unsigned int mcs0 = read_le<unsigned short>(p + tbs0_offset + 2);
+    unsigned int tbs1 = read_le<unsigned short>(p + tbs0_offset + 4);
+    s.dl_tbs_bits += tbs0 + tbs1;
+    s.n_pdsch++;
+    s.mcs_counts[(mcs0 >> 1) & 3]++;
+    return true;
+}
+
+// LTE_MAC_UL_Tx_Statistics (LteMacULTxStatistics_*Fmt)
+static bool
+feed_ul_tx_statistics (ThroughputSummary &s, const char *p, size_t length) {
+    if (length < 4)
+        return false;
+    if (p[0] != 1)      // packet version
+        return true;
+    int n_subpkt = (unsigned char) p[1];
+    size_t offset = 4;
+    for (int i = 0; i < n_subpkt; i++) {
+        if (offset + 4 + 16 > length)
+            return false;
+        int subpkt_ver = (unsigned char) p[offset + 1];
+        offset += 4;
+        size_t grant_offset;
+        if (subpkt_ver == 1)
+            grant_offset = 5;
+        else if (subpkt_ver == 2)
+            grant_offset = 6;
+        else
+            return true;    // the size of unknown versions is unknown
+        s.ul_grant_received += read_le<unsigned int>(p + offset + grant_offset);
+        s.ul_grant_utilized += read_le<unsigned int>(p + offset + grant_offset + 4);
+        offset += 16;
+    }
+    return true;
+}
+
+// LTE_MAC_UL_Buffer_Status_Internal
+// (LteMacULBufferStatusInternal_ULBufferStatusSubPacket_*Fmt)
+static bool
+feed_ul_buffer_status (ThroughputSummary &s, const char *p, size_t length) {
+    if (length < 4)
+        return false;
+    if (p[0] != 1)      // packet version
+        return true;
+    int n_subpkt = (unsigned char) p[1];
+    size_t offset = 4;
+    for (int i = 0; i < n_subpkt; i++) {
+        if (offset + 5 > length)
+            return false;
+        int subpkt_ver = (unsigned char) p[offset + 1];
+        int n_samples = (unsigned char) p[offset + 4];
+        offset += 5;
+        size_t sample_len, lcid_len;
+        if (subpkt_ver == 3) {
+            sample_len = 3;
+            lcid_len = 12;
+        } else if (subpkt_ver == 24) {
+            sample_len = 4;
+            lcid_len = 16;
+        } else {
+            return true;
+        }
+        for (int j = 0; j < n_samples; j++) {
+            if (offset + sample_len > length)
+                return false;
+            int n_lcids = (unsigned char) p[offset + sample_len - 1];
+            offset += sample_len;
+            if (offset + n_lcids * lcid_len > length)
+                return false;
+            for (int k = 0; k < n_lcids; k++, offset += lcid_len) {
+                const char *q = p + offset;
+                int lcid = (unsigned char) q[0];
+                // New (uncompressed + compressed) + Retx + Ctrl bytes
+                unsigned int total = read_le<unsigned int>(q + 2)
+                                        + read_le<unsigned int>(q + 6);
+                if (subpkt_ver == 24)
+                    total += read_le<unsigned int>(q + 10)
+                                + read_le<unsigned short>(q + 14);
+                else
+                    total += read_le<unsigned short>(q + 10);
+                LcidBufferStats &b = s.ul_buffer[lcid];     // zero-initialized
+                if (total > b.peak)
+                    b.peak = total;
+                b.last = total;
+                b.sum += total;
+                b.n_samples++;
+            }
+        }
+    }
+    return true;
+}
+
+static void
+close_window (struct ThroughputAggregatorState *pstate) {
+    if (pstate->done.size() >= TAGGR_MAX_PENDING) {
+        pstate->done.pop_front();
+        pstate->n_dropped++;
+    }
+    pstate->done.push_back(pstate->current);
+    pstate->in_window = false;
+}
+
+bool
+taggr_feed (struct ThroughputAggregatorState *pstate, const char *b, size_t length) {
+    if (pstate->window_ticks == 0 || length < TAGGR_HEADER_LEN || b[0] != '\x10')
+        return false;
+    unsigned short log_code = read_le<unsigned short>(b + 6);
+    if (log_code != LTE_PHY_PDSCH_Demapper_Configuration
+            && log_code != LTE_MAC_UL_Tx_Statistics
+            && log_code != LTE_MAC_UL_Buffer_Status_Internal)
+        return false;
+    unsigned long long timestamp = read_le<unsigned long long>(b + 8);
+
+    if (pstate->in_window && timestamp < pstate->current.t_start)
+        close_window(pstate);   // the clock went back, e.g. a new log
+    if (!pstate->in_window) {
+        reset_summary(pstate->current, timestamp);
+        pstate->in_window = true;
+    }
+
+    ThroughputSummary &s = pstate->current;
+    const char *p = b + TAGGR_HEADER_LEN;
+    size_t n = length - TAGGR_HEADER_LEN;
+    bool valid;
+    // Like LtePhyAnalyzer, PDSCHs of other RNTIs do not close the window
+    bool can_close = true;
+    if (log_code == LTE_PHY_PDSCH_Demapper_Configuration)
+        valid = feed_pdsch(s, p, n, can_close);
+    else if (log_code == LTE_MAC_UL_Tx_Statistics)
+        valid = feed_ul_tx_statistics(s, p, n);
+    else
+        valid = feed_ul_buffer_status(s, p, n);
+    if (!valid)
+        pstate->n_malformed++;
+    s.t_end = timestamp;
+
+    if (can_close && timestamp - s.t_start >= pstate->window_ticks) {
+        close_window(pstate);
+        // The next window starts where this one ends
+        reset_summary(pstate->current, timestamp);
+        pstate->in_window = true;
+    }
+    return true;
+}
+
+void
+taggr_flush (struct ThroughputAggregatorState *pstate) {
+    if (pstate->in_window && pstate->current.t_end > pstate->current.t_start)
+        close_window(pstate);
+    pstate->in_window = false;
+}
@@ -0,0 +1,62 @@
+#ifndef __DM_COLLECTOR_C_THROUGHPUT_AGGREGATOR_H__
+#define __DM_COLLECTOR_C_THROUGHPUT_AGGREGATOR_H__
+
+#include <map>
+#include <deque>
+#include <cstddef>
+
+// UL buffer occupancy of a logical channel within a window
+struct LcidBufferStats {
+    unsigned int last;          // total bytes of the latest sample
+    unsigned int peak;
+    unsigned long long sum;     // to compute the average
+    unsigned int n_samples;
+};
+
+// Link statistics of one averaging window
+struct ThroughputSummary {
+    unsigned long long t_start;     // QCDM timestamps
+    unsigned long long t_end;
+    unsigned long long dl_tbs_bits;         // TBS 0 + TBS 1 of C-RNTI PDSCHs
+    unsigned int n_pdsch;
+    unsigned int mcs_counts[4];             // QPSK, 16QAM, 64QAM, others (of MCS 0)
+    unsigned long long ul_grant_received;   // bytes
+    unsigned long long ul_grant_utilized;   // bytes
+    std::map<int, LcidBufferStats> ul_buffer;   // by LCID
+};
+
+// Aggregates LTE_PHY_PDSCH_Packet, LTE_MAC_UL_Tx_Statistics and
+// LTE_MAC_UL_Buffer_Status_Internal straight from the binary packets, and
+// produces one summary per averaging window. A window is closed by the
+// first packet that is at least window_ticks after its start, the same
+// way LtePhyAnalyzer computes its avg_window bandwidth: PDSCHs of other
+// RNTIs than C-RNTI may start a window but never close it.
+struct ThroughputAggregatorState {
+    unsigned long long window_ticks;    // 0 if disabled
+    bool in_window;
+    ThroughputSummary current;
+    std::deque<ThroughputSummary> done;
+    unsigned long long n_dropped;       // summaries not collected in time
+    unsigned long long n_malformed;     // packets too short for their version
+};
+
+// Must be called before usage
+void taggr_init_state (struct ThroughputAggregatorState *pstate);
+
+// Set the averaging window; 0 disables the aggregator and drops its state.
+void taggr_configure (struct ThroughputAggregatorState *pstate, double window_seconds);
+
+// Feed a deframed packet (after check_frame_format()). Other types of
+// packets are ignored.
+// Return: true if the packet is aggregated
+bool taggr_feed (struct ThroughputAggregatorState *pstate, const char *b, size_t length);
+
+// Close the current window, e.g. at the end of a log.
+void taggr_flush (struct ThroughputAggregatorState *pstate);
+
+inline bool
+taggr_enabled (const struct ThroughputAggregatorState *pstate) {
+    return pstate->window_ticks > 0;
+}
+
+#endif  // __DM_COLLECTOR_C_THROUGHPUT_AGGREGATOR_H__
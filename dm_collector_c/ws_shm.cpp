@@ -0,0 +1,143 @@
+/* ws_shm.cpp
+ * Sends messages to ws_dissector through shared memory instead of pipes.
+ * The request/response byte streams are the same as on stdin/stdout.
+ */
+
+#include "ws_shm.h"
+#include "../ws_dissector/aww_shm.h"
+
+#include <cstring>
+
+#ifdef AWW_SHM_SUPPORTED
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>  // for htonl()
+#endif
+
+// Keep consistent with ws_dissector.cpp
+static const char AWW_SEPARATOR[] = "===___===\n";
+static const unsigned int WSSHM_DEFAULT_CAPACITY = 1 << 20;
+
+void
+wsshm_init_state (struct WsShmState *pstate) {
+    pstate->base = NULL;
+    pstate->mapped_size = 0;
+    pstate->path = "";
+    pstate->peer = 0;
+    pstate->pending.clear();
+}
+
+#ifdef AWW_SHM_SUPPORTED
+
+bool
+wsshm_open (struct WsShmState *pstate, const char *path, unsigned int capacity) {
+    wsshm_close(pstate);
+    if (capacity == 0)
+        capacity = WSSHM_DEFAULT_CAPACITY;
+    if ((capacity & (capacity - 1)) != 0)
+        return false;
+
+    // Never reuse or follow an existing file: the directory may be /tmp
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+    if (fd < 0)
+        return false;
+    size_t size = aww_shm_size(capacity);
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        unlink(path);
+        return false;
+    }
+    aww_shm_init((AwwShmHeader *) p, capacity);
+    pstate->base = p;
+    pstate->mapped_size = size;
+    pstate->path = path;
+    return true;
+}
+
+void
+wsshm_set_peer (struct WsShmState *pstate, int pid) {
+    pstate->peer = pid;
+}
+
+void
+wsshm_close (struct WsShmState *pstate) {
+    if (pstate->base != NULL) {
+        aww_shm_close((AwwShmHeader *) pstate->base);
+        munmap(pstate->base, pstate->mapped_size);
+        unlink(pstate->path.c_str());
+    }
+    wsshm_init_state(pstate);
+}
+
+bool
+wsshm_decode (struct WsShmState *pstate, unsigned int msg_type,
+                const char *b, size_t length, std::string &out) {
+    AwwShmHeader *hdr = (AwwShmHeader *) pstate->base;
+    if (hdr == NULL)
+        return false;
+
+    unsigned int header[2];
+    header[0] = htonl(msg_type);
+    header[1] = htonl((unsigned int) length);
+    if (!aww_ring_write(hdr, &hdr->request, (const char *) header, sizeof(header), pstate->peer)
+            || !aww_ring_write(hdr, &hdr->request, b, length, pstate->peer))
+        return false;
+
+    // Collect the response up to the separator line
+    char buf[16 * 1024];
+    size_t scanned = 0;
+    while (true) {
+        size_t delim = pstate->pending.find(AWW_SEPARATOR, scanned);
+        if (delim != std::string::npos
+                && (delim == 0 || pstate->pending[delim - 1] == '\n')) {
+            out.assign(pstate->pending, 0, delim);
+            pstate->pending.erase(0, delim + strlen(AWW_SEPARATOR));
+            return true;
+        }
+        if (delim != std::string::npos)
+            scanned = delim + 1;
+        else if (pstate->pending.size() >= strlen(AWW_SEPARATOR))
+            scanned = pstate->pending.size() - strlen(AWW_SEPARATOR);
+
+        size_t cnt = aww_ring_read(hdr, &hdr->response, buf, sizeof(buf), pstate->peer);
+        if (cnt == 0)
+            return false;
+        pstate->pending.append(buf, cnt);
+    }
+}
+
+#else   // the transport is Linux only
+
+bool
+wsshm_open (struct WsShmState *pstate, const char *path, unsigned int capacity) {
+    (void)pstate;
+    (void)path;
+    (void)capacity;
+    return false;
+}
+
+void
+wsshm_set_peer (struct WsShmState *pstate, int pid) {
+    pstate->peer = pid;
+}
+
+void
+wsshm_close (struct WsShmState *pstate) {
+    wsshm_init_state(pstate);
+}
+
+bool
+wsshm_decode (struct WsShmState *pstate, unsigned int msg_type,
+                const char *b, size_t length, std::string &out) {
+    (void)pstate;
+    (void)msg_type;
+    (void)b;
+    (void)length;
+    (void)out;
+    return false;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __DM_COLLECTOR_C_WS_SHM_H__
+#define __DM_COLLECTOR_C_WS_SHM_H__
+
+#include <string>
+#include <cstddef>
+
+// Client side of the shared-memory transport to ws_dissector
+// (see ws_dissector/aww_shm.h).
+struct WsShmState {
+    void *base;         // mmap()-ed transport, NULL if not opened
+    size_t mapped_size;
+    std::string path;
+    int peer;           // pid of ws_dissector
+    std::string pending;    // response bytes after the last separator
+};
+
+// Must be called before usage
+void wsshm_init_state (struct WsShmState *pstate);
+
+// Create a transport file, which is passed to "ws_dissector --shm PATH".
+// Return: successful or not
+bool wsshm_open (struct WsShmState *pstate, const char *path, unsigned int capacity);
+void wsshm_set_peer (struct WsShmState *pstate, int pid);
+void wsshm_close (struct WsShmState *pstate);
+
+// Send an AWW request and wait for its result.
+// Return: false if the transport is closed or ws_dissector is gone
+bool wsshm_decode (struct WsShmState *pstate, unsigned int msg_type,
+                    const char *b, size_t length, std::string &out);
+
+#endif  // __DM_COLLECTOR_C_WS_SHM_H__
@@ -53,6 +53,10 @@ class Analyzer(Element):
 
         self.__parent_analyzer = []  # a list of analyzers it depends on
 
+        # Logs enabled while setting the source are attributed to this
+        # analyzer, including those enabled by overriding set_source()
+        self.set_source = self.__subscribing(self.set_source)
+
         # TODO: For Profile, each specific analyzer should declare it on demand
 
     @staticmethod
@@ -83,6 +87,23 @@ class Analyzer(Element):
         self.source = source
         source.register(self)
 
+    def __subscribing(self, set_source):
+        """
+        Wrap set_source() so that the source attributes the logs enabled
+        during the call (and only those) to this analyzer
+
+        :param set_source: the bound set_source() method
+        """
+        def wrapper(source):
+            if not hasattr(source, "_begin_subscription"):
+                return set_source(source)
+            source._begin_subscription(self)
+            try:
+                return set_source(source)
+            finally:
+                source._end_subscription(self)
+        return wrapper
+
     def add_source_callback(self, callback):
         """
         Add a callback function to the analyzer.
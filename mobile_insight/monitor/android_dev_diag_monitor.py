@@ -189,7 +189,11 @@ class AndroidDevDiagMonitor(Monitor):
     TMP_FIFO_FILE = os.path.join(get_cache_dir(), "diag_revealer_fifo")
     # Yuanjie: the smaller the lower latency, but maybe higher CPU
     # DO NOT CHANGE IT! This value has been optimized
+    # (It now bounds the packets decoded per batch; the FIFO itself is read
+    # natively in large blocks.)
     BLOCK_SIZE = 64
+    # How often the collection loop checks self.running while idle
+    POLL_TIMEOUT_MS = 1000
 
     def __init__(self):
         """
@@ -201,6 +205,7 @@ class AndroidDevDiagMonitor(Monitor):
         self._input_dir = os.path.join(get_cache_dir(), "mi2log")
         self._log_cut_size = 0.5  # change size to 1.0 M
         self._type_names = []
+        self._dispatcher = dm_collector_c.EventDispatcher()
         self._last_diag_revealer_ts = None
         self.running = False
 
@@ -281,6 +286,7 @@ class AndroidDevDiagMonitor(Monitor):
                 self._type_names.append(n)
                 self.log_info("Enable collection: " + n)
         dm_collector_c.set_filtered(self._type_names)
+        self._subscribe_log(type_name)
 
     def enable_log_all(self):
         """
@@ -463,55 +469,44 @@ class AndroidDevDiagMonitor(Monitor):
             fifo = os.open(self._fifo_path, os.O_RDONLY)
 
             # Read log packets from diag_revealer
-            chproc = ChronicleProcessor()
+            # The FIFO is read, and its chunk stream (see ChronicleProcessor
+            # for the protocol) is parsed and deframed natively; Python is
+            # only woken up with batches of decoded packets.
+            dm_collector_c.attach_fd(fifo, True)
             self.running = True
             while self.running:
                 try:
-                    # self.log_info("Before os.read(fifo, self.BLOCK_SIZE)")
-                    s = os.read(fifo, self.BLOCK_SIZE)
-                    # self.log_info("After os.read(fifo, self.BLOCK_SIZE)")
+                    results = dm_collector_c.poll_log_packets(
+                        self.POLL_TIMEOUT_MS, self.BLOCK_SIZE,
+                        self._skip_decoding,
+                        True)   # include_timestamp
                 except OSError as err:
                     if err.errno == errno.EAGAIN or err.errno == errno.EWOULDBLOCK:
                         self.log_error("err.errno="+str(err.errno))
-                        s = None
+                        results = []
                     else:
                         raise err  # something else has happened -- better reraise
 
-                while s:   # preprocess metadata
-                    # self.log_info("Before chproc.process: %s" % s)
-                    ret_msg_type, ret_ts, ret_payload, ret_filename, remain = chproc.process(
-                        s)
-                    # self.log_info("After chproc.process(s)")
-                    if ret_msg_type == ChronicleProcessor.TYPE_LOG:
-                        if ret_ts:
-                            self._last_diag_revealer_ts = ret_ts
-                        if ret_payload:
-                            dm_collector_c.feed_binary(ret_payload)
-                    elif ret_msg_type == ChronicleProcessor.TYPE_START_LOG_FILE:
-                        if ret_filename:
-                            pass
-                            # print "Start of %s" % ret_filename
-                    elif ret_msg_type == ChronicleProcessor.TYPE_END_LOG_FILE:
-                        if ret_filename:
-                            # res_dict = {'filename':ret_filename}
-                            # msg = ("new_diag_log",res_dict,"dict")
-                            msg = ('filename', ret_filename, "")
-                            # print "End of %s" % ret_filename
-                            event = Event(timeit.default_timer(),
-                                          "new_diag_log",
-                                          DMLogPacket([msg]))
-                            # ret_filename)
-                            self.send(event)
-                            del event
-                    elif ret_msg_type is not None:
-                        # raise RuntimeError("Unknown ret msg type: %s" % str(ret_msg_type))
-                        self.log_warning("Unknown ret msg type: %s" % str(ret_msg_type))
-                    s = remain
-
-                result = dm_collector_c.receive_log_packet(self._skip_decoding,
-                                                           True,   # include_timestamp
-                                                           )
-                if result:     # result = (decoded, posix_timestamp)
+                ret_ts, file_events = dm_collector_c.get_chronicle_events()
+                if ret_ts:
+                    self._last_diag_revealer_ts = ret_ts
+                for ret_msg_type, ret_filename in file_events:
+                    if ret_msg_type == ChronicleProcessor.TYPE_START_LOG_FILE:
+                        pass
+                        # print "Start of %s" % ret_filename
+                    elif ret_msg_type == ChronicleProcessor.TYPE_END_LOG_FILE and ret_filename:
+                        # res_dict = {'filename':ret_filename}
+                        # msg = ("new_diag_log",res_dict,"dict")
+                        msg = ('filename', ret_filename, "")
+                        # print "End of %s" % ret_filename
+                        event = Event(timeit.default_timer(),
+                                      "new_diag_log",
+                                      DMLogPacket([msg]))
+                        # ret_filename)
+                        self.send(event)
+                        del event
+
+                for result in results or []:   # result = (decoded, posix_timestamp)
                     try:
                         packet = DMLogPacket(result[0])
                         type_id = packet.get_type_id()
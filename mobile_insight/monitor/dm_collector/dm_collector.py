@@ -45,6 +45,7 @@ class DMCollector(Monitor):
         self.phy_ser_name = None
         self._prefs = prefs
         self._type_names = []
+        self._dispatcher = dm_collector_c.EventDispatcher()
         # Initialize Wireshark dissector
         DMLogPacket.init(self._prefs)
 
@@ -94,6 +95,7 @@ class DMCollector(Monitor):
                 self._type_names.append(n)
                 self.log_info("Enable collection: " + n)
         dm_collector_c.set_filtered(self._type_names)
+        self._subscribe_log(type_name)
 
     def enable_log_all(self):
         """
@@ -30,6 +30,11 @@ except ImportError as e:
 
 from ws_dissector import *
 
+try:
+    from .. import dm_collector_c
+except (ImportError, ValueError):
+    import dm_collector_c
+
 import itertools
 
 
@@ -51,7 +56,7 @@ class FormatError(RuntimeError):
     pass
 
 
-class DMLogPacket:
+class DMLogPacket(dm_collector_c.LogPacket):
     """
     DM log packet decoder.
 
@@ -61,6 +66,10 @@ class DMLogPacket:
 
     This class depends on Wireshark to decode some 3GPP standardized
     messages.
+
+    The conversions are done once per packet and cached, so all analyzers
+    receiving the same packet share them. ``type_id`` and ``timestamp``
+    are native attributes of *dm_collector_c.LogPacket*.
     """
 
     _init_called = False
@@ -74,16 +83,25 @@ class DMLogPacket:
         """
         cls = self.__class__
 
-        self._decoded_list, self._type_id = cls._preparse_internal_list(decoded_list)
+        lst, type_id = cls._preparse_internal_list(decoded_list)
+        # decode() and decode_list() are cached natively
+        dm_collector_c.LogPacket.__init__(self, lst)
+        self._raw_decoded_list = decoded_list
+        self._type_id = type_id
 
         # Optimization: Cache the decoded message. Avoid repetitive decoding
-        self.decoded_cache = None
         self.decoded_xml_cache = None
         self.decoded_json_cache = None
 
+    def __reduce__(self):
+        # Pickle the constructor input, since self.decoded_list is preparsed
+        return (self.__class__, (self._raw_decoded_list,))
+
     def get_type_id(self):
+        # "" if the packet has no type_id, unlike the native type_id (None)
         return self._type_id
 
+    # wcdma_sib_types: keep consistent with ws_dissector/ws_dissector.cpp
     @classmethod
     @static_var("wcdma_sib_types", {0: "RRC_MIB",
                                     1: "RRC_SIB1",
@@ -91,7 +109,6 @@ class DMLogPacket:
                                     3: "RRC_SIB3",
                                     7: "RRC_SIB7",
                                     12: "RRC_SIB12",
-                                    22: "RRC_SIB15-3",
                                     27: "RRC_SB1",
                                     31: "RRC_SIB19",
                                     })
@@ -107,10 +124,14 @@ class DMLogPacket:
                     type_id = val
                 if type_str.startswith("raw_msg/"):
                     msg_type = type_str[len("raw_msg/"):]
-                    decoded = cls._decode_msg(msg_type, val)
+                    split_sib = msg_type == "RRC_DL_BCCH_BCH" \
+                        and WSDissector.can_split_sib(msg_type)
+                    # With split_sib, ws_dissector appends the complete SIBs
+                    # by itself
+                    decoded = cls._decode_msg(msg_type, val, split_sib)
                     xmls = [decoded, ]
 
-                    if msg_type == "RRC_DL_BCCH_BCH":
+                    if msg_type == "RRC_DL_BCCH_BCH" and not split_sib:
                         sib_types = cls._preparse_internal_list.wcdma_sib_types
                         try:
                             # xml = ET.fromstring(decoded)
@@ -355,20 +376,13 @@ class DMLogPacket:
                     \"\"\",
             }
 
+        The dict is built on the first call, and each call returns a copy
+        of it. Its nested dicts and lists are shared by all analyzers that
+        receive this packet: do not modify them.
+
         :raises FormatError: this message has an unknown type
         """
-        # cls = self.__class__
-
-        # d = cls._parse_internal_list("dict", self._decoded_list)
-        # return d
-
-        # if not self.decoded_cache:
-        #     cls = self.__class__
-        #     self.decoded_cache = cls._parse_internal_list("dict", self._decoded_list)
-        # return self.decoded_cache
-
-        cls = self.__class__
-        return cls._parse_internal_list("dict", self._decoded_list)
+        return dm_collector_c.LogPacket.decode(self)
 
     def decode_xml(self):
         """
@@ -376,19 +390,13 @@ class DMLogPacket:
 
         :returns: a string that contains the converted XML document.
         """
-        # if not self.decoded_json_cache:
-        #     cls = self.__class__
-        #     xml = cls._parse_internal_list("xml/dict", self._decoded_list)
-        #     # Zengwen: what about this name?
-        #     xml.tag = "dm_log_packet"
-        #     self.decoded_json_cache = ET.tostring(xml)
-        # return self.decoded_json_cache
-
-        cls = self.__class__
-        xml = cls._parse_internal_list("xml/dict", self._decoded_list)
-        # Zengwen: what about this name?
-        xml.tag = "dm_log_packet"
-        return ET.tostring(xml)
+        if self.decoded_xml_cache is None:
+            cls = self.__class__
+            xml = cls._parse_internal_list("xml/dict", self.decoded_list)
+            # Zengwen: what about this name?
+            xml.tag = "dm_log_packet"
+            self.decoded_xml_cache = ET.tostring(xml)
+        return self.decoded_xml_cache
 
     def decode_json(self):
         """
@@ -396,32 +404,17 @@ class DMLogPacket:
 
         :returns: a string that contains the converted JSON document.
         """
-
-        # if not self.decoded_json_cache:
-        #     cls = self.__class__
-
-        #     d = self.decode()
-
-        #     try:
-        #         import xmltodict
-        #         if "Msg" in d:
-        #             d["Msg"] = xmltodict.parse(d["Msg"])
-        #     except ImportError:
-        #         pass
-        #     self.decoded_json_cache = json.dumps(d, cls=SuperEncoder)
-        # return self.decoded_json_cache
-
-        cls = self.__class__
-
-        d = self.decode()
-
-        try:
-            import xmltodict
-            if "Msg" in d:
-                d["Msg"] = xmltodict.parse(d["Msg"])
-        except ImportError:
-            pass
-        return json.dumps(d, cls=SuperEncoder)
+        if self.decoded_json_cache is None:
+            d = self.decode()
+
+            try:
+                import xmltodict
+                if "Msg" in d:
+                    d["Msg"] = xmltodict.parse(d["Msg"])
+            except ImportError:
+                pass
+            self.decoded_json_cache = json.dumps(d, cls=SuperEncoder)
+        return self.decoded_json_cache
 
     @classmethod
     def init(cls, prefs):
@@ -437,8 +430,23 @@ class DMLogPacket:
             return
         WSDissector.init_proc(prefs.get("ws_dissect_executable_path", None),
                               prefs.get("libwireshark_path", None))
+        if prefs.get("ws_dissect_cache_path", None):
+            WSDissector.enable_cache(prefs["ws_dissect_cache_path"])
         cls._init_called = True
 
+    @classmethod
+    def enable_dissect_cache(cls, path):
+        """
+        Reuse ws_dissector outputs across replays with a persistent cache.
+
+        :param path: path to the cache file
+        :type path: string
+
+        :returns: True if the cache is enabled
+        """
+        assert cls._init_called
+        return WSDissector.enable_cache(path)
+
     @classmethod
     def _search_result(cls, result, target):
         if isinstance(target, str):
@@ -461,13 +469,13 @@ class DMLogPacket:
             return tuple(ret)
 
     @classmethod
-    def _decode_msg(cls, msg_type, b):
+    def _decode_msg(cls, msg_type, b, split_sib=False):
         """
         Decode standard message using WSDissector.
         """
         assert cls._init_called
 
-        s = WSDissector.decode_msg(msg_type, b)
+        s = WSDissector.decode_msg(msg_type, b, split_sib=split_sib)
         return s
 
     @classmethod
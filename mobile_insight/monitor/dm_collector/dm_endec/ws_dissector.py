@@ -8,12 +8,14 @@ Author: Jiayao Li
 
 __all__ = ["WSDissector"]
 
+import atexit
 import os
 import binascii
 import platform
 import struct
 import subprocess
 import sys
+import timeit
 
 
 class WSDissector:
@@ -63,15 +65,34 @@ class WSDissector:
         "LTE-PDCP_DL_SRB": 300,
         "LTE-PDCP_UL_SRB": 301,
     }
+    # Set in the type field when a request carries a field list.
+    # Keep consistent with ws_dissector/ws_dissector.cpp
+    FIELDS_FLAG = 0x80000000
+    FIELDS_MIN_VERSION = (2, 1, 0)
+    SHM_MIN_VERSION = (2, 2, 0)
+    # Set in the type field of RRC_DL_BCCH_BCH to dissect its complete SIBs too.
+    SPLIT_SIB_FLAG = 0x40000000
+    SPLIT_SIB_MIN_VERSION = (2, 3, 0)
+
     _proc = None
     _init_proc_called = False
+    _executable_path = None
+    _env = None
+    _version = None
+    _cache_enabled = False
+    _selected_fields = {}
+    _use_shm = True
+    _shm_path = None
 
     @classmethod
     def init_proc(cls, executable_path, ws_library_path):
         """
-        Launch the ws_dissector program. Must be called before any actual
+        Configure the ws_dissector program. Must be called before any actual
         decoding, and should be called only once.
 
+        The program itself is launched on the first message that cannot be
+        served by the dissection cache.
+
         :param executable_path: path to ws_dissector. If set to None, uses the default path.
         :type executable_path: string or None
 
@@ -97,16 +118,148 @@ class WSDissector:
             if ws_library_path:
                 env["LD_LIBRARY_PATH"] = ws_library_path + \
                     ":" + env.get("LD_LIBRARY_PATH", "")
-        cls._proc = subprocess.Popen([real_executable_path],
+        cls._executable_path = real_executable_path
+        cls._env = env
+        cls._init_proc_called = True
+
+    @classmethod
+    def set_shm_enabled(cls, enabled):
+        """
+        Choose whether ws_dissector is driven through shared memory (Linux
+        only, requires ws_dissector 2.2.0 or later) or pipes. Shared memory
+        is used by default when available, with pipes as the fallback.
+
+        :param enabled: use shared memory or not
+        :type enabled: bool
+        """
+        cls._use_shm = enabled
+
+    @classmethod
+    def _launch_proc(cls):
+        if cls._use_shm and platform.system() == "Linux" \
+                and cls._version_at_least(cls.SHM_MIN_VERSION):
+            from .. import dm_collector_c
+            shm_dir = "/dev/shm" if os.path.isdir("/dev/shm") else "/tmp"
+            # Unpredictable, since the file may have to be created in /tmp
+            path = os.path.join(shm_dir, "mi_ws_dissector_%d_%s"
+                                % (os.getpid(), binascii.hexlify(os.urandom(8))))
+            if dm_collector_c.ws_shm_open(path):
+                cls._proc = subprocess.Popen([cls._executable_path, "--shm", path],
+                                             env=cls._env
+                                             )
+                dm_collector_c.ws_shm_set_peer(cls._proc.pid)
+                cls._shm_path = path
+                atexit.register(dm_collector_c.ws_shm_close)
+                return
+
+        cls._proc = subprocess.Popen([cls._executable_path],
                                      bufsize=-1,
                                      stdin=subprocess.PIPE,
                                      stdout=subprocess.PIPE,
-                                     env=env
+                                     env=cls._env
                                      )
-        cls._init_proc_called = True
+        cls._shm_path = None
+
+    @classmethod
+    def _decode_by_shm(cls, msg_id, b):
+        from .. import dm_collector_c
+        decoded = dm_collector_c.ws_shm_decode(msg_id, b)
+        if decoded is None:
+            # The transport is broken: fall back to pipes
+            print "MI(Unknown) ws_dissector shared memory failed, using pipes"
+            dm_collector_c.ws_shm_close()
+            cls._use_shm = False
+            cls._launch_proc()
+        return decoded
+
+    @classmethod
+    def get_version(cls):
+        """
+        Query the version of the ws_dissector program.
+
+        :returns: a version string, or None if ws_dissector cannot be run
+        """
+        assert cls._init_proc_called
+        if cls._version is None:
+            try:
+                proc = subprocess.Popen([cls._executable_path, "-v"],
+                                        stdout=subprocess.PIPE,
+                                        env=cls._env)
+                first_line = proc.communicate()[0].split("\n")[0]
+                if first_line.startswith("Version "):
+                    cls._version = first_line[len("Version "):].strip()
+            except OSError:
+                pass
+        return cls._version
+
+    @classmethod
+    def enable_cache(cls, path):
+        """
+        Keep dissection results in a persistent on-disk cache, so that
+        replaying the same logs again does not need to call Wireshark.
+
+        The cache is keyed by the raw message and the version of ws_dissector.
+
+        :param path: path to the cache file
+        :type path: string
+
+        :returns: True if the cache is enabled
+        """
+        from .. import dm_collector_c
+        version = cls.get_version()
+        if version is None:
+            return False
+        cls._cache_enabled = dm_collector_c.dissect_cache_open(path, version)
+        if cls._cache_enabled:
+            atexit.register(dm_collector_c.dissect_cache_close)
+        return cls._cache_enabled
+
+    @classmethod
+    def _version_at_least(cls, min_version):
+        version = cls.get_version()
+        if version is None:
+            return False
+        try:
+            return tuple(int(x) for x in version.split(".")) >= min_version
+        except ValueError:
+            return False
+
+    @classmethod
+    def set_fields(cls, msg_type, fields):
+        """
+        Only dissect the given fields of msg_type by default, e.g.
+        set_fields("LTE-RRC_DL_DCCH", ["lte-rrc.rsrpResult"]).
+        The output then contains these fields only, so this affects every
+        consumer of msg_type.
+
+        :param msg_type: the type of the message
+        :type msg_type: string
+
+        :param fields: Wireshark field names, or None to dissect the full message
+        :type fields: list or None
+        """
+        if fields:
+            cls._selected_fields[msg_type] = list(fields)
+        else:
+            cls._selected_fields.pop(msg_type, None)
+
+    @classmethod
+    def can_split_sib(cls, msg_type):
+        """
+        Check whether ws_dissector can split the complete SIBs out of a
+        msg_type message by itself (see decode_msg()).
+
+        :param msg_type: the type of the message
+        :type msg_type: string
+
+        :returns: True if split_sib can be used for msg_type
+        """
+        return msg_type == "RRC_DL_BCCH_BCH" \
+            and msg_type not in cls._selected_fields \
+            and cls._version_at_least(cls.SPLIT_SIB_MIN_VERSION)
 
     @classmethod
-    def decode_msg(cls, msg_type, b):
+    def decode_msg(cls, msg_type, b, fields=None, split_sib=False):
         """
         Decode a binary message of type msg_type.
 
@@ -116,6 +269,12 @@ class WSDissector:
         :param b: binary data to be decoded
         :type b: string
 
+        :param fields: if given, only these Wireshark fields are dissected and returned (requires ws_dissector 2.1.0 or later)
+        :type fields: list or None
+
+        :param split_sib: if True, the complete SIBs carried by the message are dissected as well, and appended as extra packets. Only valid if can_split_sib(msg_type) is True
+        :type split_sib: bool
+
         :returns: an XML string
         """
         assert cls._init_proc_called
@@ -123,9 +282,43 @@ class WSDissector:
             print "MI(Unknown) Unsupported message for ws_dissector:", msg_type
             return None
 
+        msg_id = cls.SUPPORTED_TYPES[msg_type]
+        if fields is None:
+            fields = cls._selected_fields.get(msg_type, None)
+        if fields and cls._version_at_least(cls.FIELDS_MIN_VERSION):
+            field_list = ",".join(fields)
+            msg_id |= cls.FIELDS_FLAG
+            b = struct.pack("!I", len(field_list)) + field_list + b
+        elif split_sib:
+            msg_id |= cls.SPLIT_SIB_FLAG
+
+        if cls._cache_enabled:
+            from .. import dm_collector_c
+            cached = dm_collector_c.dissect_cache_lookup(msg_id, b)
+            if cached is not None:
+                return cached
+
+        if cls._proc is None:
+            cls._launch_proc()
+
+        from .. import dm_collector_c
+        start = timeit.default_timer()
+        decoded = None
+        if cls._shm_path is not None:
+            decoded = cls._decode_by_shm(msg_id, b)
+        if decoded is None:
+            decoded = cls._decode_by_pipe(msg_id, b)
+        dm_collector_c.record_ws_roundtrip(timeit.default_timer() - start)
+
+        if cls._cache_enabled:
+            dm_collector_c.dissect_cache_store(msg_id, b, decoded)
+        return decoded
+
+    @classmethod
+    def _decode_by_pipe(cls, msg_id, b):
         input_data = struct.pack(
             "!II",  # in network order
-            cls.SUPPORTED_TYPES[msg_type],
+            msg_id,
             len(b),
         )
         input_data += b
@@ -24,6 +24,14 @@ class Monitor(Element):
         self._save_log_path = None
         self._save_file = None
 
+        # Native type-based dispatch of events (e.g. dm_collector_c.EventDispatcher),
+        # set by monitors whose types it knows. If None, every analyzer
+        # receives every event.
+        self._dispatcher = None
+        # The analyzers setting this monitor as their source, innermost
+        # last. Logs enabled meanwhile are attributed to the innermost one.
+        self._subscribers = []
+
     def available_log_types(self):
         """
         Return available log types
@@ -60,6 +68,10 @@ class Monitor(Element):
         """
         if analyzer not in self.to_list:
             self.to_list.append(analyzer)
+        # Until it enables logs in its set_source(), the analyzer receives
+        # every event
+        if self._dispatcher is not None:
+            self._dispatcher.subscribe(analyzer)
 
     def deregister(self, analyzer):
         """
@@ -70,6 +82,54 @@ class Monitor(Element):
         """
         if analyzer in self.to_list:
             self.to_list.remove(analyzer)
+        if self._dispatcher is not None:
+            self._dispatcher.unsubscribe(analyzer)
+
+    def _begin_subscription(self, analyzer):
+        """
+        Attribute the logs enabled from now on to the analyzer, until
+        _end_subscription() (see Analyzer.set_source())
+
+        :param analyzer: the analyzer setting this monitor as its source
+        :type analyzer: Analyzer
+        """
+        self._subscribers.append(analyzer)
+
+    def _end_subscription(self, analyzer):
+        """
+        Stop attributing the enabled logs to the analyzer
+
+        :param analyzer: the analyzer passed to _begin_subscription()
+        :type analyzer: Analyzer
+        """
+        if self._subscribers and self._subscribers[-1] is analyzer:
+            self._subscribers.pop()
+
+    def _subscribe_log(self, type_name):
+        """
+        Subscribe the analyzer setting this monitor as its source to the
+        enabled messages, so that it only receives their events. Logs
+        enabled outside of any set_source() subscribe nobody.
+
+        :param type_name: the message type(s) enabled
+        :type type_name: string or list
+        """
+        if self._dispatcher is None or not self._subscribers:
+            return
+        analyzer = self._subscribers[-1]
+        if analyzer in self.to_list:
+            self._dispatcher.subscribe(analyzer, type_name)
+
+    def send(self, event):
+        """
+        Raise an event to the analyzers that subscribed to its type
+
+        :param event: the event to be sent
+        """
+        if self._dispatcher is None:
+            Element.send(self, event)
+        elif isinstance(event, Event):
+            self._dispatcher.send(self, event)
 
     def enable_log(self, type_name):
         """
@@ -68,6 +68,9 @@ class OfflineReplayer(Monitor):
         DMLogPacket.init(prefs)
 
         self._type_names = []
+        self._dispatcher = dm_collector_c.EventDispatcher()
+        self._n_threads = None
+        self._time_window = None
 
     def __del__(self):
         if self.is_android and self.service_context:
@@ -117,6 +120,7 @@ class OfflineReplayer(Monitor):
                 self._type_names.append(n)
                 self.log_info("Enable " + n)
         dm_collector_c.set_filtered(self._type_names)
+        self._subscribe_log(type_name)
 
     def enable_log_all(self):
         """
@@ -136,6 +140,62 @@ class OfflineReplayer(Monitor):
         self._input_path = path
         # self._input_file = open(path, "rb")
 
+    def set_dissect_cache(self, path):
+        """
+        Cache the dissection results of standard messages (e.g., RRC, NAS) in
+        a file, so that replaying the same logs again skips Wireshark.
+
+        :param path: the cache file path
+        :type path: string
+        """
+        if not DMLogPacket.enable_dissect_cache(path):
+            self.log_warning("Failed to enable dissection cache: " + path)
+
+    def set_parallel_decoding(self, n_threads=-1):
+        """
+        Read and deframe the logs on worker threads. Large logs are split
+        into chunks, and all logs are merged in timestamp order instead of
+        being replayed one after another.
+
+        :param n_threads: number of worker threads (-1: number of CPUs; None: disable)
+        :type n_threads: int or None
+        """
+        self._n_threads = n_threads
+
+    def set_time_window(self, start=None, end=None):
+        """
+        Only replay the packets logged within [start, end]. Other packets are
+        skipped from their header without being decoded, and a log stops
+        being read once the window has passed. This takes precedence over
+        set_parallel_decoding().
+
+        :param start: the beginning of the window (None: unbounded)
+        :type start: datetime.datetime or None
+        :param end: the end of the window (None: unbounded)
+        :type end: datetime.datetime or None
+        """
+        if start is None and end is None:
+            self._time_window = None
+        else:
+            self._time_window = (start, end)
+
+    def _open_logs(self, log_list):
+        if self._time_window is not None:
+            start, end = self._time_window
+            for file in log_list:
+                self.log_info("Loading %s within [%s, %s]" % (file, start, end))
+                yield dm_collector_c.open_log(file, self._skip_decoding, None, start, end)
+            return
+        if self._n_threads is not None:
+            self.log_info("Loading %d files in parallel" % len(log_list))
+            yield dm_collector_c.open_logs(log_list, self._skip_decoding, self._n_threads)
+            return
+        for file in log_list:
+            self.log_info("Loading " + file)
+            self.log_info('Loading: ' + str(time.time()))
+            # The log is memory-mapped and deframed by dm_collector_c
+            yield dm_collector_c.open_log(file, self._skip_decoding)
+
     def save_log_as(self, path):
         """
         Save the log as a mi2log file (for offline analysis)
@@ -165,7 +225,7 @@ class OfflineReplayer(Monitor):
                 log_list = [self._input_path]
             elif os.path.isdir(self._input_path):
                 for file in os.listdir(self._input_path):
-                    if file.endswith(".mi2log") or file.endswith(".qmdl"):
+                    if file.endswith((".mi2log", ".mi2logz", ".qmdl")):
                         # log_list.append(self._input_path+"/"+file)
                         log_list.append(os.path.join(self._input_path, file))
             else:
@@ -175,25 +235,13 @@ class OfflineReplayer(Monitor):
 
             decoding_inter = 0
             sending_inter = 0
-            for file in log_list:
-                self.log_info("Loading " + file)
-                self.log_info('Loading: ' + str(time.time()))
-                self._input_file = open(file, "rb")
-                dm_collector_c.reset()
-                while True:
-                    s = self._input_file.read(64)
-                    if not s:   # EOF encountered
-                        break
-
-                    dm_collector_c.feed_binary(s)
-                    decoded = dm_collector_c.receive_log_packet(self._skip_decoding,
-                                                                True,   # include_timestamp
-                                                                )
+            for self._input_file in self._open_logs(log_list):
+                for decoded in self._input_file:
                     if decoded:
                         try:
                             before_decode_time = time.time()
                             # self.log_info('Before decoding: ' + str(time.time()))
-                            packet = DMLogPacket(decoded[0])
+                            packet = DMLogPacket(decoded)
                             type_id = packet.get_type_id()
                             after_decode_time = time.time()
                             decoding_inter += after_decode_time - before_decode_time
@@ -38,12 +38,28 @@ for key, value in cfg_vars.items():
 
 dm_collector_c_module = Extension('mobile_insight.monitor.dm_collector.dm_collector_c',
                                 sources = [ "dm_collector_c/dm_collector_c.cpp",
+                                            "dm_collector_c/async_writer.cpp",
+                                            "dm_collector_c/chronicle_parser.cpp",
+                                            "dm_collector_c/columnar_export.cpp",
+                                            "dm_collector_c/compressed_log.cpp",
+                                            "dm_collector_c/dissect_cache.cpp",
                                             "dm_collector_c/export_manager.cpp",
+                                            "dm_collector_c/fd_reader.cpp",
                                             "dm_collector_c/hdlc.cpp",
                                             "dm_collector_c/log_config.cpp",
+                                            "dm_collector_c/log_index.cpp",
                                             "dm_collector_c/log_packet.cpp",
-                                            "dm_collector_c/utils.cpp",],
-                                define_macros=[ ('EXPOSE_INTERNAL_LOGS', 1), ]
+                                            "dm_collector_c/log_reader.cpp",
+                                            "dm_collector_c/meas_kernels.cpp",
+                                            "dm_collector_c/message_stats.cpp",
+                                            "dm_collector_c/parallel_replay.cpp",
+                                            "dm_collector_c/perf_counters.cpp",
+                                            "dm_collector_c/rlc_tracker.cpp",
+                                            "dm_collector_c/throughput_aggregator.cpp",
+                                            "dm_collector_c/utils.cpp",
+                                            "dm_collector_c/ws_shm.cpp",],
+                                define_macros=[ ('EXPOSE_INTERNAL_LOGS', 1), ],
+                                libraries = [ "z", ],
                                 )
 
 def parse_libs(url,suffix):
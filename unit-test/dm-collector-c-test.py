@@ -0,0 +1,766 @@
+#!/usr/bin/python
+# Filename: dm-collector-c-test.py
+
+"""
+Tests of the native helpers of dm_collector_c, over the bundled logs and
+small synthetic ones.
+
+Run from this directory: python dm-collector-c-test.py
+"""
+
+import array
+import datetime
+import gc
+import json
+import os
+import pickle
+import random
+import re
+import shutil
+import struct
+import tempfile
+import unittest
+import weakref
+import zlib
+
+from mobile_insight.analyzer import LtePhyAnalyzer
+from mobile_insight.monitor import OfflineReplayer
+from mobile_insight.monitor.dm_collector import dm_collector_c
+from mobile_insight.monitor.dm_collector.dm_endec.dm_log_packet import DMLogPacket
+
+
+def hdlc_encode(payload):
+    """
+    Wrap a payload in a frame, as the device sends it
+
+    :param payload: the frame payload
+    :returns: CRC, escaping and the trailing 0x7e added
+    """
+    crc = 0xFFFF
+    for c in payload:
+        crc ^= ord(c)
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    raw = payload + struct.pack("<H", crc ^ 0xFFFF)
+    escaped = raw.replace("\x7d", "\x7d\x5d").replace("\x7e", "\x7d\x5e")
+    return escaped + "\x7e"
+
+
+def log_packet_frame(log_code, timestamp, body=""):
+    """
+    A log packet frame (0x10 command) with a raw body
+    """
+    log_msg_len = 12 + len(body)
+    return hdlc_encode(struct.pack("<BBHHHQ", 0x10, 0, log_msg_len,
+                                   log_msg_len, log_code, timestamp) + body)
+
+
+def idle_ncell_meas_body(rng):
+    """
+    An LTE_PHY_Idle_Neighbor_Cell_Meas body: a request, and results in
+    subpacket versions 2 (3 cells) and 4 (9 cells)
+    """
+    request = struct.pack("<BBHHBB", 26, 1, 8, 1850, 0, 0)
+    subpkts = [request]
+    for version, n_cells in ((2, 3), (4, 9)):
+        cells = ""
+        for _ in range(n_cells):
+            # Random bits around the fields, which must be masked out
+            words = [rng.getrandbits(32) for _ in range(13)]
+            words[3] = (words[3] & ~0xFFFF) | rng.getrandbits(16)
+            cells += struct.pack("<13I", *words)
+        n = n_cells | (1 << 7) | (2 << 9)
+        if version == 2:
+            payload = struct.pack("<HH", 5230, n)
+        else:
+            payload = struct.pack("<IHH", 66486, n, 0)
+        subpkts.append(struct.pack("<BBH", 27, version, 4 + len(payload) + len(cells))
+                       + payload + cells)
+    return struct.pack("<BBH", 1, len(subpkts), 0) + "".join(subpkts)
+
+
+def irat_wcdma_body(rng):
+    """
+    An LTE_PHY_IRAT_MDB body with a GSM subpacket (skipped) and a WCDMA
+    subpacket of two frequencies (9 and 2 cells)
+    """
+    gsm = struct.pack("<BBH", 42, 1, 8) + "\0" * 4
+    freqs = ""
+    for uarfcn, n_cells in ((10762, 9), (4385, 2)):
+        freqs += struct.pack("<HBB", uarfcn, n_cells, 0)
+        for _ in range(n_cells):
+            freqs += struct.pack("<HBBI4BHBB", rng.getrandbits(16), 0, 0, 0,
+                                 *([rng.getrandbits(8) for _ in range(4)] + [0, 0, 0]))
+    wcdma = struct.pack("<IBBBB", 0, 2, 0, 0, 0) + freqs
+    wcdma = struct.pack("<BBH", 35, 1, 4 + len(wcdma)) + wcdma
+    return struct.pack("<BBH", 1, 2, 0) + gsm + wcdma
+
+
+def frame_of(path):
+    """
+    The deframed packet of a log with a single frame
+    """
+    return list(dm_collector_c.open_log_headers(path))[0][3].tobytes()
+
+
+class DmCollectorCTest(unittest.TestCase):
+
+    def setUp(self):
+        self._paths = []
+
+    def tearDown(self):
+        for path in self._paths:
+            for p in (path, path + ".idx"):
+                if os.path.exists(p):
+                    os.remove(p)
+
+    def write_log(self, frames, suffix=".mi2log"):
+        fd, path = tempfile.mkstemp(suffix=suffix)
+        os.write(fd, "".join(frames))
+        os.close(fd)
+        self._paths.append(path)
+        return path
+
+    def test_dissect_cache_hits_and_misses(self):
+        path = self.write_log([], suffix=".cache")
+        version = "2.3.0-" + "x" * 200     # longer than the stored version
+        msg = "\x10\x15\x00\x07"
+        self.assertTrue(dm_collector_c.dissect_cache_open(path, version))
+        try:
+            self.assertEqual(dm_collector_c.dissect_cache_lookup(203, msg), None)
+            self.assertTrue(dm_collector_c.dissect_cache_store(203, msg, "<pdml/>"))
+            self.assertEqual(dm_collector_c.dissect_cache_lookup(203, msg), "<pdml/>")
+            # Keyed by the protocol number and the whole payload
+            self.assertEqual(dm_collector_c.dissect_cache_lookup(204, msg), None)
+            self.assertEqual(dm_collector_c.dissect_cache_lookup(203, msg[:-1]), None)
+        finally:
+            dm_collector_c.dissect_cache_close()
+
+        # Kept across replays of the same dissector, discarded by another one
+        self.assertTrue(dm_collector_c.dissect_cache_open(path, version))
+        self.assertEqual(dm_collector_c.dissect_cache_lookup(203, msg), "<pdml/>")
+        dm_collector_c.dissect_cache_close()
+        self.assertTrue(dm_collector_c.dissect_cache_open(path, "2.4.0"))
+        self.assertEqual(dm_collector_c.dissect_cache_lookup(203, msg), None)
+        dm_collector_c.dissect_cache_close()
+        self.assertEqual(dm_collector_c.dissect_cache_lookup(203, msg), None)
+
+    def test_open_log_headers_frame_boundaries(self):
+        rng = random.Random(46)
+        frames = []
+        expected = []
+        # More than the 256 KB of a frame block, with delimiter and escape
+        # bytes in the bodies
+        for i in range(120):
+            body = "".join(chr(rng.choice([0x7e, 0x7d, rng.getrandbits(8)]))
+                           for _ in range(rng.choice([0, 1, 100, 5000, 30000])))
+            log_code = rng.choice([0xB126, 0xB193])
+            frame = log_packet_frame(log_code, 1000 + i, body)
+            if i % 10 == 3:
+                # A CRC error, then a frame that is not a log packet
+                frames.append(frame[:-3] + chr(ord(frame[-3]) ^ 1) + frame[-2:])
+                frames.append(hdlc_encode("\x1d" + body[:8]))
+                continue
+            frames.append(frame)
+            payload = struct.pack("<BBHHHQ", 0x10, 0, 12 + len(body), 12 + len(body),
+                                  log_code, 1000 + i) + body
+            expected.append((log_code, len(payload), 1000 + i, payload))
+        path = self.write_log(frames)
+        self.assertGreater(sum(e[1] for e in expected), 2 * 256 * 1024)
+
+        reader = dm_collector_c.open_log_headers(path)
+        headers = list(reader)
+        del reader
+        gc.collect()
+        # The views keep their blocks alive
+        self.assertEqual([h[:3] + (h[3].tobytes(),) for h in headers], expected)
+        self.assertTrue(all(h[3].readonly for h in headers))
+
+        pdsch = list(dm_collector_c.open_log_headers(path, ["LTE_PHY_PDSCH_Packet"]))
+        self.assertEqual([h[3].tobytes() for h in pdsch],
+                         [e[3] for e in expected if e[0] == 0xB126])
+
+    def test_open_log_matches_feed_binary(self):
+        log = "./test-logs/att.mi2log"
+        dm_collector_c.set_filtered(["LTE_PHY_PDSCH_Packet",
+                                     "LTE_PHY_Connected_Mode_Intra_Freq_Meas"])
+        data = open(log, "rb").read()
+        dm_collector_c.reset()
+        dm_collector_c.feed_binary(data)
+        fed = []
+        for _ in range(data.count("\x7e")):
+            decoded = dm_collector_c.receive_log_packet()
+            if decoded is not None:
+                fed.append(decoded)
+        self.assertEqual(len(fed), 303)
+        self.assertEqual(list(dm_collector_c.open_log(log)), fed)
+        qmdl = self.write_log([data], suffix=".qmdl")
+        self.assertEqual(list(dm_collector_c.open_log(qmdl)), fed)
+
+        # A frame with a wrong CRC and a truncated last frame are skipped
+        frames = [hdlc_encode(h[3].tobytes()) for h in
+                  dm_collector_c.open_log_headers(log, ["LTE_PHY_PDSCH_Packet"])][:5]
+        frames[1] = frames[1][:20] + chr(ord(frames[1][20]) ^ 1) + frames[1][21:]
+        frames[4] = frames[4][:-5]
+        path = self.write_log(frames)
+        pdsch = [p for p in fed if p[1][1] == "LTE_PHY_PDSCH_Packet"]
+        self.assertEqual(list(dm_collector_c.open_log(path)),
+                         [pdsch[0], pdsch[2], pdsch[3]])
+        self.assertRaises(IOError, dm_collector_c.open_log, qmdl + ".missing")
+
+    def test_open_logs_merges_in_timestamp_order(self):
+        logs = ["./test-logs/att.mi2log", "./test-logs/tmobile.mi2log"]
+        dm_collector_c.set_filtered(["LTE_PHY_PDSCH_Packet",
+                                     "LTE_PHY_Connected_Mode_Intra_Freq_Meas"])
+        per_file = [list(dm_collector_c.open_log(log)) for log in logs]
+
+        # Take the earliest head of the files (the first file on ties), so
+        # that each file keeps its own order
+        def timestamp(p):
+            return dict((k, v) for k, v, _ in p)["timestamp"]
+        heads = [0] * len(logs)
+        expected = []
+        while True:
+            candidates = [(timestamp(per_file[f][heads[f]]), f)
+                          for f in range(len(logs)) if heads[f] < len(per_file[f])]
+            if not candidates:
+                break
+            f = min(candidates)[1]
+            expected.append(per_file[f][heads[f]])
+            heads[f] += 1
+        for n_threads, chunk_size in ((0, 1 << 20), (4, 4096)):
+            self.assertEqual(list(dm_collector_c.open_logs(logs, False, n_threads, chunk_size)),
+                             expected)
+
+    def test_index_counts_unknown_codes(self):
+        path = self.write_log([log_packet_frame(0x1234, 1000),
+                               log_packet_frame(0x1234, 2000),
+                               log_packet_frame(0x5678, 3000)])
+        dm_collector_c.build_log_index(path)
+        index = dm_collector_c.open_log_index(path)
+        self.assertEqual(index.counts(), {"0x1234": 2, "0x5678": 1})
+        index.close()
+
+    def test_compressed_log_rejects_oversized_block(self):
+        # A block header claiming almost 4 GB of raw bytes
+        z = zlib.compress(log_packet_frame(0x1234, 1000))
+        path = self.write_log(["MI2LOGZ1", struct.pack("<II", len(z), 0xFFFFFFF0), z],
+                              suffix=".mi2logz")
+        self.assertEqual(list(dm_collector_c.open_log(path)), [])
+
+    def test_window_includes_packets_at_its_bounds(self):
+        log = "./test-logs/att.mi2log"
+        types = ["LTE_PHY_PDSCH_Packet"]
+        dm_collector_c.set_filtered(types)
+        timestamps = [dict((k, v) for k, v, _ in p)["timestamp"]
+                      for p in dm_collector_c.open_log(log, True)]
+        first, last = timestamps[0], timestamps[-1]
+        window = list(dm_collector_c.open_log(log, True, types, first, last))
+        self.assertEqual(len(window), len(timestamps))
+        # A window of one packet's own timestamp
+        t = timestamps[len(timestamps) // 2]
+        at_t = [p for p in dm_collector_c.open_log(log, True, types, t, t)]
+        self.assertEqual(len(at_t), timestamps.count(t))
+        headers = list(dm_collector_c.open_log_headers(log, types, t, t))
+        self.assertEqual(len(headers), timestamps.count(t))
+        # Just outside of the window
+        us = datetime.timedelta(microseconds=1)
+        self.assertEqual(len(list(dm_collector_c.open_log(log, True, types,
+                                                          t + us, t + us))),
+                         timestamps.count(t + us))
+
+        index_path = self.write_log([open(log, "rb").read()])
+        dm_collector_c.build_log_index(index_path)
+        index = dm_collector_c.open_log_index(index_path)
+        self.assertEqual(len(list(index.iterate(types, first, last))),
+                         len(timestamps))
+        self.assertEqual(len(list(index.iterate(types, t, t))),
+                         timestamps.count(t))
+        p = index.iterate(types, t, None, True).next()
+        self.assertEqual(dict((k, v) for k, v, _ in p)["timestamp"], t)
+        index.close()
+
+    def test_export_columnar_tables(self):
+        log = "./test-logs/att.mi2log"
+        meas = "LTE_PHY_Connected_Mode_Intra_Freq_Meas"
+        dm_collector_c.set_filtered([meas])
+        packets = [dm_collector_c.LogPacket(p).decode() for p in dm_collector_c.open_log(log)]
+        directory = tempfile.mkdtemp()
+        try:
+            counts = dm_collector_c.export_columnar([log], directory, [meas])
+            table = os.path.join(directory, meas + "_v4")
+            self.assertEqual(counts, {meas + "_v4": 614})
+            schema = json.load(open(os.path.join(table, "schema.json")))
+            self.assertEqual(schema["n_rows"], 614)
+            columns = dict((c["name"], c) for c in schema["columns"])
+            self.assertEqual(columns["timestamp"]["type"], "timestamp[us]")
+            self.assertEqual(columns["RSRP(dBm)"]["type"], "float64")
+            self.assertEqual(columns["Neighbor Cells.Physical Cell ID"]["type"], "int64")
+
+            def read(name, suffix, typecode):
+                column = columns[name]
+                size = struct.calcsize("<" + typecode)
+                data = open(os.path.join(table, column["file"] + suffix), "rb").read()
+                # Null before first_row
+                data = "\0" * column["first_row"] * size + data
+                self.assertEqual(len(data), 614 * size)
+                return struct.unpack("<%d%s" % (614, typecode), data)
+
+            def values(name, typecode):
+                valid = read(name, ".valid", "b")
+                return [v for v, ok in zip(read(name, ".values", typecode), valid) if ok]
+
+            # Each neighbor cell is a row, with the fields of its packet
+            rows = [(p["RSRP(dBm)"], c["Physical Cell ID"], c["RSRQ(dB)"])
+                    for p in packets for c in p["Neighbor Cells"]]
+            valid = read("Neighbor Cells.Physical Cell ID", ".valid", "b")
+            self.assertEqual([r for r, ok in zip(zip(read("RSRP(dBm)", ".values", "d"),
+                                                     read("Neighbor Cells.Physical Cell ID",
+                                                          ".values", "q"),
+                                                     read("Neighbor Cells.RSRQ(dB)",
+                                                          ".values", "d")), valid) if ok],
+                             rows)
+            def usec(t):
+                d = t - datetime.datetime(1970, 1, 1)
+                return (d.days * 86400 + d.seconds) * 10 ** 6 + d.microseconds
+            self.assertEqual(set(values("timestamp", "q")),
+                             set(usec(p["timestamp"]) for p in packets))
+            # Strings: the end offsets of the values in the data file
+            ends = values("type_id", "q")
+            data = open(os.path.join(table, columns["type_id"]["file"] + ".data"), "rb").read()
+            self.assertEqual(set(data[b - len(meas):b] for b in ends), set([meas]))
+            self.assertEqual(len(data), len(meas) * 614)
+        finally:
+            shutil.rmtree(directory)
+
+    def test_to_records_columns(self):
+        meas = "LTE_PHY_Connected_Mode_Intra_Freq_Meas"
+        dm_collector_c.set_filtered([meas])
+        packets = [dm_collector_c.LogPacket(p)
+                   for p in dm_collector_c.open_log("./test-logs/att.mi2log")]
+        records = dm_collector_c.to_records(packets)
+        self.assertEqual(records.n_rows, 614)
+        self.assertEqual(records.n_dropped, 0)
+        fields = dict((f[0], f[1:]) for f in records.fields)
+        # Only numeric fields are kept
+        self.assertNotIn("type_id", fields)
+        self.assertEqual(fields["RSRP(dBm)"][0], "<f8")
+        self.assertEqual(fields["Neighbor Cells.Physical Cell ID"][0], "<i8")
+        self.assertEqual(fields["timestamp"][0], "<M8[us]")
+
+        # The columns are views of the buffer at the given offsets
+        buf = str(buffer(records))
+        for name in ("RSRP(dBm)", "Neighbor Cells.Physical Cell ID"):
+            dtype, offset, valid_offset = fields[name]
+            self.assertEqual(str(records.column(name)),
+                             buf[offset:offset + 8 * records.n_rows])
+            self.assertEqual(str(records.valid(name)),
+                             buf[valid_offset:valid_offset + records.n_rows])
+        self.assertRaises(KeyError, records.column, "no such field")
+
+        def values(name, typecode):
+            column = struct.unpack("<%d%s" % (records.n_rows, typecode),
+                                   str(records.column(name)))
+            valid = str(records.valid(name))
+            return [(v if valid[i] != "\0" else None) for i, v in enumerate(column)]
+        rows = [(p["RSRP(dBm)"], c["Physical Cell ID"])
+                for p in (packet.decode() for packet in packets)
+                for c in p["Neighbor Cells"]]
+        self.assertEqual([r for r in zip(values("RSRP(dBm)", "d"),
+                                         values("Neighbor Cells.Physical Cell ID", "q"))
+                          if r[1] is not None], rows)
+
+    def test_export_columnar_raises_path_errors(self):
+        class Paths(object):
+            def __len__(self):
+                return 2
+
+            def __getitem__(self, i):
+                if i == 1:
+                    raise LookupError("no path")
+                return "./test-logs/att.mi2log"
+        directory = tempfile.mkdtemp()
+        try:
+            self.assertRaises(LookupError, dm_collector_c.export_columnar,
+                              Paths(), directory, ["LTE_PHY_PDSCH_Packet"])
+        finally:
+            shutil.rmtree(directory)
+
+    def test_export_rotation_segments(self):
+        log = "./test-logs/att.mi2log"
+        types = ["LTE_PHY_PDSCH_Packet", "LTE_PHY_Connected_Mode_Intra_Freq_Meas"]
+        data = open(log, "rb").read()
+        directory = tempfile.mkdtemp()
+        try:
+            self.assertTrue(dm_collector_c.set_export_rotation(20000))
+            dm_collector_c.set_filtered_export(
+                os.path.join(directory, "seg_%Y%m%d_%H%M%S.mi2log"), types)
+            dm_collector_c.set_filtered(types)
+            dm_collector_c.reset()
+            dm_collector_c.feed_binary(data)
+            for _ in range(data.count("\x7e")):
+                dm_collector_c.receive_log_packet(True)
+            # Only the current segment is still a .part file
+            names = os.listdir(directory)
+            self.assertEqual(len([n for n in names if n.endswith(".part")]), 1)
+            self.assertTrue(dm_collector_c.set_export_rotation(0))
+            dm_collector_c.set_filtered_export(os.path.join(directory, "end.mi2log"), types)
+
+            # Segments of the same second are numbered: seg_T, seg_T.1, ...
+            segments = []
+            for name in os.listdir(directory):
+                m = re.match(r"seg_(\d+_\d+)(?:\.(\d+))?\.mi2log$", name)
+                if m is not None:
+                    segments.append((m.group(1), int(m.group(2) or 0), name))
+            self.assertEqual(len(segments) + 1, len(os.listdir(directory)))
+            self.assertGreater(len(segments), 1)
+            packets = []
+            for _, _, name in sorted(segments):
+                path = os.path.join(directory, name)
+                self.assertLessEqual(os.path.getsize(path), 20000)
+                packets += list(dm_collector_c.open_log(path, True))
+            self.assertEqual(packets, list(dm_collector_c.open_log(log, True)))
+        finally:
+            dm_collector_c.set_export_rotation(0)
+            shutil.rmtree(directory)
+
+    def test_async_export_matches_sync(self):
+        log = "./test-logs/att.mi2log"
+        types = ["LTE_PHY_PDSCH_Packet", "LTE_PHY_Connected_Mode_Intra_Freq_Meas"]
+        data = open(log, "rb").read()
+        directory = tempfile.mkdtemp()
+
+        def export(name):
+            path = os.path.join(directory, name)
+            dm_collector_c.set_filtered_export(path, types)
+            dm_collector_c.set_filtered(types)
+            dm_collector_c.reset()
+            dm_collector_c.feed_binary(data)
+            for _ in range(data.count("\x7e")):
+                dm_collector_c.receive_log_packet(True)
+            return path
+        try:
+            sync_path = export("sync.mi2log")
+            # A small queue, so that exporting has to wait for the writers
+            self.assertTrue(dm_collector_c.set_export_async(True, 4096, 2))
+            before = dm_collector_c.get_export_stats()
+            async_path = export("async.mi2log")
+            dm_collector_c.set_filtered_export(os.path.join(directory, "end.mi2log"), types)
+            after = dm_collector_c.get_export_stats()
+            self.assertTrue(dm_collector_c.set_export_async(False))
+
+            self.assertEqual(open(async_path, "rb").read(), open(sync_path, "rb").read())
+            self.assertIn(after["backend"], ("pwrite", "io_uring"))
+            self.assertEqual(after["bytes"] - before["bytes"], os.path.getsize(async_path))
+            self.assertGreater(after["writes"], before["writes"])
+            self.assertEqual(after["write_errors"], before["write_errors"])
+        finally:
+            dm_collector_c.set_export_async(False)
+            shutil.rmtree(directory)
+
+    def test_throughput_matches_lte_phy_analyzer(self):
+        log = "./test-logs/att.mi2log"
+
+        class BandwidthRecorder(LtePhyAnalyzer):
+
+            def __init__(self):
+                LtePhyAnalyzer.__init__(self)
+                self.dl_bw = []
+
+            def broadcast_info(self, method, msg_dict):
+                if method == "LTE_DL_BW":
+                    self.dl_bw.append(msg_dict)
+
+        src = OfflineReplayer()
+        src.set_input_path(log)
+        analyzer = BandwidthRecorder()
+        analyzer.set_source(src)
+        src.run()
+
+        dm_collector_c.set_throughput_window(analyzer.avg_window)
+        try:
+            list(dm_collector_c.open_log(log))
+            summaries = dm_collector_c.get_throughput_summaries()
+        finally:
+            dm_collector_c.set_throughput_window(0)
+        self.assertEqual(len(summaries), 9)
+        self.assertEqual(len(summaries), len(analyzer.dl_bw))
+        for s, bw in zip(summaries, analyzer.dl_bw):
+            self.assertEqual((s["mcs"]["QPSK"], s["mcs"]["16QAM"], s["mcs"]["64QAM"]),
+                             (int(bw["Modulation-QPSK"]), int(bw["Modulation-16QAM"]),
+                              int(bw["Modulation-64QAM"])))
+            self.assertAlmostEqual(s["dl_bandwidth_mbps"], float(bw["Bandwidth (Mbps)"]),
+                                   delta=0.006)
+
+    def test_rlc_summaries_match_decoded_pdus(self):
+        log = "./test-logs/att-iphone.mi2log"
+        types = ["LTE_RLC_UL_AM_All_PDU", "LTE_RLC_DL_AM_All_PDU"]
+        dm_collector_c.set_filtered(types)
+        dm_collector_c.set_rlc_window(10.0)
+        try:
+            packets = [DMLogPacket(p).decode() for p in dm_collector_c.open_log(log)]
+            summaries = dm_collector_c.get_rlc_summaries(True)
+            # Shorter windows split the counts, not the totals
+            dm_collector_c.set_rlc_window(0.1)
+            list(dm_collector_c.open_log(log))
+            short = dm_collector_c.get_rlc_summaries(True)
+        finally:
+            dm_collector_c.set_rlc_window(0)
+        self.assertEqual(len(packets), 10)
+
+        # Reference: SNs wait for an ACK in the order the PDUs are logged
+        stats = {}
+        pending = {"UL": {}, "DL": {}}
+        latencies = {"UL": [], "DL": []}
+        for d in ("UL", "DL"):
+            stats[d] = dict.fromkeys(["data_pdus", "data_bytes", "retx_pdus", "status_pdus",
+                                      "status_bytes", "nacks", "acked_pdus"], 0)
+            stats[d]["highest_sn"] = -1
+        for packet in packets:
+            d = "UL" if packet["type_id"] == types[0] else "DL"
+            peer = "DL" if d == "UL" else "UL"
+            for pdu in packet["Subpackets"][0]["RLC%s PDUs" % d]:
+                t = pdu["sys_fn"] * 10 + pdu["sub_fn"]
+                if pdu["PDU TYPE"] == "RLC%s DATA" % d:
+                    stats[d]["data_pdus"] += 1
+                    stats[d]["data_bytes"] += pdu["pdu_bytes"]
+                    stats[d]["retx_pdus"] += pdu["SN"] in pending[d]
+                    stats[d]["highest_sn"] = max(stats[d]["highest_sn"], pdu["SN"])
+                    pending[d][pdu["SN"]] = t
+                    continue
+                ack_sn = int(pdu["SN"].split(" = ")[1])
+                nacks = [n["NACK_SN"] for n in pdu.get("RLC CTRL NACK", [])]
+                stats[d]["status_pdus"] += 1
+                stats[d]["status_bytes"] += pdu["pdu_bytes"]
+                stats[peer]["nacks"] += len(nacks)
+                for sn, sent in pending[peer].items():
+                    if 0 < (ack_sn - sn) % 1024 <= 512 and sn not in nacks:
+                        latencies[peer].append((t - sent) % 10240)
+                        del pending[peer][sn]
+        for d in ("UL", "DL"):
+            stats[d]["acked_pdus"] = len(latencies[d])
+            stats[d]["ack_latency_avg_ms"] = float(sum(latencies[d])) / len(latencies[d])
+            stats[d]["ack_latency_max_ms"] = max(latencies[d])
+            stats[d]["outstanding"] = len(pending[d])
+
+        self.assertEqual(len(summaries), 1)
+        self.assertEqual(summaries[0]["bearers"], {33: stats})
+        self.assertEqual(stats["UL"]["ack_latency_max_ms"], 294)
+        self.assertGreater(len(short), 1)
+        for d in ("UL", "DL"):
+            for key in ("data_pdus", "data_bytes", "status_pdus", "acked_pdus"):
+                self.assertEqual(sum(w["bearers"][33][d][key] for w in short
+                                     if 33 in w["bearers"]), stats[d][key])
+
+    def test_stats_counters(self):
+        log = "./test-logs/att.mi2log"
+        frames = [hdlc_encode(h[3].tobytes()) for h in dm_collector_c.open_log_headers(log)]
+        bad = frames[0][:-3] + chr(ord(frames[0][-3]) ^ 1) + frames[0][-2:]
+        data = "".join(frames) + bad
+        directory = tempfile.mkdtemp()
+        path = os.path.join(directory, "pdsch.mi2log")
+
+        def feed():
+            dm_collector_c.reset()
+            dm_collector_c.feed_binary(data)
+            for _ in range(len(frames) + 1):
+                dm_collector_c.receive_log_packet(True)
+        try:
+            dm_collector_c.enable_stats()
+            dm_collector_c.set_filtered_export(path, ["LTE_PHY_PDSCH_Packet"])
+            dm_collector_c.set_filtered(["LTE_PHY_PDSCH_Packet"])
+            feed()
+            dm_collector_c.set_filtered_export(os.path.join(directory, "end.mi2log"), [])
+            export_size = os.path.getsize(path)
+            dm_collector_c.record_ws_roundtrip(0.002)
+            stats = dm_collector_c.get_stats(True)
+            after_reset = dm_collector_c.get_stats()
+            dm_collector_c.enable_stats(False)
+            feed()
+            disabled = dm_collector_c.get_stats()
+        finally:
+            dm_collector_c.enable_stats(False)
+            shutil.rmtree(directory)
+
+        self.assertTrue(stats["enabled"])
+        self.assertGreaterEqual(stats["elapsed"], 0)
+        self.assertEqual(stats["bytes_fed"], len(data))
+        self.assertEqual(stats["frames"], len(frames) + 1)
+        self.assertEqual(stats["crc_failures"], 1)
+        self.assertEqual(stats["filtered_out"], len(frames) - 80)
+        self.assertGreater(export_size, 0)
+        self.assertEqual(stats["export_bytes"], export_size)
+        self.assertEqual(stats["decode"].keys(), ["LTE_PHY_PDSCH_Packet"])
+        self.assertEqual(stats["decode"]["LTE_PHY_PDSCH_Packet"]["count"], 80)
+        self.assertEqual(stats["ws_dissector"]["count"], 1)
+        self.assertAlmostEqual(stats["ws_dissector"]["total_ms"], 2.0)
+        self.assertAlmostEqual(stats["ws_dissector"]["max_us"], 2000.0)
+
+        # Reset and disabled counters start over
+        for s in (after_reset, disabled):
+            self.assertEqual((s["bytes_fed"], s["frames"], s["crc_failures"], s["filtered_out"],
+                              s["export_bytes"], s["decode"], s["ws_dissector"]["count"]),
+                             (0, 0, 0, 0, 0, {}, 0))
+        self.assertTrue(after_reset["enabled"])
+        self.assertFalse(disabled["enabled"])
+
+    def test_log_packet_type_id_and_pickle(self):
+        self.assertEqual(DMLogPacket([("x", 1, "")]).get_type_id(), "")
+
+        dm_collector_c.set_filtered(["LTE_PHY_PDSCH_Packet"])
+        packet = DMLogPacket(dm_collector_c.open_log("./test-logs/att.mi2log").next())
+        copy = pickle.loads(pickle.dumps(packet, 2))
+        self.assertEqual(type(copy), DMLogPacket)
+        self.assertEqual(copy.get_type_id(), "LTE_PHY_PDSCH_Packet")
+        self.assertEqual(copy.decoded_list, packet.decoded_list)
+        self.assertEqual(copy.decode(), packet.decode())
+
+    def test_log_packet_decode_copies(self):
+        dm_collector_c.set_filtered(["LTE_PHY_PDSCH_Packet"])
+        packet = dm_collector_c.LogPacket(
+            dm_collector_c.open_log("./test-logs/att.mi2log").next())
+        d = packet.decode()
+        d["type_id"] = "changed"
+        del d["timestamp"]
+        again = packet.decode()
+        self.assertIsNot(again, d)
+        self.assertEqual(again["type_id"], "LTE_PHY_PDSCH_Packet")
+        self.assertIn("timestamp", again)
+
+    def test_log_packet_cycles_are_collected(self):
+        class Packet(dm_collector_c.LogPacket):
+            pass
+        # A cycle through decoded_list and the cached dict
+        values = []
+        packet = Packet([("type_id", "x", ""), ("values", values, "")])
+        packet.decode()
+        values.append(packet)
+        ref = weakref.ref(packet)
+        del packet, values
+        gc.collect()
+        self.assertIsNone(ref())
+
+    def test_msg_statistics_unknown_codes(self):
+        dm_collector_c.enable_msg_statistics(True)
+        path = self.write_log([log_packet_frame(0x1234, 1000),
+                               log_packet_frame(0x1234, 2000),
+                               log_packet_frame(0x5678, 3000)])
+        dm_collector_c.set_filtered([])
+        list(dm_collector_c.open_log(path))
+        codes = dm_collector_c.get_msg_statistics()["log_codes"]
+        dm_collector_c.enable_msg_statistics(False)
+        self.assertEqual(codes["0x1234"]["count"], 2)
+        self.assertEqual(codes["0x5678"]["count"], 1)
+
+    def test_extract_idle_ncell_meas(self):
+        path = self.write_log([log_packet_frame(0xB192, 1000,
+                                                idle_ncell_meas_body(random.Random(1)))])
+        m = dm_collector_c.extract_measurements(frame_of(path))
+        dm_collector_c.set_filtered(["LTE_PHY_Idle_Neighbor_Cell_Meas"])
+        decoded = dm_collector_c.LogPacket(dm_collector_c.open_log(path).next()).decode()
+        cells = [(subpkt["E-ARFCN"], cell) for subpkt in decoded["SubPackets"]
+                 if subpkt["SubPacket ID"] == 27
+                 for cell in subpkt["Neighbor Cells"]]
+        self.assertEqual(m["n_cells"], 12)
+        self.assertEqual(list(array.array("I", m["earfcn"])), [e for e, _ in cells])
+        self.assertEqual(list(array.array("H", m["pci"])),
+                         [c["Physical Cell ID"] for _, c in cells])
+        for key, field in (("rsrp", "Inst Measured RSRP"),
+                           ("rsrq", "Inst Measured RSRQ"),
+                           ("rssi", "Inst Measured RSSI")):
+            self.assertEqual(list(array.array("f", m[key])), [c[field] for _, c in cells])
+
+    def test_extract_irat_wcdma(self):
+        path = self.write_log([log_packet_frame(0xB188, 1000,
+                                                irat_wcdma_body(random.Random(2)))])
+        m = dm_collector_c.extract_measurements(frame_of(path))
+        dm_collector_c.set_filtered(["LTE_PHY_Inter_RAT_Measurement"])
+        decoded = dm_collector_c.LogPacket(dm_collector_c.open_log(path).next()).decode()
+        wcdma = decoded["Subpacket_1"]["WCDMA"]
+        cells = []
+        for j in range(wcdma["Number of frequencies"]):
+            freq = wcdma["FrequencyPacket_%d" % j]
+            for k in range(freq["Number of cells"]):
+                cells.append((freq["Frequency"], freq["CellPacket_%d" % k]))
+        self.assertEqual(m["n_cells"], 11)
+        self.assertEqual(list(array.array("H", m["uarfcn"])), [f for f, _ in cells])
+        for key, field in (("rscp", "RSCP"), ("rssi", "RSSI"), ("ecno", "EcNo")):
+            self.assertEqual(list(array.array("f", m[key])), [c[field] for _, c in cells])
+
+    def test_feed_chronicle_pieces(self):
+        log = "./test-logs/att.mi2log"
+        types = ["LTE_PHY_PDSCH_Packet"]
+        frames = [hdlc_encode(h[3].tobytes())
+                  for h in dm_collector_c.open_log_headers(log, types)]
+        # One log chunk per frame, between the start and the end of a file
+        stream = struct.pack("<hh", 2, 8) + "a.mi2log"
+        for k, frame in enumerate(frames):
+            stream += struct.pack("<hhd", 1, len(frame) + 8, 1000.0 + k) + frame
+        stream += struct.pack("<hh", 3, 8) + "a.mi2log"
+
+        dm_collector_c.set_filtered(types)
+        dm_collector_c.reset()
+        rng = random.Random(3)
+        events = []
+        received = []
+        offset = 0
+        while offset < len(stream):
+            n = rng.randint(1, 64)
+            last_timestamp, new_events = dm_collector_c.feed_chronicle(stream[offset:offset + n])
+            offset += n
+            events += new_events
+            while True:
+                packet = dm_collector_c.receive_log_packet(True, True)
+                if packet is None:
+                    break
+                received.append(packet)
+        self.assertEqual(events, [(2, "a.mi2log"), (3, "a.mi2log")])
+        self.assertEqual(last_timestamp, 1000.0 + len(frames) - 1)
+        self.assertEqual([t for _, t in received],
+                         [1000.0 + k for k in range(len(frames))])
+        self.assertEqual([p for p, _ in received], list(dm_collector_c.open_log(log, True)))
+
+    def test_poll_keeps_packets_after_callback_raises(self):
+        log = "./test-logs/att.mi2log"
+        types = ["LTE_PHY_PDSCH_Packet"]
+        frames = "".join(hdlc_encode(h[3].tobytes())
+                         for h in dm_collector_c.open_log_headers(log, types))
+        r, w = os.pipe()
+        # A chunk of diag_revealer with all packets, then a file event
+        os.write(w, struct.pack("<hhd", 1, len(frames) + 8, 1000.0) + frames)
+        os.write(w, struct.pack("<hh", 3, 3) + "end")
+        os.close(w)
+        dm_collector_c.set_filtered(types)
+        self.assertTrue(dm_collector_c.attach_fd(r, True))
+
+        received = []
+
+        def callback(packet):
+            received.append(packet)
+            if len(received) == 10:
+                raise ValueError("stop")
+        try:
+            self.assertRaises(ValueError, dm_collector_c.poll_log_packets,
+                              1000, 1024, True, False, callback)
+            # The file event comes after the packets not delivered yet
+            self.assertEqual(dm_collector_c.get_chronicle_events()[1], [])
+            self.assertEqual(dm_collector_c.poll_log_packets(1000, 30, True, False,
+                                                             received.append), 30)
+            self.assertEqual(dm_collector_c.get_chronicle_events()[1], [])
+            self.assertEqual(dm_collector_c.poll_log_packets(1000, 1024, True, False,
+                                                             received.append), 40)
+            self.assertEqual(dm_collector_c.get_chronicle_events()[1], [(3, "end")])
+            self.assertEqual(dm_collector_c.poll_log_packets(1000), None)
+        finally:
+            dm_collector_c.detach_fd()
+            os.close(r)
+        self.assertEqual(received, list(dm_collector_c.open_log(log, True)))
+
+    def test_extract_rejects_short_subpacket_size(self):
+        body = struct.pack("<BBH", 1, 1, 0) + struct.pack("<BBH", 42, 1, 2)
+        path = self.write_log([log_packet_frame(0xB188, 1000, body)])
+        self.assertEqual(dm_collector_c.extract_measurements(frame_of(path)), None)
+
+
+if __name__ == "__main__":
+    unittest.main()
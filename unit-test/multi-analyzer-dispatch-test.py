@@ -0,0 +1,88 @@
+#!/usr/bin/python
+# Filename: multi-analyzer-dispatch-test.py
+
+"""
+Tests of the type-based dispatch of events to several analyzers sharing
+a monitor.
+
+Run from this directory: python multi-analyzer-dispatch-test.py
+"""
+
+import collections
+import unittest
+
+from mobile_insight.analyzer.analyzer import Analyzer
+from mobile_insight.monitor import OfflineReplayer
+
+LOG = "./test-logs/att.mi2log"
+MEAS = "LTE_PHY_Connected_Mode_Intra_Freq_Meas"
+PDSCH = "LTE_PHY_PDSCH_Packet"
+
+
+class CountingAnalyzer(Analyzer):
+    """
+    Count the received events per type, enabling the given logs
+    """
+
+    def __init__(self, type_names):
+        Analyzer.__init__(self)
+        self.type_names = type_names
+        self.counts = collections.Counter()
+        self.add_source_callback(self.__msg_callback)
+
+    def set_source(self, source):
+        Analyzer.set_source(self, source)
+        for type_name in self.type_names:
+            source.enable_log(type_name)
+
+    def __msg_callback(self, msg):
+        self.counts[msg.type_id] += 1
+
+
+class MeasAnalyzer(CountingAnalyzer):
+
+    def __init__(self):
+        CountingAnalyzer.__init__(self, [MEAS])
+
+
+class CatchAllAnalyzer(CountingAnalyzer):
+
+    def __init__(self):
+        CountingAnalyzer.__init__(self, [])
+
+
+class MultiAnalyzerDispatchTest(unittest.TestCase):
+
+    def setUp(self):
+        Analyzer.reset()
+        self.src = OfflineReplayer()
+        self.src.set_input_path(LOG)
+
+    def test_top_level_enable_log_keeps_catch_all(self):
+        meas = MeasAnalyzer()
+        meas.set_source(self.src)
+        catch_all = CatchAllAnalyzer()
+        catch_all.set_source(self.src)
+        self.src.enable_log(PDSCH)
+        self.src.run()
+
+        self.assertEqual(meas.counts[MEAS], 223)
+        self.assertEqual(meas.counts[PDSCH], 0)
+        self.assertEqual(catch_all.counts[MEAS], 223)
+        self.assertEqual(catch_all.counts[PDSCH], 80)
+
+    def test_included_analyzer_subscriptions(self):
+        # Logs enabled by an included analyzer go to it, and those of the
+        # top analyzer to the top analyzer only
+        meas = MeasAnalyzer()
+        top = CountingAnalyzer([PDSCH])
+        top.include_analyzer("MeasAnalyzer", [])
+        top.set_source(self.src)
+        self.src.run()
+
+        self.assertEqual(dict(meas.counts), {MEAS: 223})
+        self.assertEqual(dict(top.counts), {PDSCH: 80})
+
+
+if __name__ == "__main__":
+    unittest.main()
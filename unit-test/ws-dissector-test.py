@@ -0,0 +1,173 @@
+#!/usr/bin/python
+# Filename: ws-dissector-test.py
+
+"""
+Tests of the requests WSDissector sends to ws_dissector, through pipes or
+shared memory, against a fake ws_dissector that echoes every request.
+
+Run from this directory: python ws-dissector-test.py
+"""
+
+import binascii
+import os
+import shutil
+import struct
+import sys
+import tempfile
+import unittest
+
+from mobile_insight.monitor.dm_collector.dm_endec.ws_dissector import WSDissector
+
+# Answers every AWW request with <request type="..." data="(hex)"/>.
+# The version is given by FAKE_WS_VERSION.
+FAKE_WS_DISSECTOR = """
+import binascii, os, struct, sys
+
+def answer(msg_type, b):
+    return '<request type="%d" data="%s"/>\\n===___===\\n' % (msg_type, binascii.b2a_hex(b))
+
+if sys.argv[1:] == ["-v"]:
+    print "Version " + os.environ["FAKE_WS_VERSION"]
+    sys.exit(0)
+
+if sys.argv[1:2] == ["--shm"]:
+    import mmap, time
+    f = open(sys.argv[2], "r+b")
+    m = mmap.mmap(f.fileno(), 0)
+    capacity = struct.unpack_from("<I", m, 8)[0]
+    # AwwShmHeader: magic, capacity, closed, reserved, then the two rings
+    REQUEST, RESPONSE, DATA = 64, 128, 192
+
+    def get(offset):
+        return struct.unpack_from("<I", m, offset)[0]
+
+    def put(offset, value):
+        struct.pack_into("<I", m, offset, value & 0xFFFFFFFF)
+
+    def transfer(ring, data, n, b=None):
+        out = ""
+        while len(out) < n:
+            head, tail = get(ring), get(ring + 4)
+            if b is None:
+                k = min((head - tail) & 0xFFFFFFFF, n - len(out))
+            else:
+                k = min(capacity - ((head - tail) & 0xFFFFFFFF), n - len(out))
+            if k == 0:
+                if get(12):
+                    sys.exit(0)
+                time.sleep(0.001)
+                continue
+            start = ((tail if b is None else head) & (capacity - 1))
+            k = min(k, capacity - start)    # up to the end of the ring
+            if b is None:
+                out += m[data + start:data + start + k]
+                put(ring + 4, tail + k)
+            else:
+                m[data + start:data + start + k] = b[len(out):len(out) + k]
+                out += b[len(out):len(out) + k]
+                put(ring, head + k)
+            put(ring + 8, get(ring + 8) + 1)
+        return out
+
+    while True:
+        msg_type, n = struct.unpack("!II", transfer(REQUEST, DATA, 8))
+        reply = answer(msg_type, transfer(REQUEST, DATA, n))
+        transfer(RESPONSE, DATA + capacity, len(reply), reply)
+
+while True:
+    header = sys.stdin.read(8)
+    if len(header) < 8:
+        break
+    msg_type, n = struct.unpack("!II", header)
+    sys.stdout.write(answer(msg_type, sys.stdin.read(n)))
+    sys.stdout.flush()
+"""
+
+
+def parse_request(decoded):
+    """
+    The (type, payload) of a request echoed by the fake ws_dissector
+    """
+    head = decoded.split('"')
+    return int(head[1]), binascii.a2b_hex(head[3])
+
+
+class WSDissectorTest(unittest.TestCase):
+
+    def setUp(self):
+        self._dir = tempfile.mkdtemp()
+        path = os.path.join(self._dir, "ws_dissector")
+        with open(path, "w") as f:
+            f.write("#!%s\n%s" % (sys.executable, FAKE_WS_DISSECTOR))
+        os.chmod(path, 0o755)
+        WSDissector._init_proc_called = False
+        WSDissector._proc = None
+        WSDissector._version = None
+        WSDissector._selected_fields = {}
+        WSDissector._use_shm = True
+        WSDissector._shm_path = None
+        WSDissector.init_proc(path, None)
+
+    def tearDown(self):
+        if WSDissector._shm_path is not None:
+            from mobile_insight.monitor.dm_collector import dm_collector_c
+            dm_collector_c.ws_shm_close()
+        if WSDissector._proc is not None:
+            if WSDissector._proc.stdin is not None:
+                WSDissector._proc.stdin.close()
+            WSDissector._proc.wait()
+        shutil.rmtree(self._dir)
+
+    def use_version(self, version):
+        WSDissector._env["FAKE_WS_VERSION"] = version
+        self.assertEqual(WSDissector.get_version(), version)
+
+    def test_field_selective_request(self):
+        self.use_version("2.1.0")
+        fields = ["lte-rrc.pagingRecordList", "lte-rrc.ue_Identity"]
+        field_list = ",".join(fields)
+        decoded = WSDissector.decode_msg("LTE-RRC_PCCH", "\x40\x01", fields)
+        self.assertEqual(parse_request(decoded),
+                         (200 | WSDissector.FIELDS_FLAG,
+                          struct.pack("!I", len(field_list)) + field_list + "\x40\x01"))
+
+        # The default fields of a type, until they are reset
+        WSDissector.set_fields("LTE-RRC_PCCH", fields)
+        self.assertEqual(WSDissector.decode_msg("LTE-RRC_PCCH", "\x40\x01"), decoded)
+        WSDissector.set_fields("LTE-RRC_PCCH", None)
+        self.assertEqual(parse_request(WSDissector.decode_msg("LTE-RRC_PCCH", "\x40\x01")),
+                         (200, "\x40\x01"))
+
+    def test_field_selective_request_needs_version(self):
+        self.use_version("2.0.1")
+        decoded = WSDissector.decode_msg("LTE-RRC_PCCH", "\x40\x01", ["lte-rrc.ue_Identity"])
+        self.assertEqual(parse_request(decoded), (200, "\x40\x01"))
+
+    def test_shm_round_trip(self):
+        self.use_version("2.2.0")
+        # More than the rings hold in total, so that they wrap around
+        messages = [("LTE-RRC_PCCH", "\x40\x01"),
+                    ("LTE-RRC_DL_DCCH", os.urandom(400000)),
+                    ("LTE-RRC_UL_DCCH", os.urandom(700000)),
+                    ("RRC_DL_BCCH_BCH", "")]
+        for msg_type, b in messages:
+            decoded = WSDissector.decode_msg(msg_type, b)
+            self.assertEqual(parse_request(decoded),
+                             (WSDissector.SUPPORTED_TYPES[msg_type], b))
+        self.assertIsNotNone(WSDissector._shm_path)
+        self.assertTrue(os.path.exists(WSDissector._shm_path))
+
+
+    def test_shm_open_refuses_existing_files(self):
+        from mobile_insight.monitor.dm_collector import dm_collector_c
+        path = os.path.join(self._dir, "shm")
+        target = os.path.join(self._dir, "target")
+        open(target, "w").close()
+        os.symlink(target, path)
+        self.assertFalse(dm_collector_c.ws_shm_open(path))
+        self.assertFalse(dm_collector_c.ws_shm_open(target))
+        self.assertEqual(os.path.getsize(target), 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
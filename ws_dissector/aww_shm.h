@@ -0,0 +1,177 @@
+/* aww_shm.h
+ * Shared-memory transport of the AWW protocol.
+ *
+ * A shared memory file holds two single-producer/single-consumer byte rings:
+ * requests (MobileInsight -> ws_dissector) and responses (ws_dissector ->
+ * MobileInsight). The byte streams are exactly the same as on stdin/stdout,
+ * so both sides keep their framing code. Readers and writers spin briefly
+ * and then sleep on a futex, which removes the pipe syscalls per message.
+ *
+ * This header is shared by ws_dissector and dm_collector_c. Linux only.
+ */
+
+#ifndef __AWW_SHM_H__
+#define __AWW_SHM_H__
+
+#ifdef __linux__
+#define AWW_SHM_SUPPORTED 1
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+static const char AWW_SHM_MAGIC[8] = {'A', 'W', 'W', 'S', 'H', 'M', '0', '1'};
+static const int AWW_SHM_SPIN_COUNT = 2000;
+static const long AWW_SHM_WAIT_NSEC = 100 * 1000 * 1000;  // check peer every 100ms
+
+struct AwwShmRing {
+    volatile uint32_t head;     // total bytes written (wraps around)
+    volatile uint32_t tail;     // total bytes read (wraps around)
+    volatile uint32_t seq;      // futex word, bumped whenever head/tail moves
+    volatile uint32_t waiting;  // set by a side that sleeps on seq
+    uint32_t reserved[12];
+};
+
+struct AwwShmHeader {
+    char magic[8];
+    uint32_t capacity;          // bytes of each ring, a power of two
+    volatile uint32_t closed;   // set by either side when it exits
+    uint32_t reserved[12];
+    AwwShmRing request;
+    AwwShmRing response;
+    // followed by: request data [capacity], response data [capacity]
+};
+
+static inline size_t
+aww_shm_size (uint32_t capacity) {
+    return sizeof(AwwShmHeader) + 2 * (size_t) capacity;
+}
+
+static inline void
+aww_shm_init (AwwShmHeader *hdr, uint32_t capacity) {
+    memset(hdr, 0, sizeof(AwwShmHeader));
+    memcpy(hdr->magic, AWW_SHM_MAGIC, sizeof(AWW_SHM_MAGIC));
+    hdr->capacity = capacity;
+}
+
+static inline bool
+aww_shm_valid (const AwwShmHeader *hdr, size_t mapped_size) {
+    return mapped_size >= sizeof(AwwShmHeader)
+            && memcmp(hdr->magic, AWW_SHM_MAGIC, sizeof(AWW_SHM_MAGIC)) == 0
+            && hdr->capacity > 0
+            && (hdr->capacity & (hdr->capacity - 1)) == 0
+            && aww_shm_size(hdr->capacity) <= mapped_size;
+}
+
+static inline char *
+aww_ring_data (AwwShmHeader *hdr, AwwShmRing *ring) {
+    char *data = (char *) hdr + sizeof(AwwShmHeader);
+    return ring == &hdr->request ? data : data + hdr->capacity;
+}
+
+static inline void
+aww_ring_notify (AwwShmRing *ring) {
+    __sync_fetch_and_add(&ring->seq, 1);
+    if (ring->waiting)
+        syscall(SYS_futex, &ring->seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Mark the transport as closed and wake up the peer.
+static inline void
+aww_shm_close (AwwShmHeader *hdr) {
+    hdr->closed = 1;
+    aww_ring_notify(&hdr->request);
+    aww_ring_notify(&hdr->response);
+}
+
+// Wait until the ring has data (want_data) or free space (!want_data).
+// Return: false if the transport is closed or the peer process is gone
+static inline bool
+aww_ring_wait (AwwShmHeader *hdr, AwwShmRing *ring, bool want_data, pid_t peer) {
+    // Spinning only helps if the peer runs on another CPU
+    static const int max_spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? AWW_SHM_SPIN_COUNT : 0;
+    for (int spin = 0; ; spin++) {
+        uint32_t seq = ring->seq;
+        __sync_synchronize();
+        uint32_t used = ring->head - ring->tail;
+        if (want_data ? used > 0 : used < hdr->capacity)
+            return true;
+        if (hdr->closed)
+            return false;
+        if (spin < max_spin)
+            continue;
+
+        ring->waiting = 1;
+        __sync_synchronize();
+        used = ring->head - ring->tail;
+        if (ring->seq == seq && (want_data ? used == 0 : used == hdr->capacity)) {
+            struct timespec ts;
+            ts.tv_sec = 0;
+            ts.tv_nsec = AWW_SHM_WAIT_NSEC;
+            syscall(SYS_futex, &ring->seq, FUTEX_WAIT, seq, &ts, NULL, 0);
+        }
+        ring->waiting = 0;
+        if (peer > 0 && kill(peer, 0) != 0 && errno == ESRCH)
+            return false;
+    }
+}
+
+// Write all bytes, blocking while the ring is full.
+// Return: false if the transport is closed
+static inline bool
+aww_ring_write (AwwShmHeader *hdr, AwwShmRing *ring,
+                const char *b, size_t length, pid_t peer) {
+    char *data = aww_ring_data(hdr, ring);
+    uint32_t mask = hdr->capacity - 1;
+    while (length > 0) {
+        if (!aww_ring_wait(hdr, ring, false, peer))
+            return false;
+        uint32_t head = ring->head;
+        size_t space = hdr->capacity - (head - ring->tail);
+        size_t n = length < space ? length : space;
+        size_t first = hdr->capacity - (head & mask);
+        if (first > n)
+            first = n;
+        memcpy(data + (head & mask), b, first);
+        memcpy(data, b + first, n - first);
+        __sync_synchronize();
+        ring->head = head + (uint32_t) n;
+        aww_ring_notify(ring);
+        b += n;
+        length -= n;
+    }
+    return true;
+}
+
+// Read at least one byte, blocking while the ring is empty.
+// Return: number of bytes read, or 0 if the transport is closed
+static inline size_t
+aww_ring_read (AwwShmHeader *hdr, AwwShmRing *ring,
+                char *b, size_t max_length, pid_t peer) {
+    if (!aww_ring_wait(hdr, ring, true, peer))
+        return 0;
+    char *data = aww_ring_data(hdr, ring);
+    uint32_t mask = hdr->capacity - 1;
+    uint32_t tail = ring->tail;
+    size_t used = ring->head - tail;
+    __sync_synchronize();
+    size_t n = max_length < used ? max_length : used;
+    size_t first = hdr->capacity - (tail & mask);
+    if (first > n)
+        first = n;
+    memcpy(b, data + (tail & mask), first);
+    memcpy(b + first, data, n - first);
+    __sync_synchronize();
+    ring->tail = tail + (uint32_t) n;
+    aww_ring_notify(ring);
+    return n;
+}
+
+#endif  // __linux__
+
+#endif  // __AWW_SHM_H__
@@ -6,7 +6,7 @@
 #include <stdio.h>
 #include "packet-aww.h"
 
-#define WS_DISSECTOR_VERSION "2.0.1"
+#define WS_DISSECTOR_VERSION "2.3.0"
 
 static const int PROTO_MAX = 1000;
 
@@ -16,24 +16,167 @@
 #include <epan/dissectors/packet-pdcp-lte.h>
 
 #include "packet-aww.h"
+#include "aww_shm.h"
 #include <stdio.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+#ifdef AWW_SHM_SUPPORTED
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
 #ifdef _WIN32
     #include <winsock2.h>   // for ntohl()
     #include <io.h>
     #define SET_BINARY_MODE(handle) setmode(handle, O_BINARY)
+    #define read_fd(fd, buf, count) _read(fd, buf, (unsigned int)(count))
     // Define missing types
     typedef __int32 int32_t;
     typedef unsigned __int32 uint32_t;
 #elif __GNUC__
     #include <arpa/inet.h>  // for ntohl()
+    #include <unistd.h>
+    #define read_fd(fd, buf, count) read(fd, buf, count)
 #else
     #error Your compiler is not either MS Visual C compiler or GNU gcc.
 #endif
 
-#define WS_DISSECTOR_VERSION "2.0.1"
+#define WS_DISSECTOR_VERSION "2.3.0"
+
+// Input is read in large chunks. A message larger than the chunk size grows
+// the buffer instead of overflowing it.
+const size_t READ_CHUNK_SIZE = 64 * 1024;
+const size_t MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
+const size_t AWW_HEADER_SIZE = 8;   // type (4 bytes) + length (4 bytes)
+
+// If this bit is set in the type field, the payload starts with a field list:
+// a 4-byte length followed by comma-separated field names (e.g.
+// "lte-rrc.rsrpResult,lte-rrc.rsrqResult"). Only these fields are built and
+// printed. Keep consistent with ws_dissector.py
+const unsigned int AWW_FIELDS_FLAG = 0x80000000;
+
+// If this bit is set for RRC_DL_BCCH_BCH, the complete SIBs it carries are
+// dissected as well, and printed as extra packets after the BCH message.
+// Keep consistent with ws_dissector.py and dm_log_packet.py
+const unsigned int AWW_SPLIT_SIB_FLAG = 0x40000000;
+
+// Maps the WCDMA RRC sib_Type to AWW protocol numbers
+struct SibType {
+    unsigned int sib_type;
+    unsigned int aww_type;
+};
+static const SibType SIB_TYPES[] = {
+    {0, 150},   // RRC_MIB
+    {1, 151},   // RRC_SIB1
+    {2, 152},   // RRC_SIB2
+    {3, 153},   // RRC_SIB3
+    {7, 157},   // RRC_SIB7
+    {12, 162},  // RRC_SIB12
+    {27, 181},  // RRC_SB1
+    {31, 169},  // RRC_SIB19
+};
+
+// A complete SIB found in a BCH message
+struct SibMessage {
+    unsigned int aww_type;
+    std::string data;
+};
+
+// Field list of the last request, and its registered field IDs
+struct FieldSelection {
+    std::string names;
+    std::vector<int> hfids;
+};
+
+struct InputBuffer {
+    std::vector<guchar> data;
+    size_t begin;   // first unconsumed byte
+    size_t end;     // first unused byte
+};
+
+// Results are written to g_out: stdout, or the response ring of the
+// shared-memory transport (see aww_shm.h).
+static FILE *g_out = stdout;
+
+#ifdef AWW_SHM_SUPPORTED
+static AwwShmHeader *g_shm = NULL;
+static pid_t g_shm_peer = 0;
+
+static ssize_t shm_cookie_write(void *cookie, const char *buf, size_t size)
+{
+    (void)cookie;
+    if (!aww_ring_write(g_shm, &g_shm->response, buf, size, g_shm_peer))
+        return 0;
+    return size;
+}
 
-const int BUFFER_SIZE = 2000;
-guchar buffer[BUFFER_SIZE] = {};
+// Attach to a transport created by MobileInsight, and redirect g_out to it.
+// Return: successful or not
+static bool shm_attach(const char *path)
+{
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0)
+        p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    if (!aww_shm_valid((AwwShmHeader *) p, st.st_size)) {
+        munmap(p, st.st_size);
+        return false;
+    }
+    g_shm = (AwwShmHeader *) p;
+    g_shm_peer = getppid();
+
+    cookie_io_functions_t funcs;
+    memset(&funcs, 0, sizeof(funcs));
+    funcs.write = shm_cookie_write;
+    g_out = fopencookie(NULL, "w", funcs);
+    return g_out != NULL;
+}
+#endif
+
+// Read from stdin, or the request ring of the shared-memory transport.
+static long read_input(guchar *buf, size_t count)
+{
+#ifdef AWW_SHM_SUPPORTED
+    if (g_shm != NULL)
+        return (long) aww_ring_read(g_shm, &g_shm->request, (char *) buf, count, g_shm_peer);
+#endif
+    return read_fd(fileno(stdin), buf, count);
+}
+
+// Make sure at least n unconsumed bytes are in the buffer.
+// Output is flushed before any read that may block, so results are not
+// delayed, while a deep pipe is consumed without per-message syscalls.
+// Return: false on EOF or read error
+static bool fill_input(InputBuffer &in, size_t n)
+{
+    if (in.end - in.begin >= n)
+        return true;
+    if (in.begin > 0) {    // compact
+        memmove(&in.data[0], &in.data[in.begin], in.end - in.begin);
+        in.end -= in.begin;
+        in.begin = 0;
+    }
+    if (in.data.size() < n + READ_CHUNK_SIZE)
+        in.data.resize(n + READ_CHUNK_SIZE);
+
+    while (in.end < n) {
+        fflush(g_out);
+        long cnt = read_input(&in.data[in.end], in.data.size() - in.end);
+        if (cnt < 0 && errno == EINTR)
+            continue;
+        if (cnt <= 0)
+            return false;
+        in.end += cnt;
+    }
+    return true;
+}
 
 void print_tree(const proto_tree* tree, int level)
 {
@@ -56,7 +199,125 @@ void print_tree(const proto_tree* tree, int level)
     print_tree(tree->next, level);
 }
 
-void try_dissect(epan_t *session, size_t data_len, const guchar* raw_data)
+// Convert a comma-separated field list to field IDs. Unknown names are
+// reported and skipped.
+static void select_fields(FieldSelection &sel, const guchar *names, size_t len)
+{
+    std::string s((const char *) names, len);
+    if (s == sel.names)
+        return;
+    sel.names = s;
+    sel.hfids.clear();
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos)
+            end = s.size();
+        std::string name = s.substr(start, end - start);
+        if (!name.empty()) {
+            int hfid = proto_registrar_get_id_byname(name.c_str());
+            if (hfid >= 0)
+                sel.hfids.push_back(hfid);
+            else
+                fprintf(stderr, "Error: unknown field %s.\n", name.c_str());
+        }
+        start = end + 1;
+    }
+}
+
+static void print_xml_escaped(const char *s)
+{
+    for (; *s != '\0'; s++) {
+        switch (*s) {
+        case '<': fputs("&lt;", g_out); break;
+        case '>': fputs("&gt;", g_out); break;
+        case '&': fputs("&amp;", g_out); break;
+        case '"': fputs("&quot;", g_out); break;
+        default: fputc(*s, g_out); break;
+        }
+    }
+}
+
+// Print the selected fields in PDML format
+static void print_selected_fields(epan_dissect_t *edt, const std::vector<int> &hfids)
+{
+    fprintf(g_out, "<packet>\n");
+    for (size_t i = 0; i < hfids.size(); i++) {
+        GPtrArray *finfos = proto_get_finfo_ptr_array(edt->tree, hfids[i]);
+        if (finfos == NULL)
+            continue;
+        for (guint j = 0; j < finfos->len; j++) {
+            field_info *finfo = (field_info *) finfos->pdata[j];
+            gchar label[ITEM_LABEL_LENGTH + 1] = {0};
+            proto_item_fill_label(finfo, label);
+            gchar *show = fvalue_to_string_repr(&finfo->value, FTREPR_DISPLAY,
+                                                finfo->hfinfo->display, NULL);
+
+            fprintf(g_out, "<field name=\"%s\" showname=\"", finfo->hfinfo->abbrev);
+            print_xml_escaped(label);
+            fprintf(g_out, "\" show=\"");
+            print_xml_escaped(show != NULL ? show : "");
+            fprintf(g_out, "\" value=\"");
+            if (finfo->ds_tvb != NULL && finfo->length > 0) {
+                const guint8 *p = tvb_get_ptr(finfo->ds_tvb, finfo->start, finfo->length);
+                for (gint k = 0; k < finfo->length; k++)
+                    fprintf(g_out, "%02x", p[k]);
+            }
+            fprintf(g_out, "\"/>\n");
+            g_free(show);
+        }
+    }
+    fprintf(g_out, "</packet>\n");
+}
+
+// Find rrc.CompleteSIBshort_element fields in document order, and collect
+// the SIBs of supported types.
+static void collect_sibs(const proto_node *node, std::vector<SibMessage> &sibs)
+{
+    static int hf_complete_sib = proto_registrar_get_id_byname("rrc.CompleteSIBshort_element");
+    static int hf_sib_type = proto_registrar_get_id_byname("rrc.sib_Type");
+    static int hf_sib_data = proto_registrar_get_id_byname("rrc.sib_Data_variable");
+
+    for (; node != NULL; node = node->next) {
+        if (node->finfo == NULL || node->finfo->hfinfo->id != hf_complete_sib) {
+            collect_sibs(node->first_child, sibs);
+            continue;
+        }
+        const field_info *type_finfo = NULL;
+        const field_info *data_finfo = NULL;
+        for (const proto_node *child = node->first_child; child != NULL; child = child->next) {
+            if (child->finfo == NULL)
+                continue;
+            if (child->finfo->hfinfo->id == hf_sib_type && type_finfo == NULL)
+                type_finfo = child->finfo;
+            else if (child->finfo->hfinfo->id == hf_sib_data && data_finfo == NULL)
+                data_finfo = child->finfo;
+        }
+        if (type_finfo == NULL || data_finfo == NULL || data_finfo->ds_tvb == NULL)
+            continue;
+
+        unsigned int sib_type = fvalue_get_uinteger(const_cast<fvalue_t *>(&type_finfo->value));
+        size_t i = 0;
+        while (i < sizeof(SIB_TYPES) / sizeof(SIB_TYPES[0]) && SIB_TYPES[i].sib_type != sib_type)
+            i++;
+        if (i == sizeof(SIB_TYPES) / sizeof(SIB_TYPES[0])) {
+            fprintf(stderr, "(MI)Unknown RRC SIB Type: %u\n", sib_type);
+            continue;
+        }
+        SibMessage sib;
+        sib.aww_type = SIB_TYPES[i].aww_type;
+        sib.data.assign((const char *) tvb_get_ptr(data_finfo->ds_tvb, data_finfo->start,
+                                                    data_finfo->length),
+                        data_finfo->length);
+        sibs.push_back(sib);
+    }
+}
+
+// If hfids is not NULL, only these fields are dissected and printed;
+// otherwise the whole protocol tree is printed.
+// If sibs is not NULL, complete SIBs found in the tree are appended to it.
+void try_dissect(epan_t *session, size_t data_len, const guchar* raw_data,
+                    const std::vector<int> *hfids, std::vector<SibMessage> *sibs)
 {
     wtap_pkthdr phdr;
     frame_data fdata;
@@ -88,11 +349,22 @@ void try_dissect(epan_t *session, size_t data_len, const guchar* raw_data)
     // fdata->abs_ts.nsecs = 0;
     // fdata->opt_comment = NULL;
 
-    epan_dissect_t *edt = epan_dissect_new(session, TRUE, TRUE);
+    // With a field selection, the tree is invisible and only the primed
+    // fields are actually built.
+    epan_dissect_t *edt = epan_dissect_new(session, TRUE, hfids == NULL);
+    if (hfids != NULL) {
+        for (size_t i = 0; i < hfids->size(); i++)
+            proto_tree_prime_hfid(edt->tree, (*hfids)[i]);
+    }
     epan_dissect_run(edt, 0, &phdr, tvb_new_real_data(raw_data, data_len, data_len), &fdata, NULL);
     // const proto_tree *payload_tree = edt->tree->first_child->next;
     // print_tree(payload_tree, 0);
-    write_pdml_proto_tree(edt, stdout);
+    if (hfids != NULL)
+        print_selected_fields(edt, *hfids);
+    else
+        write_pdml_proto_tree(edt, g_out);
+    if (sibs != NULL)
+        collect_sibs(edt->tree, *sibs);
 
     epan_dissect_free(edt);
     frame_data_destroy(&fdata);
@@ -110,7 +382,8 @@ int main(int argc, char** argv)
      // freopen(NULL, "rb", stdin);
 #endif
 
-    if (argc > 1) {
+    bool use_shm = argc > 2 && strcmp(argv[1], "--shm") == 0;
+    if (argc > 1 && !use_shm) {
         printf("Version " WS_DISSECTOR_VERSION "\n");
         printf("Supported protocols:\n");
         print_proto_list();
@@ -142,19 +415,70 @@ int main(int argc, char** argv)
     }
     prefs_apply_all();
 
-    while (!feof(stdin)) {  // stop dissect when the pipe is closed
-        fflush(stdin);
-        fflush(stdout);
-        size_t ign = fread(buffer, sizeof(uint32_t), 2, stdin);
-        if (ign < 2)
+    if (use_shm) {
+#ifdef AWW_SHM_SUPPORTED
+        if (!shm_attach(argv[2])) {
+            fprintf(stderr, "Failed to attach to shared memory %s.\n", argv[2]);
+            return 1;
+        }
+#else
+        fprintf(stderr, "Shared memory transport is not supported.\n");
+        return 1;
+#endif
+    }
+
+    // Results are written in large blocks and flushed by fill_input()
+    setvbuf(g_out, NULL, _IOFBF, READ_CHUNK_SIZE);
+
+    InputBuffer in;
+    in.begin = in.end = 0;
+    std::vector<guchar> framed;     // scratch buffer for rewritten messages
+    std::vector<guchar> sib_framed; // scratch buffer for SIBs split from BCH messages
+    FieldSelection selection;
+
+    while (fill_input(in, AWW_HEADER_SIZE)) {  // stop dissect when the pipe is closed
+        const guchar *header = &in.data[in.begin];
+        unsigned int type = ntohl(*(uint32_t *)header);
+        size_t data_len = ntohl(*((uint32_t *)(header + 4)));
+        if (data_len > MAX_MESSAGE_SIZE) {
+            fprintf(stderr, "Error: message too large (%u bytes).\n", (unsigned int) data_len);
             break;
-        unsigned int type = ntohl(*(uint32_t *)buffer);
-        size_t data_len = ntohl(*((uint32_t *)(buffer + 4)));
-        size_t offset = 8;
-        size_t framingHeader_len = 0;
+        }
+        if (!fill_input(in, AWW_HEADER_SIZE + data_len))
+            break;
+        const guchar *msg = &in.data[in.begin];
+        size_t msg_len = AWW_HEADER_SIZE + data_len;
+        const guchar *payload = msg + AWW_HEADER_SIZE;
+        size_t payload_len = data_len;
+        bool use_selection = false;
+        bool split_sib = (type & AWW_SPLIT_SIB_FLAG) != 0;
+        type &= ~AWW_SPLIT_SIB_FLAG;
+
+        if (type & AWW_FIELDS_FLAG) {
+            size_t names_len = payload_len >= 4 ? ntohl(*(uint32_t *)payload) : 0;
+            if (payload_len < 4 || names_len > payload_len - 4) {
+                fprintf(stderr, "Error: malformed field list.\n");
+                break;
+            }
+            select_fields(selection, payload + 4, names_len);
+            payload += 4 + names_len;
+            payload_len -= 4 + names_len;
+            type &= ~AWW_FIELDS_FLAG;
+            use_selection = true;
+        }
+
+        if (type == 300 || type == 301 || use_selection || split_sib) {
+            // Rebuild the message: the AWW dissector expects a plain header
+            framed.resize(AWW_HEADER_SIZE + 64 + payload_len);
+            *(uint32_t *)&framed[0] = htonl(type);
+        }
+
         if (type == 300 || type == 301) {
             /* If type is pdcp-lte signaling message, we need to add framing
              * header before read pdcp PDU. */
+            guchar *buffer = &framed[0];
+            size_t offset = AWW_HEADER_SIZE;
+
             /* Fixed start to each frame (allowing heuristic dissector to work
              * ) */
             memcpy(buffer + offset, PDCP_LTE_START_STRING,
@@ -194,14 +518,42 @@ int main(int argc, char** argv)
             buffer[offset++] = 0;
 
             buffer[offset++] = PDCP_LTE_PAYLOAD_TAG;
-            framingHeader_len = offset - 8;
+            memcpy(buffer + offset, payload, payload_len);
+            *(uint32_t *)(buffer + 4) = htonl(payload_len);
+            msg = buffer;
+            msg_len = offset + payload_len;
+        } else if (use_selection || split_sib) {
+            guchar *buffer = &framed[0];
+            memcpy(buffer + AWW_HEADER_SIZE, payload, payload_len);
+            *(uint32_t *)(buffer + 4) = htonl(payload_len);
+            msg = buffer;
+            msg_len = AWW_HEADER_SIZE + payload_len;
         }
-        fread(buffer + offset, 1, data_len, stdin);
         // fprintf(stderr, "type = %u, size = %u\n", type, (unsigned int) data_len);
 
-        try_dissect(session, data_len + 2 * 4 + framingHeader_len, buffer);
-        printf("===___===\n");  // this line CANNOT be deleted. used to seperate msgs
+        // Other messages are dissected in place
+        if (split_sib && !use_selection) {
+            std::vector<SibMessage> sibs;
+            try_dissect(session, msg_len, msg, NULL, &sibs);
+            for (size_t i = 0; i < sibs.size(); i++) {
+                const std::string &data = sibs[i].data;
+                sib_framed.resize(AWW_HEADER_SIZE + data.size());
+                *(uint32_t *)&sib_framed[0] = htonl(sibs[i].aww_type);
+                *(uint32_t *)&sib_framed[4] = htonl(data.size());
+                memcpy(&sib_framed[AWW_HEADER_SIZE], data.data(), data.size());
+                try_dissect(session, sib_framed.size(), &sib_framed[0], NULL, NULL);
+            }
+        } else {
+            try_dissect(session, msg_len, msg, use_selection ? &selection.hfids : NULL, NULL);
+        }
+        fprintf(g_out, "===___===\n");  // this line CANNOT be deleted. used to seperate msgs
+        in.begin += AWW_HEADER_SIZE + data_len;
     }
+    fflush(g_out);
+#ifdef AWW_SHM_SUPPORTED
+    if (g_shm != NULL)
+        aww_shm_close(g_shm);
+#endif
 
     epan_free(session);
     epan_cleanup();